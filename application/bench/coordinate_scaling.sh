@@ -0,0 +1,55 @@
+#!/bin/sh
+
+# ABSTRACT: Coordinate accumulation scaling benchmark
+#
+# Converts single-polygon WKT files of increasing vertex counts and
+# reports the conversion time per vertex. The coordinates of a geometry
+# are accumulated in amortized constant time, so the time per vertex
+# must stay roughly flat as the polygon grows; a time per vertex that
+# grows with the polygon size indicates a quadratic regression.
+#
+# Usage: coordinate_scaling.sh <wkt2geojson binary> [vertex counts...]
+
+set -e
+
+if [ "$#" -lt 1 ]; then
+    echo "Usage: $0 <wkt2geojson binary> [vertex counts...]"
+    exit 1
+fi
+
+BINARY=$1
+shift
+
+if [ "$#" -eq 0 ]; then
+    set -- 62500 125000 250000 500000
+fi
+
+WORK_DIR="$(mktemp -d)"
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+# Prints a closed polygon with the given number of vertices.
+generate_polygon() {
+    awk -v n="$1" 'BEGIN {
+        printf "POLYGON ((";
+        for (i = 0; i < n - 1; i++) {
+            printf "%d.%d %d.%d, ", i % 360, i % 97, i % 180, i % 89;
+        }
+        printf "0.0 0.0))\n";
+    }'
+}
+
+printf "%10s %12s %14s\n" "vertices" "seconds" "ns/vertex"
+
+for VERTICES in "$@"; do
+    generate_polygon "$VERTICES" > "$WORK_DIR/polygon.wkt"
+
+    START=$(date +%s%N)
+    "$BINARY" -i "$WORK_DIR/polygon.wkt" -o /dev/null
+    END=$(date +%s%N)
+
+    ELAPSED=$((END - START))
+    awk -v n="$VERTICES" -v t="$ELAPSED" \
+        'BEGIN { printf "%10d %12.3f %14.1f\n", n, t / 1e9, t / n }'
+done
+
+# EOF
@@ -0,0 +1,215 @@
+/*
+ * corpus.c
+ *
+ * Synthetic WKT corpus generator. Writes deterministic inputs covering
+ * the shapes that stress different parts of the transpiler:
+ *
+ *   points.wkt      - millions of POINT records;
+ *   linestrings.wkt - long LINESTRING records;
+ *   holes.wkt       - POLYGON records with many holes;
+ *   mixed.wkt       - a mix of the three types and sizes.
+ *
+ * The same scale always produces the same bytes, so that throughput
+ * figures of different builds can be compared.
+ *
+ * Usage: corpus <directory> [scale]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Records of each file at scale 1. */
+#define POINTS 2000000
+#define LINESTRINGS 200
+#define HOLED_POLYGONS 500
+#define MIXED_RECORDS 100000
+
+/* Sizes of the generated geometries. */
+#define LINESTRING_VERTICES 10000
+#define POLYGON_HOLES 200
+#define HOLE_VERTICES 5
+#define EXTERIOR_VERTICES 64
+
+
+/*
+ * Deterministic xorshift generator, so that every run writes the same
+ * corpus.
+ */
+static uint64_t next_random(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+
+/*
+ * Returns a coordinate in [-range, range).
+ */
+static double next_coordinate(uint64_t *state, double range) {
+    return (double)(next_random(state) % 2000000000ULL) / 1e9 * range
+           - range;
+}
+
+
+/*
+ * Writes a vertex with 6 to 9 fraction digits.
+ */
+static void write_vertex(FILE *out, uint64_t *state, double x, double y) {
+    int digits = 6 + (int)(next_random(state) % 4);
+    fprintf(out, "%.*f %.*f", digits, x, digits, y);
+}
+
+
+static void write_point(FILE *out, uint64_t *state) {
+    fputs("POINT (", out);
+    write_vertex(out, state, next_coordinate(state, 180.0),
+                 next_coordinate(state, 90.0));
+    fputs(")\n", out);
+}
+
+
+/*
+ * Writes a random walk of `vertices` vertices.
+ */
+static void write_linestring(FILE *out, uint64_t *state, size_t vertices) {
+    double x = next_coordinate(state, 170.0);
+    double y = next_coordinate(state, 80.0);
+
+    fputs("LINESTRING (", out);
+    for (size_t i = 0; i < vertices; i++) {
+        if (i) {
+            fputs(", ", out);
+        }
+        write_vertex(out, state, x, y);
+        x += next_coordinate(state, 0.01);
+        y += next_coordinate(state, 0.01);
+    }
+    fputs(")\n", out);
+}
+
+
+/*
+ * Writes a closed ring of `vertices` vertices around (x, y).
+ */
+static void write_ring(FILE *out, uint64_t *state, double x, double y,
+                       double radius, size_t vertices) {
+    double first_x = x + radius;
+    double first_y = y;
+
+    fputc('(', out);
+    write_vertex(out, state, first_x, first_y);
+    for (size_t i = 1; i + 1 < vertices; i++) {
+        /* A diamond around the center. */
+        double t = (double)i / (double)(vertices - 1);
+        double dx = t < 0.5 ? 1.0 - 4.0 * t : 4.0 * t - 3.0;
+        double dy = t < 0.5 ? (t < 0.25 ? 4.0 * t : 2.0 - 4.0 * t)
+                            : (t < 0.75 ? 2.0 - 4.0 * t : 4.0 * t - 4.0);
+        fputs(", ", out);
+        write_vertex(out, state, x + radius * dx, y + radius * dy);
+    }
+    fputs(", ", out);
+    write_vertex(out, state, first_x, first_y);
+    fputc(')', out);
+}
+
+
+/*
+ * Writes a polygon made of an exterior ring and `holes` holes.
+ */
+static void write_polygon(FILE *out, uint64_t *state, size_t holes,
+                          size_t vertices) {
+    double x = next_coordinate(state, 170.0);
+    double y = next_coordinate(state, 80.0);
+
+    fputs("POLYGON (", out);
+    write_ring(out, state, x, y, 1.0, vertices);
+    for (size_t i = 0; i < holes; i++) {
+        fputs(", ", out);
+        write_ring(out, state, x + next_coordinate(state, 0.5),
+                   y + next_coordinate(state, 0.5), 0.001, HOLE_VERTICES);
+    }
+    fputs(")\n", out);
+}
+
+
+static FILE* create(const char *dir, const char *name) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        perror(path);
+        exit(1);
+    }
+    return out;
+}
+
+
+static void finish(FILE *out) {
+    if (ferror(out) | fclose(out)) {
+        perror("Error writing the corpus");
+        exit(1);
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <directory> [scale]\n", argv[0]);
+        return 1;
+    }
+    double scale = argc > 2 ? atof(argv[2]) : 1.0;
+    if (scale <= 0.0) {
+        fprintf(stderr, "Invalid scale: %s\n", argv[2]);
+        return 1;
+    }
+    const char *dir = argv[1];
+    uint64_t state;
+    FILE *out;
+
+    state = 0x9E3779B97F4A7C15ULL;
+    out = create(dir, "points.wkt");
+    for (size_t i = 0; i < (size_t)(POINTS * scale); i++) {
+        write_point(out, &state);
+    }
+    finish(out);
+
+    state = 0xD1B54A32D192ED03ULL;
+    out = create(dir, "linestrings.wkt");
+    for (size_t i = 0; i < (size_t)(LINESTRINGS * scale); i++) {
+        write_linestring(out, &state, LINESTRING_VERTICES);
+    }
+    finish(out);
+
+    state = 0x8CB92BA72F3D8DD7ULL;
+    out = create(dir, "holes.wkt");
+    for (size_t i = 0; i < (size_t)(HOLED_POLYGONS * scale); i++) {
+        write_polygon(out, &state, POLYGON_HOLES, EXTERIOR_VERTICES);
+    }
+    finish(out);
+
+    /* Mostly small features, as in real dumps, with a tail of large
+     * ones. */
+    state = 0xA0761D6478BD642FULL;
+    out = create(dir, "mixed.wkt");
+    for (size_t i = 0; i < (size_t)(MIXED_RECORDS * scale); i++) {
+        uint64_t r = next_random(&state);
+        size_t size = r % 1000 ? 4 + (size_t)(r >> 32) % 28
+                              : 500 + (size_t)(r >> 32) % 2000;
+        switch ((r >> 8) % 3) {
+            case 0:
+                write_point(out, &state);
+                break;
+            case 1:
+                write_linestring(out, &state, size);
+                break;
+            default:
+                write_polygon(out, &state, (size_t)(r >> 16) % 8, size);
+                break;
+        }
+    }
+    finish(out);
+
+    return 0;
+}
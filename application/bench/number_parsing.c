@@ -0,0 +1,139 @@
+/*
+ * number_parsing.c
+ *
+ * Number parsing benchmark. Generates a deterministic set of vertex
+ * coordinates as WKT number tokens (plain decimals, negatives and
+ * exponents) and reports the vertices per second converted by `atof`,
+ * the previous conversion of the scanner, and by `parse_number`.
+ * Both conversions must produce the same doubles.
+ *
+ * Usage: number_parsing [vertex count]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/number.h"
+
+/* Default number of vertices, i.e. of coordinate pairs. */
+#define DEFAULT_VERTICES 2000000
+
+/* Number of timed passes over the tokens; the fastest one is kept. */
+#define PASSES 5
+
+
+/*
+ * Deterministic xorshift generator, so that every run parses the same
+ * tokens.
+ */
+static uint64_t next_random(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+
+/*
+ * Writes a NUL-terminated coordinate token to `out`: mostly decimal
+ * degrees with 6 to 15 fraction digits, some projected coordinates,
+ * negatives and exponents. Returns the token length.
+ */
+static size_t generate_token(uint64_t *state, char *out, size_t size) {
+    uint64_t r = next_random(state);
+    double value = (double)(r % 36000000000ULL) / 1e8 - 180.0;
+    int length;
+
+    switch (r >> 60) {
+        case 0:
+            length = snprintf(out, size, "%.6e", value);
+            break;
+        case 1:
+        case 2:
+            length = snprintf(out, size, "%.2f", value * 20000.0);
+            break;
+        case 3:
+            length = snprintf(out, size, "%.15f", value);
+            break;
+        default:
+            length = snprintf(out, size, "%.*f", 6 + (int)(r % 4), value);
+            break;
+    }
+    return (size_t)length;
+}
+
+
+static double elapsed_seconds(const struct timespec *start,
+                              const struct timespec *end) {
+    return (double)(end->tv_sec - start->tv_sec)
+           + (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+
+int main(int argc, char *argv[]) {
+    size_t vertices = argc > 1 ? (size_t)strtoul(argv[1], NULL, 10)
+                               : DEFAULT_VERTICES;
+    size_t count = 2 * vertices;
+
+    /* Tokens are stored back to back, each one NUL-terminated so that
+     * `atof` can read it as the scanner did with `yytext`. */
+    char *text = malloc(count * 32);
+    size_t *offsets = malloc(count * sizeof(size_t));
+    size_t *lengths = malloc(count * sizeof(size_t));
+    double *expected = malloc(count * sizeof(double));
+    double *actual = malloc(count * sizeof(double));
+    if (!text || !offsets || !lengths || !expected || !actual) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    size_t used = 0;
+    for (size_t i = 0; i < count; i++) {
+        offsets[i] = used;
+        lengths[i] = generate_token(&state, text + used, 32);
+        used += lengths[i] + 1;
+    }
+
+    double best_atof = 0.0, best_parse = 0.0;
+    for (int pass = 0; pass < PASSES; pass++) {
+        struct timespec start, middle, end;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (size_t i = 0; i < count; i++) {
+            expected[i] = atof(text + offsets[i]);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &middle);
+        for (size_t i = 0; i < count; i++) {
+            actual[i] = parse_number(text + offsets[i], lengths[i]);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        double atof_time = elapsed_seconds(&start, &middle);
+        double parse_time = elapsed_seconds(&middle, &end);
+        if (!pass || atof_time < best_atof) best_atof = atof_time;
+        if (!pass || parse_time < best_parse) best_parse = parse_time;
+    }
+
+    if (memcmp(expected, actual, count * sizeof(double))) {
+        fprintf(stderr, "Error: parse_number and atof disagree\n");
+        return 1;
+    }
+
+    printf("%-14s %14s %12s\n", "parser", "vertices/s", "ns/vertex");
+    printf("%-14s %14.0f %12.1f\n", "atof",
+           (double)vertices / best_atof, best_atof * 1e9 / (double)vertices);
+    printf("%-14s %14.0f %12.1f\n", "parse_number",
+           (double)vertices / best_parse, best_parse * 1e9 / (double)vertices);
+    printf("speedup: %.2fx\n", best_atof / best_parse);
+
+    free(text);
+    free(offsets);
+    free(lengths);
+    free(expected);
+    free(actual);
+    return 0;
+}
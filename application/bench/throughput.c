@@ -0,0 +1,297 @@
+/*
+ * throughput.c
+ *
+ * Throughput benchmark. Converts every input file in separate phases
+ * and reports, for each phase, the MB/s of WKT, features/s and
+ * vertices/s as JSON on stdout, so that results can be recorded and
+ * compared over time:
+ *
+ *   scan       - the tokens of the mapped input, without parsing;
+ *   parse      - the parser alone: parsing the input into an IR (see
+ *                `ir.h`), minus the scan time;
+ *   write      - the GeoJSON serialization of that IR into memory;
+ *   end_to_end - a complete conversion, from opening the input to
+ *                writing the document to /dev/null.
+ *
+ * Every phase runs PASSES times and the fastest pass is kept.
+ *
+ * Usage: throughput [-t engine] [-p digits] file...
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "../src/parser.tab.h"
+
+/* Number of timed passes per phase; the fastest one is kept. */
+#define PASSES 3
+
+/* Flex scanner, generated in `lex.yy.c`. */
+int flex_lex(YYSTYPE *yylval_param, void *yyscanner);
+
+/* Phases of a conversion, in the order they are reported. */
+enum {
+    PHASE_SCAN,
+    PHASE_PARSE,
+    PHASE_WRITE,
+    PHASE_END_TO_END,
+    PHASE_COUNT
+};
+
+static const char *const phase_names[PHASE_COUNT] = {
+    "scan", "parse", "write", "end_to_end"
+};
+
+
+/*
+ * Returns the time of the monotonic clock, in seconds.
+ */
+static double now(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+
+/*
+ * Creates a context converting `path` as `wkt2geojson -i` does, with a
+ * mapped input and the selected engine.
+ */
+static wkt2geojson_ctx* open_ctx(const char *path, tokenizer_engine engine,
+                                 FILE *out_file, FILE **in_file) {
+    *in_file = fopen(path, "r");
+    if (!*in_file) {
+        perror(path);
+        exit(1);
+    }
+    wkt2geojson_ctx *ctx = wkt2geojson_ctx_new(*in_file, out_file);
+    if (ctx) {
+        wkt2geojson_ctx_map_input(ctx, 0);
+    }
+    if (!ctx || wkt2geojson_ctx_use_tokenizer(ctx, engine) < 0) {
+        fprintf(stderr, "Error: cannot initialize the tokenizer\n");
+        exit(1);
+    }
+    return ctx;
+}
+
+
+/*
+ * Returns the seconds taken to read every token of `path` with
+ * `engine`, without parsing them.
+ */
+static double time_scan(const char *path, tokenizer_engine engine) {
+    FILE *in_file;
+    wkt2geojson_ctx *ctx = open_ctx(path, engine, NULL, &in_file);
+
+    double start = now();
+    YYSTYPE value;
+    int token;
+    do {
+        token = ctx->tokenizer ? tokenizer_next(ctx->tokenizer, &value.dval)
+                               : flex_lex(&value, ctx->scanner);
+    } while (token > 0);
+    double elapsed = now() - start;
+
+    wkt2geojson_ctx_free(ctx);
+    fclose(in_file);
+    return elapsed;
+}
+
+
+/*
+ * Returns the seconds taken to parse `path` with `engine` into `ir`,
+ * which is cleared first and keeps the geometries for `time_write`.
+ * Exits on a syntax error.
+ */
+static double time_parse(const char *path, tokenizer_engine engine,
+                         wkt_ir *ir) {
+    FILE *in_file;
+    wkt2geojson_ctx *ctx = open_ctx(path, engine, NULL, &in_file);
+    wkt_ir_clear(ir);
+    ctx->ir = ir;
+    ctx->defer_errors = 1;
+
+    double start = now();
+    int status = transpile_features(ctx);
+    double elapsed = now() - start;
+
+    if (status) {
+        fprintf(stderr, "Error: %s: %s\n", path,
+                ctx->error ? ctx->error : "syntax error");
+        exit(1);
+    }
+    wkt2geojson_ctx_free(ctx);
+    fclose(in_file);
+    return elapsed;
+}
+
+
+/*
+ * Returns the seconds taken to serialize the geometries of `ir` as
+ * GeoJSON into an in-memory sink, with `precision` fraction digits.
+ */
+static double time_write(const wkt_ir *ir, int precision) {
+    output_sink sink;
+    if (output_sink_init(&sink, -1, 0) < 0) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+    }
+
+    double start = now();
+    if (write_ir(&sink, ir, precision, 1) < 0) {
+        fprintf(stderr, "Error: out of memory\n");
+        exit(1);
+    }
+    double elapsed = now() - start;
+
+    output_sink_release(&sink);
+    return elapsed;
+}
+
+
+/*
+ * Returns the seconds taken by a complete conversion of `path` with
+ * `engine` and `precision`, written to `null_file`, including the
+ * opening and the mapping of the input. Exits if the conversion fails.
+ */
+static double time_end_to_end(const char *path, tokenizer_engine engine,
+                              int precision, FILE *null_file) {
+    double start = now();
+    FILE *in_file;
+    wkt2geojson_ctx *ctx = open_ctx(path, engine, null_file, &in_file);
+    ctx->precision = precision;
+    int status = transpile_ctx(ctx);
+    wkt2geojson_ctx_free(ctx);
+    fclose(in_file);
+    double elapsed = now() - start;
+
+    if (status) {
+        exit(1);
+    }
+    return elapsed;
+}
+
+
+/*
+ * Writes `text` as a JSON string.
+ */
+static void print_string(const char *text) {
+    putchar('"');
+    for (; *text; text++) {
+        if (*text == '"' || *text == '\\') {
+            putchar('\\');
+        }
+        putchar(*text);
+    }
+    putchar('"');
+}
+
+
+int main(int argc, char *argv[]) {
+    tokenizer_engine engine = TOKENIZER_FLEX;
+    const char *engine_name = "flex";
+    int precision = WRITER_SHORTEST;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:p:")) != -1) {
+        switch (opt) {
+            case 't':
+                if (tokenizer_engine_from_name(optarg, &engine) < 0
+                        || !tokenizer_engine_supported(engine)) {
+                    fprintf(stderr, "Unsupported tokenizer engine: %s\n",
+                            optarg);
+                    return 1;
+                }
+                engine_name = optarg;
+                break;
+            case 'p':
+                precision = atoi(optarg);
+                if (precision < 0 || precision > WRITER_MAX_PRECISION) {
+                    fprintf(stderr, "Invalid precision: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-t engine] [-p digits]"
+                        " file...\n", argv[0]);
+                return 1;
+        }
+    }
+
+    FILE *null_file = fopen("/dev/null", "w");
+    wkt_ir ir;
+    if (!null_file || wkt_ir_init(&ir) < 0) {
+        fprintf(stderr, "Error: cannot initialize the benchmark\n");
+        return 1;
+    }
+
+    char timestamp[32];
+    time_t seconds = time(NULL);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ",
+             gmtime(&seconds));
+
+    printf("{\n  \"timestamp\": \"%s\",\n  \"engine\": ", timestamp);
+    print_string(engine_name);
+    printf(",\n  \"precision\": %d,\n  \"passes\": %d,\n  \"results\": [",
+           precision, PASSES);
+
+    for (int i = optind; i < argc; i++) {
+        const char *path = argv[i];
+        struct stat status;
+        if (stat(path, &status) < 0) {
+            perror(path);
+            return 1;
+        }
+
+        double best[PHASE_COUNT];
+        for (int pass = 0; pass < PASSES; pass++) {
+            double times[PHASE_COUNT];
+            times[PHASE_SCAN] = time_scan(path, engine);
+            times[PHASE_PARSE] = time_parse(path, engine, &ir);
+            times[PHASE_WRITE] = time_write(&ir, precision);
+            times[PHASE_END_TO_END] = time_end_to_end(path, engine,
+                                                      precision, null_file);
+            for (int p = 0; p < PHASE_COUNT; p++) {
+                if (!pass || times[p] < best[p]) {
+                    best[p] = times[p];
+                }
+            }
+        }
+
+        /* The parse pass also scans the input. */
+        best[PHASE_PARSE] -= best[PHASE_SCAN];
+        if (best[PHASE_PARSE] < 1e-9) {
+            best[PHASE_PARSE] = 1e-9;
+        }
+
+        double megabytes = (double)status.st_size / 1e6;
+        double features = (double)ir.geometry_count;
+        double vertices = (double)ir.vertex_count;
+
+        printf("%s\n    {\n      \"file\": ", i > optind ? "," : "");
+        print_string(path);
+        printf(",\n      \"bytes\": %lld,\n      \"features\": %zu,\n"
+               "      \"vertices\": %zu,\n      \"phases\": {",
+               (long long)status.st_size, ir.geometry_count,
+               ir.vertex_count);
+        for (int p = 0; p < PHASE_COUNT; p++) {
+            printf("%s\n        \"%s\": { \"seconds\": %.6f,"
+                   " \"mb_per_s\": %.1f, \"features_per_s\": %.0f,"
+                   " \"vertices_per_s\": %.0f }",
+                   p ? "," : "", phase_names[p], best[p],
+                   megabytes / best[p], features / best[p],
+                   vertices / best[p]);
+        }
+        printf("\n      }\n    }");
+        fflush(stdout);
+    }
+    printf("\n  ]\n}\n");
+
+    wkt_ir_release(&ir);
+    fclose(null_file);
+    return 0;
+}
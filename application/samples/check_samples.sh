@@ -0,0 +1,437 @@
+#!/bin/sh
+
+# ABSTRACT: Sample conversions regression test
+#
+# Converts the sample inputs with the options of every case and
+# compares the exit status, the output and, for the cases that list
+# them, the rejected records with the files of the `expected`
+# directory: `<case>.geojson` and `<case>.rejects`. Cases checking
+# that two ways of converting an input agree, such as `-j` against a
+# single thread, compare their outputs with each other instead, on
+# inputs generated large enough to take the code paths under test.
+#
+# The daemon of --serve is only checked when a client built from
+# `serve_client.c` is given.
+#
+# Usage: check_samples.sh <wkt2geojson binary> [serve_client binary]
+
+if [ "$#" -lt 1 ] || [ "$#" -gt 2 ]; then
+    echo "Usage: $0 <wkt2geojson binary> [serve_client binary]"
+    exit 1
+fi
+
+BINARY=$1
+CLIENT=$2
+SAMPLES_DIR="$(cd "$(dirname "$0")" && pwd)"
+EXPECTED_DIR="$SAMPLES_DIR/expected"
+
+WORK_DIR="$(mktemp -d)"
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+CASES=0
+FAILURES=0
+
+# Reports a failed case.
+fail() {
+    echo "FAIL $1: $2"
+    FAILURES=$((FAILURES + 1))
+}
+
+# Runs the binary with the given options, its output written to
+# `$WORK_DIR/<case>.geojson`, then compares it and the exit status with
+# the expected ones. When `<case>.rejects` is expected, the options
+# must list the rejects in `$WORK_DIR/<case>.rejects`.
+#
+# Usage: check <case> <expected status> <options...>
+check() {
+    NAME=$1
+    STATUS=$2
+    shift 2
+    CASES=$((CASES + 1))
+
+    "$BINARY" "$@" > "$WORK_DIR/$NAME.geojson" 2> "$WORK_DIR/$NAME.err"
+    RESULT=$?
+
+    if [ "$RESULT" -ne "$STATUS" ]; then
+        fail "$NAME" "exit status $RESULT instead of $STATUS"
+    elif ! cmp -s "$EXPECTED_DIR/$NAME.geojson" "$WORK_DIR/$NAME.geojson"; then
+        fail "$NAME" "output differs from $NAME.geojson"
+    elif [ -f "$EXPECTED_DIR/$NAME.rejects" ] \
+            && ! cmp -s "$EXPECTED_DIR/$NAME.rejects" \
+                         "$WORK_DIR/$NAME.rejects"; then
+        fail "$NAME" "rejects differ from $NAME.rejects"
+    fi
+}
+
+# Runs the binary with the given options, its output written to
+# `$WORK_DIR/<file>`, and counts a failure if it does not succeed.
+#
+# Usage: run <file> <options...>
+run() {
+    OUTPUT=$1
+    shift
+    CASES=$((CASES + 1))
+    if ! "$BINARY" "$@" > "$WORK_DIR/$OUTPUT" 2> "$WORK_DIR/$OUTPUT.err"; then
+        fail "$OUTPUT" "conversion failed: $(cat "$WORK_DIR/$OUTPUT.err")"
+    fi
+}
+
+# Prints a WKT input of the given number of points and short lines,
+# spread over the whole world: large enough, at 60000 records, to be
+# split by `-j 4` and to overflow `--sort-memory 1`.
+generate_features() {
+    awk -v n="$1" 'BEGIN {
+        for (i = 0; i < n; i++) {
+            x = (i * 7919) % 3600 - 1800;
+            y = (i * 104729) % 1700 - 850;
+            if (i % 5) {
+                printf "POINT (%d.%d %d.%d)\n", x / 10, i % 97, y / 10, i % 89;
+            } else {
+                printf "LINESTRING (%d.%d %d.%d, %d.5 %d.25)\n",
+                       x / 10, i % 7, y / 10, i % 3, x / 10 + 1, y / 10 - 1;
+            }
+        }
+    }'
+}
+
+# Checks that two files of the work directory are identical.
+#
+# Usage: same <case> <file> <file>
+same() {
+    CASES=$((CASES + 1))
+    if ! cmp -s "$WORK_DIR/$2" "$WORK_DIR/$3"; then
+        fail "$1" "$2 and $3 differ"
+    fi
+}
+
+# Prints the features of a FeatureCollection written by the binary,
+# one per line, as --format ndjson writes them.
+collection_lines() {
+    sed -n '3,$p' "$1" | sed 's/^"features": \[//; s/^,//' | grep '^{'
+}
+
+WKT="$SAMPLES_DIR/wkt"
+WKB="$SAMPLES_DIR/wkb"
+FEATURES="$WORK_DIR/features.wkt"
+generate_features 60000 > "$FEATURES"
+
+# --format ndjson writes the features of the collection one per line,
+# and geojsonseq the same lines, each after a record separator.
+check ndjson 0 -i "$WKT/geometries.wkt" --format ndjson
+run collection.geojson -i "$WKT/geometries.wkt"
+collection_lines "$WORK_DIR/collection.geojson" > "$WORK_DIR/collection.lines"
+same ndjson_collection ndjson.geojson collection.lines
+run seq.geojson -i "$WKT/geometries.wkt" --format geojsonseq
+tr -d '\036' < "$WORK_DIR/seq.geojson" > "$WORK_DIR/seq.lines"
+same geojsonseq seq.lines ndjson.geojson
+CASES=$((CASES + 1))
+if [ "$(grep -c "^$(printf '\036'){" "$WORK_DIR/seq.geojson")" \
+        -ne "$(wc -l < "$WORK_DIR/seq.geojson")" ]; then
+    fail geojsonseq_separators "a line lacks its record separator"
+fi
+run features.ndjson -i "$FEATURES" --format ndjson -j 4
+run features.geojson -i "$FEATURES"
+collection_lines "$WORK_DIR/features.geojson" > "$WORK_DIR/features.lines"
+same ndjson_parallel features.ndjson features.lines
+
+# Compressed outputs, chosen with --compress or from the extension of
+# -o, and inputs, detected from their magic bytes, decompress to the
+# plain ones; a truncated input is an error. zstd is only checked when
+# the build supports it and the zstd tool is installed.
+run gzip.log -i "$WKT/geometries.wkt" -o "$WORK_DIR/out.geojson.gz"
+gzip -dc "$WORK_DIR/out.geojson.gz" > "$WORK_DIR/gunzip.geojson"
+same gzip_extension gunzip.geojson collection.geojson
+run piped.gz -i "$WKT/geometries.wkt" --compress gzip --format ndjson
+gzip -dc "$WORK_DIR/piped.gz" > "$WORK_DIR/gunzip.ndjson"
+same gzip_ndjson gunzip.ndjson ndjson.geojson
+gzip -c "$FEATURES" > "$WORK_DIR/features.wkt.gz"
+run features_gzip.geojson -i "$WORK_DIR/features.wkt.gz"
+same gzip_input features_gzip.geojson features.geojson
+head -c 2000 "$WORK_DIR/features.wkt.gz" > "$WORK_DIR/truncated.gz"
+CASES=$((CASES + 1))
+if "$BINARY" -i "$WORK_DIR/truncated.gz" > /dev/null 2>&1; then
+    fail gzip_truncated "a truncated input was converted"
+fi
+if command -v zstd > /dev/null 2>&1 \
+        && "$BINARY" -i "$WKT/geometries.wkt" --compress zstd \
+               > /dev/null 2>&1; then
+    run out.zst -i "$WKT/geometries.wkt" --compress zstd
+    zstd -dcq "$WORK_DIR/out.zst" > "$WORK_DIR/unzstd.geojson"
+    same zstd_output unzstd.geojson collection.geojson
+    zstd -cq "$FEATURES" > "$WORK_DIR/features.wkt.zst"
+    run features_zstd.geojson -i "$WORK_DIR/features.wkt.zst"
+    same zstd_input features_zstd.geojson features.geojson
+fi
+
+# Records with syntax errors stop the conversion, or are skipped and
+# listed with --rejects, up to --max-errors of them.
+check rejects_stop 1 -i "$WKT/rejects.wkt"
+check rejects_skip 0 -i "$WKT/rejects.wkt" \
+    --rejects "$WORK_DIR/rejects_skip.rejects"
+check rejects_limit 1 -i "$WKT/rejects.wkt" --max-errors 2 \
+    --rejects "$WORK_DIR/rejects_limit.rejects"
+check rejects_within 0 -i "$WKT/rejects.wkt" --max-errors 3 \
+    --rejects "$WORK_DIR/rejects_within.rejects"
+
+# Raw and hex-encoded WKB, in both byte orders, upper and lower case,
+# and with the SRID of PostGIS EWKB, give the output of the same
+# geometries in WKT. Invalid lines of a hex-encoded input are errors,
+# or rejects.
+check wkb 0 -i "$WKB/geometries.wkb" --input-format wkb
+check hexwkb 0 -i "$WKB/geometries.hex" --input-format hexwkb
+run geometries.geojson -i "$WKT/geometries.wkt"
+same wkb_wkt wkb.geojson geometries.geojson
+check hexwkb_stop 1 -i "$WKB/rejects.hex" --input-format hexwkb
+check hexwkb_rejects 0 -i "$WKB/rejects.hex" --input-format hexwkb \
+    --rejects "$WORK_DIR/hexwkb_rejects.rejects"
+
+# Numbers too large for a double, and infinite or NaN WKB coordinates,
+# cannot be written in GeoJSON: their records are errors, or rejects,
+# with either tokenizer. Numbers too small for one round to zero.
+check ranges_stop 1 -i "$WKT/ranges.wkt"
+check ranges_rejects 0 -i "$WKT/ranges.wkt" \
+    --rejects "$WORK_DIR/ranges_rejects.rejects"
+run ranges_simd.geojson -i "$WKT/ranges.wkt" -t simd \
+    --rejects "$WORK_DIR/ranges_simd.rejects"
+same ranges_simd ranges_rejects.geojson ranges_simd.geojson
+same ranges_simd_rejects ranges_rejects.rejects ranges_simd.rejects
+check ranges_hexwkb 0 -i "$WKB/ranges.hex" --input-format hexwkb \
+    --rejects "$WORK_DIR/ranges_hexwkb.rejects"
+
+# -p rounds half to even on the exact value of the double, without
+# trailing zeros or negative zeros, and formats the values too large
+# for the integer fast path exactly too. It only takes 0 to 17 digits.
+check precision_0 0 -i "$WKT/precision.wkt" -p 0 --format ndjson
+check precision_2 0 -i "$WKT/precision.wkt" -p 2 --format ndjson
+check precision_17 0 -i "$WKT/precision.wkt" -p 17 --format ndjson
+CASES=$((CASES + 1))
+if "$BINARY" -i "$WKT/precision.wkt" -p 18 > /dev/null 2>&1; then
+    fail precision_range "-p 18 was accepted"
+fi
+run precision_serial.geojson -i "$FEATURES" -p 1
+run precision_parallel.geojson -i "$FEATURES" -p 1 -j 4
+same precision_parallel precision_serial.geojson precision_parallel.geojson
+
+# --simplify drops the vertices within the tolerance of the shape, with
+# Douglas-Peucker or Visvalingam-Whyatt, but keeps the endpoints, at
+# least two vertices of a line and four of a ring, even for a tolerance
+# larger than the geometries. Points are left as they are.
+check simplify_dp 0 -i "$WKT/simplify.wkt" --simplify 0.5 --format ndjson
+check simplify_vw 0 -i "$WKT/simplify.wkt" --simplify 0.5 \
+    --simplify-method vw --format ndjson
+check simplify_dp_minimum 0 -i "$WKT/simplify.wkt" --simplify 100 \
+    --format ndjson
+check simplify_vw_minimum 0 -i "$WKT/simplify.wkt" --simplify 100 \
+    --simplify-method vw --format ndjson
+run simplify_serial.geojson -i "$FEATURES" --simplify 1 --simplify-method vw
+run simplify_parallel.geojson -i "$FEATURES" --simplify 1 \
+    --simplify-method vw -j 4
+same simplify_parallel simplify_serial.geojson simplify_parallel.geojson
+
+# --emit-bbox writes the extent of every feature, holes included, and
+# with =all that of the kept features on the collection, after the
+# features. Bounding boxes are rounded like the coordinates. The bbox
+# of a point copies the text of its corner, whatever the length of its
+# numbers at a fixed precision.
+check emit_bbox 0 -i "$WKT/geometries.wkt" --emit-bbox
+check emit_bbox_all 0 -i "$WKT/geometries.wkt" --emit-bbox=all
+check emit_bbox_filtered 0 -i "$WKT/spatial.wkt" --emit-bbox=all \
+    --bbox 0,0,10,10
+check emit_bbox_rounded 0 -i "$WKT/geometries.wkt" --emit-bbox=all -p 0
+check bbox_large 0 -i "$WKT/large.wkt" -p 2 --emit-bbox=all
+run emit_bbox_serial.geojson -i "$FEATURES" --emit-bbox=all
+run emit_bbox_parallel.geojson -i "$FEATURES" --emit-bbox=all -j 4
+same emit_bbox_parallel emit_bbox_serial.geojson emit_bbox_parallel.geojson
+
+# Spatial filters keep the features intersecting a box, boundaries
+# included, or one of the geometries of a WKT text: lines crossing the
+# query without a vertex inside it are kept, and features whose extent
+# overlaps it without touching it, such as a polygon whose hole holds
+# the box, are dropped.
+check bbox 0 -i "$WKT/spatial.wkt" --bbox 0,0,10,10
+check intersects_wkt 0 -i "$WKT/spatial.wkt" \
+    --intersects-wkt "POLYGON ((0 0, 10 0, 0 10, 0 0)) POINT (20 20)"
+check bbox_hexwkb 0 -i "$WKB/geometries.hex" --input-format hexwkb \
+    --bbox -80,40,0,50
+
+# A conversion on several threads gives the output of a single one,
+# even when the first records come after more blank lines than a
+# thread's share of the input, which all go to the first chunk.
+run serial.geojson -i "$FEATURES"
+run parallel.geojson -i "$FEATURES" -j 4
+same parallel serial.geojson parallel.geojson
+awk 'BEGIN { for (i = 0; i < 300000; i++) print "" }' > "$WORK_DIR/blank.wkt"
+head -n 200 "$FEATURES" >> "$WORK_DIR/blank.wkt"
+run blank_serial.geojson -i "$WORK_DIR/blank.wkt"
+run blank_parallel.geojson -i "$WORK_DIR/blank.wkt" -j 4
+run blank_rejects.geojson -i "$WORK_DIR/blank.wkt" -j 4 \
+    --rejects "$WORK_DIR/blank.rejects"
+same parallel_blank blank_serial.geojson blank_parallel.geojson
+CASES=$((CASES + 1))
+if [ -s "$WORK_DIR/blank.rejects" ]; then
+    fail parallel_blank_rejects "blank lines rejected with -j 4"
+fi
+
+# --sort=hilbert follows the Hilbert curve over a grid, and only
+# reorders the features. The output does not depend on the memory of
+# the sort, spilled to temporary files beyond --sort-memory (which the
+# conversion cannot do in a missing directory), nor on -j.
+check sort_grid 0 -i "$WKT/grid.wkt" --sort hilbert --format ndjson
+run unsorted.ndjson -i "$FEATURES" --format ndjson
+run sorted.ndjson -i "$FEATURES" --format ndjson --sort hilbert
+sort "$WORK_DIR/unsorted.ndjson" > "$WORK_DIR/unsorted.lines"
+sort "$WORK_DIR/sorted.ndjson" > "$WORK_DIR/sorted.lines"
+same sort_features unsorted.lines sorted.lines
+run sorted_memory.geojson -i "$FEATURES" --sort hilbert --sort-memory 0
+run sorted_spill.geojson -i "$FEATURES" --sort hilbert --sort-memory 1 \
+    --temp-dir "$WORK_DIR"
+run sorted_parallel.geojson -i "$FEATURES" --sort hilbert \
+    --sort-memory 1 --temp-dir "$WORK_DIR" -j 4
+same sort_spill sorted_memory.geojson sorted_spill.geojson
+same sort_parallel sorted_memory.geojson sorted_parallel.geojson
+CASES=$((CASES + 1))
+if "$BINARY" -i "$FEATURES" -o /dev/null --sort hilbert --sort-memory 1 \
+        --temp-dir "$WORK_DIR/missing" 2> /dev/null; then
+    fail sort_spill_forced "nothing was spilled with --sort-memory 1"
+fi
+
+# With -j, the features held for the sort stay within --sort-memory:
+# on an output of 50 MiB, 4 threads peak at most a few MiB above
+# a single one.
+generate_features 600000 > "$WORK_DIR/large.wkt"
+run sort_serial.log -i "$WORK_DIR/large.wkt" -o /dev/null --sort hilbert \
+    --sort-memory 1 --temp-dir "$WORK_DIR" --stats="$WORK_DIR/sort_serial.json"
+run sort_parallel.log -i "$WORK_DIR/large.wkt" -o /dev/null --sort hilbert \
+    --sort-memory 1 --temp-dir "$WORK_DIR" -j 4 \
+    --stats="$WORK_DIR/sort_parallel.json"
+SERIAL_RSS=$(sed -n 's/.*"peak_rss_kib": \([0-9]*\).*/\1/p' \
+                 "$WORK_DIR/sort_serial.json")
+PARALLEL_RSS=$(sed -n 's/.*"peak_rss_kib": \([0-9]*\).*/\1/p' \
+                   "$WORK_DIR/sort_parallel.json")
+CASES=$((CASES + 1))
+if [ "$PARALLEL_RSS" -gt $((SERIAL_RSS + 8192)) ]; then
+    fail sort_parallel_memory \
+        "peak RSS of $PARALLEL_RSS KiB with -j 4, $SERIAL_RSS KiB without"
+fi
+
+# --index writes an R-tree of the features of the output, whose
+# --query-index returns the features whose bbox intersects a box. The
+# index does not depend on -j, and a query gives the features of the
+# output that --bbox keeps (the lines of the generated input being too
+# short to tell their bbox from their vertices), even once sorted.
+run spatial.log -i "$WKT/spatial.wkt" -o "$WORK_DIR/spatial.geojson" \
+    --index "$WORK_DIR/spatial.idx"
+check query_index 0 --query-index "$WORK_DIR/spatial.idx" --bbox 0,0,10,10 \
+    -i "$WORK_DIR/spatial.geojson"
+run serial.log -i "$FEATURES" -o "$WORK_DIR/serial.out" \
+    --index "$WORK_DIR/serial.idx"
+run parallel.log -i "$FEATURES" -o "$WORK_DIR/parallel.out" \
+    --index "$WORK_DIR/parallel.idx" -j 4
+same index_parallel serial.idx parallel.idx
+run sorted.log -i "$FEATURES" -o "$WORK_DIR/sorted.out" \
+    --index "$WORK_DIR/sorted.idx" --sort hilbert --sort-memory 1 \
+    --temp-dir "$WORK_DIR" -j 4
+run query.ndjson --query-index "$WORK_DIR/serial.idx" --format ndjson \
+    --bbox -20,-10,30,25 -i "$WORK_DIR/serial.out"
+run filter.ndjson -i "$FEATURES" --format ndjson --bbox -20,-10,30,25
+run query_sorted.ndjson --query-index "$WORK_DIR/sorted.idx" \
+    --format ndjson --bbox -20,-10,30,25 -i "$WORK_DIR/sorted.out"
+same query_filter query.ndjson filter.ndjson
+sort "$WORK_DIR/query.ndjson" > "$WORK_DIR/query.lines"
+sort "$WORK_DIR/query_sorted.ndjson" > "$WORK_DIR/query_sorted.lines"
+same query_sorted query.lines query_sorted.lines
+
+# --batch merges the features of its inputs, given as operands, glob
+# patterns or a manifest on stdin, in input order and on any number of
+# threads, as the command line converts them one after the other. A
+# failing input is reported with its path and does not stop the batch.
+# With --output-dir, every output mirrors the path of its input below
+# their common directory, and two inputs that would share an output
+# fail the batch before anything is written.
+mkdir -p "$WORK_DIR/tiles/a" "$WORK_DIR/tiles/b"
+cp "$WKT/geometries.wkt" "$WORK_DIR/tiles/a/geometries.wkt"
+cp "$WKT/precision.wkt" "$WORK_DIR/tiles/b/precision.wkt"
+cp "$WKT/precision.wkt" "$WORK_DIR/tiles/b/precision.txt"
+TILES="$WORK_DIR/tiles/a/geometries.wkt $WORK_DIR/tiles/b/precision.wkt"
+run tile_a.ndjson -i "$WORK_DIR/tiles/a/geometries.wkt" --format ndjson
+run tile_b.ndjson -i "$WORK_DIR/tiles/b/precision.wkt" --format ndjson
+cat "$WORK_DIR/tile_a.ndjson" "$WORK_DIR/tile_b.ndjson" \
+    > "$WORK_DIR/tiles.ndjson"
+run batch.geojson --batch $TILES
+collection_lines "$WORK_DIR/batch.geojson" > "$WORK_DIR/batch.lines"
+same batch batch.lines tiles.ndjson
+run batch_glob.ndjson --batch "$WORK_DIR/tiles/*/*.wkt" --format ndjson -j 2
+same batch_glob batch_glob.ndjson tiles.ndjson
+printf '%s\n\n%s\n' $TILES > "$WORK_DIR/tiles.list"
+run batch_manifest.ndjson --batch --format ndjson < "$WORK_DIR/tiles.list"
+same batch_manifest batch_manifest.ndjson tiles.ndjson
+"$BINARY" -i "$WKT/rejects.wkt" --format ndjson \
+    > "$WORK_DIR/tile_rejects.ndjson" 2> /dev/null
+cat "$WORK_DIR/tile_a.ndjson" "$WORK_DIR/tile_rejects.ndjson" \
+    "$WORK_DIR/tile_b.ndjson" > "$WORK_DIR/tiles_rejects.ndjson"
+CASES=$((CASES + 1))
+if "$BINARY" --batch --format ndjson "$WORK_DIR/tiles/a/geometries.wkt" \
+        "$WKT/rejects.wkt" "$WORK_DIR/tiles/b/precision.wkt" \
+        > "$WORK_DIR/batch_failure.ndjson" \
+        2> "$WORK_DIR/batch_failure.err"; then
+    fail batch_failure "a failing input did not fail the batch"
+elif ! grep -q "$WKT/rejects.wkt: syntax error" \
+        "$WORK_DIR/batch_failure.err"; then
+    fail batch_failure "error: $(cat "$WORK_DIR/batch_failure.err")"
+fi
+same batch_failure_output tiles_rejects.ndjson batch_failure.ndjson
+run batch_dir.log --batch --output-dir "$WORK_DIR/out" $TILES
+run tile_a.geojson -i "$WORK_DIR/tiles/a/geometries.wkt"
+run tile_b.geojson -i "$WORK_DIR/tiles/b/precision.wkt"
+same batch_dir_a tile_a.geojson out/a/geometries.geojson
+same batch_dir_b tile_b.geojson out/b/precision.geojson
+CASES=$((CASES + 1))
+if "$BINARY" --batch --output-dir "$WORK_DIR/duplicates" \
+        "$WORK_DIR/tiles/b/precision.wkt" "$WORK_DIR/tiles/b/precision.txt" \
+        2> /dev/null; then
+    fail batch_duplicate "two inputs were written to the same output"
+elif [ -e "$WORK_DIR/duplicates" ]; then
+    fail batch_duplicate "outputs were written before the error"
+fi
+
+# --serve converts the requests of a connection one after the other,
+# with the options of the daemon, as the command line does. A failed
+# request ends with its error after the document of the features
+# before it, and leaves the connection open for the next one. The
+# socket is removed on SIGTERM.
+if [ -n "$CLIENT" ]; then
+    SOCKET="$WORK_DIR/serve.sock"
+    "$BINARY" --serve "$SOCKET" --workers 2 -p 2 --format ndjson \
+        > /dev/null 2> "$WORK_DIR/serve.log" &
+    SERVER=$!
+    "$BINARY" -i "$WKT/rejects.wkt" -p 2 --format ndjson \
+        > "$WORK_DIR/serve_rejects.geojson" 2> /dev/null
+    cat "$EXPECTED_DIR/precision_2.geojson" "$WORK_DIR/serve_rejects.geojson" \
+        "$EXPECTED_DIR/precision_2.geojson" > "$WORK_DIR/serve_cli.geojson"
+    "$CLIENT" "$SOCKET" "$WKT/precision.wkt" "$WKT/rejects.wkt" \
+        "$WKT/precision.wkt" > "$WORK_DIR/serve.geojson" \
+        2> "$WORK_DIR/serve.err"
+    RESULT=$?
+    CASES=$((CASES + 1))
+    if [ "$RESULT" -ne 1 ]; then
+        fail serve_status \
+            "client status $RESULT instead of 1: $(cat "$WORK_DIR/serve.err")"
+    fi
+    same serve serve_cli.geojson serve.geojson
+    CASES=$((CASES + 1))
+    if [ "$(cat "$WORK_DIR/serve.err")" != "syntax error" ]; then
+        fail serve_error "error frame: $(cat "$WORK_DIR/serve.err")"
+    fi
+    kill -TERM "$SERVER"
+    wait "$SERVER"
+    RESULT=$?
+    CASES=$((CASES + 1))
+    if [ "$RESULT" -ne 0 ] || [ -e "$SOCKET" ]; then
+        fail serve_shutdown "status $RESULT on SIGTERM, or socket left"
+    fi
+fi
+
+echo "$CASES cases, $FAILURES failed"
+[ "$FAILURES" -eq 0 ]
+
+# EOF
@@ -0,0 +1,225 @@
+/*
+ * serve_client.c
+ *
+ * Minimal client of the conversion daemon (see `server.h` for the
+ * protocol), used by `check_samples.sh` to check `--serve`. Sends every
+ * file as a request, one after the other on the same connection, and
+ * writes the GeoJSON of the responses to stdout and the message of
+ * every failed conversion to stderr.
+ *
+ * The connection is retried for a few seconds, so that the client can
+ * be started along with the daemon.
+ *
+ * Usage: serve_client <socket> <file...>
+ *
+ * Exits with 0 if every conversion succeeded, 1 if one failed, or 2 if
+ * a file or the connection fails.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Attempts to connect, and the delay between them in milliseconds. */
+#define CONNECT_ATTEMPTS 100
+#define CONNECT_DELAY 50
+
+
+/*
+ * Connects to the daemon listening at `path`, until it is listening.
+ * Returns the socket, or -1 in case of error.
+ */
+static int connect_server(const char *path) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    for (int attempt = 0; attempt < CONNECT_ATTEMPTS; attempt++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            perror("socket");
+            return -1;
+        }
+        if (connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0) {
+            return fd;
+        }
+        int error = errno;
+        close(fd);
+        if (error != ENOENT && error != ECONNREFUSED) {
+            fprintf(stderr, "%s: %s\n", path, strerror(error));
+            return -1;
+        }
+        struct timespec delay = { 0, CONNECT_DELAY * 1000000L };
+        nanosleep(&delay, NULL);
+    }
+    fprintf(stderr, "%s: no daemon listening\n", path);
+    return -1;
+}
+
+
+/*
+ * Writes `length` bytes to the socket.
+ * Returns 0 on success or -1 in case of error.
+ */
+static int write_all(int fd, const char *data, size_t length) {
+    while (length) {
+        ssize_t count = write(fd, data, length);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return -1;
+        }
+        data += count;
+        length -= (size_t)count;
+    }
+    return 0;
+}
+
+
+/*
+ * Reads exactly `length` bytes from the socket.
+ * Returns 0 on success or -1 in case of error or end of stream.
+ */
+static int read_all(int fd, char *data, size_t length) {
+    while (length) {
+        ssize_t count = read(fd, data, length);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return -1;
+        }
+        data += count;
+        length -= (size_t)count;
+    }
+    return 0;
+}
+
+
+/*
+ * Reads the whole file at `path` into a new buffer.
+ * Returns the buffer, or NULL in case of error.
+ */
+static char *read_file(const char *path, size_t *length) {
+    FILE *in = fopen(path, "rb");
+    if (!in) {
+        perror(path);
+        return NULL;
+    }
+    char *data = NULL;
+    size_t size = 0;
+    *length = 0;
+    for (;;) {
+        if (*length == size) {
+            size = size ? size * 2 : 65536;
+            char *grown = realloc(data, size);
+            if (!grown) {
+                perror(path);
+                free(data);
+                fclose(in);
+                return NULL;
+            }
+            data = grown;
+        }
+        size_t count = fread(data + *length, 1, size - *length, in);
+        if (!count) {
+            break;
+        }
+        *length += count;
+    }
+    int failed = ferror(in);
+    fclose(in);
+    if (failed) {
+        perror(path);
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+
+/*
+ * Sends the file at `path` as a request and copies the frames of its
+ * response until the end frame.
+ * Returns 0 if the conversion succeeded, 1 if it failed, or 2 in case
+ * of error.
+ */
+static int convert(int fd, const char *path) {
+    size_t length;
+    char *wkt = read_file(path, &length);
+    if (!wkt) {
+        return 2;
+    }
+    unsigned char header[5] = {
+        (unsigned char)(length >> 24), (unsigned char)(length >> 16),
+        (unsigned char)(length >> 8), (unsigned char)length
+    };
+    int failed = write_all(fd, (const char *)header, 4) < 0
+                 || write_all(fd, wkt, length) < 0;
+    free(wkt);
+    if (failed) {
+        perror("Error sending the request");
+        return 2;
+    }
+
+    char buffer[65536];
+    for (;;) {
+        if (read_all(fd, (char *)header, 5) < 0) {
+            fprintf(stderr, "%s: connection closed\n", path);
+            return 2;
+        }
+        size_t remaining = (size_t)header[1] << 24 | (size_t)header[2] << 16
+                           | (size_t)header[3] << 8 | header[4];
+        FILE *out = header[0] == 'E' ? stderr : stdout;
+        if (header[0] != 'D' && header[0] != 'Z' && header[0] != 'E') {
+            fprintf(stderr, "%s: unknown frame '%c'\n", path, header[0]);
+            return 2;
+        }
+        while (remaining) {
+            size_t count = remaining < sizeof(buffer)
+                           ? remaining : sizeof(buffer);
+            if (read_all(fd, buffer, count) < 0) {
+                fprintf(stderr, "%s: connection closed\n", path);
+                return 2;
+            }
+            fwrite(buffer, 1, count, out);
+            remaining -= count;
+        }
+        if (header[0] == 'E') {
+            fputc('\n', stderr);
+            return 1;
+        }
+        if (header[0] == 'Z') {
+            return 0;
+        }
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <socket> <file...>\n", argv[0]);
+        return 2;
+    }
+    int fd = connect_server(argv[1]);
+    if (fd < 0) {
+        return 2;
+    }
+    int status = 0;
+    for (int i = 2; i < argc && status < 2; i++) {
+        int result = convert(fd, argv[i]);
+        status = result > status ? result : status;
+    }
+    close(fd);
+    fflush(stdout);
+    return status;
+}
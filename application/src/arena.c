@@ -0,0 +1,162 @@
+/*
+ * arena.c
+ *
+ * This module provides the bump allocator holding the semantic values
+ * of the parser. The coordinate buffers of a feature are carved from
+ * the arena of the context and released all at once when the feature
+ * has been written, instead of being allocated, grown and freed on the
+ * heap for every geometry. The arena keeps its memory from one feature
+ * to the next, so that once it has grown to the size of the largest
+ * feature, parsing runs without calling malloc at all, and threads
+ * converting chunks of an input do not contend for the heap.
+ */
+
+#include "arena.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Size, in bytes, of the first block of an arena. */
+#define ARENA_INITIAL_BLOCK (64 * 1024)
+
+
+/*
+ * Rounds `size` up to the alignment of the allocations.
+ */
+static size_t align_size(size_t size) {
+    size_t align = sizeof(max_align_t);
+    return (size + align - 1) / align * align;
+}
+
+
+/*
+ * Allocates a block of at least `size` bytes, at least twice as large
+ * as the current block, and makes it the current block.
+ *
+ * Returns:
+ *   0 on success, or -1 if the memory could not be allocated.
+ */
+static int add_block(value_arena *arena, size_t size) {
+    size_t block_size = arena->block ? 2 * arena->block->size
+                                     : ARENA_INITIAL_BLOCK;
+    while (block_size < size) {
+        block_size *= 2;
+    }
+
+    arena_block *block = malloc(sizeof(arena_block) + block_size);
+    if (!block) {
+        return -1;
+    }
+    block->next = arena->block;
+    block->size = block_size;
+    block->used = 0;
+    arena->block = block;
+    arena->allocations++;
+    return 0;
+}
+
+
+/*
+ * Allocates memory from the arena.
+ *
+ * Parameters:
+ *   arena - The arena to allocate from.
+ *   size  - The number of bytes to allocate.
+ *
+ * Returns:
+ *   The allocated memory, aligned for any type, or NULL if an error
+ *   occurs.
+ */
+void* arena_alloc(value_arena *arena, size_t size) {
+    size = align_size(size);
+    arena_block *block = arena->block;
+    if (!block || block->size - block->used < size) {
+        if (add_block(arena, size) < 0) {
+            return NULL;
+        }
+        block = arena->block;
+    }
+
+    void *ptr = (char*)block->data + block->used;
+    block->used += size;
+    arena->last = ptr;
+    return ptr;
+}
+
+
+/*
+ * Grows an allocation of the arena.
+ *
+ * Parameters:
+ *   arena    - The arena the allocation belongs to.
+ *   ptr      - The allocation, or NULL.
+ *   old_size - The size `ptr` was allocated or last grown with.
+ *   new_size - The size to grow the allocation to.
+ *
+ * Returns:
+ *   The grown allocation, or NULL if an error occurs.
+ */
+void* arena_grow(value_arena *arena, void *ptr, size_t old_size,
+                 size_t new_size) {
+    arena_block *block = arena->block;
+    if (ptr && ptr == arena->last) {
+        size_t offset = (size_t)((char*)ptr - (char*)block->data);
+        if (block->size - offset >= align_size(new_size)) {
+            block->used = offset + align_size(new_size);
+            return ptr;
+        }
+    }
+
+    void *grown = arena_alloc(arena, new_size);
+    if (grown && ptr) {
+        memcpy(grown, ptr, old_size);
+    }
+    return grown;
+}
+
+
+/*
+ * Releases every allocation of the arena. When the last feature did
+ * not fit in one block, the blocks are replaced by one block of their
+ * total size, so that the next features fit in a single block.
+ *
+ * Parameters:
+ *   arena - The arena to reset.
+ */
+void arena_reset(value_arena *arena) {
+    arena_block *block = arena->block;
+    arena->last = NULL;
+    if (!block) {
+        return;
+    }
+
+    if (block->next) {
+        size_t total = 0;
+        for (arena_block *b = block; b; b = b->next) {
+            total += b->size;
+        }
+        arena_release(arena);
+        /* Without memory, the next allocation retries. */
+        add_block(arena, total);
+        return;
+    }
+    block->used = 0;
+}
+
+
+/*
+ * Releases the memory of the arena.
+ *
+ * Parameters:
+ *   arena - The arena to release.
+ */
+void arena_release(value_arena *arena) {
+    arena_block *block = arena->block;
+    while (block) {
+        arena_block *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->block = NULL;
+    arena->last = NULL;
+}
@@ -0,0 +1,70 @@
+/*
+ * arena.h
+ *
+ * Interface for the arena module, a bump allocator holding the
+ * semantic values of the parser for the duration of one feature.
+ */
+#include <stddef.h>
+
+#ifndef INCLUDED_ARENA_H
+#define INCLUDED_ARENA_H
+
+/*
+ * Block of memory allocations are carved from.
+ */
+typedef struct arena_block {
+    struct arena_block *next;    /* previously filled block, or NULL */
+    size_t size;                 /* bytes available at `data` */
+    size_t used;                 /* bytes allocated from `data` */
+    max_align_t data[];          /* allocated memory */
+} arena_block;
+
+
+/*
+ * Bump allocator.
+ * Allocations are carved from the current block, and are all released
+ * at once by `arena_reset`, which keeps the memory for the following
+ * allocations. `allocations` counts the blocks obtained from the heap,
+ * which stops growing once the blocks fit the largest feature.
+ * A zeroed arena is empty and ready for use.
+ */
+typedef struct value_arena {
+    arena_block *block;          /* current block, or NULL */
+    void *last;                  /* last allocation, which can grow */
+    size_t allocations;          /* heap allocations made so far */
+} value_arena;
+
+
+/*
+ * Allocates `size` bytes, aligned for any type, from the arena.
+ * Returns NULL in case of error.
+ */
+void* arena_alloc(value_arena *arena, size_t size);
+
+
+/*
+ * Grows the allocation of `old_size` bytes at `ptr` to `new_size`
+ * bytes, in place when it is the last allocation of the arena, or by
+ * copying it to a new allocation otherwise. `ptr` may be NULL.
+ * Returns the grown allocation, or NULL in case of error, in which
+ * case `ptr` is left untouched.
+ */
+void* arena_grow(value_arena *arena, void *ptr, size_t old_size,
+                 size_t new_size);
+
+
+/*
+ * Releases every allocation of the arena at once, keeping a single
+ * block as large as all of the blocks used so far.
+ */
+void arena_reset(value_arena *arena);
+
+
+/*
+ * Releases the memory of the arena, which is left empty.
+ */
+void arena_release(value_arena *arena);
+
+#endif  /* INCLUDED_ARENA_H */
+
+// EOF
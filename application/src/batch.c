@@ -0,0 +1,733 @@
+/*
+ * batch.c
+ *
+ * This module converts many WKT files in a single process. Every input
+ * is converted by a context of its own, on a pool of threads.
+ *
+ * Inputs are scheduled by work stealing: every thread owns a deque
+ * holding a contiguous range of the inputs, and takes its next input
+ * from the front of that range. A thread whose range is empty steals
+ * the back half of the range of another thread. A thread that comes
+ * across a huge input thus keeps its remaining inputs only until an
+ * idle thread takes them over, and a mix of tiny and huge files keeps
+ * every thread busy without splitting the list by size up front.
+ *
+ * With an output directory, every thread writes the document of its
+ * input to a file of its own, at the path of the input relative to the
+ * deepest directory holding every input, so that inputs of the same
+ * name in different directories (as the `z/x/y.wkt` files of a tile
+ * dump) do not overwrite each other. Two inputs that would still share
+ * an output, such as `a.wkt` and `a.txt`, fail the batch before any
+ * conversion starts.
+ *
+ * Otherwise, the features of every input are kept in memory and the
+ * calling thread appends them, in input order, to a single
+ * FeatureCollection as soon as they are ready. As with chunks of a
+ * single input (see `parallel.c`), the inputs of a merged batch are
+ * converted as `continued`, and the comma leading the first feature of
+ * a FeatureCollection is dropped.
+ *
+ * Errors are deferred in the contexts and reported by the calling
+ * thread in input order, prefixed with the path of the input, so the
+ * diagnostics do not depend on the scheduling.
+ */
+
+#include "batch.h"
+
+#include <errno.h>
+#include <glob.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "context.h"
+#include "parser.tab.h"
+#include "writer.h"
+
+
+/*
+ * An input of the batch and the result of its conversion.
+ */
+typedef struct task {
+    const char *path;        /* path of the input */
+    char *output;            /* path of the output file, or NULL */
+    wkt2geojson_ctx *ctx;    /* features of a merged input, or NULL */
+    char *error;             /* error to report, or NULL */
+    int failed;              /* whether the conversion failed */
+    int done;                /* whether the conversion is over */
+} task;
+
+
+/*
+ * Deque of a thread of the pool: the inputs [next, end) not taken yet.
+ */
+typedef struct worker {
+    pthread_mutex_t lock;    /* protects `next` and `end` */
+    size_t next;             /* next input taken by the owner */
+    size_t end;              /* end of the range of the owner */
+    pthread_t thread;        /* thread owning the deque */
+    int started;             /* whether `thread` was created */
+    size_t index;            /* position of the deque in the pool */
+    struct batch *batch;     /* batch the thread works for */
+} worker;
+
+
+/*
+ * State shared by the threads of a batch.
+ */
+typedef struct batch {
+    const batch_options *options;  /* options of the conversions */
+    task *tasks;                   /* inputs of the batch */
+    size_t count;                  /* number of inputs */
+    worker *workers;               /* deques of the threads */
+    size_t jobs;                   /* number of threads */
+    pthread_mutex_t lock;          /* protects the fields below */
+    pthread_cond_t progress;       /* signals a finished input */
+    size_t untaken;                /* inputs no thread has taken */
+} batch;
+
+
+/*
+ * Appends a path to the list.
+ *
+ * Returns:
+ *   0 on success, or -1 if the memory could not be allocated.
+ */
+static int list_append(batch_list *list, const char *path, size_t length) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 64;
+        char **paths = realloc(list->paths, capacity * sizeof(char *));
+        if (!paths) {
+            return -1;
+        }
+        list->paths = paths;
+        list->capacity = capacity;
+    }
+
+    char *copy = malloc(length + 1);
+    if (!copy) {
+        return -1;
+    }
+    memcpy(copy, path, length);
+    copy[length] = '\0';
+    list->paths[list->count++] = copy;
+    return 0;
+}
+
+
+/*
+ * Appends the paths matching a glob pattern to the list.
+ *
+ * Parameters:
+ *   list    - The list of inputs.
+ *   pattern - A path, or a glob pattern matching paths.
+ *
+ * Returns:
+ *   0 on success, or -1 if an error occurs.
+ */
+int batch_list_add(batch_list *list, const char *pattern) {
+    glob_t matches;
+    if (glob(pattern, GLOB_NOCHECK, NULL, &matches)) {
+        globfree(&matches);
+        return -1;
+    }
+
+    int status = 0;
+    for (size_t i = 0; i < matches.gl_pathc && !status; i++) {
+        status = list_append(list, matches.gl_pathv[i],
+                             strlen(matches.gl_pathv[i]));
+    }
+    globfree(&matches);
+    return status;
+}
+
+
+/*
+ * Appends the paths of a manifest, one per line, to the list.
+ *
+ * Parameters:
+ *   list     - The list of inputs.
+ *   manifest - The stream listing the paths.
+ *
+ * Returns:
+ *   0 on success, or -1 if an error occurs.
+ */
+int batch_list_read(batch_list *list, FILE *manifest) {
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t length;
+    int status = 0;
+
+    while (!status && (length = getline(&line, &size, manifest)) >= 0) {
+        while (length > 0 && (line[length - 1] == '\n'
+                              || line[length - 1] == '\r')) {
+            length--;
+        }
+        if (length > 0) {
+            status = list_append(list, line, (size_t)length);
+        }
+    }
+    if (ferror(manifest)) {
+        status = -1;
+    }
+    free(line);
+    return status;
+}
+
+
+/*
+ * Releases the paths of the list.
+ *
+ * Parameters:
+ *   list - The list of inputs.
+ */
+void batch_list_release(batch_list *list) {
+    for (size_t i = 0; i < list->count; i++) {
+        free(list->paths[i]);
+    }
+    free(list->paths);
+    list->paths = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+
+/*
+ * Records the error of a task, unless one is already recorded.
+ */
+static void fail_task(task *t, const char *error) {
+    if (!t->failed) {
+        t->failed = 1;
+        t->error = strdup(error);
+    }
+}
+
+
+/*
+ * Builds the path of the output file of an input: the path of the
+ * input below the common directory of the inputs, with
+ * BATCH_OUTPUT_EXTENSION instead of its extension, in the output
+ * directory.
+ *
+ * Parameters:
+ *   dir      - The output directory.
+ *   relative - The canonical path of the input, below the common
+ *              directory of the inputs.
+ *
+ * Returns:
+ *   A dynamically allocated path, or NULL if an error occurs.
+ */
+static char* output_path(const char *dir, const char *relative) {
+    const char *name = strrchr(relative, '/');
+    name = name ? name + 1 : relative;
+    const char *dot = strrchr(name, '.');
+    size_t stem = (size_t)(name - relative)
+                  + (dot && dot != name ? (size_t)(dot - name) : strlen(name));
+
+    size_t dir_length = strlen(dir);
+    size_t size = dir_length + 1 + stem + sizeof(BATCH_OUTPUT_EXTENSION);
+    char *path = malloc(size);
+    if (path) {
+        snprintf(path, size, "%s/%.*s%s", dir, (int)stem, relative,
+                 BATCH_OUTPUT_EXTENSION);
+    }
+    return path;
+}
+
+
+/*
+ * Orders tasks by output path, tasks without one first.
+ */
+static int compare_outputs(const void *a, const void *b) {
+    const task *p = *(const task *const *)a;
+    const task *q = *(const task *const *)b;
+    if (!p->output || !q->output) {
+        return (p->output != NULL) - (q->output != NULL);
+    }
+    return strcmp(p->output, q->output);
+}
+
+
+/*
+ * Sets the output path of every input of a batch written to an output
+ * directory, and checks that no two inputs share one. An input whose
+ * path cannot be resolved fails without an output.
+ *
+ * Parameters:
+ *   b - The batch.
+ *
+ * Returns:
+ *   0 on success, or -1 if an error was reported.
+ */
+static int plan_outputs(batch *b) {
+    char **canonical = calloc(b->count ? b->count : 1, sizeof(char *));
+    task **sorted = malloc((b->count ? b->count : 1) * sizeof(task *));
+    if (!canonical || !sorted) {
+        fprintf(stderr, "Error: out of memory\n");
+        free(canonical);
+        free(sorted);
+        return -1;
+    }
+
+    /* The common directory is the longest prefix, ending with a slash,
+     * of every canonical path. */
+    const char *first = NULL;
+    size_t common = 0;
+    for (size_t i = 0; i < b->count; i++) {
+        task *t = &b->tasks[i];
+        canonical[i] = realpath(t->path, NULL);
+        if (!canonical[i]) {
+            fail_task(t, strerror(errno));
+            continue;
+        }
+        const char *path = canonical[i];
+        if (!first) {
+            first = path;
+            common = (size_t)(strrchr(path, '/') - path) + 1;
+            continue;
+        }
+        size_t shared = 0;
+        while (shared < common && path[shared] == first[shared]) {
+            shared++;
+        }
+        while (shared > 0 && first[shared - 1] != '/') {
+            shared--;
+        }
+        common = shared;
+    }
+
+    int status = 0;
+    for (size_t i = 0; i < b->count && !status; i++) {
+        task *t = &b->tasks[i];
+        if (canonical[i]) {
+            t->output = output_path(b->options->output_dir,
+                                    canonical[i] + common);
+            if (!t->output) {
+                fprintf(stderr, "Error: out of memory\n");
+                status = -1;
+            }
+        }
+        sorted[i] = t;
+    }
+
+    if (!status) {
+        qsort(sorted, b->count, sizeof(task *), compare_outputs);
+        for (size_t i = 1; i < b->count && !status; i++) {
+            if (sorted[i - 1]->output
+                    && !strcmp(sorted[i - 1]->output, sorted[i]->output)) {
+                fprintf(stderr, "Error: %s and %s would both be written to"
+                        " %s\n", sorted[i - 1]->path, sorted[i]->path,
+                        sorted[i]->output);
+                status = -1;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < b->count; i++) {
+        free(canonical[i]);
+    }
+    free(canonical);
+    free(sorted);
+    return status;
+}
+
+
+/*
+ * Creates the missing directories leading to a file.
+ *
+ * Returns:
+ *   0 on success, or an errno value if a directory cannot be created.
+ */
+static int make_parents(const char *path) {
+    char *copy = strdup(path);
+    if (!copy) {
+        return ENOMEM;
+    }
+
+    int error = 0;
+    for (char *slash = strchr(copy + 1, '/'); slash && !error;
+         slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        if (mkdir(copy, 0777) < 0 && errno != EEXIST) {
+            error = errno;
+        }
+        *slash = '/';
+    }
+    free(copy);
+    return error;
+}
+
+
+/*
+ * Converts one input of the batch: into its output file when an output
+ * directory is set, otherwise into the memory of the context of the
+ * task, which is kept for the merge.
+ */
+static void convert_task(batch *b, task *t) {
+    const batch_options *options = b->options;
+    if (t->failed) {
+        return;
+    }
+
+    FILE *in_file = fopen(t->path, "r");
+    if (!in_file) {
+        fail_task(t, strerror(errno));
+        return;
+    }
+    const char *error;
+    compressed_input *input = compressed_input_open(in_file, &error);
+    if (!input) {
+        fail_task(t, error);
+        fclose(in_file);
+        return;
+    }
+
+    FILE *out_file = NULL;
+    if (options->output_dir) {
+        int parents = make_parents(t->output);
+        out_file = parents ? NULL : fopen(t->output, "w");
+        if (!out_file) {
+            fail_task(t, strerror(parents ? parents : errno));
+            compressed_input_close(input);
+            fclose(in_file);
+            return;
+        }
+    }
+
+    wkt2geojson_ctx *ctx = wkt2geojson_ctx_new(compressed_input_file(input),
+                                               out_file);
+    if (ctx) {
+        /* Falls back to streaming when the file cannot be mapped. */
+        wkt2geojson_ctx_map_input(ctx, options->huge_pages);
+    }
+    if (!ctx || wkt2geojson_ctx_use_tokenizer(ctx, options->engine) < 0) {
+        fail_task(t, "cannot initialize the tokenizer");
+    } else {
+        ctx->format = options->input;
+        ctx->precision = options->precision;
+        ctx->simplify = options->simplify;
+        ctx->filter = options->filter;
+        output_sink_set_format(&ctx->sink, options->format);
+        output_sink_set_bbox(&ctx->sink, options->bbox);
+        ctx->defer_errors = 1;
+        int status;
+        if (out_file) {
+            status = transpile_ctx(ctx);
+        } else {
+            ctx->continued = 1;
+            status = transpile_features(ctx);
+        }
+        if (compressed_input_error(input)) {
+            fail_task(t, compressed_input_error(input));
+        }
+        if (status) {
+            fail_task(t, ctx->error ? ctx->error : "syntax error");
+        }
+    }
+
+    if (out_file && fclose(out_file)) {
+        fail_task(t, strerror(errno));
+    }
+    /* A mapped input stays readable once the file is closed, which
+     * keeps the number of open files bounded by the number of threads
+     * in a merged batch. */
+    compressed_input_close(input);
+    fclose(in_file);
+
+    if (out_file) {
+        wkt2geojson_ctx_free(ctx);
+    } else {
+        t->ctx = ctx;
+    }
+}
+
+
+/*
+ * Takes the next input of the deque of a thread.
+ *
+ * Returns:
+ *   1 if an input was taken, or 0 if the deque is empty.
+ */
+static int take_task(worker *w, size_t *index) {
+    pthread_mutex_lock(&w->lock);
+    int found = w->next < w->end;
+    if (found) {
+        *index = w->next++;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return found;
+}
+
+
+/*
+ * Steals the back half of the deque of another thread, keeping its
+ * first input and putting the others in the deque of `w`.
+ *
+ * Returns:
+ *   1 if an input was stolen, or 0 if every deque is empty.
+ */
+static int steal_task(worker *w, size_t *index) {
+    batch *b = w->batch;
+
+    for (;;) {
+        for (size_t k = 1; k < b->jobs; k++) {
+            worker *victim = &b->workers[(w->index + k) % b->jobs];
+
+            pthread_mutex_lock(&victim->lock);
+            size_t remaining = victim->end - victim->next;
+            size_t start = victim->next + remaining / 2;
+            size_t end = victim->end;
+            if (remaining) {
+                victim->end = start;
+            }
+            pthread_mutex_unlock(&victim->lock);
+
+            if (remaining) {
+                pthread_mutex_lock(&w->lock);
+                w->next = start + 1;
+                w->end = end;
+                pthread_mutex_unlock(&w->lock);
+                *index = start;
+                return 1;
+            }
+        }
+
+        /* The deques may all look empty while a thief moves a range
+         * into its own: only leave once every input is taken. */
+        pthread_mutex_lock(&b->lock);
+        size_t untaken = b->untaken;
+        pthread_mutex_unlock(&b->lock);
+        if (!untaken) {
+            return 0;
+        }
+        sched_yield();
+    }
+}
+
+
+/*
+ * Thread body converting inputs until none is left.
+ */
+static void* run_worker(void *arg) {
+    worker *w = arg;
+    batch *b = w->batch;
+    size_t index;
+
+    while (take_task(w, &index) || steal_task(w, &index)) {
+        pthread_mutex_lock(&b->lock);
+        b->untaken--;
+        pthread_mutex_unlock(&b->lock);
+
+        convert_task(b, &b->tasks[index]);
+
+        pthread_mutex_lock(&b->lock);
+        b->tasks[index].done = 1;
+        pthread_cond_broadcast(&b->progress);
+        pthread_mutex_unlock(&b->lock);
+    }
+    return NULL;
+}
+
+
+/*
+ * Waits for the conversion of an input to be over.
+ */
+static void wait_task(batch *b, task *t) {
+    pthread_mutex_lock(&b->lock);
+    while (!t->done) {
+        pthread_cond_wait(&b->progress, &b->lock);
+    }
+    pthread_mutex_unlock(&b->lock);
+}
+
+
+/*
+ * Reports the error of an input, if any.
+ *
+ * Returns:
+ *   0 if the input was converted, or 1 otherwise.
+ */
+static int report_task(const task *t) {
+    if (!t->failed) {
+        return 0;
+    }
+    fprintf(stderr, "Error: %s: %s\n", t->path,
+            t->error ? t->error : "out of memory");
+    return 1;
+}
+
+
+/*
+ * Appends the features of every input, in input order, to a single
+ * document written to `out_file`, as the inputs are converted.
+ *
+ * Returns:
+ *   0 on success, or 1 if an error occurs.
+ */
+static int merge_tasks(batch *b, FILE *out_file) {
+    int status = 0;
+    int features = 0;
+    int failed = 0;
+
+    fflush(out_file);
+    output_sink sink = { 0 };
+    compressed_output *output = NULL;
+    const char *error = "out of memory";
+    if (b->options->compress != COMPRESSION_NONE) {
+        output = compressed_output_open(fileno(out_file),
+                                        b->options->compress, &error);
+    }
+    if ((b->options->compress != COMPRESSION_NONE && !output)
+            || output_sink_init(&sink, fileno(out_file), 0) < 0) {
+        fprintf(stderr, "Error: %s\n", error);
+        failed = 1;
+    } else {
+        output_sink_set_format(&sink, b->options->format);
+        output_sink_set_bbox(&sink, b->options->bbox);
+        if (output) {
+            output_sink_set_callback(&sink, compressed_output_write, output);
+        }
+        failed = write_header(&sink) < 0;
+    }
+
+    for (size_t i = 0; i < b->count; i++) {
+        task *t = &b->tasks[i];
+        wait_task(b, t);
+        status |= report_task(t);
+
+        wkt2geojson_ctx *ctx = t->ctx;
+        if (ctx && ctx->count && !failed) {
+            /* Drops the comma leading the first feature, which
+             * features of a sequence do not have. */
+            size_t skip = features || sink.format != WRITER_FEATURE_COLLECTION
+                              ? 0 : 1;
+            if (output_sink_write(&sink, ctx->sink.data + skip,
+                                  ctx->sink.length - skip) < 0) {
+                failed = 1;
+            }
+            features += ctx->count;
+            bounding_box_merge(&sink.extent, &ctx->sink.extent);
+        }
+        wkt2geojson_ctx_free(ctx);
+        t->ctx = NULL;
+    }
+
+    if (!failed && (write_footer(&sink, b->options->precision) < 0
+                    || output_sink_flush(&sink) < 0)) {
+        failed = 1;
+    }
+    int write_error = compressed_output_close(output);
+    if (!sink.error && !failed) {
+        sink.error = write_error;
+        failed = write_error != 0;
+    }
+    if (failed && sink.error) {
+        fprintf(stderr, "Error writing output file: %s\n",
+                strerror(sink.error));
+    }
+    output_sink_release(&sink);
+    return status | failed;
+}
+
+
+/*
+ * Converts a batch of inputs on a work-stealing pool of threads.
+ *
+ * Parameters:
+ *   list     - The paths of the inputs.
+ *   options  - The options of the conversions.
+ *   out_file - The stream the merged document is written to, when no
+ *              output directory is set.
+ *
+ * Returns:
+ *   0 if every input was converted, or 1 otherwise.
+ */
+int batch_run(const batch_list *list, const batch_options *options,
+              FILE *out_file) {
+    size_t jobs = options->jobs > 0 ? (size_t)options->jobs : 0;
+    if (!jobs) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = cpus > 0 ? (size_t)cpus : 1;
+    }
+    if (jobs > list->count) {
+        jobs = list->count ? list->count : 1;
+    }
+
+    batch b = { .options = options, .count = list->count, .jobs = jobs,
+                .untaken = list->count };
+    b.tasks = calloc(list->count ? list->count : 1, sizeof(task));
+    b.workers = calloc(jobs, sizeof(worker));
+    if (!b.tasks || !b.workers) {
+        fprintf(stderr, "Error: out of memory\n");
+        free(b.tasks);
+        free(b.workers);
+        return 1;
+    }
+    pthread_mutex_init(&b.lock, NULL);
+    pthread_cond_init(&b.progress, NULL);
+
+    for (size_t i = 0; i < list->count; i++) {
+        b.tasks[i].path = list->paths[i];
+    }
+    if (options->output_dir && plan_outputs(&b) < 0) {
+        for (size_t i = 0; i < b.count; i++) {
+            free(b.tasks[i].output);
+            free(b.tasks[i].error);
+        }
+        pthread_cond_destroy(&b.progress);
+        pthread_mutex_destroy(&b.lock);
+        free(b.workers);
+        free(b.tasks);
+        return 1;
+    }
+
+    /* Every deque starts with an equal, contiguous range of inputs. */
+    for (size_t i = 0; i < jobs; i++) {
+        worker *w = &b.workers[i];
+        pthread_mutex_init(&w->lock, NULL);
+        w->next = list->count * i / jobs;
+        w->end = list->count * (i + 1) / jobs;
+        w->index = i;
+        w->batch = &b;
+    }
+
+    size_t started = 0;
+    for (size_t i = 0; i < jobs; i++) {
+        worker *w = &b.workers[i];
+        w->started = !pthread_create(&w->thread, NULL, run_worker, w);
+        started += (size_t)w->started;
+    }
+    if (!started) {
+        /* The inputs of the other deques are stolen by this one. */
+        run_worker(&b.workers[0]);
+    }
+
+    int status = 0;
+    if (options->output_dir) {
+        for (size_t i = 0; i < b.count; i++) {
+            wait_task(&b, &b.tasks[i]);
+            status |= report_task(&b.tasks[i]);
+        }
+    } else {
+        status = merge_tasks(&b, out_file);
+    }
+
+    for (size_t i = 0; i < jobs; i++) {
+        if (b.workers[i].started) {
+            pthread_join(b.workers[i].thread, NULL);
+        }
+        pthread_mutex_destroy(&b.workers[i].lock);
+    }
+    for (size_t i = 0; i < b.count; i++) {
+        free(b.tasks[i].output);
+        free(b.tasks[i].error);
+    }
+    pthread_cond_destroy(&b.progress);
+    pthread_mutex_destroy(&b.lock);
+    free(b.workers);
+    free(b.tasks);
+    return status;
+}
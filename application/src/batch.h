@@ -0,0 +1,101 @@
+/*
+ * batch.h
+ *
+ * Interface for the batch module, used to convert many WKT files in a
+ * single process, either into one GeoJSON file per input or into a
+ * single merged FeatureCollection.
+ */
+#include <stdio.h>
+
+#include "compression.h"
+#include "filter.h"
+#include "input.h"
+#include "simplify.h"
+#include "tokenizer.h"
+#include "writer.h"
+
+#ifndef INCLUDED_BATCH_H
+#define INCLUDED_BATCH_H
+
+/*
+ * Largest number of threads of a batch.
+ */
+#define BATCH_MAX_JOBS 1024
+
+/*
+ * Extension of the files written to an output directory.
+ */
+#define BATCH_OUTPUT_EXTENSION ".geojson"
+
+
+/*
+ * Growable list of the input paths of a batch.
+ */
+typedef struct batch_list {
+    char **paths;        /* dynamically allocated paths */
+    size_t count;        /* number of paths */
+    size_t capacity;     /* number of paths `paths` can hold */
+} batch_list;
+
+
+/*
+ * Options of a batch conversion.
+ * Inputs are converted on `jobs` threads (one per CPU when it is 0).
+ * When `output_dir` is set, every input is written to a file of that
+ * directory at the path of the input below the deepest directory
+ * holding every input, with its extension replaced by
+ * BATCH_OUTPUT_EXTENSION; otherwise the features of every input are
+ * merged, in input order, into a single document, compressed with
+ * `compress`. Compressed inputs are detected and decompressed.
+ */
+typedef struct batch_options {
+    tokenizer_engine engine; /* tokenizer engine of every input */
+    input_format input;      /* encoding of every input */
+    int precision;           /* fraction digits, or WRITER_SHORTEST */
+    simplify_options simplify; /* simplification of every geometry */
+    const spatial_filter *filter; /* query selecting the features, or NULL */
+    writer_format format;    /* layout of every output */
+    writer_bbox bbox;        /* bounding boxes of every output */
+    int huge_pages;          /* whether to advise huge pages */
+    int jobs;                /* number of threads, or 0 for one per CPU */
+    const char *output_dir;  /* directory of the outputs, or NULL */
+    compression compress;    /* compression of the merged document */
+} batch_options;
+
+
+/*
+ * Appends the paths matching the glob `pattern` to `list`, or the
+ * pattern itself when nothing matches.
+ * Returns 0 on success or -1 in case of error.
+ */
+int batch_list_add(batch_list *list, const char *pattern);
+
+
+/*
+ * Appends the paths listed in `manifest`, one per line, to `list`.
+ * Empty lines are skipped.
+ * Returns 0 on success or -1 in case of error.
+ */
+int batch_list_read(batch_list *list, FILE *manifest);
+
+
+/*
+ * Releases the paths of `list` and empties it.
+ */
+void batch_list_release(batch_list *list);
+
+
+/*
+ * Converts the inputs of `list` with `options`, writing the merged
+ * document to `out_file` when no output directory is set. An input
+ * that cannot be converted is reported on stderr, with its path, and
+ * does not stop the batch; two inputs that would be written to the
+ * same file of the output directory stop it before any conversion.
+ * Returns 0 if every input was converted or 1 otherwise.
+ */
+int batch_run(const batch_list *list, const batch_options *options,
+              FILE *out_file);
+
+#endif  /* INCLUDED_BATCH_H */
+
+// EOF
@@ -0,0 +1,775 @@
+/*
+ * compression.c
+ *
+ * This module reads compressed inputs and writes compressed outputs,
+ * so that archives do not have to be piped through zcat(1) or gzip(1),
+ * which costs a copy through a pipe and a context switch per block.
+ *
+ * The compression of an input is detected from its magic bytes. A
+ * compressed input is decompressed into a stdio stream of its own
+ * (fopencookie(3)), which both tokenizer engines stream like a plain
+ * pipe. A plain regular file is left untouched, so that it can still
+ * be mapped in memory; the magic bytes of a plain pipe, which cannot
+ * be put back, are handed back before the rest of the pipe. A stream
+ * that ends early because of corrupt or truncated data reads as a
+ * short input, and its error is kept for the caller to report.
+ *
+ * An output is compressed on a thread of its own, so that compressing
+ * overlaps with parsing and formatting: the output sink (`writer.h`)
+ * hands every flushed block to `compressed_output_write`, which copies
+ * it into a small queue of blocks, and the thread compresses them in
+ * order and writes the compressed stream to the file descriptor.
+ *
+ * gzip is always supported, through zlib. zstd requires libzstd and is
+ * only compiled in with WKT2GEOJSON_ZSTD (`make ZSTD=1`).
+ */
+
+#define _GNU_SOURCE  /* fopencookie */
+
+#include "compression.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ZLIB_CONST  /* const input buffers */
+#include <zlib.h>
+#ifdef WKT2GEOJSON_ZSTD
+#include <zstd.h>
+#endif
+
+/* Size of the buffers of compressed bytes. */
+#define COMPRESSION_BUFFER_SIZE (128 * 1024)
+
+/* Largest block of output queued at once, and number of blocks the
+ * queue of a compressor holds. */
+#define COMPRESSION_BLOCK_MAX (1024 * 1024)
+#define COMPRESSION_QUEUE_BLOCKS 4
+
+/* Compression levels of the output: fast levels, so that compressing
+ * keeps up with the conversion. */
+#define COMPRESSION_GZIP_LEVEL 1
+#define COMPRESSION_ZSTD_LEVEL 3
+
+/* gzip window bits, plus the flag selecting the gzip wrapper. */
+#define GZIP_WINDOW_BITS (15 + 16)
+
+/* Largest number of magic bytes of a format. */
+#define MAGIC_MAX 4
+
+static const unsigned char GZIP_MAGIC[] = { 0x1f, 0x8b };
+static const unsigned char ZSTD_MAGIC[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+
+/*
+ * Decompressed view of an input stream.
+ * `buffer` holds the bytes read from `source` and not decoded yet,
+ * starting with the magic bytes of a stream that cannot be read again.
+ */
+struct compressed_input {
+    FILE *source;            /* compressed input */
+    FILE *file;              /* decompressed stream, or `source` */
+    compression codec;       /* compression of `source` */
+    const char *error;       /* error ending the stream, or NULL */
+    unsigned char *buffer;   /* bytes read from `source` */
+    size_t length;           /* number of bytes in `buffer` */
+    size_t position;         /* next byte of `buffer` to decode */
+    int ended;               /* whether the last member is complete */
+    z_stream inflater;       /* gzip decoder */
+#ifdef WKT2GEOJSON_ZSTD
+    ZSTD_DStream *zstd;      /* zstd decoder */
+#endif
+};
+
+
+/*
+ * Block of output waiting to be compressed.
+ */
+typedef struct output_block {
+    char *data;              /* bytes to compress */
+    size_t length;           /* number of bytes at `data` */
+    size_t capacity;         /* size of `data` */
+} output_block;
+
+
+/*
+ * Compressor of an output file descriptor.
+ * The blocks `head` to `head + count` (modulo the size of the queue)
+ * are waiting for the thread, which owns the encoder and `buffer`.
+ */
+struct compressed_output {
+    int fd;                  /* destination file descriptor */
+    compression codec;       /* compression of the output */
+    unsigned char *buffer;   /* compressed bytes to write */
+    z_stream deflater;       /* gzip encoder */
+#ifdef WKT2GEOJSON_ZSTD
+    ZSTD_CStream *zstd;      /* zstd encoder */
+#endif
+    pthread_t thread;        /* compressing thread */
+    pthread_mutex_t lock;    /* protects the fields below */
+    pthread_cond_t filled;   /* signals a queued block or the closing */
+    pthread_cond_t drained;  /* signals a compressed block or an error */
+    output_block blocks[COMPRESSION_QUEUE_BLOCKS];
+    size_t head;             /* first queued block */
+    size_t count;            /* number of queued blocks */
+    int closing;             /* whether no more blocks will be queued */
+    int error;               /* errno of the first failure, or 0 */
+};
+
+
+/*
+ * Looks up the compression called `name`.
+ *
+ * Parameters:
+ *   name  - The name of the compression, as given on the command line.
+ *   codec - Where the compression is stored.
+ *
+ * Returns:
+ *   0 on success, or -1 if the name is unknown.
+ */
+int compression_from_name(const char *name, compression *codec) {
+    static const struct {
+        const char *name;
+        compression codec;
+    } names[] = {
+        { "none", COMPRESSION_NONE },
+        { "gzip", COMPRESSION_GZIP },
+        { "zstd", COMPRESSION_ZSTD }
+    };
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (!strcmp(name, names[i].name)) {
+            *codec = names[i].codec;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
+/*
+ * Returns 1 if `path` ends with `suffix`, 0 otherwise.
+ */
+static int has_suffix(const char *path, const char *suffix) {
+    size_t length = strlen(path);
+    size_t suffix_length = strlen(suffix);
+    return length > suffix_length
+           && !strcmp(path + length - suffix_length, suffix);
+}
+
+
+/*
+ * Looks up the compression named by the extension of a path.
+ *
+ * Parameters:
+ *   path - The path of a file.
+ *
+ * Returns:
+ *   The compression of the extension, or COMPRESSION_NONE.
+ */
+compression compression_from_path(const char *path) {
+    if (has_suffix(path, ".gz")) {
+        return COMPRESSION_GZIP;
+    }
+    if (has_suffix(path, ".zst")) {
+        return COMPRESSION_ZSTD;
+    }
+    return COMPRESSION_NONE;
+}
+
+
+/*
+ * Returns 1 if the compression is supported by this build, 0 otherwise.
+ */
+int compression_supported(compression codec) {
+#ifdef WKT2GEOJSON_ZSTD
+    (void)codec;
+    return 1;
+#else
+    return codec != COMPRESSION_ZSTD;
+#endif
+}
+
+
+/*
+ * Returns the compression whose magic bytes start `magic`.
+ */
+static compression detect_compression(const unsigned char *magic,
+                                      size_t length) {
+    if (length >= sizeof(GZIP_MAGIC)
+            && !memcmp(magic, GZIP_MAGIC, sizeof(GZIP_MAGIC))) {
+        return COMPRESSION_GZIP;
+    }
+    if (length >= sizeof(ZSTD_MAGIC)
+            && !memcmp(magic, ZSTD_MAGIC, sizeof(ZSTD_MAGIC))) {
+        return COMPRESSION_ZSTD;
+    }
+    return COMPRESSION_NONE;
+}
+
+
+/*
+ * Reads the next bytes of the source of an input into its buffer.
+ *
+ * Returns:
+ *   0 on success, or -1 at the end of the source or if an error
+ *   occurs, in which case the error of the input is set.
+ */
+static int refill_input(compressed_input *input) {
+    input->position = 0;
+    input->length = fread(input->buffer, 1, COMPRESSION_BUFFER_SIZE,
+                          input->source);
+    if (!input->length) {
+        if (ferror(input->source)) {
+            input->error = "cannot read the input";
+        }
+        return -1;
+    }
+    return 0;
+}
+
+
+/*
+ * Decodes the buffered bytes of a gzip input into `data`, starting a
+ * new member after a complete one, as gzip(1) does for concatenated
+ * files.
+ *
+ * Returns:
+ *   The number of bytes stored in `data`.
+ */
+static size_t inflate_input(compressed_input *input, char *data,
+                            size_t size) {
+    z_stream *z = &input->inflater;
+    if (input->ended && input->position < input->length) {
+        if (inflateReset(z) != Z_OK) {
+            input->error = "invalid gzip data";
+            return 0;
+        }
+        input->ended = 0;
+    }
+
+    z->next_in = input->buffer + input->position;
+    z->avail_in = (uInt)(input->length - input->position);
+    z->next_out = (Bytef*)data;
+    z->avail_out = (uInt)size;
+    int status = inflate(z, Z_NO_FLUSH);
+    input->position = input->length - z->avail_in;
+    if (status == Z_STREAM_END) {
+        input->ended = 1;
+    } else if (status != Z_OK && status != Z_BUF_ERROR) {
+        input->error = "invalid gzip data";
+    }
+    return size - z->avail_out;
+}
+
+
+#ifdef WKT2GEOJSON_ZSTD
+/*
+ * Decodes the buffered bytes of a zstd input into `data`.
+ *
+ * Returns:
+ *   The number of bytes stored in `data`.
+ */
+static size_t decompress_zstd_input(compressed_input *input, char *data,
+                                    size_t size) {
+    ZSTD_inBuffer in = { input->buffer, input->length, input->position };
+    ZSTD_outBuffer out = { data, size, 0 };
+    size_t status = ZSTD_decompressStream(input->zstd, &out, &in);
+    if (ZSTD_isError(status)) {
+        input->error = "invalid zstd data";
+        return 0;
+    }
+    /* A call without input past the end of a frame does not start
+     * another one. */
+    if (!status) {
+        input->ended = 1;
+    } else if (in.pos > input->position || out.pos) {
+        input->ended = 0;
+    }
+    input->position = in.pos;
+    return out.pos;
+}
+#endif
+
+
+/*
+ * Copies the buffered bytes of a plain input into `data`.
+ *
+ * Returns:
+ *   The number of bytes stored in `data`.
+ */
+static size_t copy_input(compressed_input *input, char *data, size_t size) {
+    size_t length = input->length - input->position;
+    if (length > size) {
+        length = size;
+    }
+    memcpy(data, input->buffer + input->position, length);
+    input->position += length;
+    return length;
+}
+
+
+/*
+ * Reads decompressed bytes, as the read function of the stream of the
+ * input. Decoders are also run once the source is exhausted, as they
+ * may hold output back; an error ends the stream.
+ *
+ * Returns:
+ *   The number of bytes stored in `data`, 0 at the end of the stream.
+ */
+static ssize_t read_input(void *cookie, char *data, size_t size) {
+    compressed_input *input = cookie;
+    size_t produced = 0;
+    while (produced < size && !input->error) {
+        int exhausted = input->position == input->length
+                        && refill_input(input) < 0;
+        if (input->error) {
+            break;
+        }
+
+        size_t decoded = 0;
+        switch (input->codec) {
+            case COMPRESSION_GZIP:
+                decoded = inflate_input(input, data + produced,
+                                        size - produced);
+                break;
+#ifdef WKT2GEOJSON_ZSTD
+            case COMPRESSION_ZSTD:
+                decoded = decompress_zstd_input(input, data + produced,
+                                                size - produced);
+                break;
+#endif
+            default:
+                decoded = copy_input(input, data + produced,
+                                     size - produced);
+                break;
+        }
+        produced += decoded;
+
+        if (exhausted && !decoded) {
+            if (!input->ended && !input->error) {
+                input->error = "truncated compressed input";
+            }
+            break;
+        }
+    }
+    return (ssize_t)produced;
+}
+
+
+/*
+ * Detects the compression of an input stream and opens a view of its
+ * decompressed bytes.
+ *
+ * Parameters:
+ *   in_file - The input stream, at its beginning.
+ *   error   - Where the error message is stored.
+ *
+ * Returns:
+ *   A dynamically allocated view, or NULL if an error occurs.
+ */
+compressed_input* compressed_input_open(FILE *in_file, const char **error) {
+    compressed_input *input = calloc(1, sizeof(compressed_input));
+    unsigned char *buffer = malloc(COMPRESSION_BUFFER_SIZE);
+    if (!input || !buffer) {
+        free(input);
+        free(buffer);
+        *error = "out of memory";
+        return NULL;
+    }
+    input->source = in_file;
+    input->file = in_file;
+    input->buffer = buffer;
+    input->ended = 1;
+
+    /* A regular file is peeked at, so that a plain one can be mapped;
+     * the magic bytes of other streams are kept in the buffer. */
+    struct stat st;
+    int fd = fileno(in_file);
+    if (fd >= 0 && !fstat(fd, &st) && S_ISREG(st.st_mode)) {
+        off_t offset = ftello(in_file);
+        ssize_t read = pread(fd, buffer, MAGIC_MAX, offset > 0 ? offset : 0);
+        input->codec = detect_compression(buffer,
+                                          read > 0 ? (size_t)read : 0);
+        if (input->codec == COMPRESSION_NONE) {
+            return input;
+        }
+    } else {
+        input->length = fread(buffer, 1, MAGIC_MAX, in_file);
+        input->codec = detect_compression(buffer, input->length);
+        if (input->codec == COMPRESSION_NONE && !input->length) {
+            return input;
+        }
+    }
+
+    const char *message = "out of memory";
+    int failed = 0;
+    if (input->codec == COMPRESSION_GZIP) {
+        input->ended = 0;
+        failed = inflateInit2(&input->inflater, GZIP_WINDOW_BITS) != Z_OK;
+    } else if (input->codec == COMPRESSION_ZSTD) {
+#ifdef WKT2GEOJSON_ZSTD
+        input->ended = 0;
+        input->zstd = ZSTD_createDStream();
+        failed = !input->zstd;
+#else
+        message = "zstd input is not supported by this build";
+        failed = 1;
+#endif
+    }
+
+    if (!failed) {
+        cookie_io_functions_t functions = { .read = read_input };
+        input->file = fopencookie(input, "r", functions);
+        failed = !input->file;
+    }
+    if (failed) {
+        input->file = input->source;
+        compressed_input_close(input);
+        *error = message;
+        return NULL;
+    }
+    return input;
+}
+
+
+/*
+ * Returns the stream of the decompressed bytes of an input.
+ */
+FILE* compressed_input_file(const compressed_input *input) {
+    return input->file;
+}
+
+
+/*
+ * Returns the compression detected on an input.
+ */
+compression compressed_input_codec(const compressed_input *input) {
+    return input->codec;
+}
+
+
+/*
+ * Returns the error that ended the decompressed stream, or NULL.
+ */
+const char* compressed_input_error(const compressed_input *input) {
+    return input->error;
+}
+
+
+/*
+ * Closes the view of an input, leaving the input stream open.
+ *
+ * Parameters:
+ *   input - The view to close, or NULL.
+ */
+void compressed_input_close(compressed_input *input) {
+    if (!input) {
+        return;
+    }
+    if (input->file != input->source) {
+        fclose(input->file);
+    }
+    /* Ending a stream that was never initialized does nothing. */
+    if (input->codec == COMPRESSION_GZIP) {
+        inflateEnd(&input->inflater);
+    }
+#ifdef WKT2GEOJSON_ZSTD
+    ZSTD_freeDStream(input->zstd);
+#endif
+    free(input->buffer);
+    free(input);
+}
+
+
+/*
+ * Writes `length` bytes to a file descriptor, retrying on partial
+ * writes and interruptions.
+ *
+ * Returns:
+ *   0 on success, or the errno value of the failure.
+ */
+static int write_all(int fd, const unsigned char *data, size_t length) {
+    size_t written = 0;
+    while (written < length) {
+        ssize_t count = write(fd, data + written, length - written);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        written += (size_t)count;
+    }
+    return 0;
+}
+
+
+/*
+ * Compresses a block of output and writes the compressed bytes, or
+ * ends the compressed stream when `finish` is set.
+ *
+ * Returns:
+ *   0 on success, or the errno value of the failure.
+ */
+static int compress_block(compressed_output *output, const char *data,
+                          size_t length, int finish) {
+    int error = 0;
+    if (output->codec == COMPRESSION_GZIP) {
+        z_stream *z = &output->deflater;
+        z->next_in = (const Bytef*)data;
+        z->avail_in = (uInt)length;
+        int status;
+        do {
+            z->next_out = output->buffer;
+            z->avail_out = COMPRESSION_BUFFER_SIZE;
+            status = deflate(z, finish ? Z_FINISH : Z_NO_FLUSH);
+            if (status == Z_STREAM_ERROR) {
+                return EIO;
+            }
+            error = write_all(output->fd, output->buffer,
+                              COMPRESSION_BUFFER_SIZE - z->avail_out);
+        } while (!error && (finish ? status != Z_STREAM_END
+                                   : z->avail_in || !z->avail_out));
+#ifdef WKT2GEOJSON_ZSTD
+    } else if (output->codec == COMPRESSION_ZSTD) {
+        ZSTD_inBuffer in = { data, length, 0 };
+        size_t remaining;
+        do {
+            ZSTD_outBuffer out = { output->buffer, COMPRESSION_BUFFER_SIZE,
+                                   0 };
+            remaining = ZSTD_compressStream2(output->zstd, &out, &in,
+                                             finish ? ZSTD_e_end
+                                                    : ZSTD_e_continue);
+            if (ZSTD_isError(remaining)) {
+                return EIO;
+            }
+            error = write_all(output->fd, output->buffer, out.pos);
+        } while (!error && (finish ? remaining != 0 : in.pos < in.size));
+#endif
+    } else {
+        error = write_all(output->fd, (const unsigned char*)data, length);
+    }
+    return error;
+}
+
+
+/*
+ * Compresses the queued blocks in order, until the compressor is
+ * closed or fails, then ends the compressed stream.
+ *
+ * Parameters:
+ *   arg - The compressor.
+ *
+ * Returns:
+ *   NULL.
+ */
+static void* run_compressor(void *arg) {
+    compressed_output *output = arg;
+
+    pthread_mutex_lock(&output->lock);
+    for (;;) {
+        while (!output->count && !output->closing) {
+            pthread_cond_wait(&output->filled, &output->lock);
+        }
+        if (!output->count) {
+            break;
+        }
+        output_block *block = &output->blocks[output->head];
+        pthread_mutex_unlock(&output->lock);
+
+        int error = compress_block(output, block->data, block->length, 0);
+
+        pthread_mutex_lock(&output->lock);
+        output->head = (output->head + 1) % COMPRESSION_QUEUE_BLOCKS;
+        output->count--;
+        if (error) {
+            output->error = error;
+        }
+        pthread_cond_broadcast(&output->drained);
+        if (output->error) {
+            break;
+        }
+    }
+    int finish = !output->error;
+    pthread_mutex_unlock(&output->lock);
+
+    if (finish) {
+        int error = compress_block(output, NULL, 0, 1);
+        pthread_mutex_lock(&output->lock);
+        output->error = error;
+        pthread_mutex_unlock(&output->lock);
+    }
+    return NULL;
+}
+
+
+/*
+ * Releases the encoder, the buffers and the synchronization of a
+ * compressor whose thread is not running.
+ */
+static void release_output(compressed_output *output) {
+    /* Ending a stream that was never initialized does nothing. */
+    if (output->codec == COMPRESSION_GZIP) {
+        deflateEnd(&output->deflater);
+    }
+#ifdef WKT2GEOJSON_ZSTD
+    ZSTD_freeCStream(output->zstd);
+#endif
+    for (size_t i = 0; i < COMPRESSION_QUEUE_BLOCKS; i++) {
+        free(output->blocks[i].data);
+    }
+    pthread_cond_destroy(&output->drained);
+    pthread_cond_destroy(&output->filled);
+    pthread_mutex_destroy(&output->lock);
+    free(output->buffer);
+    free(output);
+}
+
+
+/*
+ * Opens a compressor writing to a file descriptor from its own thread.
+ *
+ * Parameters:
+ *   fd    - The destination file descriptor.
+ *   codec - The compression of the output.
+ *   error - Where the error message is stored.
+ *
+ * Returns:
+ *   A dynamically allocated compressor, or NULL if an error occurs.
+ */
+compressed_output* compressed_output_open(int fd, compression codec,
+                                          const char **error) {
+    if (!compression_supported(codec)) {
+        *error = "zstd output is not supported by this build";
+        return NULL;
+    }
+
+    compressed_output *output = calloc(1, sizeof(compressed_output));
+    unsigned char *buffer = malloc(COMPRESSION_BUFFER_SIZE);
+    if (!output || !buffer) {
+        free(output);
+        free(buffer);
+        *error = "out of memory";
+        return NULL;
+    }
+    output->fd = fd;
+    output->codec = codec;
+    output->buffer = buffer;
+    pthread_mutex_init(&output->lock, NULL);
+    pthread_cond_init(&output->filled, NULL);
+    pthread_cond_init(&output->drained, NULL);
+
+    int failed = 0;
+    if (codec == COMPRESSION_GZIP) {
+        failed = deflateInit2(&output->deflater, COMPRESSION_GZIP_LEVEL,
+                              Z_DEFLATED, GZIP_WINDOW_BITS, 8,
+                              Z_DEFAULT_STRATEGY) != Z_OK;
+    }
+#ifdef WKT2GEOJSON_ZSTD
+    if (codec == COMPRESSION_ZSTD) {
+        output->zstd = ZSTD_createCStream();
+        failed = !output->zstd
+                 || ZSTD_isError(ZSTD_CCtx_setParameter(
+                        output->zstd, ZSTD_c_compressionLevel,
+                        COMPRESSION_ZSTD_LEVEL));
+    }
+#endif
+    if (failed) {
+        *error = "out of memory";
+        release_output(output);
+        return NULL;
+    }
+    if (pthread_create(&output->thread, NULL, run_compressor, output)) {
+        *error = "cannot start the compression thread";
+        release_output(output);
+        return NULL;
+    }
+    return output;
+}
+
+
+/*
+ * Queues bytes for the thread of a compressor, in blocks of at most
+ * COMPRESSION_BLOCK_MAX bytes, waiting while the queue is full.
+ *
+ * Parameters:
+ *   user_data - The compressor.
+ *   data      - The bytes to compress.
+ *   length    - The number of bytes at `data`.
+ *
+ * Returns:
+ *   0 on success, or the errno value of a failure of the compressor.
+ */
+int compressed_output_write(void *user_data, const char *data,
+                            size_t length) {
+    compressed_output *output = user_data;
+    while (length) {
+        size_t size = length < COMPRESSION_BLOCK_MAX ? length
+                                                     : COMPRESSION_BLOCK_MAX;
+
+        pthread_mutex_lock(&output->lock);
+        while (output->count == COMPRESSION_QUEUE_BLOCKS && !output->error) {
+            pthread_cond_wait(&output->drained, &output->lock);
+        }
+        int error = output->error;
+        size_t index = (output->head + output->count)
+                       % COMPRESSION_QUEUE_BLOCKS;
+        pthread_mutex_unlock(&output->lock);
+        if (error) {
+            return error;
+        }
+
+        /* The thread does not read the blocks past the queued ones. */
+        output_block *block = &output->blocks[index];
+        if (block->capacity < size) {
+            char *grown = realloc(block->data, size);
+            if (!grown) {
+                return ENOMEM;
+            }
+            block->data = grown;
+            block->capacity = size;
+        }
+        memcpy(block->data, data, size);
+        block->length = size;
+
+        pthread_mutex_lock(&output->lock);
+        output->count++;
+        pthread_cond_signal(&output->filled);
+        pthread_mutex_unlock(&output->lock);
+
+        data += size;
+        length -= size;
+    }
+    return 0;
+}
+
+
+/*
+ * Compresses the queued blocks, ends the compressed stream and
+ * releases the compressor.
+ *
+ * Parameters:
+ *   output - The compressor, or NULL.
+ *
+ * Returns:
+ *   0 on success, or the errno value of the first failure.
+ */
+int compressed_output_close(compressed_output *output) {
+    if (!output) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&output->lock);
+    output->closing = 1;
+    pthread_cond_signal(&output->filled);
+    pthread_mutex_unlock(&output->lock);
+    pthread_join(output->thread, NULL);
+
+    int error = output->error;
+    release_output(output);
+    return error;
+}
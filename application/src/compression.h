@@ -0,0 +1,117 @@
+/*
+ * compression.h
+ *
+ * Interface for the compression module, used to read gzip or zstd
+ * compressed input and to write compressed output without external
+ * pipes.
+ */
+#include <stddef.h>
+#include <stdio.h>
+
+#ifndef INCLUDED_COMPRESSION_H
+#define INCLUDED_COMPRESSION_H
+
+/*
+ * Compression formats. zstd is only available when the program is
+ * built with WKT2GEOJSON_ZSTD.
+ */
+typedef enum compression {
+    COMPRESSION_NONE,    /* plain bytes */
+    COMPRESSION_GZIP,    /* gzip members, as written by gzip(1) */
+    COMPRESSION_ZSTD     /* zstd frames, as written by zstd(1) */
+} compression;
+
+/*
+ * Opaque decompressed view of an input stream.
+ */
+typedef struct compressed_input compressed_input;
+
+/*
+ * Opaque compressor of an output file descriptor.
+ */
+typedef struct compressed_output compressed_output;
+
+
+/*
+ * Looks up the compression called `name`: "gzip", "zstd" or "none".
+ * Returns 0 on success or -1 if the name is unknown.
+ */
+int compression_from_name(const char *name, compression *codec);
+
+
+/*
+ * Returns the compression named by the extension of `path` (".gz" or
+ * ".zst"), or COMPRESSION_NONE.
+ */
+compression compression_from_path(const char *path);
+
+
+/*
+ * Returns 1 if `codec` is supported by this build, 0 otherwise.
+ */
+int compression_supported(compression codec);
+
+
+/*
+ * Detects the compression of `in_file` from its magic bytes and opens
+ * a view of it that reads the decompressed bytes. The view of a plain
+ * regular file reads `in_file` itself, which can then be mapped in
+ * memory. `in_file` is not owned by the view.
+ * Returns NULL in case of error, with `*error` set to a message.
+ */
+compressed_input* compressed_input_open(FILE *in_file, const char **error);
+
+
+/*
+ * Returns the stream of the decompressed bytes of `input`.
+ */
+FILE* compressed_input_file(const compressed_input *input);
+
+
+/*
+ * Returns the compression detected on `input`.
+ */
+compression compressed_input_codec(const compressed_input *input);
+
+
+/*
+ * Returns the message of the error that ended the decompressed stream
+ * early, such as corrupt or truncated data, or NULL.
+ */
+const char* compressed_input_error(const compressed_input *input);
+
+
+/*
+ * Closes the view of the input, but not the input itself. Accepts NULL.
+ */
+void compressed_input_close(compressed_input *input);
+
+
+/*
+ * Opens a compressor writing `codec` data to `fd` from a thread of its
+ * own, so that compressing overlaps with converting.
+ * Returns NULL in case of error, with `*error` set to a message.
+ */
+compressed_output* compressed_output_open(int fd, compression codec,
+                                          const char **error);
+
+
+/*
+ * Hands `length` bytes to compress to the compressor at `user_data`,
+ * as an `output_sink_fn` (see `writer.h`).
+ * Returns 0 on success or the errno value of a failure.
+ */
+int compressed_output_write(void *user_data, const char *data,
+                            size_t length);
+
+
+/*
+ * Compresses the bytes still pending, ends the compressed stream and
+ * releases the compressor. Accepts NULL.
+ * Returns 0 on success or the errno value of the first failure.
+ */
+int compressed_output_close(compressed_output *output);
+
+#endif  /* INCLUDED_COMPRESSION_H */
+
+// EOF
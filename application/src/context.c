@@ -0,0 +1,211 @@
+/*
+ * context.c
+ *
+ * This module creates and releases the transpile contexts used by the
+ * parser. A context ties together a reentrant scanner (or a SIMD
+ * tokenizer), the optional mapping of the input, the output sink and
+ * the feature counter of one conversion, replacing the global state
+ * previously shared by every call to `transpile`.
+ */
+
+#include "context.h"
+
+#include <stdlib.h>
+
+/* Reentrant scanner API, generated by Flex in `lex.yy.c`. */
+int yylex_init(void **scanner);
+void yyset_in(FILE *in_file, void *scanner);
+void yyset_extra(wkt2geojson_ctx *ctx, void *scanner);
+int yylex_destroy(void *scanner);
+
+
+/*
+ * Creates a context reading WKT from `in_file` and writing GeoJSON to
+ * `out_file`.
+ *
+ * Parameters:
+ *   in_file  - The WKT input stream.
+ *   out_file - The GeoJSON output stream, or NULL to keep the output
+ *              in memory.
+ *
+ * Returns:
+ *   A dynamically allocated context, or NULL if an error occurs.
+ */
+wkt2geojson_ctx* wkt2geojson_ctx_new(FILE *in_file, FILE *out_file) {
+    wkt2geojson_ctx *ctx = calloc(1, sizeof(wkt2geojson_ctx));
+    if (!ctx) {
+        return NULL;
+    }
+
+    if (out_file) {
+        fflush(out_file);
+    }
+    if (output_sink_init(&ctx->sink, out_file ? fileno(out_file) : -1,
+                         0) < 0) {
+        free(ctx);
+        return NULL;
+    }
+
+    if (yylex_init(&ctx->scanner)) {
+        output_sink_release(&ctx->sink);
+        free(ctx);
+        return NULL;
+    }
+
+    yyset_in(in_file, ctx->scanner);
+    yyset_extra(ctx, ctx->scanner);
+    ctx->input = in_file;
+    ctx->precision = WRITER_SHORTEST;
+    ctx->scanned.line = 1;
+    return ctx;
+}
+
+
+/*
+ * Creates a context reading WKT from a part of a mapped input and
+ * writing GeoJSON to memory, to convert one chunk of a larger input.
+ *
+ * Parameters:
+ *   data   - The first byte of the chunk, within a mapped input.
+ *   length - The length of the chunk.
+ *
+ * Returns:
+ *   A dynamically allocated context, or NULL if an error occurs.
+ */
+wkt2geojson_ctx* wkt2geojson_ctx_new_memory(const char *data, size_t length) {
+    wkt2geojson_ctx *ctx = calloc(1, sizeof(wkt2geojson_ctx));
+    if (!ctx) {
+        return NULL;
+    }
+
+    if (output_sink_init(&ctx->sink, -1, 0) < 0) {
+        free(ctx);
+        return NULL;
+    }
+
+    ctx->mapped = mapped_input_view(data, length);
+    if (!ctx->mapped || yylex_init(&ctx->scanner)) {
+        mapped_input_close(ctx->mapped);
+        output_sink_release(&ctx->sink);
+        free(ctx);
+        return NULL;
+    }
+
+    yyset_extra(ctx, ctx->scanner);
+    ctx->precision = WRITER_SHORTEST;
+    ctx->scanned.line = 1;
+    return ctx;
+}
+
+
+/*
+ * Maps the input file of the context in memory, so that the selected
+ * engine reads it without read(2) calls.
+ *
+ * Parameters:
+ *   ctx        - The context, before any token is read.
+ *   huge_pages - Non-zero to advise transparent huge pages.
+ *
+ * Returns:
+ *   0 if the input is mapped, or -1 if it is streamed.
+ */
+int wkt2geojson_ctx_map_input(wkt2geojson_ctx *ctx, int huge_pages) {
+    if (!ctx->mapped) {
+        stats_phase previous = stats_enter(ctx->stats, STATS_READ);
+        ctx->mapped = mapped_input_open(ctx->input, huge_pages);
+        stats_leave(ctx->stats, previous);
+        if (!ctx->mapped) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * Selects the tokenizer engine used to read the input of the context.
+ *
+ * Parameters:
+ *   ctx    - The context.
+ *   engine - TOKENIZER_FLEX for the Flex scanner, or one of the SIMD
+ *            tokenizer engines.
+ *
+ * Returns:
+ *   0 on success, or -1 if the engine is not supported by the CPU or
+ *   an error occurs.
+ */
+int wkt2geojson_ctx_use_tokenizer(wkt2geojson_ctx *ctx,
+                                  tokenizer_engine engine) {
+    tokenizer_free(ctx->tokenizer);
+    ctx->tokenizer = NULL;
+    ctx->engine = TOKENIZER_FLEX;
+
+    if (engine == TOKENIZER_FLEX) {
+        return 0;
+    }
+
+    if (ctx->mapped) {
+        ctx->tokenizer = tokenizer_new_mapped(ctx->mapped->data,
+                                              ctx->mapped->length, engine);
+    } else {
+        ctx->tokenizer = tokenizer_new(ctx->input, engine);
+    }
+    if (!ctx->tokenizer) {
+        return -1;
+    }
+    tokenizer_set_stats(ctx->tokenizer, ctx->stats);
+    ctx->engine = engine;
+    return 0;
+}
+
+
+/*
+ * Records the statistics of the conversion of the context.
+ *
+ * Parameters:
+ *   ctx   - The context.
+ *   stats - The statistics, or NULL to stop recording them.
+ */
+void wkt2geojson_ctx_set_stats(wkt2geojson_ctx *ctx, wkt2geojson_stats *stats) {
+    ctx->stats = stats;
+    ctx->sink.stats = stats;
+    if (ctx->tokenizer) {
+        tokenizer_set_stats(ctx->tokenizer, stats);
+    }
+}
+
+
+/*
+ * Makes the context skip and log the records with a syntax error.
+ *
+ * Parameters:
+ *   ctx     - The context, with its tokenizer engine selected and
+ *             before any token is read.
+ *   rejects - The log of the rejected records.
+ */
+void wkt2geojson_ctx_set_rejects(wkt2geojson_ctx *ctx, reject_log *rejects) {
+    ctx->rejects = rejects;
+    if (ctx->tokenizer) {
+        tokenizer_count_lines(ctx->tokenizer);
+    }
+}
+
+
+/*
+ * Releases the context, its scanners and its output sink. Buffered
+ * output that was not flushed is discarded.
+ *
+ * Parameters:
+ *   ctx - The context to release. May be NULL.
+ */
+void wkt2geojson_ctx_free(wkt2geojson_ctx *ctx) {
+    if (!ctx) {
+        return;
+    }
+    yylex_destroy(ctx->scanner);
+    tokenizer_free(ctx->tokenizer);
+    mapped_input_close(ctx->mapped);
+    output_sink_release(&ctx->sink);
+    arena_release(&ctx->arena);
+    free(ctx);
+}
@@ -0,0 +1,148 @@
+/*
+ * context.h
+ *
+ * Interface for the context module. A transpile context holds all of
+ * the state of a single WKT to GeoJSON conversion, so that several
+ * conversions can run at the same time in one process.
+ */
+#ifndef INCLUDED_CONTEXT_H
+#define INCLUDED_CONTEXT_H
+
+#include <stdio.h>
+
+#include "arena.h"
+#include "filter.h"
+#include "input.h"
+#include "ir.h"
+#include "reject.h"
+#include "simplify.h"
+#include "stats.h"
+#include "tokenizer.h"
+#include "writer.h"
+
+/*
+ * State of a WKT to GeoJSON conversion.
+ * Every context owns its own reentrant scanner, so contexts can be
+ * used concurrently as long as each one is used by a single thread.
+ * When `tokenizer` is set, tokens are read from the SIMD tokenizer
+ * instead of the Flex scanner. When `mapped` is set, the input file is
+ * read from memory by either engine. When `format` is not INPUT_WKT,
+ * the input holds WKB geometries, which are decoded without either
+ * engine (see `wkb.h`). Coordinates are rounded to `precision`
+ * fraction digits, or written with their shortest round-trip
+ * representation when it is WRITER_SHORTEST (the default). When `ir`
+ * is set, geometries are appended to it instead of being written.
+ * The semantic values of the feature being parsed are allocated from
+ * `arena`, which is reset after every feature (see `arena.h`). When
+ * `filter` is set, the features it does not keep are dropped before
+ * they are simplified and written (see `filter.h`).
+ *
+ * A mapped input is converted on `jobs` threads when it is more than
+ * one (see `parallel.h`). A context converting a chunk of a larger
+ * input sets `continued`, so that its first feature is separated from
+ * those of the previous chunks, and `defer_errors`, so that its first
+ * error is kept in `error` instead of being printed.
+ *
+ * When `stats` is set, the phases of the conversion are timed and its
+ * features counted (see `stats.h`).
+ *
+ * When `rejects` is set, an invalid record is skipped and
+ * added to the log instead of ending the conversion (see `reject.h`).
+ * The parser then tracks the start of the record being parsed and of
+ * the last geometry keyword read, and the Flex scanner the end of its
+ * last token.
+ */
+typedef struct wkt2geojson_ctx {
+    void *scanner;           /* reentrant Flex scanner (yyscan_t) */
+    tokenizer *tokenizer;    /* SIMD tokenizer, or NULL to use Flex */
+    tokenizer_engine engine; /* engine of `tokenizer`, or TOKENIZER_FLEX */
+    FILE *input;             /* source the WKT records are read from */
+    mapped_input *mapped;    /* `input` mapped in memory, or NULL */
+    input_format format;     /* encoding of the input records */
+    output_sink sink;        /* sink the GeoJSON document is written to */
+    wkt_ir *ir;              /* IR receiving the geometries, or NULL */
+    value_arena arena;       /* values of the feature being parsed */
+    int count;               /* number of features written so far */
+    int precision;           /* fraction digits, or WRITER_SHORTEST */
+    simplify_options simplify; /* simplification of lines and rings */
+    const spatial_filter *filter; /* query selecting the features, or NULL */
+    int jobs;                /* threads converting a mapped input */
+    int continued;           /* whether features precede the output */
+    int defer_errors;        /* whether errors are kept, not printed */
+    const char *error;       /* first error message, or NULL */
+    wkt2geojson_stats *stats; /* statistics of the conversion, or NULL */
+    reject_log *rejects;     /* log of the rejected records, or NULL */
+    const char *record_error; /* error awaiting its reject, or NULL */
+    int lookahead;           /* last token read, when recording rejects */
+    int record_open;         /* whether `record` is being parsed */
+    input_position record;   /* start of the record being parsed */
+    input_position keyword;  /* last geometry keyword read */
+    input_position scanned;  /* end of the last token of Flex */
+} wkt2geojson_ctx;
+
+
+/*
+ * Creates a context reading WKT from `in_file` and writing GeoJSON to
+ * `out_file`. The files are not owned by the context. The output is
+ * written to the file descriptor of `out_file`, bypassing its stdio
+ * buffer, which is flushed first, or kept in memory when `out_file` is
+ * NULL.
+ * Returns NULL in case of error.
+ */
+wkt2geojson_ctx* wkt2geojson_ctx_new(FILE *in_file, FILE *out_file);
+
+
+/*
+ * Creates a context reading the `length` bytes of WKT at `data`, a
+ * part of a mapped input (see `input.h`), and keeping the GeoJSON
+ * features in the memory of its sink.
+ * Returns NULL in case of error.
+ */
+wkt2geojson_ctx* wkt2geojson_ctx_new_memory(const char *data, size_t length);
+
+
+/*
+ * Maps the input file of the context in memory, advising huge pages
+ * when `huge_pages` is set. Must be called before selecting the
+ * tokenizer engine and before any token is read.
+ * Returns 0 if the input is mapped, or -1 if it is not a regular file
+ * or in case of error, in which case it keeps being streamed.
+ */
+int wkt2geojson_ctx_map_input(wkt2geojson_ctx *ctx, int huge_pages);
+
+
+/*
+ * Records the statistics of the conversion in `stats`, which must
+ * outlive the context, or stops recording them when it is NULL.
+ */
+void wkt2geojson_ctx_set_stats(wkt2geojson_ctx *ctx, wkt2geojson_stats *stats);
+
+
+/*
+ * Skips the records with a syntax error and adds them to `rejects`,
+ * which must outlive the context, instead of stopping at the first
+ * error. Must be called after selecting the tokenizer engine and
+ * before any token is read.
+ */
+void wkt2geojson_ctx_set_rejects(wkt2geojson_ctx *ctx, reject_log *rejects);
+
+
+/*
+ * Selects the tokenizer engine of the context. Must be called before
+ * any token is read.
+ * Returns 0 on success or -1 if the engine is not supported by the CPU
+ * or in case of error.
+ */
+int wkt2geojson_ctx_use_tokenizer(wkt2geojson_ctx *ctx,
+                                  tokenizer_engine engine);
+
+
+/*
+ * Releases the context, its scanners and its output sink, discarding
+ * output that was not flushed. Accepts NULL.
+ */
+void wkt2geojson_ctx_free(wkt2geojson_ctx *ctx);
+
+#endif  /* INCLUDED_CONTEXT_H */
+
+// EOF
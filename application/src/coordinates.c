@@ -0,0 +1,259 @@
+/*
+ * coordinates.c
+ *
+ * This module provides a growable buffer of vertices. The parser
+ * appends every coordinate it reads to the buffer of the geometry
+ * being recognized, instead of re-formatting all of the previous
+ * vertices into a new string on each reduction. Appending is done in
+ * amortized constant time, so the cost of a geometry grows linearly
+ * with its number of vertices.
+ *
+ * Buffers are allocated from the arena of the parser (see `arena.h`),
+ * which releases them all at once after every feature: once the arena
+ * has grown to the size of the largest feature, the following ones
+ * are parsed without allocating memory.
+ *
+ * The module also computes the bounding boxes of interleaved
+ * coordinates. An x/y pair fills one SSE2 register, so the minimum and
+ * maximum of both axes are reduced at once, over four independent
+ * accumulators to hide the latency of the comparisons.
+ */
+
+#include "coordinates.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define COORDINATES_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+/* Initial capacity, in doubles, of a coordinate buffer. */
+#define COORDINATE_BUFFER_INITIAL_CAPACITY 64
+
+/* Initial capacity, in rings, of a coordinate buffer. */
+#define COORDINATE_BUFFER_INITIAL_RINGS 4
+
+
+/*
+ * Ensures the buffer can hold `extra` more doubles, doubling its
+ * capacity as many times as required.
+ *
+ * Returns:
+ *   0 on success, or -1 if the memory could not be allocated.
+ */
+static int reserve_values(coordinate_buffer *buffer, size_t extra) {
+    size_t required = buffer->size + extra;
+    if (required <= buffer->capacity) {
+        return 0;
+    }
+
+    size_t capacity = buffer->capacity ? buffer->capacity
+                                       : COORDINATE_BUFFER_INITIAL_CAPACITY;
+    while (capacity < required) {
+        capacity *= 2;
+    }
+
+    double *values = arena_grow(buffer->arena, buffer->values,
+                                buffer->size * sizeof(double),
+                                capacity * sizeof(double));
+    if (!values) {
+        return -1;
+    }
+
+    buffer->values = values;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+
+/*
+ * Allocates an empty coordinate buffer.
+ *
+ * Parameters:
+ *   arena - The arena the buffer and its storage are allocated from.
+ *
+ * Returns:
+ *   A buffer allocated from `arena`, or NULL if an error occurs.
+ */
+coordinate_buffer* coordinate_buffer_new(value_arena *arena) {
+    coordinate_buffer *buffer = arena_alloc(arena, sizeof(coordinate_buffer));
+    if (buffer) {
+        memset(buffer, 0, sizeof(coordinate_buffer));
+        buffer->arena = arena;
+    }
+    return buffer;
+}
+
+
+/*
+ * Appends a vertex to the end of the buffer.
+ *
+ * Parameters:
+ *   buffer - The buffer to append to.
+ *   v      - The vertex to append.
+ *
+ * Returns:
+ *   0 on success, or -1 if the memory could not be allocated.
+ */
+int coordinate_buffer_append(coordinate_buffer *buffer, vertex v) {
+    if (reserve_values(buffer, 2) < 0) {
+        return -1;
+    }
+    buffer->values[buffer->size++] = v.x;
+    buffer->values[buffer->size++] = v.y;
+    return 0;
+}
+
+
+/*
+ * Closes the vertices appended since the previous ring as a new ring,
+ * recording the ring end offset.
+ *
+ * Parameters:
+ *   buffer - The buffer whose last ring is closed.
+ *
+ * Returns:
+ *   0 on success, or -1 if the memory could not be allocated.
+ */
+int coordinate_buffer_close_ring(coordinate_buffer *buffer) {
+    if (buffer->ring_count == buffer->ring_capacity) {
+        size_t capacity = buffer->ring_capacity
+                              ? buffer->ring_capacity * 2
+                              : COORDINATE_BUFFER_INITIAL_RINGS;
+        size_t *rings = arena_grow(buffer->arena, buffer->rings,
+                                   buffer->ring_count * sizeof(size_t),
+                                   capacity * sizeof(size_t));
+        if (!rings) {
+            return -1;
+        }
+        buffer->rings = rings;
+        buffer->ring_capacity = capacity;
+    }
+
+    buffer->rings[buffer->ring_count++] = coordinate_buffer_length(buffer);
+    return 0;
+}
+
+
+/*
+ * Appends every vertex of `source` to `buffer` and closes them as a
+ * new ring.
+ *
+ * Parameters:
+ *   buffer - The buffer to append to.
+ *   source - The buffer holding the vertices of the ring.
+ *
+ * Returns:
+ *   0 on success, or -1 if the memory could not be allocated.
+ */
+int coordinate_buffer_append_ring(coordinate_buffer *buffer,
+                                  const coordinate_buffer *source) {
+    if (reserve_values(buffer, source->size) < 0) {
+        return -1;
+    }
+    if (source->size) {
+        memcpy(buffer->values + buffer->size, source->values,
+               source->size * sizeof(double));
+    }
+    buffer->size += source->size;
+    return coordinate_buffer_close_ring(buffer);
+}
+
+
+/*
+ * Returns the number of vertices stored in the buffer.
+ */
+size_t coordinate_buffer_length(const coordinate_buffer *buffer) {
+    return buffer->size / 2;
+}
+
+
+/*
+ * Empties a bounding box.
+ *
+ * Parameters:
+ *   box - The box to empty.
+ */
+void bounding_box_reset(bounding_box *box) {
+    box->min.x = INFINITY;
+    box->min.y = INFINITY;
+    box->max.x = -INFINITY;
+    box->max.y = -INFINITY;
+}
+
+
+/*
+ * Extends a bounding box to interleaved coordinates.
+ *
+ * Parameters:
+ *   box   - The box to extend.
+ *   xy    - The x/y pairs of the vertices.
+ *   count - The number of vertices.
+ */
+void bounding_box_extend(bounding_box *box, const double *xy, size_t count) {
+#ifdef COORDINATES_HAVE_SSE2
+    /* The vertex is the first operand, so a NaN yields the box. */
+    __m128d low = _mm_loadu_pd(&box->min.x);
+    __m128d high = _mm_loadu_pd(&box->max.x);
+    __m128d low1 = low, low2 = low, low3 = low;
+    __m128d high1 = high, high2 = high, high3 = high;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128d v0 = _mm_loadu_pd(xy + 2 * i);
+        __m128d v1 = _mm_loadu_pd(xy + 2 * i + 2);
+        __m128d v2 = _mm_loadu_pd(xy + 2 * i + 4);
+        __m128d v3 = _mm_loadu_pd(xy + 2 * i + 6);
+        low = _mm_min_pd(v0, low);
+        low1 = _mm_min_pd(v1, low1);
+        low2 = _mm_min_pd(v2, low2);
+        low3 = _mm_min_pd(v3, low3);
+        high = _mm_max_pd(v0, high);
+        high1 = _mm_max_pd(v1, high1);
+        high2 = _mm_max_pd(v2, high2);
+        high3 = _mm_max_pd(v3, high3);
+    }
+    for (; i < count; i++) {
+        __m128d v = _mm_loadu_pd(xy + 2 * i);
+        low = _mm_min_pd(v, low);
+        high = _mm_max_pd(v, high);
+    }
+    low = _mm_min_pd(_mm_min_pd(low, low1), _mm_min_pd(low2, low3));
+    high = _mm_max_pd(_mm_max_pd(high, high1), _mm_max_pd(high2, high3));
+    _mm_storeu_pd(&box->min.x, low);
+    _mm_storeu_pd(&box->max.x, high);
+#else
+    for (size_t i = 0; i < count; i++) {
+        double x = xy[2 * i];
+        double y = xy[2 * i + 1];
+        box->min.x = x < box->min.x ? x : box->min.x;
+        box->min.y = y < box->min.y ? y : box->min.y;
+        box->max.x = x > box->max.x ? x : box->max.x;
+        box->max.y = y > box->max.y ? y : box->max.y;
+    }
+#endif
+}
+
+
+/*
+ * Extends a bounding box to the extent of another one.
+ *
+ * Parameters:
+ *   box   - The box to extend.
+ *   other - The box to include.
+ */
+void bounding_box_merge(bounding_box *box, const bounding_box *other) {
+    /* The corners of `other` are two interleaved vertices. */
+    if (!bounding_box_empty(other)) {
+        bounding_box_extend(box, &other->min.x, 2);
+    }
+}
+
+
+/*
+ * Returns 1 if a bounding box holds no vertex, 0 otherwise.
+ */
+int bounding_box_empty(const bounding_box *box) {
+    return !(box->min.x <= box->max.x && box->min.y <= box->max.y);
+}
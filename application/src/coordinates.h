@@ -0,0 +1,114 @@
+/*
+ * coordinates.h
+ *
+ * Interface for the coordinates module, a growable buffer used by the
+ * parser to accumulate the vertices of a geometry.
+ */
+#include <stddef.h>
+
+#include "arena.h"
+
+#ifndef INCLUDED_COORDINATES_H
+#define INCLUDED_COORDINATES_H
+
+/*
+ * A single vertex, as read by the `coordinate` grammar rule.
+ */
+typedef struct vertex {
+    double x;
+    double y;
+} vertex;
+
+
+/*
+ * Axis-aligned extent of a set of vertices. A box holding no vertex
+ * has its minimum above its maximum.
+ */
+typedef struct bounding_box {
+    vertex min;    /* smallest x and y */
+    vertex max;    /* largest x and y */
+} bounding_box;
+
+
+/*
+ * Growable buffer of vertices.
+ * Vertices are stored as interleaved x/y pairs in `values`. The buffer
+ * also keeps the end offset (in vertices) of every closed ring, so that
+ * the rings of a polygon can be told apart by the writer. The buffer
+ * and its storage are allocated from `arena`, and released with it.
+ */
+typedef struct coordinate_buffer {
+    value_arena *arena;
+    double *values;
+    size_t size;
+    size_t capacity;
+    size_t *rings;
+    size_t ring_count;
+    size_t ring_capacity;
+} coordinate_buffer;
+
+
+/*
+ * Allocates an empty coordinate buffer from `arena`.
+ * Returns NULL in case of error.
+ */
+coordinate_buffer* coordinate_buffer_new(value_arena *arena);
+
+
+/*
+ * Appends a vertex to the end of the buffer, in amortized constant time.
+ * Returns 0 on success or -1 in case of error.
+ */
+int coordinate_buffer_append(coordinate_buffer *buffer, vertex v);
+
+
+/*
+ * Closes the vertices appended since the previous ring as a new ring.
+ * Returns 0 on success or -1 in case of error.
+ */
+int coordinate_buffer_close_ring(coordinate_buffer *buffer);
+
+
+/*
+ * Appends every vertex of `source` to `buffer` and closes them as a
+ * new ring.
+ * Returns 0 on success or -1 in case of error.
+ */
+int coordinate_buffer_append_ring(coordinate_buffer *buffer,
+                                  const coordinate_buffer *source);
+
+
+/*
+ * Returns the number of vertices stored in the buffer.
+ */
+size_t coordinate_buffer_length(const coordinate_buffer *buffer);
+
+
+/*
+ * Empties `box`.
+ */
+void bounding_box_reset(bounding_box *box);
+
+
+/*
+ * Extends `box` to the `count` vertices of the interleaved coordinates
+ * `xy`. NaN coordinates are ignored.
+ */
+void bounding_box_extend(bounding_box *box, const double *xy, size_t count);
+
+
+/*
+ * Extends `box` to the extent of `other`.
+ */
+void bounding_box_merge(bounding_box *box, const bounding_box *other);
+
+
+/*
+ * Returns 1 if `box` holds no vertex, 0 otherwise.
+ */
+int bounding_box_empty(const bounding_box *box);
+
+
+#endif  /* INCLUDED_COORDINATES_H */
+
+// EOF
@@ -0,0 +1,717 @@
+/*
+ * dtoa.c
+ *
+ * This module formats the coordinates written by the GeoJSON writer.
+ * `printf("%f")` always writes six fraction digits, which inflates the
+ * output for most inputs and drops precision for projected
+ * coordinates, and it was the main cost of writing a vertex.
+ *
+ * `dtoa_shortest` implements the Grisu3 algorithm (Loitsch, "Printing
+ * Floating-Point Numbers Quickly and Accurately with Integers", 2010):
+ * the value and the boundaries of its rounding interval are scaled by
+ * a cached power of ten into 64-bit fixed-point numbers, and digits are
+ * generated until the result falls inside the interval. The scaled
+ * numbers are off by a known error, so Grisu3 checks that the digits
+ * are the shortest and closest despite it, which fails for about 0.5%
+ * of the values (`1e23` among them); those are formatted with exact
+ * arithmetic instead, by reading back the digits printf rounds them to.
+ * The output is thus always the shortest representation that reads
+ * back as the same double.
+ *
+ * `dtoa_fixed` writes a value rounded to a number of fraction digits,
+ * without the trailing zeros `%.*f` pads it with. The value is scaled
+ * by the power of ten once and rounded to an integer, whose digits are
+ * written two at a time from a table. The product is rounded, so the
+ * exact product is only worked out, with 128-bit integers, when the
+ * rounded one falls on a midpoint; the digits are thus the ones of
+ * `%.*f`, which rounds the exact value half to even.
+ */
+
+#include "dtoa.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Binary64 layout. */
+#define SIGNIFICAND_BITS 52
+#define EXPONENT_BIAS 1075
+#define HIDDEN_BIT (UINT64_C(1) << SIGNIFICAND_BITS)
+
+/* Range of the binary exponent of the scaled value, in which the
+ * integral part fits in 32 bits. */
+#define GRISU_ALPHA (-60)
+#define GRISU_GAMMA (-32)
+
+/* Decimal exponent of the first cached power, and step between two. */
+#define CACHED_POWERS_MIN_EXPONENT (-300)
+#define CACHED_POWERS_STEP 8
+
+/* Decimal notation is used for exponents in (-6, 21], as JavaScript. */
+#define DECIMAL_MIN_EXPONENT (-6)
+#define DECIMAL_MAX_EXPONENT 21
+
+/* Largest number of fraction digits of `dtoa_fixed`, and bound of the
+ * scaled values it rounds, below which every integer is a double. */
+#define FIXED_MAX_PRECISION 17
+#define FIXED_LIMIT 9007199254740992.0  /* 2^53 */
+
+__extension__ typedef unsigned __int128 uint128;
+
+
+/*
+ * Floating-point number f * 2^e with a 64-bit significand.
+ */
+typedef struct diyfp {
+    uint64_t f;
+    int e;
+} diyfp;
+
+
+/*
+ * Normalized 64-bit approximations f * 2^e of 10^k, for k from -300
+ * to 324 in steps of 8, rounded to nearest.
+ */
+static const struct {
+    uint64_t f;
+    int e;
+    int k;
+} cached_powers[] = {
+    { 0xAB70FE17C79AC6CAULL, -1060, -300 },
+    { 0xFF77B1FCBEBCDC4FULL, -1034, -292 },
+    { 0xBE5691EF416BD60CULL, -1007, -284 },
+    { 0x8DD01FAD907FFC3CULL, -980, -276 },
+    { 0xD3515C2831559A83ULL, -954, -268 },
+    { 0x9D71AC8FADA6C9B5ULL, -927, -260 },
+    { 0xEA9C227723EE8BCBULL, -901, -252 },
+    { 0xAECC49914078536DULL, -874, -244 },
+    { 0x823C12795DB6CE57ULL, -847, -236 },
+    { 0xC21094364DFB5637ULL, -821, -228 },
+    { 0x9096EA6F3848984FULL, -794, -220 },
+    { 0xD77485CB25823AC7ULL, -768, -212 },
+    { 0xA086CFCD97BF97F4ULL, -741, -204 },
+    { 0xEF340A98172AACE5ULL, -715, -196 },
+    { 0xB23867FB2A35B28EULL, -688, -188 },
+    { 0x84C8D4DFD2C63F3BULL, -661, -180 },
+    { 0xC5DD44271AD3CDBAULL, -635, -172 },
+    { 0x936B9FCEBB25C996ULL, -608, -164 },
+    { 0xDBAC6C247D62A584ULL, -582, -156 },
+    { 0xA3AB66580D5FDAF6ULL, -555, -148 },
+    { 0xF3E2F893DEC3F126ULL, -529, -140 },
+    { 0xB5B5ADA8AAFF80B8ULL, -502, -132 },
+    { 0x87625F056C7C4A8BULL, -475, -124 },
+    { 0xC9BCFF6034C13053ULL, -449, -116 },
+    { 0x964E858C91BA2655ULL, -422, -108 },
+    { 0xDFF9772470297EBDULL, -396, -100 },
+    { 0xA6DFBD9FB8E5B88FULL, -369, -92 },
+    { 0xF8A95FCF88747D94ULL, -343, -84 },
+    { 0xB94470938FA89BCFULL, -316, -76 },
+    { 0x8A08F0F8BF0F156BULL, -289, -68 },
+    { 0xCDB02555653131B6ULL, -263, -60 },
+    { 0x993FE2C6D07B7FACULL, -236, -52 },
+    { 0xE45C10C42A2B3B06ULL, -210, -44 },
+    { 0xAA242499697392D3ULL, -183, -36 },
+    { 0xFD87B5F28300CA0EULL, -157, -28 },
+    { 0xBCE5086492111AEBULL, -130, -20 },
+    { 0x8CBCCC096F5088CCULL, -103, -12 },
+    { 0xD1B71758E219652CULL, -77, -4 },
+    { 0x9C40000000000000ULL, -50, 4 },
+    { 0xE8D4A51000000000ULL, -24, 12 },
+    { 0xAD78EBC5AC620000ULL, 3, 20 },
+    { 0x813F3978F8940984ULL, 30, 28 },
+    { 0xC097CE7BC90715B3ULL, 56, 36 },
+    { 0x8F7E32CE7BEA5C70ULL, 83, 44 },
+    { 0xD5D238A4ABE98068ULL, 109, 52 },
+    { 0x9F4F2726179A2245ULL, 136, 60 },
+    { 0xED63A231D4C4FB27ULL, 162, 68 },
+    { 0xB0DE65388CC8ADA8ULL, 189, 76 },
+    { 0x83C7088E1AAB65DBULL, 216, 84 },
+    { 0xC45D1DF942711D9AULL, 242, 92 },
+    { 0x924D692CA61BE758ULL, 269, 100 },
+    { 0xDA01EE641A708DEAULL, 295, 108 },
+    { 0xA26DA3999AEF774AULL, 322, 116 },
+    { 0xF209787BB47D6B85ULL, 348, 124 },
+    { 0xB454E4A179DD1877ULL, 375, 132 },
+    { 0x865B86925B9BC5C2ULL, 402, 140 },
+    { 0xC83553C5C8965D3DULL, 428, 148 },
+    { 0x952AB45CFA97A0B3ULL, 455, 156 },
+    { 0xDE469FBD99A05FE3ULL, 481, 164 },
+    { 0xA59BC234DB398C25ULL, 508, 172 },
+    { 0xF6C69A72A3989F5CULL, 534, 180 },
+    { 0xB7DCBF5354E9BECEULL, 561, 188 },
+    { 0x88FCF317F22241E2ULL, 588, 196 },
+    { 0xCC20CE9BD35C78A5ULL, 614, 204 },
+    { 0x98165AF37B2153DFULL, 641, 212 },
+    { 0xE2A0B5DC971F303AULL, 667, 220 },
+    { 0xA8D9D1535CE3B396ULL, 694, 228 },
+    { 0xFB9B7CD9A4A7443CULL, 720, 236 },
+    { 0xBB764C4CA7A44410ULL, 747, 244 },
+    { 0x8BAB8EEFB6409C1AULL, 774, 252 },
+    { 0xD01FEF10A657842CULL, 800, 260 },
+    { 0x9B10A4E5E9913129ULL, 827, 268 },
+    { 0xE7109BFBA19C0C9DULL, 853, 276 },
+    { 0xAC2820D9623BF429ULL, 880, 284 },
+    { 0x80444B5E7AA7CF85ULL, 907, 292 },
+    { 0xBF21E44003ACDD2DULL, 933, 300 },
+    { 0x8E679C2F5E44FF8FULL, 960, 308 },
+    { 0xD433179D9C8CB841ULL, 986, 316 },
+    { 0x9E19DB92B4E31BA9ULL, 1013, 324 }
+};
+
+
+/*
+ * Powers of ten of the fixed precisions, as doubles (all exact) and as
+ * integers, and the matching powers of five.
+ */
+static const double POWERS_OF_TEN[FIXED_MAX_PRECISION + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+    1e13, 1e14, 1e15, 1e16, 1e17
+};
+
+static const uint64_t INTEGER_POWERS_OF_TEN[FIXED_MAX_PRECISION + 1] = {
+    UINT64_C(1), UINT64_C(10), UINT64_C(100), UINT64_C(1000),
+    UINT64_C(10000), UINT64_C(100000), UINT64_C(1000000),
+    UINT64_C(10000000), UINT64_C(100000000), UINT64_C(1000000000),
+    UINT64_C(10000000000), UINT64_C(100000000000),
+    UINT64_C(1000000000000), UINT64_C(10000000000000),
+    UINT64_C(100000000000000), UINT64_C(1000000000000000),
+    UINT64_C(10000000000000000), UINT64_C(100000000000000000)
+};
+
+static const uint64_t POWERS_OF_FIVE[FIXED_MAX_PRECISION + 1] = {
+    UINT64_C(1), UINT64_C(5), UINT64_C(25), UINT64_C(125), UINT64_C(625),
+    UINT64_C(3125), UINT64_C(15625), UINT64_C(78125), UINT64_C(390625),
+    UINT64_C(1953125), UINT64_C(9765625), UINT64_C(48828125),
+    UINT64_C(244140625), UINT64_C(1220703125), UINT64_C(6103515625),
+    UINT64_C(30517578125), UINT64_C(152587890625),
+    UINT64_C(762939453125)
+};
+
+/* The decimal digits of 0 to 99, two characters each. */
+static const char DIGIT_PAIRS[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233"
+    "34353637383940414243444546474849505152535455565758596061626364656667"
+    "6869707172737475767778798081828384858687888990919293949596979899";
+
+
+static diyfp diyfp_make(uint64_t f, int e) {
+    diyfp x = { f, e };
+    return x;
+}
+
+
+/*
+ * Returns x * y, rounded to 64 bits.
+ */
+static diyfp diyfp_mul(diyfp x, diyfp y) {
+    uint128 product = (uint128)x.f * y.f + (UINT64_C(1) << 63);
+    return diyfp_make((uint64_t)(product >> 64), x.e + y.e + 64);
+}
+
+
+static diyfp diyfp_normalize(diyfp x) {
+    int shift = __builtin_clzll(x.f);
+    return diyfp_make(x.f << shift, x.e - shift);
+}
+
+
+/*
+ * Returns x with the binary exponent `e`, which must not be larger
+ * than the exponent of x.
+ */
+static diyfp diyfp_normalize_to(diyfp x, int e) {
+    return diyfp_make(x.f << (x.e - e), e);
+}
+
+
+/*
+ * Computes the normalized value `v` and the boundaries `minus` and
+ * `plus` of the interval of real numbers that round to it, which
+ * share the exponent of `plus`.
+ */
+static void compute_boundaries(double value, diyfp *v, diyfp *minus,
+                               diyfp *plus) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint64_t fraction = bits & (HIDDEN_BIT - 1);
+    int exponent = (int)((bits >> SIGNIFICAND_BITS) & 0x7FF);
+
+    diyfp w = exponent == 0
+        ? diyfp_make(fraction, 1 - EXPONENT_BIAS)
+        : diyfp_make(fraction + HIDDEN_BIT, exponent - EXPONENT_BIAS);
+
+    /* The lower boundary is closer for powers of two, where the
+     * exponent changes. */
+    int lower_closer = fraction == 0 && exponent > 1;
+
+    diyfp m_plus = diyfp_make(2 * w.f + 1, w.e - 1);
+    diyfp m_minus = lower_closer ? diyfp_make(4 * w.f - 1, w.e - 2)
+                                 : diyfp_make(2 * w.f - 1, w.e - 1);
+
+    *plus = diyfp_normalize(m_plus);
+    *minus = diyfp_normalize_to(m_minus, plus->e);
+    *v = diyfp_normalize(w);
+}
+
+
+/*
+ * Returns the number of decimal digits of `n`, storing in `power` the
+ * power of ten of its leading digit.
+ */
+static int largest_power_of_ten(uint32_t n, uint32_t *power) {
+    static const uint32_t powers[] = {
+        1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+        1000000000
+    };
+
+    int digits = 10;
+    while (digits > 1 && n < powers[digits - 1]) {
+        digits--;
+    }
+    *power = powers[digits - 1];
+    return digits;
+}
+
+
+/*
+ * Moves the last digit down while the result stays inside the unsafe
+ * interval and gets closer to the exact value, then checks that the
+ * digits are the closest shortest ones despite the rounding of the
+ * scaled values, which are off by less than `unit`.
+ *
+ * Parameters:
+ *   buffer    - The digits generated.
+ *   length    - The number of digits.
+ *   distance  - The distance from the scaled value to the upper bound
+ *               of the unsafe interval.
+ *   unsafe    - The width of the unsafe interval.
+ *   rest      - The distance from the digits to the upper bound.
+ *   ten_kappa - The weight of the last digit.
+ *   unit      - The error bound of the scaled values.
+ *
+ * Returns:
+ *   1 if the digits are proven correct, or 0 if they may not be.
+ */
+static int grisu_round_weed(char *buffer, size_t length, uint64_t distance,
+                            uint64_t unsafe, uint64_t rest,
+                            uint64_t ten_kappa, uint64_t unit) {
+    uint64_t small_distance = distance - unit;
+    uint64_t big_distance = distance + unit;
+
+    /* Approach the largest value the exact one may be. */
+    while (rest < small_distance && unsafe - rest >= ten_kappa
+           && (rest + ten_kappa < small_distance
+               || small_distance - rest >= rest + ten_kappa - small_distance)) {
+        buffer[length - 1]--;
+        rest += ten_kappa;
+    }
+
+    /* If the smallest value the exact one may be would rather have the
+     * next digit down, the closest digits cannot be told apart. */
+    if (rest < big_distance && unsafe - rest >= ten_kappa
+        && (rest + ten_kappa < big_distance
+            || big_distance - rest > rest + ten_kappa - big_distance)) {
+        return 0;
+    }
+
+    /* The digits must be inside the safe interval. */
+    return 2 * unit <= rest && rest <= unsafe - 4 * unit;
+}
+
+
+/*
+ * Generates the digits of `w`, scaled by a cached power of ten, until
+ * they fall inside the unsafe interval around (`minus`, `plus`).
+ *
+ * Returns:
+ *   The number of digits, with `exponent` adjusted so that the value is
+ *   digits * 10^exponent, or 0 if the digits may not be the closest
+ *   shortest ones.
+ */
+static size_t grisu_digits(char *buffer, int *exponent, diyfp minus,
+                           diyfp w, diyfp plus) {
+    size_t length = 0;
+    uint64_t unit = 1;
+    uint64_t too_high = plus.f + unit;
+    uint64_t unsafe = too_high - (minus.f - unit);
+    uint64_t distance = too_high - w.f;
+
+    int shift = -plus.e;
+    uint64_t one = UINT64_C(1) << shift;
+
+    uint32_t p1 = (uint32_t)(too_high >> shift);
+    uint64_t p2 = too_high & (one - 1);
+
+    uint32_t power;
+    int n = largest_power_of_ten(p1, &power);
+
+    /* Integral digits. */
+    while (n > 0) {
+        uint32_t digit = p1 / power;
+        p1 %= power;
+        buffer[length++] = (char)('0' + digit);
+        n--;
+
+        uint64_t rest = ((uint64_t)p1 << shift) + p2;
+        if (rest < unsafe) {
+            *exponent += n;
+            return grisu_round_weed(buffer, length, distance, unsafe, rest,
+                                    (uint64_t)power << shift, unit)
+                ? length : 0;
+        }
+        power /= 10;
+    }
+
+    /* Fractional digits. */
+    int m = 0;
+    for (;;) {
+        p2 *= 10;
+        unit *= 10;
+        unsafe *= 10;
+        buffer[length++] = (char)('0' + (p2 >> shift));
+        p2 &= one - 1;
+        m++;
+        if (p2 < unsafe) {
+            break;
+        }
+    }
+
+    *exponent -= m;
+    return grisu_round_weed(buffer, length, distance * unit, unsafe, p2, one,
+                            unit)
+        ? length : 0;
+}
+
+
+/*
+ * Writes the shortest digits of the positive `value` to `buffer`, with
+ * Grisu3.
+ *
+ * Returns:
+ *   The number of digits, with `exponent` set so that the value is
+ *   digits * 10^exponent, or 0 for the rare values Grisu3 cannot prove
+ *   the result of.
+ */
+static size_t grisu3(char *buffer, int *exponent, double value) {
+    diyfp v, minus, plus;
+    compute_boundaries(value, &v, &minus, &plus);
+
+    /* Pick the cached power 10^-k that brings the exponent of `plus`
+     * within [GRISU_ALPHA, GRISU_GAMMA]. */
+    int f = GRISU_ALPHA - plus.e - 1;
+    int k = (f * 78913) / (1 << 18) + (f > 0);
+    size_t index = (size_t)((-CACHED_POWERS_MIN_EXPONENT + k
+                             + (CACHED_POWERS_STEP - 1))
+                            / CACHED_POWERS_STEP);
+    diyfp c = diyfp_make(cached_powers[index].f, cached_powers[index].e);
+
+    diyfp w = diyfp_mul(v, c);
+    diyfp w_minus = diyfp_mul(minus, c);
+    diyfp w_plus = diyfp_mul(plus, c);
+
+    *exponent = -cached_powers[index].k;
+    return grisu_digits(buffer, exponent, w_minus, w, w_plus);
+}
+
+
+/*
+ * Returns whether the decimal `digits` * 10^`exponent` read back as
+ * `value`.
+ */
+static int reads_back(const char *digits, size_t count, int exponent,
+                      double value) {
+    char text[DTOA_SHORTEST_MAX];
+    memcpy(text, digits, count);
+    snprintf(text + count, sizeof(text) - count, "e%d", exponent);
+
+    double read = strtod(text, NULL);
+    return !memcmp(&read, &value, sizeof(value));
+}
+
+
+/*
+ * Writes the shortest digits of the positive `value` to `buffer` with
+ * exact arithmetic, for the values Grisu3 rejects: the digits rounded
+ * correctly by printf to 1, 2, ... 17 significant digits are read back
+ * until they give the value. For a power of two, the interval below the
+ * value is half the one above, so the digits just above the rounded
+ * ones are tried as well.
+ *
+ * Returns:
+ *   The number of digits, with `exponent` set so that the value is
+ *   digits * 10^exponent.
+ */
+static size_t exact_shortest(char *buffer, int *exponent, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int power_of_two = (bits & (HIDDEN_BIT - 1)) == 0;
+
+    char text[DTOA_SHORTEST_MAX];
+    size_t count = 0;
+    for (int precision = 1; precision <= 17; precision++) {
+        /* `text` is `d.ddde+x`: its digits become `dddd`. */
+        snprintf(text, sizeof(text), "%.*e", precision - 1, value);
+        count = (size_t)precision;
+        buffer[0] = text[0];
+        memcpy(buffer + 1, text + 2, count - 1);
+        *exponent = atoi(strchr(text, 'e') + 1) - (precision - 1);
+        if (reads_back(buffer, count, *exponent, value)) {
+            break;
+        }
+
+        if (power_of_two) {
+            char above[20];
+            memcpy(above, buffer, count);
+            size_t i = count;
+            while (i > 0 && above[i - 1] == '9') {
+                above[--i] = '0';
+            }
+            int above_exponent = *exponent;
+            if (i > 0) {
+                above[i - 1]++;
+            } else {
+                /* 99..9 becomes 10..0: one more digit of weight. */
+                above[0] = '1';
+                above_exponent++;
+            }
+            if (reads_back(above, count, above_exponent, value)) {
+                memcpy(buffer, above, count);
+                *exponent = above_exponent;
+                break;
+            }
+        }
+    }
+
+    /* A carry may leave trailing zeros. */
+    while (count > 1 && buffer[count - 1] == '0') {
+        count--;
+        (*exponent)++;
+    }
+    return count;
+}
+
+
+/*
+ * Writes the exponent of the exponential notation.
+ */
+static size_t write_exponent(char *out, int exponent) {
+    size_t length = 0;
+    out[length++] = 'e';
+    if (exponent < 0) {
+        out[length++] = '-';
+        exponent = -exponent;
+    } else {
+        out[length++] = '+';
+    }
+
+    if (exponent >= 100) {
+        out[length++] = (char)('0' + exponent / 100);
+        exponent %= 100;
+        out[length++] = (char)('0' + exponent / 10);
+    } else if (exponent >= 10) {
+        out[length++] = (char)('0' + exponent / 10);
+    }
+    out[length++] = (char)('0' + exponent % 10);
+    return length;
+}
+
+
+/*
+ * Compares the exact product of the non-negative `value` and
+ * 10^precision with the midpoint `twice_midpoint` / 2.
+ *
+ * Returns:
+ *   A negative number, zero or a positive number if the product is
+ *   below, at or above the midpoint.
+ */
+static int compare_midpoint(double value, int precision,
+                            uint64_t twice_midpoint) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint64_t f = bits & (HIDDEN_BIT - 1);
+    int e = (int)(bits >> SIGNIFICAND_BITS);
+    if (e) {
+        f |= HIDDEN_BIT;
+        e -= EXPONENT_BIAS;
+    } else {
+        e = 1 - EXPONENT_BIAS;
+    }
+
+    /* 2 * value * 10^precision = f * 5^precision * 2^shift. Both sides
+     * are close, so neither shifted side exceeds 128 bits. */
+    uint128 product = (uint128)f * POWERS_OF_FIVE[precision];
+    uint128 midpoint = twice_midpoint;
+    int shift = e + precision + 1;
+    if (shift >= 0) {
+        product <<= shift;
+    } else {
+        midpoint <<= -shift;
+    }
+    return (product > midpoint) - (product < midpoint);
+}
+
+
+/*
+ * Writes the decimal digits of `n`, padded with zeros to `width`
+ * digits, backwards from `end`.
+ *
+ * Returns:
+ *   The first character written.
+ */
+static char* write_digits_backwards(char *end, uint64_t n, int width) {
+    char *start = end;
+    while (n >= 100) {
+        start -= 2;
+        memcpy(start, DIGIT_PAIRS + 2 * (n % 100), 2);
+        n /= 100;
+    }
+    if (n >= 10) {
+        start -= 2;
+        memcpy(start, DIGIT_PAIRS + 2 * n, 2);
+    } else {
+        *--start = (char)('0' + n);
+    }
+    while (end - start < width) {
+        *--start = '0';
+    }
+    return start;
+}
+
+
+/*
+ * Writes `value` rounded to `precision` fraction digits, without
+ * trailing zeros.
+ *
+ * Parameters:
+ *   out       - Where the characters are written. Must hold
+ *               DTOA_SHORTEST_MAX characters.
+ *   value     - A finite double.
+ *   precision - The number of fraction digits, from 0 to 17.
+ *
+ * Returns:
+ *   The number of characters written, or 0 if the scaled value does
+ *   not fit in 53 bits, in which case nothing is written.
+ */
+size_t dtoa_fixed(char *out, double value, int precision) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int negative = (int)(bits >> 63);
+    bits &= ~(UINT64_C(1) << 63);
+    memcpy(&value, &bits, sizeof(value));
+
+    double scaled = value * POWERS_OF_TEN[precision];
+    if (!(scaled < FIXED_LIMIT)) {
+        return 0;
+    }
+
+    /* The integral part and the fraction of the scaled value are exact,
+     * so only a rounded product that is exactly a midpoint can be on
+     * the wrong side of it. */
+    uint64_t n = (uint64_t)scaled;
+    double excess = scaled - (double)n - 0.5;
+    if (excess > 0) {
+        n++;
+    } else if (!(excess < 0)) {
+        int side = compare_midpoint(value, precision, 2 * n + 1);
+        if (side > 0 || (side == 0 && (n & 1))) {
+            n++;
+        }
+    }
+
+    char buffer[DTOA_SHORTEST_MAX];
+    char *end = buffer + sizeof(buffer);
+    char *start = end;
+    uint64_t unit = INTEGER_POWERS_OF_TEN[precision];
+    uint64_t fraction = n % unit;
+    if (fraction) {
+        int width = precision;
+        while (fraction % 10 == 0) {
+            fraction /= 10;
+            width--;
+        }
+        start = write_digits_backwards(end, fraction, width);
+        *--start = '.';
+    }
+    start = write_digits_backwards(start, n / unit, 1);
+    if (negative && n) {
+        *--start = '-';
+    }
+
+    size_t length = (size_t)(end - start);
+    memcpy(out, start, length);
+    return length;
+}
+
+
+/*
+ * Writes the shortest decimal representation of `value`.
+ *
+ * Parameters:
+ *   out   - Where the characters are written. Must hold
+ *           DTOA_SHORTEST_MAX characters.
+ *   value - A finite double.
+ *
+ * Returns:
+ *   The number of characters written.
+ */
+size_t dtoa_shortest(char *out, double value) {
+    size_t length = 0;
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    if (bits >> 63) {
+        out[length++] = '-';
+        bits &= ~(UINT64_C(1) << 63);
+        memcpy(&value, &bits, sizeof(value));
+    }
+
+    if (bits == 0) {
+        out[length++] = '0';
+        return length;
+    }
+
+    char digits[20];
+    int exponent;
+    size_t count = grisu3(digits, &exponent, value);
+    if (!count) {
+        count = exact_shortest(digits, &exponent, value);
+    }
+
+    /* The value is 0.digits * 10^point. */
+    int point = (int)count + exponent;
+
+    if ((int)count <= point && point <= DECIMAL_MAX_EXPONENT) {
+        /* Integer: digits followed by zeros. */
+        memcpy(out + length, digits, count);
+        length += count;
+        memset(out + length, '0', (size_t)point - count);
+        length += (size_t)point - count;
+    } else if (0 < point && point <= DECIMAL_MAX_EXPONENT) {
+        /* Decimal point inside the digits. */
+        memcpy(out + length, digits, (size_t)point);
+        length += (size_t)point;
+        out[length++] = '.';
+        memcpy(out + length, digits + point, count - (size_t)point);
+        length += count - (size_t)point;
+    } else if (DECIMAL_MIN_EXPONENT < point && point <= 0) {
+        /* Leading zeros after the decimal point. */
+        out[length++] = '0';
+        out[length++] = '.';
+        memset(out + length, '0', (size_t)-point);
+        length += (size_t)-point;
+        memcpy(out + length, digits, count);
+        length += count;
+    } else {
+        /* Exponential notation. */
+        out[length++] = digits[0];
+        if (count > 1) {
+            out[length++] = '.';
+            memcpy(out + length, digits + 1, count - 1);
+            length += count - 1;
+        }
+        length += write_exponent(out + length, point - 1);
+    }
+    return length;
+}
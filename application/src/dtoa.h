@@ -0,0 +1,43 @@
+/*
+ * dtoa.h
+ *
+ * Interface for the dtoa module, which formats doubles with the
+ * shortest decimal representation that reads back as the same value,
+ * or rounded to a number of fraction digits.
+ */
+#include <stddef.h>
+
+#ifndef INCLUDED_DTOA_H
+#define INCLUDED_DTOA_H
+
+/*
+ * Largest number of characters written by `dtoa_shortest`.
+ */
+#define DTOA_SHORTEST_MAX 32
+
+
+/*
+ * Writes the shortest decimal representation of the finite `value`
+ * that reads back as the same double, in the notation of JavaScript's
+ * Number.prototype.toString (`12.5`, `0.001`, `1e+21`, `-1.5e-7`), to
+ * `out`, which must hold DTOA_SHORTEST_MAX characters. No terminator
+ * is written.
+ * Returns the number of characters written.
+ */
+size_t dtoa_shortest(char *out, double value);
+
+
+/*
+ * Writes the finite `value` rounded half to even to `precision`
+ * fraction digits, from 0 to 17, without trailing zeros (`12.5` rather
+ * than `12.500000`, `-0.0001` as `0` with 2 digits), to `out`, which
+ * must hold DTOA_SHORTEST_MAX characters. No terminator is written.
+ * Returns the number of characters written, or 0 if the value is too
+ * large to be rounded exactly (10^precision times it reaches 2^53),
+ * in which case the caller must format it otherwise.
+ */
+size_t dtoa_fixed(char *out, double value, int precision);
+
+#endif  /* INCLUDED_DTOA_H */
+
+// EOF
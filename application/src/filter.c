@@ -0,0 +1,465 @@
+/*
+ * filter.c
+ *
+ * This module selects the features intersecting a query, so that a
+ * region can be extracted from a large input without formatting and
+ * writing the features outside of it. The parser tests every geometry
+ * once its coordinates are in the buffer (see `coordinates.h`), before
+ * it is simplified or handed to the writer.
+ *
+ * A feature is first compared with the extent of the query: most
+ * features of a selective query are rejected by these four
+ * comparisons, after one pass over their vertices. When the query is a
+ * box, a feature whose extent lies inside it is kept without further
+ * tests. Otherwise two geometries intersect when an edge of one
+ * crosses or touches an edge of the other, or, when no edges meet, when
+ * one holds the first vertex of a ring of the other: that ring is then
+ * entirely inside it. Edges are compared in O(n m) time, skipping the edges
+ * outside the extent of the other geometry.
+ *
+ * The query geometries are parsed with the grammar of the input (see
+ * `parser.y`) into an IR (see `ir.h`), whose rings are tested in place.
+ */
+
+#include "filter.h"
+
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "context.h"
+#include "parser.tab.h"
+
+
+/*
+ * Geometry tested by the filter: rings of the interleaved coordinates
+ * `xy` ending at the vertex offsets `ring_ends`, the first one starting
+ * at vertex `start`, as handed to the writer.
+ */
+typedef struct filter_shape {
+    wkt_geometry_type type;
+    const double *xy;
+    size_t start;
+    const size_t *ring_ends;
+    size_t rings;
+    bounding_box extent;
+} filter_shape;
+
+
+/*
+ * Computes the extent of a shape.
+ */
+static void shape_bound(filter_shape *shape) {
+    size_t end = shape->rings ? shape->ring_ends[shape->rings - 1]
+                              : shape->start;
+    bounding_box_reset(&shape->extent);
+    bounding_box_extend(&shape->extent, shape->xy + 2 * shape->start,
+                        end - shape->start);
+}
+
+
+/*
+ * Returns 1 if two bounding boxes share a point, 0 otherwise.
+ */
+static int boxes_overlap(const bounding_box *a, const bounding_box *b) {
+    return a->min.x <= b->max.x && b->min.x <= a->max.x
+           && a->min.y <= b->max.y && b->min.y <= a->max.y;
+}
+
+
+/*
+ * Returns 1 if box `inner` lies inside box `outer`, 0 otherwise.
+ */
+static int box_contains(const bounding_box *outer,
+                        const bounding_box *inner) {
+    return outer->min.x <= inner->min.x && inner->max.x <= outer->max.x
+           && outer->min.y <= inner->min.y && inner->max.y <= outer->max.y;
+}
+
+
+/*
+ * Returns the sign of the cross product of `b - a` and `c - a`: 1 if
+ * `c` is on the left of the line from `a` to `b`, -1 if it is on its
+ * right, and 0 if the three points are aligned.
+ */
+static int orientation(const double *a, const double *b, const double *c) {
+    double cross = (b[0] - a[0]) * (c[1] - a[1])
+                   - (b[1] - a[1]) * (c[0] - a[0]);
+    return (cross > 0) - (cross < 0);
+}
+
+
+/*
+ * Returns 1 if `p`, aligned with the segment from `a` to `b`, lies
+ * within its extent, 0 otherwise.
+ */
+static int within_segment(const double *p, const double *a, const double *b) {
+    return (a[0] < b[0] ? a[0] : b[0]) <= p[0]
+           && p[0] <= (a[0] < b[0] ? b[0] : a[0])
+           && (a[1] < b[1] ? a[1] : b[1]) <= p[1]
+           && p[1] <= (a[1] < b[1] ? b[1] : a[1]);
+}
+
+
+/*
+ * Returns 1 if `p` lies on the segment from `a` to `b`, 0 otherwise.
+ */
+static int on_segment(const double *p, const double *a, const double *b) {
+    return !orientation(a, b, p) && within_segment(p, a, b);
+}
+
+
+/*
+ * Returns 1 if the segments from `a` to `b` and from `c` to `d` share a
+ * point, 0 otherwise.
+ */
+static int segments_intersect(const double *a, const double *b,
+                              const double *c, const double *d) {
+    int abc = orientation(a, b, c);
+    int abd = orientation(a, b, d);
+    int cda = orientation(c, d, a);
+    int cdb = orientation(c, d, b);
+
+    if (abc * abd < 0 && cda * cdb < 0) {
+        return 1;
+    }
+    return (!abc && within_segment(c, a, b))
+           || (!abd && within_segment(d, a, b))
+           || (!cda && within_segment(a, c, d))
+           || (!cdb && within_segment(b, c, d));
+}
+
+
+/*
+ * Returns 1 if the segment from `a` to `b` shares a point with an edge
+ * of `shape`, 0 otherwise.
+ */
+static int segment_meets_shape(const double *a, const double *b,
+                               const filter_shape *shape) {
+    bounding_box segment;
+    bounding_box_reset(&segment);
+    bounding_box_extend(&segment, a, 1);
+    bounding_box_extend(&segment, b, 1);
+    if (!boxes_overlap(&segment, &shape->extent)) {
+        return 0;
+    }
+
+    size_t start = shape->start;
+    for (size_t r = 0; r < shape->rings; r++) {
+        const double *xy = shape->xy;
+        for (size_t i = start + 1; i < shape->ring_ends[r]; i++) {
+            if (segments_intersect(a, b, xy + 2 * (i - 1), xy + 2 * i)) {
+                return 1;
+            }
+        }
+        start = shape->ring_ends[r];
+    }
+    return 0;
+}
+
+
+/*
+ * Returns 1 if an edge of `a` shares a point with an edge of `b`, 0
+ * otherwise.
+ */
+static int edges_meet(const filter_shape *a, const filter_shape *b) {
+    size_t start = a->start;
+    for (size_t r = 0; r < a->rings; r++) {
+        const double *xy = a->xy;
+        for (size_t i = start + 1; i < a->ring_ends[r]; i++) {
+            if (segment_meets_shape(xy + 2 * (i - 1), xy + 2 * i, b)) {
+                return 1;
+            }
+        }
+        start = a->ring_ends[r];
+    }
+    return 0;
+}
+
+
+/*
+ * Returns 1 if `p` lies in `shape`, boundary included, 0 otherwise.
+ * A point lies in a Polygon when a ray from it crosses its rings an
+ * odd number of times, so holes are excluded.
+ */
+static int shape_holds(const filter_shape *shape, const double *p) {
+    if (p[0] < shape->extent.min.x || p[0] > shape->extent.max.x
+            || p[1] < shape->extent.min.y || p[1] > shape->extent.max.y) {
+        return 0;
+    }
+    if (shape->type == WKT_POINT) {
+        return 1;
+    }
+
+    int inside = 0;
+    size_t start = shape->start;
+    for (size_t r = 0; r < shape->rings; r++) {
+        const double *xy = shape->xy;
+        for (size_t i = start + 1; i < shape->ring_ends[r]; i++) {
+            const double *a = xy + 2 * (i - 1);
+            const double *b = xy + 2 * i;
+            if (on_segment(p, a, b)) {
+                return 1;
+            }
+            if ((a[1] > p[1]) != (b[1] > p[1])
+                    && p[0] < a[0] + (p[1] - a[1]) * (b[0] - a[0])
+                                     / (b[1] - a[1])) {
+                inside = !inside;
+            }
+        }
+        start = shape->ring_ends[r];
+    }
+    return shape->type == WKT_POLYGON && inside;
+}
+
+
+/*
+ * Returns 1 if `shape` holds the first vertex of a ring of `rings`, 0
+ * otherwise.
+ */
+static int holds_a_ring(const filter_shape *shape, const filter_shape *rings) {
+    size_t start = rings->start;
+    for (size_t r = 0; r < rings->rings; r++) {
+        if (start < rings->ring_ends[r]
+                && shape_holds(shape, rings->xy + 2 * start)) {
+            return 1;
+        }
+        start = rings->ring_ends[r];
+    }
+    return 0;
+}
+
+
+/*
+ * Returns 1 if two shapes, whose extents overlap, share a point, 0
+ * otherwise. When no edges meet, every ring lies either inside or
+ * outside of the other shape, so testing one vertex of every ring is
+ * enough, even for rings that cross themselves or holes outside of
+ * their shell.
+ */
+static int shapes_intersect(const filter_shape *a, const filter_shape *b) {
+    if (a->type != WKT_POINT && b->type != WKT_POINT && edges_meet(a, b)) {
+        return 1;
+    }
+    return holds_a_ring(b, a) || holds_a_ring(a, b);
+}
+
+
+/*
+ * Tests a geometry against a filter.
+ *
+ * Parameters:
+ *   filter    - The filter, or NULL to keep every geometry.
+ *   type      - The type of the geometry.
+ *   xy        - The interleaved coordinates of the geometry.
+ *   ring_ends - The vertex offsets at which its rings end.
+ *   rings     - The number of rings, the first one starting at vertex 0.
+ *
+ * Returns:
+ *   1 if the geometry is kept, 0 otherwise.
+ */
+static int filter_match(const spatial_filter *filter, wkt_geometry_type type,
+                        const double *xy, const size_t *ring_ends,
+                        size_t rings) {
+    if (!filter) {
+        return 1;
+    }
+
+    filter_shape shape = {
+        .type = type, .xy = xy, .ring_ends = ring_ends, .rings = rings
+    };
+    shape_bound(&shape);
+    if (bounding_box_empty(&shape.extent)
+            || !boxes_overlap(&shape.extent, &filter->envelope)) {
+        return 0;
+    }
+
+    if (filter->rectangle) {
+        static const size_t ring_end = 5;
+        filter_shape box = {
+            .type = WKT_POLYGON, .xy = filter->corners,
+            .ring_ends = &ring_end, .rings = 1, .extent = filter->envelope
+        };
+        return box_contains(&filter->envelope, &shape.extent)
+               || shapes_intersect(&shape, &box);
+    }
+
+    const wkt_ir *query = &filter->query;
+    for (size_t g = 0; g < query->geometry_count; g++) {
+        size_t ring = query->part_offsets[g];
+        filter_shape other = {
+            .type = (wkt_geometry_type)query->types[g], .xy = query->xy,
+            .start = query->ring_offsets[ring],
+            .ring_ends = query->ring_offsets + ring + 1,
+            .rings = query->part_offsets[g + 1] - ring,
+            .extent = filter->extents[g]
+        };
+        if (boxes_overlap(&shape.extent, &other.extent)
+                && shapes_intersect(&shape, &other)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * Initializes a filter keeping the features that intersect a box.
+ *
+ * Parameters:
+ *   filter - The filter to initialize.
+ *   text   - The box, as "minx,miny,maxx,maxy".
+ *
+ * Returns:
+ *   0 on success, or -1 if the box is invalid.
+ */
+int spatial_filter_init_bbox(spatial_filter *filter, const char *text) {
+    double values[4];
+    const char *p = text;
+    for (int i = 0; i < 4; i++) {
+        char *end;
+        values[i] = strtod(p, &end);
+        if (end == p || *end != (i < 3 ? ',' : '\0')
+                || !(values[i] >= -DBL_MAX && values[i] <= DBL_MAX)) {
+            return -1;
+        }
+        p = end + 1;
+    }
+    if (values[0] > values[2] || values[1] > values[3]) {
+        return -1;
+    }
+
+    memset(filter, 0, sizeof(spatial_filter));
+    filter->envelope.min.x = values[0];
+    filter->envelope.min.y = values[1];
+    filter->envelope.max.x = values[2];
+    filter->envelope.max.y = values[3];
+    filter->rectangle = 1;
+
+    /* Counter-clockwise from the lower left corner. */
+    static const int corners[10] = { 0, 1, 2, 1, 2, 3, 0, 3, 0, 1 };
+    for (int i = 0; i < 10; i++) {
+        filter->corners[i] = values[corners[i]];
+    }
+    return 0;
+}
+
+
+/*
+ * Initializes a filter keeping the features that intersect geometries
+ * given in WKT.
+ *
+ * Parameters:
+ *   filter - The filter to initialize.
+ *   wkt    - The query geometries, as WKT text.
+ *   error  - Where the error message is stored.
+ *
+ * Returns:
+ *   0 on success, or -1 if an error occurs.
+ */
+int spatial_filter_init_wkt(spatial_filter *filter, const char *wkt,
+                            const char **error) {
+    memset(filter, 0, sizeof(spatial_filter));
+    bounding_box_reset(&filter->envelope);
+    if (wkt_ir_init(&filter->query) < 0) {
+        *error = "out of memory";
+        return -1;
+    }
+
+    const char *message = "out of memory";
+    wkt2geojson_ctx *ctx = wkt2geojson_ctx_new_memory(wkt, strlen(wkt));
+    int status = 1;
+    if (ctx) {
+        ctx->ir = &filter->query;
+        ctx->defer_errors = 1;
+        status = transpile_features(ctx);
+        if (status) {
+            message = ctx->error ? ctx->error : "syntax error";
+        }
+        wkt2geojson_ctx_free(ctx);
+    }
+
+    size_t count = filter->query.geometry_count;
+    if (!status && !count) {
+        message = "no query geometry";
+        status = 1;
+    }
+    if (!status) {
+        filter->extents = malloc(count * sizeof(bounding_box));
+        status = !filter->extents;
+    }
+    if (status) {
+        *error = message;
+        spatial_filter_release(filter);
+        return -1;
+    }
+
+    const wkt_ir *query = &filter->query;
+    for (size_t g = 0; g < count; g++) {
+        size_t first = query->ring_offsets[query->part_offsets[g]];
+        size_t last = query->ring_offsets[query->part_offsets[g + 1]];
+        bounding_box_reset(&filter->extents[g]);
+        bounding_box_extend(&filter->extents[g], query->xy + 2 * first,
+                            last - first);
+        bounding_box_merge(&filter->envelope, &filter->extents[g]);
+    }
+    return 0;
+}
+
+
+/*
+ * Releases the query geometries of a filter.
+ *
+ * Parameters:
+ *   filter - The filter, or NULL.
+ */
+void spatial_filter_release(spatial_filter *filter) {
+    if (!filter) {
+        return;
+    }
+    wkt_ir_release(&filter->query);
+    free(filter->extents);
+    filter->extents = NULL;
+}
+
+
+/*
+ * Tests a point against a filter.
+ *
+ * Parameters:
+ *   filter     - The filter, or NULL to keep every point.
+ *   coordinate - The vertex of the point.
+ *
+ * Returns:
+ *   1 if the point is kept, 0 otherwise.
+ */
+int spatial_filter_match_point(const spatial_filter *filter,
+                               vertex coordinate) {
+    static const size_t ring_end = 1;
+    double xy[2] = { coordinate.x, coordinate.y };
+    return filter_match(filter, WKT_POINT, xy, &ring_end, 1);
+}
+
+
+/*
+ * Tests a LineString or Polygon against a filter.
+ *
+ * Parameters:
+ *   filter      - The filter, or NULL to keep every geometry.
+ *   type        - WKT_LINESTRING or WKT_POLYGON.
+ *   coordinates - The vertices of the geometry, split into rings for a
+ *                 Polygon.
+ *
+ * Returns:
+ *   1 if the geometry is kept, 0 otherwise.
+ */
+int spatial_filter_match_buffer(const spatial_filter *filter,
+                                wkt_geometry_type type,
+                                const coordinate_buffer *coordinates) {
+    size_t ring_end = coordinate_buffer_length(coordinates);
+    if (type == WKT_POLYGON) {
+        return filter_match(filter, type, coordinates->values,
+                            coordinates->rings, coordinates->ring_count);
+    }
+    return filter_match(filter, type, coordinates->values, &ring_end, 1);
+}
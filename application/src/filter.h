@@ -0,0 +1,74 @@
+/*
+ * filter.h
+ *
+ * Interface for the filter module, used to keep only the features
+ * intersecting a query box or geometry, tested right after their
+ * coordinates are parsed so that the other features are never
+ * formatted.
+ */
+#include <stddef.h>
+
+#include "coordinates.h"
+#include "ir.h"
+
+#ifndef INCLUDED_FILTER_H
+#define INCLUDED_FILTER_H
+
+/*
+ * Spatial query of a conversion: a feature is kept when it intersects
+ * one of the query geometries, boundaries included. Features whose
+ * bounding box does not overlap `envelope` are rejected without
+ * further tests.
+ */
+typedef struct spatial_filter {
+    bounding_box envelope;     /* extent of every query geometry */
+    int rectangle;             /* whether the query is `envelope` itself */
+    double corners[10];        /* closed ring of `envelope` */
+    wkt_ir query;              /* query geometries, unless `rectangle` */
+    bounding_box *extents;     /* extent of every query geometry */
+} spatial_filter;
+
+
+/*
+ * Initializes `filter` to the box given as "minx,miny,maxx,maxy".
+ * Returns 0 on success or -1 if the box is invalid.
+ */
+int spatial_filter_init_bbox(spatial_filter *filter, const char *text);
+
+
+/*
+ * Initializes `filter` to the Points, LineStrings and Polygons of the
+ * WKT text `wkt`. Nothing is printed.
+ * Returns 0 on success or -1 in case of error, with `*error` set to a
+ * message.
+ */
+int spatial_filter_init_wkt(spatial_filter *filter, const char *wkt,
+                            const char **error);
+
+
+/*
+ * Releases the query geometries of `filter`. Accepts NULL.
+ */
+void spatial_filter_release(spatial_filter *filter);
+
+
+/*
+ * Returns 1 if the point `coordinate` is kept by `filter`, or by no
+ * filter when it is NULL, 0 otherwise.
+ */
+int spatial_filter_match_point(const spatial_filter *filter,
+                               vertex coordinate);
+
+
+/*
+ * Returns 1 if the LineString or Polygon of the coordinate buffer
+ * filled by the parser is kept by `filter`, or by no filter when it is
+ * NULL, 0 otherwise.
+ */
+int spatial_filter_match_buffer(const spatial_filter *filter,
+                                wkt_geometry_type type,
+                                const coordinate_buffer *coordinates);
+
+#endif  /* INCLUDED_FILTER_H */
+
+// EOF
@@ -0,0 +1,183 @@
+/*
+ * input.c
+ *
+ * This module maps WKT input files in memory. A mapped file is read by
+ * the SIMD tokenizer in place, and copied into the buffer of the Flex
+ * scanner without going through stdio, which saves a read(2) call and
+ * a copy per chunk of input.
+ *
+ * The mapping is laid over an anonymous reservation one page larger
+ * than the file, so that the file is always followed by zero bytes:
+ * the tokenizer can then load whole blocks past the end of the input,
+ * as it does with the padding of its own buffer.
+ *
+ * Only regular files are mapped; pipes and terminals are streamed as
+ * before. The file must not be truncated while it is being converted.
+ *
+ * The same files can hold WKB instead of WKT (see `wkb.h`), as named
+ * by `input_format_from_name`.
+ */
+
+#include "input.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/*
+ * Looks up the input format called `name`.
+ *
+ * Parameters:
+ *   name   - The name of the format, as given on the command line.
+ *   format - Where the format is stored.
+ *
+ * Returns:
+ *   0 on success, or -1 if the name is unknown.
+ */
+int input_format_from_name(const char *name, input_format *format) {
+    static const struct {
+        const char *name;
+        input_format format;
+    } names[] = {
+        { "wkt", INPUT_WKT },
+        { "wkb", INPUT_WKB },
+        { "hexwkb", INPUT_HEX_WKB }
+    };
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (!strcmp(name, names[i].name)) {
+            *format = names[i].format;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
+/*
+ * Maps an input file in memory.
+ *
+ * Parameters:
+ *   in_file    - The WKT input stream, at its beginning.
+ *   huge_pages - Non-zero to advise transparent huge pages for the
+ *                mapping. The advice is ignored where unsupported.
+ *
+ * Returns:
+ *   A dynamically allocated mapped input, or NULL if the file is not a
+ *   non-empty regular file or an error occurs.
+ */
+mapped_input* mapped_input_open(FILE *in_file, int huge_pages) {
+    int fd = fileno(in_file);
+    struct stat status;
+    if (fd < 0 || fstat(fd, &status) < 0 || !S_ISREG(status.st_mode)
+            || status.st_size <= 0) {
+        return NULL;
+    }
+
+    long page = sysconf(_SC_PAGESIZE);
+    if (page <= 0) {
+        return NULL;
+    }
+
+    size_t length = (size_t)status.st_size;
+    size_t mapped = (length / (size_t)page + 2) * (size_t)page;
+
+    /* The zero pages of the reservation stay after the end of the file
+     * once the file is mapped over its beginning. */
+    char *data = mmap(NULL, mapped, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS,
+                      -1, 0);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+    if (mmap(data, length, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0)
+            == MAP_FAILED) {
+        munmap(data, mapped);
+        return NULL;
+    }
+
+    madvise(data, length, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    if (huge_pages) {
+        madvise(data, length, MADV_HUGEPAGE);
+    }
+#endif
+
+    mapped_input *input = malloc(sizeof(mapped_input));
+    if (!input) {
+        munmap(data, mapped);
+        return NULL;
+    }
+
+    input->data = data;
+    input->length = length;
+    input->position = 0;
+    input->mapped = mapped;
+    return input;
+}
+
+
+/*
+ * Creates a view of a part of a mapped input, such as the chunk of the
+ * file converted by one thread.
+ *
+ * Parameters:
+ *   data   - The first byte of the view.
+ *   length - The length of the view.
+ *
+ * Returns:
+ *   A dynamically allocated view, or NULL if an error occurs.
+ */
+mapped_input* mapped_input_view(const char *data, size_t length) {
+    mapped_input *input = malloc(sizeof(mapped_input));
+    if (!input) {
+        return NULL;
+    }
+
+    input->data = data;
+    input->length = length;
+    input->position = 0;
+    input->mapped = 0;
+    return input;
+}
+
+
+/*
+ * Unmaps the input and releases it.
+ *
+ * Parameters:
+ *   input - The mapped input or view. May be NULL.
+ */
+void mapped_input_close(mapped_input *input) {
+    if (!input) {
+        return;
+    }
+    if (input->mapped) {
+        munmap((void *)input->data, input->mapped);
+    }
+    free(input);
+}
+
+
+/*
+ * Copies the next bytes of the input, for the Flex scanner.
+ *
+ * Parameters:
+ *   input  - The mapped input.
+ *   buffer - The destination buffer.
+ *   size   - The size of the destination buffer.
+ *
+ * Returns:
+ *   The number of bytes copied, 0 at the end of the input.
+ */
+size_t mapped_input_read(mapped_input *input, char *buffer, size_t size) {
+    size_t remaining = input->length - input->position;
+    if (size > remaining) {
+        size = remaining;
+    }
+    memcpy(buffer, input->data + input->position, size);
+    input->position += size;
+    return size;
+}
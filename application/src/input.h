@@ -0,0 +1,77 @@
+/*
+ * input.h
+ *
+ * Interface for the input module, used to map WKT input files in
+ * memory so that they can be tokenized without read(2) calls.
+ */
+#include <stdio.h>
+
+#ifndef INCLUDED_INPUT_H
+#define INCLUDED_INPUT_H
+
+/*
+ * Encodings of the input records.
+ */
+typedef enum input_format {
+    INPUT_WKT,           /* Well-Known Text, parsed by the grammar */
+    INPUT_WKB,           /* Well-Known Binary geometries, back to back */
+    INPUT_HEX_WKB        /* one hex-encoded (E)WKB geometry per line */
+} input_format;
+
+
+/*
+ * Input file mapped in memory, or view of a part of such a file.
+ * The `length` bytes of a file at `data` are followed by at least one
+ * page of zero bytes, as required by `tokenizer_new_mapped`; a view
+ * is followed by the rest of the file. `position` is the offset of the
+ * next byte handed to the Flex scanner by `mapped_input_read`.
+ */
+typedef struct mapped_input {
+    const char *data;    /* first byte of the file */
+    size_t length;       /* length of the file */
+    size_t position;     /* next byte read by `mapped_input_read` */
+    size_t mapped;       /* length of the mapping, or 0 for a view */
+} mapped_input;
+
+
+/*
+ * Looks up the input format called `name`: "wkt", "wkb" or "hexwkb".
+ * Returns 0 on success or -1 if the name is unknown.
+ */
+int input_format_from_name(const char *name, input_format *format);
+
+
+/*
+ * Maps `in_file` in memory if it is a non-empty regular file, advising
+ * the kernel of a sequential access and, when `huge_pages` is set, of
+ * a preference for transparent huge pages.
+ * Returns NULL if the file cannot be mapped (pipes, terminals, empty
+ * files) or in case of error, in which case it must be streamed.
+ */
+mapped_input* mapped_input_open(FILE *in_file, int huge_pages);
+
+
+/*
+ * Creates a view of the `length` bytes at `data`, which belong to a
+ * mapped input and must outlive the view.
+ * Returns NULL in case of error.
+ */
+mapped_input* mapped_input_view(const char *data, size_t length);
+
+
+/*
+ * Unmaps the input, unless it is a view, and releases it. Accepts NULL.
+ */
+void mapped_input_close(mapped_input *input);
+
+
+/*
+ * Copies up to `size` of the next bytes of the input to `buffer`, as
+ * fread does.
+ * Returns the number of bytes copied, 0 at the end of the input.
+ */
+size_t mapped_input_read(mapped_input *input, char *buffer, size_t size);
+
+#endif  /* INCLUDED_INPUT_H */
+
+// EOF
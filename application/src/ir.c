@@ -0,0 +1,226 @@
+/*
+ * ir.c
+ *
+ * This module stores parsed geometries in a columnar intermediate
+ * representation: one array of coordinates for all of the vertices,
+ * and offset arrays delimiting rings and geometries, in the layout of
+ * columnar formats such as Arrow. Services that only need coordinates
+ * can read them from the IR (`wkt_parse_to_ir`, or `wkt2geojson_parse`
+ * in the library) without producing and re-parsing GeoJSON, and the
+ * writer serializes geometries from the same arrays.
+ *
+ * Every array grows geometrically, so appending a geometry is done in
+ * amortized linear time in its number of vertices, and clearing the IR
+ * keeps its storage for the next batch of geometries.
+ */
+
+#include "ir.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Initial capacity, in vertices, of an IR. */
+#define IR_INITIAL_VERTICES 256
+
+/* Initial capacity, in rings and in geometries, of an IR. */
+#define IR_INITIAL_RINGS 16
+
+
+/*
+ * Returns the capacity to grow `capacity` to so that it holds
+ * `required` elements, doubling it as many times as needed, or
+ * `capacity` itself if it is large enough.
+ */
+static size_t grown_capacity(size_t capacity, size_t required,
+                             size_t initial) {
+    if (required <= capacity) {
+        return capacity;
+    }
+    capacity = capacity ? capacity : initial;
+    while (capacity < required) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+
+/*
+ * Ensures the IR can take a geometry of `rings` rings and `vertices`
+ * vertices. The offset arrays keep room for their final entry.
+ *
+ * Returns:
+ *   0 on success, or -1 if the memory could not be allocated.
+ */
+static int reserve_geometry(wkt_ir *ir, size_t rings, size_t vertices) {
+    size_t capacity = grown_capacity(ir->vertex_capacity,
+                                     ir->vertex_count + vertices,
+                                     IR_INITIAL_VERTICES);
+    if (capacity > ir->vertex_capacity) {
+        double *xy = realloc(ir->xy, 2 * capacity * sizeof(double));
+        if (!xy) {
+            return -1;
+        }
+        ir->xy = xy;
+        ir->vertex_capacity = capacity;
+    }
+
+    capacity = grown_capacity(ir->ring_capacity, ir->ring_count + rings + 1,
+                              IR_INITIAL_RINGS);
+    if (capacity > ir->ring_capacity) {
+        size_t *offsets = realloc(ir->ring_offsets, capacity * sizeof(size_t));
+        if (!offsets) {
+            return -1;
+        }
+        ir->ring_offsets = offsets;
+        ir->ring_capacity = capacity;
+    }
+
+    capacity = grown_capacity(ir->geometry_capacity, ir->geometry_count + 2,
+                              IR_INITIAL_RINGS);
+    if (capacity > ir->geometry_capacity) {
+        size_t *offsets = realloc(ir->part_offsets, capacity * sizeof(size_t));
+        if (!offsets) {
+            return -1;
+        }
+        ir->part_offsets = offsets;
+
+        unsigned char *types = realloc(ir->types, capacity);
+        if (!types) {
+            return -1;
+        }
+        ir->types = types;
+        ir->geometry_capacity = capacity;
+    }
+    return 0;
+}
+
+
+/*
+ * Appends the coordinates of a geometry to the IR, whose room has been
+ * reserved.
+ *
+ * Parameters:
+ *   ir        - The IR.
+ *   type      - The type of the geometry.
+ *   xy        - The interleaved coordinates of the vertices.
+ *   ring_ends - The end offset, in vertices, of every ring.
+ *   rings     - The number of rings.
+ */
+static void append_geometry(wkt_ir *ir, wkt_geometry_type type,
+                            const double *xy, const size_t *ring_ends,
+                            size_t rings) {
+    size_t vertices = rings ? ring_ends[rings - 1] : 0;
+
+    memcpy(ir->xy + 2 * ir->vertex_count, xy, 2 * vertices * sizeof(double));
+    for (size_t r = 0; r < rings; r++) {
+        ir->ring_offsets[ir->ring_count + r + 1] = ir->vertex_count
+                                                   + ring_ends[r];
+    }
+
+    ir->vertex_count += vertices;
+    ir->ring_count += rings;
+    ir->types[ir->geometry_count] = (unsigned char)type;
+    ir->part_offsets[++ir->geometry_count] = ir->ring_count;
+}
+
+
+/*
+ * Initializes an empty IR.
+ *
+ * Parameters:
+ *   ir - The IR to initialize.
+ *
+ * Returns:
+ *   0 on success, or -1 if the memory could not be allocated.
+ */
+int wkt_ir_init(wkt_ir *ir) {
+    memset(ir, 0, sizeof(wkt_ir));
+    if (reserve_geometry(ir, 0, 0) < 0) {
+        wkt_ir_release(ir);
+        return -1;
+    }
+    ir->ring_offsets[0] = 0;
+    ir->part_offsets[0] = 0;
+    return 0;
+}
+
+
+/*
+ * Removes every geometry from the IR, keeping its storage.
+ *
+ * Parameters:
+ *   ir - The IR to clear.
+ */
+void wkt_ir_clear(wkt_ir *ir) {
+    ir->vertex_count = 0;
+    ir->ring_count = 0;
+    ir->geometry_count = 0;
+}
+
+
+/*
+ * Releases the storage of the IR, which is left empty.
+ *
+ * Parameters:
+ *   ir - The IR to release.
+ */
+void wkt_ir_release(wkt_ir *ir) {
+    free(ir->xy);
+    free(ir->ring_offsets);
+    free(ir->part_offsets);
+    free(ir->types);
+    memset(ir, 0, sizeof(wkt_ir));
+}
+
+
+/*
+ * Appends a Point geometry.
+ *
+ * Parameters:
+ *   ir         - The IR.
+ *   coordinate - The vertex of the point.
+ *
+ * Returns:
+ *   0 on success, or -1 if the memory could not be allocated.
+ */
+int wkt_ir_append_point(wkt_ir *ir, vertex coordinate) {
+    static const size_t ring_end = 1;
+    double xy[2] = { coordinate.x, coordinate.y };
+
+    if (reserve_geometry(ir, 1, 1) < 0) {
+        return -1;
+    }
+    append_geometry(ir, WKT_POINT, xy, &ring_end, 1);
+    return 0;
+}
+
+
+/*
+ * Appends a LineString or Polygon geometry.
+ *
+ * Parameters:
+ *   ir          - The IR.
+ *   type        - WKT_LINESTRING or WKT_POLYGON.
+ *   coordinates - The vertices of the geometry, with the rings of a
+ *                 Polygon closed.
+ *
+ * Returns:
+ *   0 on success, or -1 if the memory could not be allocated.
+ */
+int wkt_ir_append_buffer(wkt_ir *ir, wkt_geometry_type type,
+                         const coordinate_buffer *coordinates) {
+    size_t vertices = coordinate_buffer_length(coordinates);
+    const size_t *ring_ends = &vertices;
+    size_t rings = 1;
+
+    if (type == WKT_POLYGON) {
+        ring_ends = coordinates->rings;
+        rings = coordinates->ring_count;
+    }
+
+    if (reserve_geometry(ir, rings, vertices) < 0) {
+        return -1;
+    }
+    append_geometry(ir, type, coordinates->values, ring_ends, rings);
+    return 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * ir.h
+ *
+ * Interface for the IR module, a columnar in-memory representation of
+ * parsed WKT geometries that can be used instead of GeoJSON text.
+ */
+#include <stddef.h>
+
+#include "coordinates.h"
+
+#ifndef INCLUDED_IR_H
+#define INCLUDED_IR_H
+
+/*
+ * Types of the geometries of an IR.
+ */
+typedef enum wkt_geometry_type {
+    WKT_POINT,           /* one ring of a single vertex */
+    WKT_LINESTRING,      /* one ring holding the vertices of the line */
+    WKT_POLYGON          /* the exterior ring, then the holes */
+} wkt_geometry_type;
+
+
+/*
+ * Geometries stored as a struct of arrays.
+ * The vertices of every geometry are stored back to back as
+ * interleaved x/y pairs in `xy`. Geometry `g` has type `types[g]` and
+ * is made of the rings `part_offsets[g]` to `part_offsets[g + 1]`
+ * (excluded); ring `r` is made of the vertices `ring_offsets[r]` to
+ * `ring_offsets[r + 1]` (excluded). Both offset arrays thus hold one
+ * more entry than there are rings or geometries, the first one being
+ * 0, so that they can be handed as they are to columnar formats.
+ */
+typedef struct wkt_ir {
+    double *xy;                /* x/y of every vertex, interleaved */
+    size_t vertex_count;       /* number of vertices */
+    size_t *ring_offsets;      /* first vertex of every ring, then the end */
+    size_t ring_count;         /* number of rings */
+    size_t *part_offsets;      /* first ring of every geometry, then the end */
+    unsigned char *types;      /* wkt_geometry_type of every geometry */
+    size_t geometry_count;     /* number of geometries */
+    size_t vertex_capacity;    /* room in `xy`, in vertices */
+    size_t ring_capacity;      /* room in `ring_offsets`, in rings */
+    size_t geometry_capacity;  /* room in `part_offsets` and `types` */
+} wkt_ir;
+
+
+/*
+ * Initializes an empty IR.
+ * Returns 0 on success or -1 in case of error.
+ */
+int wkt_ir_init(wkt_ir *ir);
+
+
+/*
+ * Removes every geometry from the IR, keeping its storage.
+ */
+void wkt_ir_clear(wkt_ir *ir);
+
+
+/*
+ * Releases the storage of the IR.
+ */
+void wkt_ir_release(wkt_ir *ir);
+
+
+/*
+ * Appends a Point geometry made of `coordinate`.
+ * Returns 0 on success or -1 in case of error.
+ */
+int wkt_ir_append_point(wkt_ir *ir, vertex coordinate);
+
+
+/*
+ * Appends a LineString or Polygon geometry from the coordinate buffer
+ * filled by the parser. The rings of a Polygon are the rings closed in
+ * the buffer; a LineString is a single ring of every vertex.
+ * Returns 0 on success or -1 in case of error.
+ */
+int wkt_ir_append_buffer(wkt_ir *ir, wkt_geometry_type type,
+                         const coordinate_buffer *coordinates);
+
+#endif  /* INCLUDED_IR_H */
+
+// EOF
@@ -0,0 +1,446 @@
+/*
+ * libwkt2geojson.c
+ *
+ * This module implements the public interface of the library
+ * (`libwkt2geojson.h`) on top of the transpile contexts: the input
+ * buffer is read through a memory view, as a mapped file is, and the
+ * output sink hands its buffer to the caller's function whenever it is
+ * flushed, so a conversion costs a function call instead of a process.
+ *
+ * `wkt2geojson_parse` fills the columnar IR (`ir.h`) instead, which is
+ * handed to the caller behind an opaque type and read with accessors,
+ * so that the layout of the internal one can change.
+ *
+ * Errors are deferred on the context instead of being printed, and
+ * returned to the caller.
+ */
+
+#include "libwkt2geojson.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "context.h"
+#include "parallel.h"
+#include "parser.tab.h"
+#include "rtree.h"
+
+_Static_assert(WKT2GEOJSON_SHORTEST == WRITER_SHORTEST,
+               "the public and internal shortest precisions differ");
+_Static_assert(WKT2GEOJSON_POINT == WKT_POINT
+               && WKT2GEOJSON_LINESTRING == WKT_LINESTRING
+               && WKT2GEOJSON_POLYGON == WKT_POLYGON,
+               "the public and internal geometry types differ");
+
+/*
+ * IR of the public interface, wrapping the internal one.
+ */
+struct wkt2geojson_ir {
+    wkt_ir ir;           /* the geometries */
+};
+
+
+/*
+ * Initializes conversion options with their defaults.
+ *
+ * Parameters:
+ *   options - The options to initialize.
+ */
+void wkt2geojson_options_init(wkt2geojson_options *options) {
+    options->precision = WKT2GEOJSON_SHORTEST;
+    options->tokenizer = NULL;
+    options->jobs = 1;
+    options->format = NULL;
+    options->input_format = NULL;
+    options->simplify = 0;
+    options->simplify_method = NULL;
+    options->bbox = NULL;
+    options->filter_bbox = NULL;
+    options->intersects_wkt = NULL;
+}
+
+
+/*
+ * Checks the options of a conversion and looks up their engine, input
+ * format, output format, simplification and bounding boxes.
+ *
+ * Returns:
+ *   NULL if the options are valid, or an error message.
+ */
+static const char* check_options(const wkt2geojson_options *options,
+                                 tokenizer_engine *engine,
+                                 input_format *in_format,
+                                 writer_format *format,
+                                 simplify_options *simplify,
+                                 writer_bbox *bbox) {
+    *engine = TOKENIZER_FLEX;
+    *in_format = INPUT_WKT;
+    *format = WRITER_FEATURE_COLLECTION;
+    simplify->tolerance = options->simplify;
+    simplify->method = SIMPLIFY_DOUGLAS_PEUCKER;
+    *bbox = WRITER_BBOX_NONE;
+    if (options->tokenizer
+            && tokenizer_engine_from_name(options->tokenizer, engine) < 0) {
+        return "unknown tokenizer engine";
+    }
+    if (!tokenizer_engine_supported(*engine)) {
+        return "tokenizer engine not supported by this CPU";
+    }
+    if (options->precision != WKT2GEOJSON_SHORTEST
+            && (options->precision < 0
+                || options->precision > WRITER_MAX_PRECISION)) {
+        return "invalid precision";
+    }
+    if (options->jobs < 0 || options->jobs > PARALLEL_MAX_JOBS) {
+        return "invalid number of threads";
+    }
+    if (options->format
+            && writer_format_from_name(options->format, format) < 0) {
+        return "unknown output format";
+    }
+    if (options->input_format
+            && input_format_from_name(options->input_format, in_format) < 0) {
+        return "unknown input format";
+    }
+    if (!(options->simplify >= 0 && options->simplify <= DBL_MAX)) {
+        return "invalid simplification tolerance";
+    }
+    if (options->simplify_method
+            && simplify_method_from_name(options->simplify_method,
+                                         &simplify->method) < 0) {
+        return "unknown simplification method";
+    }
+    if (options->bbox && writer_bbox_from_name(options->bbox, bbox) < 0) {
+        return "unknown bounding boxes";
+    }
+    return NULL;
+}
+
+
+/*
+ * Initializes the spatial filter selected by the options, if any.
+ *
+ * Returns:
+ *   The filter, or NULL if the options select none or in case of
+ *   error, in which case `*message` is set.
+ */
+static const spatial_filter* init_filter(const wkt2geojson_options *options,
+                                         spatial_filter *filter,
+                                         const char **message) {
+    if (options->filter_bbox && options->intersects_wkt) {
+        *message = "bbox and WKT filters cannot be combined";
+        return NULL;
+    }
+    if (options->filter_bbox) {
+        if (spatial_filter_init_bbox(filter, options->filter_bbox) < 0) {
+            *message = "invalid bbox filter";
+            return NULL;
+        }
+        return filter;
+    }
+    if (options->intersects_wkt) {
+        if (spatial_filter_init_wkt(filter, options->intersects_wkt,
+                                    message) < 0) {
+            return NULL;
+        }
+        return filter;
+    }
+    return NULL;
+}
+
+
+/*
+ * Conversion of a buffer set up from the options of the library.
+ */
+typedef struct conversion {
+    wkt2geojson_ctx *ctx;        /* context reading the input */
+    spatial_filter filter;       /* storage of the spatial filter */
+    const spatial_filter *query; /* the spatial filter, or NULL */
+    char *padded;                /* padded copy of the input, or NULL */
+    writer_format format;        /* output format */
+    writer_bbox bbox;            /* bounding boxes written */
+} conversion;
+
+
+/*
+ * Sets up the context reading a buffer with the options of the
+ * library. The output of the context is left to the caller.
+ *
+ * Parameters:
+ *   conv    - The conversion to set up.
+ *   wkt     - The WKT input.
+ *   length  - The length of the input.
+ *   options - The conversion options, or NULL for the defaults.
+ *
+ * Returns:
+ *   NULL on success, or an error message, in which case the conversion
+ *   holds nothing to release.
+ */
+static const char* open_conversion(conversion *conv, const char *wkt,
+                                   size_t length,
+                                   const wkt2geojson_options *options) {
+    wkt2geojson_options defaults;
+    if (!options) {
+        wkt2geojson_options_init(&defaults);
+        options = &defaults;
+    }
+
+    tokenizer_engine engine;
+    input_format in_format;
+    simplify_options simplify;
+    const char *message = check_options(options, &engine, &in_format,
+                                        &conv->format, &simplify,
+                                        &conv->bbox);
+    conv->query = message ? NULL
+        : init_filter(options, &conv->filter, &message);
+    if (message) {
+        return message;
+    }
+
+    /* The SIMD tokenizer scans its input in place, and needs padding
+     * that the caller's buffer does not have. */
+    conv->padded = NULL;
+    if (engine != TOKENIZER_FLEX) {
+        conv->padded = malloc(length + TOKENIZER_PADDING);
+        if (!conv->padded) {
+            spatial_filter_release(conv->query ? &conv->filter : NULL);
+            return "out of memory";
+        }
+        memcpy(conv->padded, wkt, length);
+        memset(conv->padded + length, 0, TOKENIZER_PADDING);
+    }
+
+    conv->ctx = wkt2geojson_ctx_new_memory(conv->padded ? conv->padded : wkt,
+                                           length);
+    if (!conv->ctx || wkt2geojson_ctx_use_tokenizer(conv->ctx, engine) < 0) {
+        wkt2geojson_ctx_free(conv->ctx);
+        spatial_filter_release(conv->query ? &conv->filter : NULL);
+        free(conv->padded);
+        return "out of memory";
+    }
+
+    conv->ctx->format = in_format;
+    conv->ctx->precision = options->precision;
+    conv->ctx->simplify = simplify;
+    conv->ctx->filter = conv->query;
+    conv->ctx->jobs = options->jobs;
+    conv->ctx->defer_errors = 1;
+    return NULL;
+}
+
+
+/*
+ * Releases a conversion set up by `open_conversion`.
+ *
+ * Parameters:
+ *   conv - The conversion.
+ */
+static void close_conversion(conversion *conv) {
+    wkt2geojson_ctx_free(conv->ctx);
+    spatial_filter_release(conv->query ? &conv->filter : NULL);
+    free(conv->padded);
+}
+
+
+/*
+ * Converts a buffer of WKT into GeoJSON handed to a function.
+ *
+ * Parameters:
+ *   wkt       - The WKT input.
+ *   length    - The length of the input.
+ *   options   - The conversion options, or NULL for the defaults.
+ *   sink      - The function receiving the output.
+ *   user_data - The first argument of `sink`.
+ *   error     - Where to store the error message, or NULL.
+ *
+ * Returns:
+ *   0 on success, or -1 if an error occurs.
+ */
+int wkt2geojson_convert(const char *wkt, size_t length,
+                        const wkt2geojson_options *options,
+                        wkt2geojson_sink sink, void *user_data,
+                        const char **error) {
+    conversion conv;
+    const char *message = open_conversion(&conv, wkt, length, options);
+    if (message) {
+        if (error) {
+            *error = message;
+        }
+        return -1;
+    }
+
+    output_sink_set_callback(&conv.ctx->sink, sink, user_data);
+    output_sink_set_format(&conv.ctx->sink, conv.format);
+    output_sink_set_bbox(&conv.ctx->sink, conv.bbox);
+    int status = transpile_ctx(conv.ctx);
+    if (status && error) {
+        *error = conv.ctx->error ? conv.ctx->error : "conversion failed";
+    }
+    close_conversion(&conv);
+    return status ? -1 : 0;
+}
+
+
+/*
+ * Parses a buffer of WKT into an IR.
+ *
+ * Parameters:
+ *   wkt     - The WKT input.
+ *   length  - The length of the input.
+ *   options - The conversion options, or NULL for the defaults.
+ *   error   - Where to store the error message, or NULL.
+ *
+ * Returns:
+ *   The IR, or NULL if an error occurs.
+ */
+wkt2geojson_ir* wkt2geojson_parse(const char *wkt, size_t length,
+                                  const wkt2geojson_options *options,
+                                  const char **error) {
+    wkt2geojson_ir *ir = malloc(sizeof(wkt2geojson_ir));
+    if (!ir || wkt_ir_init(&ir->ir) < 0) {
+        free(ir);
+        if (error) {
+            *error = "out of memory";
+        }
+        return NULL;
+    }
+
+    conversion conv;
+    const char *message = open_conversion(&conv, wkt, length, options);
+    if (!message) {
+        conv.ctx->ir = &ir->ir;
+        if (transpile_features(conv.ctx)) {
+            message = conv.ctx->error ? conv.ctx->error : "conversion failed";
+        }
+        close_conversion(&conv);
+    }
+
+    if (message) {
+        if (error) {
+            *error = message;
+        }
+        wkt2geojson_ir_free(ir);
+        return NULL;
+    }
+    return ir;
+}
+
+
+/*
+ * Returns the number of geometries of an IR.
+ */
+size_t wkt2geojson_ir_geometry_count(const wkt2geojson_ir *ir) {
+    return ir->ir.geometry_count;
+}
+
+
+/*
+ * Returns the type of every geometry of an IR.
+ */
+const unsigned char* wkt2geojson_ir_types(const wkt2geojson_ir *ir) {
+    return ir->ir.types;
+}
+
+
+/*
+ * Returns the first ring of every geometry of an IR, then the end.
+ */
+const size_t* wkt2geojson_ir_part_offsets(const wkt2geojson_ir *ir) {
+    return ir->ir.part_offsets;
+}
+
+
+/*
+ * Returns the number of rings of an IR.
+ */
+size_t wkt2geojson_ir_ring_count(const wkt2geojson_ir *ir) {
+    return ir->ir.ring_count;
+}
+
+
+/*
+ * Returns the first vertex of every ring of an IR, then the end.
+ */
+const size_t* wkt2geojson_ir_ring_offsets(const wkt2geojson_ir *ir) {
+    return ir->ir.ring_offsets;
+}
+
+
+/*
+ * Returns the number of vertices of an IR.
+ */
+size_t wkt2geojson_ir_vertex_count(const wkt2geojson_ir *ir) {
+    return ir->ir.vertex_count;
+}
+
+
+/*
+ * Returns the interleaved coordinates of the vertices of an IR.
+ */
+const double* wkt2geojson_ir_xy(const wkt2geojson_ir *ir) {
+    return ir->ir.xy;
+}
+
+
+/*
+ * Releases an IR.
+ *
+ * Parameters:
+ *   ir - The IR, or NULL.
+ */
+void wkt2geojson_ir_free(wkt2geojson_ir *ir) {
+    if (ir) {
+        wkt_ir_release(&ir->ir);
+        free(ir);
+    }
+}
+
+
+/*
+ * Reads the features of an indexed GeoJSON file intersecting a box.
+ *
+ * Parameters:
+ *   index_path   - The path of the index of the file.
+ *   geojson_path - The path of the GeoJSON file.
+ *   bbox         - The query box: min x, min y, max x and max y.
+ *   sink         - The function receiving the features.
+ *   user_data    - The first argument of `sink`.
+ *   error        - Where to store the error message, or NULL.
+ *
+ * Returns:
+ *   0 on success, or -1 if an error occurs.
+ */
+int wkt2geojson_query_index(const char *index_path, const char *geojson_path,
+                            const double bbox[4], wkt2geojson_sink sink,
+                            void *user_data, const char **error) {
+    const char *message = NULL;
+    bounding_box query = {
+        { bbox[0], bbox[1] }, { bbox[2], bbox[3] }
+    };
+    if (!(query.min.x <= query.max.x && query.min.y <= query.max.y)) {
+        message = "invalid bbox";
+    }
+
+    rtree_index tree;
+    if (!message && rtree_open(&tree, index_path, &message) == 0) {
+        int fd = open(geojson_path, O_RDONLY | O_CLOEXEC);
+        int status = fd < 0 ? errno
+                            : rtree_query(&tree, fd, &query, sink, user_data);
+        if (status) {
+            message = rtree_error_message(status);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        rtree_close(&tree);
+    }
+
+    if (message && error) {
+        *error = message;
+    }
+    return message ? -1 : 0;
+}
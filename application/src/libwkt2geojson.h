@@ -0,0 +1,197 @@
+/*
+ * libwkt2geojson.h
+ *
+ * Public interface of the wkt2geojson library, used to convert WKT to
+ * GeoJSON from within a program instead of running the command-line
+ * tool. This header is installed with `libwkt2geojson.a` and
+ * `libwkt2geojson.so` and does not depend on the other headers of the
+ * project.
+ */
+#include <stddef.h>
+
+#ifndef INCLUDED_LIBWKT2GEOJSON_H
+#define INCLUDED_LIBWKT2GEOJSON_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Marks the functions exported by the library, which hides every
+ * other symbol.
+ */
+#if defined(__GNUC__)
+#define WKT2GEOJSON_API __attribute__((visibility("default")))
+#else
+#define WKT2GEOJSON_API
+#endif
+
+/*
+ * Precision selecting the shortest representation of every coordinate
+ * that reads back as the same double.
+ */
+#define WKT2GEOJSON_SHORTEST (-1)
+
+
+/*
+ * Function receiving the GeoJSON output, in pieces of any size and in
+ * order. Returns 0 to continue the conversion, or a positive errno
+ * value to stop it.
+ */
+typedef int (*wkt2geojson_sink)(void *user_data, const char *data,
+                                size_t length);
+
+
+/*
+ * Options of a conversion, to be initialized with
+ * `wkt2geojson_options_init`.
+ */
+typedef struct wkt2geojson_options {
+    int precision;          /* fraction digits, or WKT2GEOJSON_SHORTEST */
+    const char *tokenizer;  /* "flex", "simd", "avx2", "sse4.2", "scalar" */
+    int jobs;               /* number of threads converting the input */
+    const char *format;     /* "geojson", "geojsonseq" or "ndjson" */
+    const char *input_format; /* "wkt", "wkb" or "hexwkb" */
+    double simplify;        /* simplification tolerance, or 0 */
+    const char *simplify_method; /* "dp" or "vw" */
+    const char *bbox;       /* "features", "all", or NULL for none */
+    const char *filter_bbox; /* "minx,miny,maxx,maxy" to keep, or NULL */
+    const char *intersects_wkt; /* WKT of the geometries to keep, or NULL */
+} wkt2geojson_options;
+
+
+/*
+ * Initializes `options` with the defaults of the command-line tool:
+ * WKT input, shortest coordinates, the Flex scanner, a single thread,
+ * no simplification and a FeatureCollection of every feature, without
+ * bounding boxes.
+ */
+WKT2GEOJSON_API void wkt2geojson_options_init(wkt2geojson_options *options);
+
+
+/*
+ * Converts the `length` bytes of WKT (or WKB, as selected by the
+ * options) at `wkt` into a GeoJSON
+ * FeatureCollection, or a sequence of features, handed to `sink` with
+ * `user_data`, as the command-line tool does. `options` may be NULL for the defaults.
+ * Nothing is printed: in case of error, the output ends after the
+ * features converted so far, and `*error` (when `error` is not NULL)
+ * is set to a message that stays valid until the next conversion of
+ * the calling thread.
+ * Returns 0 on success or -1 in case of error.
+ */
+WKT2GEOJSON_API int wkt2geojson_convert(const char *wkt, size_t length,
+                                        const wkt2geojson_options *options,
+                                        wkt2geojson_sink sink,
+                                        void *user_data, const char **error);
+
+
+/*
+ * Geometries parsed into columnar arrays, read with the
+ * `wkt2geojson_ir_*` functions instead of GeoJSON text.
+ */
+typedef struct wkt2geojson_ir wkt2geojson_ir;
+
+/*
+ * Types of the geometries of an IR.
+ */
+#define WKT2GEOJSON_POINT 0       /* one ring of a single vertex */
+#define WKT2GEOJSON_LINESTRING 1  /* one ring of the vertices of the line */
+#define WKT2GEOJSON_POLYGON 2     /* the exterior ring, then the holes */
+
+
+/*
+ * Parses the `length` bytes of WKT (or WKB) at `wkt` into an IR, with
+ * the tokenizer, input format, simplification and spatial filter of
+ * `options`, which may be NULL for the defaults; the other options are
+ * ignored and the input is parsed on a single thread.
+ * Returns the IR, to be freed with `wkt2geojson_ir_free`, or NULL in
+ * case of error, with `*error` (when `error` is not NULL) set as by
+ * `wkt2geojson_convert`.
+ */
+WKT2GEOJSON_API wkt2geojson_ir* wkt2geojson_parse(
+    const char *wkt, size_t length, const wkt2geojson_options *options,
+    const char **error);
+
+
+/*
+ * Returns the number of geometries of the IR.
+ */
+WKT2GEOJSON_API size_t wkt2geojson_ir_geometry_count(
+    const wkt2geojson_ir *ir);
+
+
+/*
+ * Returns the WKT2GEOJSON_* type of every geometry of the IR.
+ */
+WKT2GEOJSON_API const unsigned char* wkt2geojson_ir_types(
+    const wkt2geojson_ir *ir);
+
+
+/*
+ * Returns the first ring of every geometry of the IR, followed by the
+ * number of rings: geometry `g` is made of the rings `offsets[g]` to
+ * `offsets[g + 1]` (excluded).
+ */
+WKT2GEOJSON_API const size_t* wkt2geojson_ir_part_offsets(
+    const wkt2geojson_ir *ir);
+
+
+/*
+ * Returns the number of rings of the IR.
+ */
+WKT2GEOJSON_API size_t wkt2geojson_ir_ring_count(const wkt2geojson_ir *ir);
+
+
+/*
+ * Returns the first vertex of every ring of the IR, followed by the
+ * number of vertices: ring `r` is made of the vertices `offsets[r]` to
+ * `offsets[r + 1]` (excluded).
+ */
+WKT2GEOJSON_API const size_t* wkt2geojson_ir_ring_offsets(
+    const wkt2geojson_ir *ir);
+
+
+/*
+ * Returns the number of vertices of the IR.
+ */
+WKT2GEOJSON_API size_t wkt2geojson_ir_vertex_count(
+    const wkt2geojson_ir *ir);
+
+
+/*
+ * Returns the x/y coordinates of every vertex of the IR, interleaved.
+ */
+WKT2GEOJSON_API const double* wkt2geojson_ir_xy(const wkt2geojson_ir *ir);
+
+
+/*
+ * Releases an IR returned by `wkt2geojson_parse`. Accepts NULL.
+ */
+WKT2GEOJSON_API void wkt2geojson_ir_free(wkt2geojson_ir *ir);
+
+
+/*
+ * Hands to `sink`, with `user_data`, the features of the GeoJSON file
+ * at `geojson_path` whose bbox intersects `bbox` (min x, min y, max x,
+ * max y; boundaries included), looked up in the index written with
+ * the file by `wkt2geojson --index` at `index_path`. Only the matching
+ * features are read. Every feature is handed as a single piece, its
+ * JSON object without separators, in the order of the file.
+ * Returns 0 on success or -1 in case of error, with `*error` (when
+ * `error` is not NULL) set to a static message.
+ */
+WKT2GEOJSON_API int wkt2geojson_query_index(const char *index_path,
+                                            const char *geojson_path,
+                                            const double bbox[4],
+                                            wkt2geojson_sink sink,
+                                            void *user_data,
+                                            const char **error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* INCLUDED_LIBWKT2GEOJSON_H */
+
+// EOF
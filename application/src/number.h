@@ -0,0 +1,23 @@
+/*
+ * number.h
+ *
+ * Interface for the number module, a locale-independent parser for the
+ * NUMBER tokens recognized by the scanner and the SIMD tokenizer.
+ */
+#include <stddef.h>
+
+#ifndef INCLUDED_NUMBER_H
+#define INCLUDED_NUMBER_H
+
+/*
+ * Converts the `length` bytes at `text` into the nearest double.
+ * The text must match the NUMBER token:
+ *   -?[0-9]+(\.[0-9]+)?([eE][-+]?[0-9]+)?
+ * It does not need to be NUL-terminated, and the result does not depend
+ * on the current locale.
+ */
+double parse_number(const char *text, size_t length);
+
+#endif  /* INCLUDED_NUMBER_H */
+
+// EOF
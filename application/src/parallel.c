@@ -0,0 +1,468 @@
+/*
+ * parallel.c
+ *
+ * This module converts a single memory-mapped input on several
+ * threads. WKT records are independent, and the geometry keywords
+ * (`POINT`, `LINESTRING`, `POLYGON`) can only appear at the start of a
+ * record: the input is therefore cut into byte ranges that start with
+ * a keyword, and every range is converted by a context of its own into
+ * an in-memory sink.
+ *
+ * The ranges, or chunks, are much smaller than a thread's share of a
+ * large input. The threads take the next chunk of the input one after
+ * the other, while the calling thread appends the sinks of the chunks
+ * to the sink of the conversion in input order, as soon as they are
+ * converted. A chunk is only taken when fewer than PARALLEL_CHUNKS_AHEAD
+ * chunks per thread are converted or being converted ahead of the
+ * output, so the memory of a conversion is bounded by that of a few
+ * chunks, however large its input. Every chunk but the first one is
+ * marked as `continued`, so that its first feature carries the comma
+ * that separates it from the features of the previous chunk.
+ *
+ * Errors are deferred in the chunks. Since a single-threaded conversion
+ * stops at the first error, the output stops after the features of the
+ * first chunk that fails, and only its error is reported; the output
+ * is thus the same with any number of threads. No chunk is taken past
+ * a failure.
+ *
+ * When rejects are recorded, every chunk skips its bad records and
+ * keeps them in a log of its own, with positions relative to the
+ * chunk. The calling thread adds them to the log of the conversion in
+ * input order, counting the lines before every chunk only then. A
+ * chunk that overflows the tolerated number of rejects has its output
+ * cut at the record that overflowed it, as a single thread would.
+ *
+ * When the features are sorted, every chunk hands its features to an
+ * in-memory sorter of its own instead of its sink, and the calling
+ * thread adds them to the sorter of the conversion in input order, so
+ * that ties keep the order of a single thread. The chunks are then
+ * made small enough for those ahead of the output to fit in the memory
+ * of the sort, as much as PARALLEL_MIN_CHUNK allows, so that the sort
+ * spills as it would on a single thread rather than holding the
+ * features of the chunks in memory beyond its budget. Likewise, every chunk
+ * indexes its features with offsets in its own sink, moved to their
+ * offset in the output when the sink is merged.
+ *
+ * With statistics, every chunk times its own phases, and the calling
+ * thread adds them to the statistics of the conversion once the chunk
+ * is merged; its own wait is not counted.
+ *
+ * A keyword found in the raw bytes is always a token of its own: the
+ * other keywords do not contain `P` or `L` past their first letter,
+ * and numbers do not contain letters other than exponents.
+ */
+
+#include "parallel.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parser.tab.h"
+
+
+/*
+ * A range of the input and the context converting it.
+ */
+typedef struct chunk {
+    wkt2geojson_ctx *ctx;    /* context converting the range, or NULL */
+    int converted;           /* whether the conversion is over */
+    int status;              /* result of `transpile_features` */
+    wkt2geojson_stats stats; /* statistics of the chunk, if recorded */
+    reject_log rejects;      /* records rejected by the chunk */
+    size_t start;            /* offset of the range in the input */
+    size_t end;              /* offset past the range in the input */
+    feature_sorter *sorter;  /* sorter of the features, if sorted */
+    feature_index index;     /* index of the features, if indexed */
+} chunk;
+
+/*
+ * Chunks of an input converted by a pool of threads and merged in
+ * input order by the calling thread. Chunk `n` is kept in slot
+ * `n % window` from the time a thread takes it until it is merged.
+ */
+typedef struct pipeline {
+    wkt2geojson_ctx *ctx;    /* context of the conversion */
+    int continued;           /* whether features precede the input */
+    size_t size;             /* bytes of input of a chunk, at least */
+    size_t first;            /* offset of the first keyword of the input */
+    chunk *slots;            /* chunks taken and not merged yet */
+    size_t window;           /* number of slots */
+    size_t next;             /* number of the next chunk to take */
+    size_t next_start;       /* offset of the next chunk to take */
+    size_t merged;           /* number of chunks merged */
+    int stop;                /* whether the conversion failed */
+    pthread_mutex_t lock;    /* guards the fields above and the slots */
+    pthread_cond_t converted; /* signalled when a chunk is converted */
+    pthread_cond_t room;     /* signalled when a chunk is merged */
+} pipeline;
+
+
+/* Bytes a chunk takes in a sorter per byte of its WKT, at most about:
+ * the GeoJSON of a short point is several times as long as its WKT,
+ * and every feature is stored with its box. */
+#define SORT_EXPANSION 8
+
+
+/* Keywords starting a WKT record. */
+static const char *const keywords[] = { "POINT", "LINESTRING", "POLYGON" };
+
+
+/*
+ * Returns the offset of the first keyword of `data` at or after `from`,
+ * or `length` if there is none.
+ */
+static size_t find_record(const char *data, size_t length, size_t from) {
+    for (size_t i = from; i < length; i++) {
+        if (data[i] != 'P' && data[i] != 'L') {
+            continue;
+        }
+        for (size_t k = 0; k < sizeof(keywords) / sizeof(keywords[0]); k++) {
+            size_t size = strlen(keywords[k]);
+            if (length - i >= size && !memcmp(data + i, keywords[k], size)) {
+                return i;
+            }
+        }
+    }
+    return length;
+}
+
+
+/*
+ * Returns the offset past the chunk of the input of `p` starting at
+ * `start`: the first keyword past the size of a chunk. Every chunk
+ * holds at least one geometry keyword, which the grammar needs: the
+ * first one also holds whatever comes before the first keyword of the
+ * input.
+ */
+static size_t chunk_end(const pipeline *p, size_t start) {
+    size_t target = start + p->size;
+    size_t from = (start ? start : p->first) + 1;
+    return find_record(p->ctx->mapped->data, p->ctx->mapped->length,
+                       target > from ? target : from);
+}
+
+
+/*
+ * Creates the context converting a chunk, configured like the context
+ * of the conversion.
+ *
+ * Parameters:
+ *   p      - The pipeline.
+ *   c      - The chunk, with its range set.
+ *   number - The rank of the chunk in the input.
+ *
+ * Returns:
+ *   0 on success, or -1 if the memory could not be allocated, in which
+ *   case the chunk has no context.
+ */
+static int open_chunk(const pipeline *p, chunk *c, size_t number) {
+    const wkt2geojson_ctx *ctx = p->ctx;
+    c->ctx = wkt2geojson_ctx_new_memory(ctx->mapped->data + c->start,
+                                        c->end - c->start);
+    if (ctx->sink.sorter) {
+        c->sorter = feature_sorter_new(0, NULL);
+    }
+    if (!c->ctx || wkt2geojson_ctx_use_tokenizer(c->ctx, ctx->engine) < 0
+            || (ctx->sink.sorter && !c->sorter)) {
+        wkt2geojson_ctx_free(c->ctx);
+        c->ctx = NULL;
+        return -1;
+    }
+
+    if (ctx->stats) {
+        stats_init(&c->stats, STATS_IDLE);
+        wkt2geojson_ctx_set_stats(c->ctx, &c->stats);
+    }
+    if (ctx->rejects) {
+        reject_log_init(&c->rejects, NULL, ctx->rejects->max_errors);
+        wkt2geojson_ctx_set_rejects(c->ctx, &c->rejects);
+    }
+    c->ctx->precision = ctx->precision;
+    c->ctx->simplify = ctx->simplify;
+    c->ctx->filter = ctx->filter;
+    output_sink_set_format(&c->ctx->sink, ctx->sink.format);
+    output_sink_set_bbox(&c->ctx->sink, ctx->sink.bbox);
+    output_sink_set_sorter(&c->ctx->sink, c->sorter);
+    if (ctx->sink.index) {
+        output_sink_set_index(&c->ctx->sink, &c->index);
+    }
+    c->ctx->continued = number > 0 || p->continued;
+    c->ctx->defer_errors = 1;
+    return 0;
+}
+
+
+/*
+ * Releases the context and the results of a chunk, and empties its
+ * slot.
+ */
+static void close_chunk(chunk *c) {
+    wkt2geojson_ctx_free(c->ctx);
+    feature_sorter_free(c->sorter);
+    feature_index_release(&c->index);
+    reject_log_release(&c->rejects);
+    memset(c, 0, sizeof(chunk));
+}
+
+
+/*
+ * Thread body taking the chunks of the input one after the other, as
+ * long as the calling thread keeps up with them, and converting them.
+ */
+static void* convert_chunks(void *arg) {
+    pipeline *p = arg;
+    size_t length = p->ctx->mapped->length;
+
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        while (!p->stop && p->next_start < length
+                && p->next >= p->merged + p->window) {
+            pthread_cond_wait(&p->room, &p->lock);
+        }
+        if (p->stop || p->next_start >= length) {
+            break;
+        }
+
+        size_t number = p->next++;
+        chunk *c = &p->slots[number % p->window];
+        c->start = p->next_start;
+        c->end = chunk_end(p, c->start);
+        p->next_start = c->end;
+        pthread_mutex_unlock(&p->lock);
+
+        if (!open_chunk(p, c, number)) {
+            c->status = transpile_features(c->ctx);
+            stats_enter(c->ctx->stats, STATS_IDLE);
+        }
+
+        pthread_mutex_lock(&p->lock);
+        c->converted = 1;
+        pthread_cond_broadcast(&p->converted);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+
+/*
+ * Advances `position` to `offset`, counting the line feeds of `data`
+ * in between.
+ */
+static void advance_position(const char *data, input_position *position,
+                             size_t offset) {
+    const char *p = data + position->offset;
+    const char *last = data + offset;
+    while (p < last && (p = memchr(p, '\n', (size_t)(last - p)))) {
+        position->line++;
+        p++;
+    }
+    position->offset = offset;
+}
+
+
+/*
+ * Adds the records rejected by a chunk to the log of the conversion,
+ * in input order.
+ *
+ * Parameters:
+ *   ctx      - The context of the conversion.
+ *   c        - The chunk, converted.
+ *   position - The position the lines of the input were counted to,
+ *              before the chunk.
+ *
+ * Returns:
+ *   The entry the conversion stops at, because the log overflowed or
+ *   could not be written, or NULL.
+ */
+static const reject_entry* merge_rejects(wkt2geojson_ctx *ctx, chunk *c,
+                                         input_position *position) {
+    if (!c->rejects.count) {
+        return NULL;
+    }
+    advance_position(ctx->mapped->data, position, c->start);
+
+    for (size_t i = 0; i < c->rejects.count; i++) {
+        const reject_entry *entry = &c->rejects.entries[i];
+        reject_entry merged = *entry;
+        merged.position.offset += c->start;
+        merged.position.line += position->line - 1;
+        if (reject_log_add(ctx->rejects, &merged) < 0
+                || ctx->rejects->count > ctx->rejects->max_errors) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * Appends the output of a converted chunk to the conversion, with its
+ * features, rejects and error.
+ *
+ * Parameters:
+ *   ctx      - The context of the conversion.
+ *   c        - The chunk.
+ *   number   - The rank of the chunk in the input.
+ *   position - The position the lines of the input were counted to.
+ *
+ * Returns:
+ *   0 on success, or 1 if the conversion stops at the chunk.
+ */
+static int merge_chunk(wkt2geojson_ctx *ctx, chunk *c, size_t number,
+                       input_position *position) {
+    if (!c->ctx) {
+        yyerror(ctx, "out of memory");
+        return 1;
+    }
+
+    const output_sink *sink = &c->ctx->sink;
+    const reject_entry *last = ctx->rejects
+        ? merge_rejects(ctx, c, position) : NULL;
+    size_t length = last ? last->output_length : sink->length;
+    /* Drops the comma leading the first feature of a chunk when the
+     * spatial filter dropped every feature before it. */
+    size_t skip = number > 0 && length && !ctx->count && !ctx->continued
+                      && ctx->sink.format == WRITER_FEATURE_COLLECTION
+                      ? 1 : 0;
+    size_t features = (size_t)(last ? last->count : c->ctx->count);
+    uint64_t base = ctx->sink.offset + ctx->sink.length - skip;
+    int error = c->sorter
+        ? feature_sorter_append(ctx->sink.sorter, c->sorter, features)
+        : 0;
+    if (!error && sink->index
+            && feature_index_append(ctx->sink.index, &c->index,
+                                    features, base) < 0) {
+        error = ENOMEM;
+    }
+
+    if (error) {
+        yyerror(ctx, strerror(error));
+        return 1;
+    }
+    if (output_sink_write(&ctx->sink, sink->data + skip, length - skip) < 0) {
+        yyerror(ctx, strerror(ctx->sink.error));
+        return 1;
+    }
+    if (last) {
+        ctx->count += last->count;
+        yyerror(ctx, ctx->rejects->count > ctx->rejects->max_errors
+                         ? "too many rejected records"
+                         : "cannot record a rejected record");
+        return 1;
+    }
+
+    ctx->count += c->ctx->count;
+    bounding_box_merge(&ctx->sink.extent, &sink->extent);
+    if (c->status) {
+        yyerror(ctx, c->ctx->error ? c->ctx->error : "syntax error");
+        return 1;
+    }
+    return 0;
+}
+
+
+/*
+ * Converts the mapped input of a context on several threads.
+ *
+ * Parameters:
+ *   ctx - The context, with `jobs` threads and before any token is
+ *         read.
+ *
+ * Returns:
+ *   0 on success, or 1 if an error occurs.
+ */
+int transpile_parallel(wkt2geojson_ctx *ctx) {
+    size_t jobs = ctx->jobs > 0 ? (size_t)ctx->jobs : 1;
+    if (ctx->mapped && jobs > ctx->mapped->length / PARALLEL_MIN_CHUNK) {
+        jobs = ctx->mapped->length / PARALLEL_MIN_CHUNK;
+    }
+    if (!ctx->mapped || ctx->ir || jobs < 2) {
+        return transpile_features(ctx);
+    }
+
+    size_t length = ctx->mapped->length;
+    pipeline p = {
+        .ctx = ctx,
+        .continued = ctx->continued || ctx->count,
+        .size = length / jobs < PARALLEL_CHUNK_SIZE ? length / jobs
+                                                    : PARALLEL_CHUNK_SIZE,
+        .first = find_record(ctx->mapped->data, length, 0),
+        .window = jobs * PARALLEL_CHUNKS_AHEAD
+    };
+    size_t memory = ctx->sink.sorter
+        ? feature_sorter_memory(ctx->sink.sorter) : 0;
+    if (memory) {
+        size_t share = memory / (p.window * SORT_EXPANSION);
+        share = share > PARALLEL_MIN_CHUNK ? share : PARALLEL_MIN_CHUNK;
+        p.size = share < p.size ? share : p.size;
+    }
+
+    /* Running out of memory or threads here only costs the
+     * parallelism. */
+    p.slots = calloc(p.window, sizeof(chunk));
+    pthread_t *threads = malloc(jobs * sizeof(pthread_t));
+    size_t started = 0;
+    if (p.slots && threads) {
+        pthread_mutex_init(&p.lock, NULL);
+        pthread_cond_init(&p.converted, NULL);
+        pthread_cond_init(&p.room, NULL);
+        while (started < jobs && !pthread_create(&threads[started], NULL,
+                                                 convert_chunks, &p)) {
+            started++;
+        }
+    }
+    if (!started) {
+        if (p.slots && threads) {
+            pthread_cond_destroy(&p.room);
+            pthread_cond_destroy(&p.converted);
+            pthread_mutex_destroy(&p.lock);
+        }
+        free(threads);
+        free(p.slots);
+        return transpile_features(ctx);
+    }
+
+    int status = 0;
+    input_position position = { 0, 1 };
+    for (size_t number = 0;; number++) {
+        chunk *c = &p.slots[number % p.window];
+        stats_phase previous = stats_enter(ctx->stats, STATS_IDLE);
+        pthread_mutex_lock(&p.lock);
+        while (number < p.next ? !c->converted
+                               : !p.stop && p.next_start < length) {
+            pthread_cond_wait(&p.converted, &p.lock);
+        }
+        int done = number >= p.next;
+        pthread_mutex_unlock(&p.lock);
+        stats_leave(ctx->stats, previous);
+        if (done) {
+            break;
+        }
+
+        if (ctx->stats) {
+            stats_merge(ctx->stats, &c->stats);
+        }
+        if (!status) {
+            status = merge_chunk(ctx, c, number, &position);
+        }
+        close_chunk(c);
+
+        pthread_mutex_lock(&p.lock);
+        p.merged++;
+        p.stop = status;
+        pthread_cond_broadcast(&p.room);
+        pthread_mutex_unlock(&p.lock);
+    }
+
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_cond_destroy(&p.room);
+    pthread_cond_destroy(&p.converted);
+    pthread_mutex_destroy(&p.lock);
+    free(threads);
+    free(p.slots);
+    return status;
+}
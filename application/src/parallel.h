@@ -0,0 +1,52 @@
+/*
+ * parallel.h
+ *
+ * Interface for the parallel module, used to convert a memory-mapped
+ * WKT input on several threads.
+ */
+#include "context.h"
+
+#ifndef INCLUDED_PARALLEL_H
+#define INCLUDED_PARALLEL_H
+
+/*
+ * Smallest chunk of input worth a thread of its own.
+ */
+#ifndef PARALLEL_MIN_CHUNK
+#define PARALLEL_MIN_CHUNK (64 * 1024)
+#endif
+
+/*
+ * Bytes of input of a chunk of a large input, which is cut into many
+ * more chunks than threads. At least PARALLEL_MIN_CHUNK.
+ */
+#ifndef PARALLEL_CHUNK_SIZE
+#define PARALLEL_CHUNK_SIZE (256 * 1024)
+#endif
+
+/*
+ * Number of chunks per thread converted ahead of the output at most.
+ */
+#define PARALLEL_CHUNKS_AHEAD 2
+
+/*
+ * Largest number of threads of a conversion.
+ */
+#define PARALLEL_MAX_JOBS 256
+
+
+/*
+ * Converts the WKT of `ctx` into GeoJSON features appended to its
+ * sink, as `transpile_features` does, on up to `ctx->jobs` threads.
+ * The mapped input is split into chunks that start with a geometry
+ * keyword, of which only a few per thread are held in memory at a
+ * time, and the features of every chunk are written in input order.
+ * Inputs that are not mapped, or too small to be split, and contexts
+ * filling an IR are converted on the calling thread.
+ * Returns 0 on success or 1 in case of error.
+ */
+int transpile_parallel(wkt2geojson_ctx *ctx);
+
+#endif  /* INCLUDED_PARALLEL_H */
+
+// EOF
@@ -55,7 +55,7 @@
 #define YYSKELETON_NAME "yacc.c"
 
 /* Pure parsers.  */
-#define YYPURE 0
+#define YYPURE 2
 
 /* Push parsers.  */
 #define YYPUSH 0
@@ -67,15 +67,15 @@
 
 
 /* First part of user prologue.  */
-#line 30 "parser.y"
+#line 55 "parser.y"
 
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
+#include "parallel.h"
+#include "wkb.h"
 #include "writer.h"
 
-void yyerror(const char *s);
-int yylex(void);
-
 #line 80 "parser.tab.c"
 
 # ifndef YY_CAST
@@ -117,25 +117,40 @@ enum yysymbol_kind_t
   YYSYMBOL_YYACCEPT = 10,                  /* $accept  */
   YYSYMBOL_geometry = 11,                  /* geometry  */
   YYSYMBOL_geometry_list = 12,             /* geometry_list  */
-  YYSYMBOL_point = 13,                     /* point  */
-  YYSYMBOL_linestring = 14,                /* linestring  */
-  YYSYMBOL_polygon = 15,                   /* polygon  */
-  YYSYMBOL_polygon_coordinates = 16,       /* polygon_coordinates  */
-  YYSYMBOL_coordinate = 17,                /* coordinate  */
-  YYSYMBOL_coordinate_list = 18            /* coordinate_list  */
+  YYSYMBOL_feature = 13,                   /* feature  */
+  YYSYMBOL_point = 14,                     /* point  */
+  YYSYMBOL_15_1 = 15,                      /* $@1  */
+  YYSYMBOL_linestring = 16,                /* linestring  */
+  YYSYMBOL_17_2 = 17,                      /* $@2  */
+  YYSYMBOL_polygon = 18,                   /* polygon  */
+  YYSYMBOL_19_3 = 19,                      /* $@3  */
+  YYSYMBOL_polygon_coordinates = 20,       /* polygon_coordinates  */
+  YYSYMBOL_coordinate = 21,                /* coordinate  */
+  YYSYMBOL_coordinate_list = 22            /* coordinate_list  */
 };
 typedef enum yysymbol_kind_t yysymbol_kind_t;
 
 
 
 /* Unqualified %code blocks.  */
-#line 48 "parser.y"
+#line 93 "parser.y"
+
+    int flex_lex(YYSTYPE *yylval_param, yyscan_t yyscanner);
+    int yyget_leng(yyscan_t yyscanner);
+    static int yylex(YYSTYPE *yylval_param, wkt2geojson_ctx *ctx);
+
+    static input_position token_position(wkt2geojson_ctx *ctx);
+    static void report_record_error(wkt2geojson_ctx *ctx,
+                                    const char *message);
+    static void begin_record(wkt2geojson_ctx *ctx);
+    static int skip_record(wkt2geojson_ctx *ctx);
 
-    extern FILE *yyin;
-    static int count = 0;
-    static FILE *y_output_file = NULL;
+    static int first_feature(const wkt2geojson_ctx *ctx);
+    static void drop_feature(wkt2geojson_ctx *ctx);
+    static int end_feature(wkt2geojson_ctx *ctx, int status,
+                           wkt_geometry_type type, size_t vertices);
 
-#line 139 "parser.tab.c"
+#line 154 "parser.tab.c"
 
 #ifdef short
 # undef short
@@ -328,7 +343,7 @@ typedef int yy_state_fast_t;
 
 #define YY_ASSERT(E) ((void) (0 && (E)))
 
-#if !defined yyoverflow
+#if 1
 
 /* The parser invokes alloca or malloc; define the necessary symbols.  */
 
@@ -393,7 +408,7 @@ void free (void *); /* INFRINGES ON USER NAME SPACE */
 #   endif
 #  endif
 # endif
-#endif /* !defined yyoverflow */
+#endif /* 1 */
 
 #if (! defined yyoverflow \
      && (! defined __cplusplus \
@@ -456,18 +471,18 @@ union yyalloc
 #endif /* !YYCOPY_NEEDED */
 
 /* YYFINAL -- State number of the termination state.  */
-#define YYFINAL  12
+#define YYFINAL  14
 /* YYLAST -- Last index in YYTABLE.  */
-#define YYLAST   26
+#define YYLAST   31
 
 /* YYNTOKENS -- Number of terminals.  */
 #define YYNTOKENS  10
 /* YYNNTS -- Number of nonterminals.  */
-#define YYNNTS  9
+#define YYNNTS  13
 /* YYNRULES -- Number of rules.  */
-#define YYNRULES  16
+#define YYNRULES  19
 /* YYNSTATES -- Number of states.  */
-#define YYNSTATES  34
+#define YYNSTATES  37
 
 /* YYMAXUTOK -- Last valid token kind.  */
 #define YYMAXUTOK   261
@@ -517,42 +532,39 @@ static const yytype_int8 yytranslate[] =
 /* YYRLINE[YYN] -- Source line where rule number YYN was defined.  */
 static const yytype_uint8 yyrline[] =
 {
-       0,    64,    64,    68,    69,    70,    71,    72,    73,    77,
-      92,   108,   124,   129,   138,   145,   150
+       0,   121,   121,   125,   126,   130,   131,   132,   133,   142,
+     142,   161,   161,   185,   185,   209,   217,   228,   241,   249
 };
 #endif
 
 /** Accessing symbol of state STATE.  */
 #define YY_ACCESSING_SYMBOL(State) YY_CAST (yysymbol_kind_t, yystos[State])
 
-#if YYDEBUG || 0
+#if 1
 /* The user-facing name of the symbol whose (internal) number is
    YYSYMBOL.  No bounds checking.  */
 static const char *yysymbol_name (yysymbol_kind_t yysymbol) YY_ATTRIBUTE_UNUSED;
 
-/* YYTNAME[SYMBOL-NUM] -- String name of the symbol SYMBOL-NUM.
-   First, the terminals, then, starting at YYNTOKENS, nonterminals.  */
-static const char *const yytname[] =
-{
-  "\"end of file\"", "error", "\"invalid token\"", "','", "NUMBER",
-  "POINT", "LINESTRING", "POLYGON", "'('", "')'", "$accept", "geometry",
-  "geometry_list", "point", "linestring", "polygon", "polygon_coordinates",
-  "coordinate", "coordinate_list", YY_NULLPTR
-};
-
 static const char *
 yysymbol_name (yysymbol_kind_t yysymbol)
 {
-  return yytname[yysymbol];
+  static const char *const yy_sname[] =
+  {
+  "end of file", "error", "invalid token", "','", "NUMBER", "POINT",
+  "LINESTRING", "POLYGON", "'('", "')'", "$accept", "geometry",
+  "geometry_list", "feature", "point", "$@1", "linestring", "$@2",
+  "polygon", "$@3", "polygon_coordinates", "coordinate", "coordinate_list", YY_NULLPTR
+  };
+  return yy_sname[yysymbol];
 }
 #endif
 
-#define YYPACT_NINF (-20)
+#define YYPACT_NINF (-23)
 
 #define yypact_value_is_default(Yyn) \
   ((Yyn) == YYPACT_NINF)
 
-#define YYTABLE_NINF (-1)
+#define YYTABLE_NINF (-3)
 
 #define yytable_value_is_error(Yyn) \
   0
@@ -561,10 +573,10 @@ yysymbol_name (yysymbol_kind_t yysymbol)
    STATE-NUM.  */
 static const yytype_int8 yypact[] =
 {
-      11,    -2,     5,     6,     7,    11,   -20,   -20,   -20,    15,
-      15,    12,   -20,   -20,   -20,   -20,    17,    13,   -20,    -1,
-      15,     0,   -20,   -20,    15,   -20,     1,    16,   -20,   -20,
-     -20,    15,     2,   -20
+       9,   -23,   -23,   -23,   -23,     4,     2,   -23,   -23,   -23,
+     -23,    -3,    -2,    13,   -23,   -23,    18,    18,    19,    21,
+      20,   -23,    10,    18,    14,   -23,   -23,    18,   -23,    15,
+      22,   -23,   -23,   -23,    18,    17,   -23
 };
 
 /* YYDEFACT[STATE-NUM] -- Default reduction number in state STATE-NUM.
@@ -572,22 +584,24 @@ static const yytype_int8 yypact[] =
    means the default is an error.  */
 static const yytype_int8 yydefact[] =
 {
-       0,     0,     0,     0,     0,     2,     3,     4,     5,     0,
-       0,     0,     1,     6,     7,     8,     0,     0,    15,     0,
-       0,     0,    14,     9,     0,    10,     0,     0,    11,    16,
-      12,     0,     0,    13
+       0,     8,     9,    11,    13,     0,     0,     3,     5,     6,
+       7,     0,     0,     0,     1,     4,     0,     0,     0,     0,
+       0,    18,     0,     0,     0,    17,    10,     0,    12,     0,
+       0,    14,    19,    15,     0,     0,    16
 };
 
 /* YYPGOTO[NTERM-NUM].  */
 static const yytype_int8 yypgoto[] =
 {
-     -20,   -20,   -20,    18,    20,    21,   -20,    -9,   -19
+     -23,   -23,   -23,    25,   -23,   -23,   -23,   -23,   -23,   -23,
+     -23,   -16,   -22
 };
 
 /* YYDEFGOTO[NTERM-NUM].  */
 static const yytype_int8 yydefgoto[] =
 {
-       0,     4,     5,     6,     7,     8,    21,    18,    19
+       0,     5,     6,     7,     8,    11,     9,    12,    10,    13,
+      24,    21,    22
 };
 
 /* YYTABLE[YYPACT[STATE-NUM]] -- What to do in state STATE-NUM.  If
@@ -595,40 +609,42 @@ static const yytype_int8 yydefgoto[] =
    number is the opposite.  If YYTABLE_NINF, syntax error.  */
 static const yytype_int8 yytable[] =
 {
-      17,    26,    24,    27,    24,    24,     9,    12,    25,    28,
-      30,    33,    32,    10,    11,    29,     1,     2,     3,    16,
-      20,    22,    23,    13,    31,    14,    15
+      20,    29,    -2,     1,    14,    16,    17,     2,     3,     4,
+       1,    32,    35,    27,     2,     3,     4,    30,    27,    28,
+      27,    18,    19,    31,    33,    25,    36,    23,     0,    26,
+      34,    15
 };
 
 static const yytype_int8 yycheck[] =
 {
-       9,    20,     3,     3,     3,     3,     8,     0,     9,     9,
-       9,     9,    31,     8,     8,    24,     5,     6,     7,     4,
-       8,     4,     9,     5,     8,     5,     5
+      16,    23,     0,     1,     0,     8,     8,     5,     6,     7,
+       1,    27,    34,     3,     5,     6,     7,     3,     3,     9,
+       3,     8,     4,     9,     9,     4,     9,     8,    -1,     9,
+       8,     6
 };
 
 /* YYSTOS[STATE-NUM] -- The symbol kind of the accessing symbol of
    state STATE-NUM.  */
 static const yytype_int8 yystos[] =
 {
-       0,     5,     6,     7,    11,    12,    13,    14,    15,     8,
-       8,     8,     0,    13,    14,    15,     4,    17,    17,    18,
-       8,    16,     4,     9,     3,     9,    18,     3,     9,    17,
-       9,     8,    18,     9
+       0,     1,     5,     6,     7,    11,    12,    13,    14,    16,
+      18,    15,    17,    19,     0,    13,     8,     8,     8,     4,
+      21,    21,    22,     8,    20,     4,     9,     3,     9,    22,
+       3,     9,    21,     9,     8,    22,     9
 };
 
 /* YYR1[RULE-NUM] -- Symbol kind of the left-hand side of rule RULE-NUM.  */
 static const yytype_int8 yyr1[] =
 {
-       0,    10,    11,    12,    12,    12,    12,    12,    12,    13,
-      14,    15,    16,    16,    17,    18,    18
+       0,    10,    11,    12,    12,    13,    13,    13,    13,    15,
+      14,    17,    16,    19,    18,    20,    20,    21,    22,    22
 };
 
 /* YYR2[RULE-NUM] -- Number of symbols on the right-hand side of rule RULE-NUM.  */
 static const yytype_int8 yyr2[] =
 {
-       0,     2,     1,     1,     1,     1,     2,     2,     2,     4,
-       4,     4,     3,     5,     2,     1,     3
+       0,     2,     1,     1,     2,     1,     1,     1,     1,     0,
+       5,     0,     5,     0,     5,     3,     5,     2,     1,     3
 };
 
 
@@ -657,7 +673,7 @@ enum { YYENOMEM = -2 };
       }                                                           \
     else                                                          \
       {                                                           \
-        yyerror (YY_("syntax error: cannot back up")); \
+        yyerror (ctx, YY_("syntax error: cannot back up")); \
         YYERROR;                                                  \
       }                                                           \
   while (0)
@@ -690,7 +706,7 @@ do {                                                                      \
     {                                                                     \
       YYFPRINTF (stderr, "%s ", Title);                                   \
       yy_symbol_print (stderr,                                            \
-                  Kind, Value); \
+                  Kind, Value, ctx); \
       YYFPRINTF (stderr, "\n");                                           \
     }                                                                     \
 } while (0)
@@ -702,10 +718,11 @@ do {                                                                      \
 
 static void
 yy_symbol_value_print (FILE *yyo,
-                       yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep)
+                       yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep, wkt2geojson_ctx *ctx)
 {
   FILE *yyoutput = yyo;
   YY_USE (yyoutput);
+  YY_USE (ctx);
   if (!yyvaluep)
     return;
   YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
@@ -720,12 +737,12 @@ yy_symbol_value_print (FILE *yyo,
 
 static void
 yy_symbol_print (FILE *yyo,
-                 yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep)
+                 yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep, wkt2geojson_ctx *ctx)
 {
   YYFPRINTF (yyo, "%s %s (",
              yykind < YYNTOKENS ? "token" : "nterm", yysymbol_name (yykind));
 
-  yy_symbol_value_print (yyo, yykind, yyvaluep);
+  yy_symbol_value_print (yyo, yykind, yyvaluep, ctx);
   YYFPRINTF (yyo, ")");
 }
 
@@ -759,7 +776,7 @@ do {                                                            \
 
 static void
 yy_reduce_print (yy_state_t *yyssp, YYSTYPE *yyvsp,
-                 int yyrule)
+                 int yyrule, wkt2geojson_ctx *ctx)
 {
   int yylno = yyrline[yyrule];
   int yynrhs = yyr2[yyrule];
@@ -772,7 +789,7 @@ yy_reduce_print (yy_state_t *yyssp, YYSTYPE *yyvsp,
       YYFPRINTF (stderr, "   $%d = ", yyi + 1);
       yy_symbol_print (stderr,
                        YY_ACCESSING_SYMBOL (+yyssp[yyi + 1 - yynrhs]),
-                       &yyvsp[(yyi + 1) - (yynrhs)]);
+                       &yyvsp[(yyi + 1) - (yynrhs)], ctx);
       YYFPRINTF (stderr, "\n");
     }
 }
@@ -780,7 +797,7 @@ yy_reduce_print (yy_state_t *yyssp, YYSTYPE *yyvsp,
 # define YY_REDUCE_PRINT(Rule)          \
 do {                                    \
   if (yydebug)                          \
-    yy_reduce_print (yyssp, yyvsp, Rule); \
+    yy_reduce_print (yyssp, yyvsp, Rule, ctx); \
 } while (0)
 
 /* Nonzero means print parse trace.  It is left uninitialized so that
@@ -811,9 +828,71 @@ int yydebug;
 #endif
 
 
+/* Context of a parse error.  */
+typedef struct
+{
+  yy_state_t *yyssp;
+  yysymbol_kind_t yytoken;
+} yypcontext_t;
+
+/* Put in YYARG at most YYARGN of the expected tokens given the
+   current YYCTX, and return the number of tokens stored in YYARG.  If
+   YYARG is null, return the number of expected tokens (guaranteed to
+   be less than YYNTOKENS).  Return YYENOMEM on memory exhaustion.
+   Return 0 if there are more than YYARGN expected tokens, yet fill
+   YYARG up to YYARGN. */
+static int
+yypcontext_expected_tokens (const yypcontext_t *yyctx,
+                            yysymbol_kind_t yyarg[], int yyargn)
+{
+  /* Actual size of YYARG. */
+  int yycount = 0;
+  int yyn = yypact[+*yyctx->yyssp];
+  if (!yypact_value_is_default (yyn))
+    {
+      /* Start YYX at -YYN if negative to avoid negative indexes in
+         YYCHECK.  In other words, skip the first -YYN actions for
+         this state because they are default actions.  */
+      int yyxbegin = yyn < 0 ? -yyn : 0;
+      /* Stay within bounds of both yycheck and yytname.  */
+      int yychecklim = YYLAST - yyn + 1;
+      int yyxend = yychecklim < YYNTOKENS ? yychecklim : YYNTOKENS;
+      int yyx;
+      for (yyx = yyxbegin; yyx < yyxend; ++yyx)
+        if (yycheck[yyx + yyn] == yyx && yyx != YYSYMBOL_YYerror
+            && !yytable_value_is_error (yytable[yyx + yyn]))
+          {
+            if (!yyarg)
+              ++yycount;
+            else if (yycount == yyargn)
+              return 0;
+            else
+              yyarg[yycount++] = YY_CAST (yysymbol_kind_t, yyx);
+          }
+    }
+  if (yyarg && yycount == 0 && 0 < yyargn)
+    yyarg[0] = YYSYMBOL_YYEMPTY;
+  return yycount;
+}
+
 
 
 
+/* The kind of the lookahead of this context.  */
+static yysymbol_kind_t
+yypcontext_token (const yypcontext_t *yyctx) YY_ATTRIBUTE_UNUSED;
+
+static yysymbol_kind_t
+yypcontext_token (const yypcontext_t *yyctx)
+{
+  return yyctx->yytoken;
+}
+
+
+
+/* User defined function to report a syntax error.  */
+static int
+yyreport_syntax_error (const yypcontext_t *yyctx, wkt2geojson_ctx *ctx);
 
 /*-----------------------------------------------.
 | Release the memory associated to this symbol.  |
@@ -821,9 +900,10 @@ int yydebug;
 
 static void
 yydestruct (const char *yymsg,
-            yysymbol_kind_t yykind, YYSTYPE *yyvaluep)
+            yysymbol_kind_t yykind, YYSTYPE *yyvaluep, wkt2geojson_ctx *ctx)
 {
   YY_USE (yyvaluep);
+  YY_USE (ctx);
   if (!yymsg)
     yymsg = "Deleting";
   YY_SYMBOL_PRINT (yymsg, yykind, yyvaluep, yylocationp);
@@ -834,13 +914,6 @@ yydestruct (const char *yymsg,
 }
 
 
-/* Lookahead token kind.  */
-int yychar;
-
-/* The semantic value of the lookahead symbol.  */
-YYSTYPE yylval;
-/* Number of syntax errors so far.  */
-int yynerrs;
 
 
 
@@ -850,8 +923,21 @@ int yynerrs;
 `----------*/
 
 int
-yyparse (void)
+yyparse (wkt2geojson_ctx *ctx)
 {
+/* Lookahead token kind.  */
+int yychar;
+
+
+/* The semantic value of the lookahead symbol.  */
+/* Default value used for initialization, for pacifying older GCCs
+   or non-GCC compilers.  */
+YY_INITIAL_VALUE (static YYSTYPE yyval_default;)
+YYSTYPE yylval YY_INITIAL_VALUE (= yyval_default);
+
+    /* Number of syntax errors so far.  */
+    int yynerrs = 0;
+
     yy_state_fast_t yystate = 0;
     /* Number of tokens to shift before error messages enabled.  */
     int yyerrstatus = 0;
@@ -1004,7 +1090,7 @@ yybackup:
   if (yychar == YYEMPTY)
     {
       YYDPRINTF ((stderr, "Reading a token\n"));
-      yychar = yylex ();
+      yychar = yylex (&yylval, ctx);
     }
 
   if (yychar <= YYEOF)
@@ -1091,104 +1177,168 @@ yyreduce:
   YY_REDUCE_PRINT (yyn);
   switch (yyn)
     {
-  case 9: /* point: POINT '(' coordinate ')'  */
-#line 78 "parser.y"
+  case 8: /* feature: error  */
+#line 134 "parser.y"
     {
-        (yyval.sval) = to_geojson_point((yyvsp[-1].sval));
-        count++;
-        if (count > 1) {
-            fprintf(y_output_file, ",%s\n", (yyval.sval));
-        } else {
-            fprintf(y_output_file, "%s\n", (yyval.sval));
+        if (skip_record(ctx) < 0) {
+            YYABORT;
         }
-        free((yyvsp[-1].sval));
-        free((yyval.sval));
     }
-#line 1108 "parser.tab.c"
+#line 1188 "parser.tab.c"
     break;
 
-  case 10: /* linestring: LINESTRING '(' coordinate_list ')'  */
-#line 93 "parser.y"
+  case 9: /* $@1: %empty  */
+#line 142 "parser.y"
+          { begin_record(ctx); yyerrok; }
+#line 1194 "parser.tab.c"
+    break;
+
+  case 10: /* point: POINT $@1 '(' coordinate ')'  */
+#line 143 "parser.y"
     {
-        (yyval.sval) = to_geojson_linestring((yyvsp[-1].sval));
-        count++;
-        if (count > 1) {
-            fprintf(y_output_file, ",%s\n", (yyval.sval));
+        if (!spatial_filter_match_point(ctx->filter, (yyvsp[-1].vval))) {
+            drop_feature(ctx);
         } else {
-            fprintf(y_output_file, "%s\n", (yyval.sval));
+            stats_phase previous = stats_enter(ctx->stats, STATS_FORMAT);
+            int status = ctx->ir
+                ? wkt_ir_append_point(ctx->ir, (yyvsp[-1].vval))
+                : write_point(&ctx->sink, (yyvsp[-1].vval), ctx->precision,
+                              first_feature(ctx));
+            stats_leave(ctx->stats, previous);
+            if (end_feature(ctx, status, WKT_POINT, 1) < 0) {
+                YYABORT;
+            }
         }
-
-        free((yyvsp[-1].sval));
-        free((yyval.sval));
     }
-#line 1125 "parser.tab.c"
+#line 1214 "parser.tab.c"
     break;
 
-  case 11: /* polygon: POLYGON '(' polygon_coordinates ')'  */
-#line 109 "parser.y"
+  case 11: /* $@2: %empty  */
+#line 161 "parser.y"
+               { begin_record(ctx); yyerrok; }
+#line 1220 "parser.tab.c"
+    break;
+
+  case 12: /* linestring: LINESTRING $@2 '(' coordinate_list ')'  */
+#line 162 "parser.y"
     {
-        (yyval.sval) = to_geojson_polygon((yyvsp[-1].sval));
-        count++;
-        if (count > 1) {
-            fprintf(y_output_file, ",%s\n", (yyval.sval));
+        if (!spatial_filter_match_buffer(ctx->filter, WKT_LINESTRING, (yyvsp[-1].cval))) {
+            drop_feature(ctx);
         } else {
-            fprintf(y_output_file, "%s\n", (yyval.sval));
+            if (simplify_coordinates((yyvsp[-1].cval), &ctx->simplify) < 0) {
+                yyerror(ctx, "out of memory");
+                YYABORT;
+            }
+            stats_phase previous = stats_enter(ctx->stats, STATS_FORMAT);
+            int status = ctx->ir
+                ? wkt_ir_append_buffer(ctx->ir, WKT_LINESTRING, (yyvsp[-1].cval))
+                : write_linestring(&ctx->sink, (yyvsp[-1].cval), ctx->precision,
+                                   first_feature(ctx));
+            stats_leave(ctx->stats, previous);
+            size_t vertices = (yyvsp[-1].cval)->size / 2;
+            if (end_feature(ctx, status, WKT_LINESTRING, vertices) < 0) {
+                YYABORT;
+            }
         }
+    }
+#line 1245 "parser.tab.c"
+    break;
+
+  case 13: /* $@3: %empty  */
+#line 185 "parser.y"
+            { begin_record(ctx); yyerrok; }
+#line 1251 "parser.tab.c"
+    break;
 
-        free((yyvsp[-1].sval));
-        free((yyval.sval));
+  case 14: /* polygon: POLYGON $@3 '(' polygon_coordinates ')'  */
+#line 186 "parser.y"
+    {
+        if (!spatial_filter_match_buffer(ctx->filter, WKT_POLYGON, (yyvsp[-1].cval))) {
+            drop_feature(ctx);
+        } else {
+            if (simplify_coordinates((yyvsp[-1].cval), &ctx->simplify) < 0) {
+                yyerror(ctx, "out of memory");
+                YYABORT;
+            }
+            stats_phase previous = stats_enter(ctx->stats, STATS_FORMAT);
+            int status = ctx->ir
+                ? wkt_ir_append_buffer(ctx->ir, WKT_POLYGON, (yyvsp[-1].cval))
+                : write_polygon(&ctx->sink, (yyvsp[-1].cval), ctx->precision,
+                                first_feature(ctx));
+            stats_leave(ctx->stats, previous);
+            size_t vertices = (yyvsp[-1].cval)->size / 2;
+            if (end_feature(ctx, status, WKT_POLYGON, vertices) < 0) {
+                YYABORT;
+            }
+        }
     }
-#line 1142 "parser.tab.c"
+#line 1276 "parser.tab.c"
     break;
 
-  case 12: /* polygon_coordinates: '(' coordinate_list ')'  */
-#line 125 "parser.y"
+  case 15: /* polygon_coordinates: '(' coordinate_list ')'  */
+#line 210 "parser.y"
     {
-        (yyval.sval) = strdup((yyvsp[-1].sval));
-        free((yyvsp[-1].sval));
+        (yyval.cval) = (yyvsp[-1].cval);
+        if (coordinate_buffer_close_ring((yyval.cval)) < 0) {
+            yyerror(ctx, "out of memory");
+            YYABORT;
+        }
     }
-#line 1151 "parser.tab.c"
+#line 1288 "parser.tab.c"
     break;
 
-  case 13: /* polygon_coordinates: polygon_coordinates ',' '(' coordinate_list ')'  */
-#line 130 "parser.y"
+  case 16: /* polygon_coordinates: polygon_coordinates ',' '(' coordinate_list ')'  */
+#line 218 "parser.y"
     {
-        write_string(&(yyval.sval), "%s, %s", (yyvsp[-4].sval), (yyvsp[-1].sval));
-        free((yyvsp[-4].sval));
-        free((yyvsp[-1].sval));
+        (yyval.cval) = (yyvsp[-4].cval);
+        if (coordinate_buffer_append_ring((yyval.cval), (yyvsp[-1].cval)) < 0) {
+            yyerror(ctx, "out of memory");
+            YYABORT;
+        }
     }
-#line 1161 "parser.tab.c"
+#line 1300 "parser.tab.c"
     break;
 
-  case 14: /* coordinate: NUMBER NUMBER  */
-#line 139 "parser.y"
+  case 17: /* coordinate: NUMBER NUMBER  */
+#line 229 "parser.y"
     {
-        write_string(&(yyval.sval), "[%f, %f]", (yyvsp[-1].dval), (yyvsp[0].dval));
+        /* Numbers beyond the range of a double overflow to infinity. */
+        if (!isfinite((yyvsp[-1].dval)) || !isfinite((yyvsp[0].dval))) {
+            report_record_error(ctx, "number out of range");
+            YYERROR;
+        }
+        (yyval.vval).x = (yyvsp[-1].dval);
+        (yyval.vval).y = (yyvsp[0].dval);
     }
-#line 1169 "parser.tab.c"
+#line 1314 "parser.tab.c"
     break;
 
-  case 15: /* coordinate_list: coordinate  */
-#line 146 "parser.y"
+  case 18: /* coordinate_list: coordinate  */
+#line 242 "parser.y"
     {
-        (yyval.sval) = strdup((yyvsp[0].sval));
-        free((yyvsp[0].sval));
+        (yyval.cval) = coordinate_buffer_new(&ctx->arena);
+        if (!(yyval.cval) || coordinate_buffer_append((yyval.cval), (yyvsp[0].vval)) < 0) {
+            yyerror(ctx, "out of memory");
+            YYABORT;
+        }
     }
-#line 1178 "parser.tab.c"
+#line 1326 "parser.tab.c"
     break;
 
-  case 16: /* coordinate_list: coordinate_list ',' coordinate  */
-#line 151 "parser.y"
+  case 19: /* coordinate_list: coordinate_list ',' coordinate  */
+#line 250 "parser.y"
     {
-        write_string(&(yyval.sval), "%s, %s", (yyvsp[-2].sval), (yyvsp[0].sval));
-        free((yyvsp[-2].sval));
-        free((yyvsp[0].sval));
+        (yyval.cval) = (yyvsp[-2].cval);
+        if (coordinate_buffer_append((yyval.cval), (yyvsp[0].vval)) < 0) {
+            yyerror(ctx, "out of memory");
+            YYABORT;
+        }
     }
-#line 1188 "parser.tab.c"
+#line 1338 "parser.tab.c"
     break;
 
 
-#line 1192 "parser.tab.c"
+#line 1342 "parser.tab.c"
 
       default: break;
     }
@@ -1235,7 +1385,12 @@ yyerrlab:
   if (!yyerrstatus)
     {
       ++yynerrs;
-      yyerror (YY_("syntax error"));
+      {
+        yypcontext_t yyctx
+          = {yyssp, yytoken};
+        if (yyreport_syntax_error (&yyctx, ctx) == 2)
+          YYNOMEM;
+      }
     }
 
   if (yyerrstatus == 3)
@@ -1252,7 +1407,7 @@ yyerrlab:
       else
         {
           yydestruct ("Error: discarding",
-                      yytoken, &yylval);
+                      yytoken, &yylval, ctx);
           yychar = YYEMPTY;
         }
     }
@@ -1308,7 +1463,7 @@ yyerrlab1:
 
 
       yydestruct ("Error: popping",
-                  YY_ACCESSING_SYMBOL (yystate), yyvsp);
+                  YY_ACCESSING_SYMBOL (yystate), yyvsp, ctx);
       YYPOPSTACK (1);
       yystate = *yyssp;
       YY_STACK_PRINT (yyss, yyssp);
@@ -1346,7 +1501,7 @@ yyabortlab:
 | yyexhaustedlab -- YYNOMEM (memory exhaustion) comes here.  |
 `-----------------------------------------------------------*/
 yyexhaustedlab:
-  yyerror (YY_("memory exhausted"));
+  yyerror (ctx, YY_("memory exhausted"));
   yyresult = 2;
   goto yyreturnlab;
 
@@ -1361,7 +1516,7 @@ yyreturnlab:
          user semantic actions for why this is necessary.  */
       yytoken = YYTRANSLATE (yychar);
       yydestruct ("Cleanup: discarding lookahead",
-                  yytoken, &yylval);
+                  yytoken, &yylval, ctx);
     }
   /* Do not reclaim the symbols of the rule whose action triggered
      this YYABORT or YYACCEPT.  */
@@ -1370,7 +1525,7 @@ yyreturnlab:
   while (yyssp != yyss)
     {
       yydestruct ("Cleanup: popping",
-                  YY_ACCESSING_SYMBOL (+*yyssp), yyvsp);
+                  YY_ACCESSING_SYMBOL (+*yyssp), yyvsp, ctx);
       YYPOPSTACK (1);
     }
 #ifndef yyoverflow
@@ -1381,32 +1536,261 @@ yyreturnlab:
   return yyresult;
 }
 
-#line 158 "parser.y"
+#line 259 "parser.y"
 
 
-void yyerror(const char *s) {
-    fprintf(stderr, "Error: %s\n", s);
+void yyerror(wkt2geojson_ctx *ctx, const char *s) {
+    if (!ctx->error) {
+        ctx->error = s;
+    }
+    if (!ctx->defer_errors) {
+        fprintf(stderr, "Error: %s\n", s);
+    }
 }
 
-int transpile(FILE *in_file, FILE *out_file) {
+/*
+ * Returns the next token from the tokenizer engine of the context.
+ */
+static int yylex(YYSTYPE *yylval_param, wkt2geojson_ctx *ctx) {
+    stats_phase previous = stats_enter(ctx->stats, STATS_SCAN);
+    int token = ctx->tokenizer
+        ? tokenizer_next(ctx->tokenizer, &yylval_param->dval)
+        : flex_lex(yylval_param, ctx->scanner);
+    stats_leave(ctx->stats, previous);
+
+    if (ctx->rejects) {
+        ctx->lookahead = token;
+        if (token == POINT || token == LINESTRING || token == POLYGON) {
+            ctx->keyword = token_position(ctx);
+        }
+    }
+    return token;
+}
+
+/*
+ * Returns the position in the input of the last token read, when the
+ * context records rejects.
+ */
+static input_position token_position(wkt2geojson_ctx *ctx) {
+    input_position position;
+    if (ctx->tokenizer) {
+        position.offset = tokenizer_offset(ctx->tokenizer);
+        position.line = tokenizer_line(ctx->tokenizer);
+    } else {
+        /* The end of the input (or a zero byte) is located after its
+         * last byte, like the tokenizer does. */
+        position = ctx->scanned;
+        if (ctx->lookahead) {
+            position.offset -= (size_t)yyget_leng(ctx->scanner);
+        }
+    }
+    return position;
+}
+
+/*
+ * Reports an error in the record being parsed. When the context records
+ * rejects, the error is left to `skip_record`, run once the parser has
+ * resynchronized.
+ */
+static void report_record_error(wkt2geojson_ctx *ctx,
+                                const char *message) {
+    if (ctx->rejects) {
+        ctx->record_error = message;
+    } else {
+        yyerror(ctx, message);
+    }
+}
+
+/*
+ * Reports a syntax error.
+ */
+static int yyreport_syntax_error(const yypcontext_t *yyctx,
+                                 wkt2geojson_ctx *ctx) {
+    /* The expected tokens are not reported. */
+    (void)yyctx;
+    (void)yypcontext_expected_tokens;
+    report_record_error(ctx, "syntax error");
+    return 0;
+}
+
+/*
+ * Marks the start of a record, at the geometry keyword just shifted.
+ */
+static void begin_record(wkt2geojson_ctx *ctx) {
+    ctx->record = ctx->keyword;
+    ctx->record_open = 1;
+}
+
+/*
+ * Skips the record that caused a syntax error or held a number out of
+ * range, run by the `error` production once the tokens of the record
+ * have been popped. The record is added to the log of rejects, starting at its geometry
+ * keyword or, for stray tokens between records, at the token the error
+ * was found at. The parser then discards tokens, running this function
+ * again for each of them, until the next geometry keyword.
+ * Returns 0 on success, or -1 if the context does not record rejects,
+ * if more records than tolerated have been rejected, or in case of
+ * error.
+ */
+static int skip_record(wkt2geojson_ctx *ctx) {
+    if (!ctx->rejects) {
+        return -1;
+    }
+    arena_reset(&ctx->arena);
+    if (!ctx->record_error) {
+        return 0;
+    }
+
+    reject_entry entry = {
+        .position = ctx->record_open ? ctx->record : token_position(ctx),
+        .message = ctx->record_error,
+        .output_length = ctx->sink.length,
+        .count = ctx->count
+    };
+    ctx->record_error = NULL;
+    ctx->record_open = 0;
+
+    if (reject_log_add(ctx->rejects, &entry) < 0) {
+        yyerror(ctx, "cannot record a rejected record");
+        return -1;
+    }
+    if (ctx->rejects->count > ctx->rejects->max_errors) {
+        yyerror(ctx, "too many rejected records");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Returns 1 if the next feature is the first one of the collection,
+ * which is written without a leading comma.
+ */
+static int first_feature(const wkt2geojson_ctx *ctx) {
+    return !ctx->count && !ctx->continued;
+}
+
+/*
+ * Releases the semantic values of a feature dropped by the spatial
+ * filter of the context, which is neither written nor counted.
+ */
+static void drop_feature(wkt2geojson_ctx *ctx) {
+    arena_reset(&ctx->arena);
+    ctx->record_open = 0;
+}
+
+/*
+ * Accounts for a feature of `vertices` vertices written to the sink of
+ * the context by the writer, or appended to its IR, reporting the
+ * error if it failed. The semantic values of the feature, held by the
+ * arena of the context, are released.
+ * Returns 0 on success or -1 if the feature could not be written.
+ */
+static int end_feature(wkt2geojson_ctx *ctx, int status,
+                       wkt_geometry_type type, size_t vertices) {
+    arena_reset(&ctx->arena);
+    ctx->record_open = 0;
+    if (status < 0) {
+        yyerror(ctx, ctx->ir ? "out of memory" : strerror(ctx->sink.error));
+        return -1;
+    }
+
+    ctx->count++;
+    stats_count_feature(ctx->stats, type, vertices);
+    return 0;
+}
+
+/*
+ * Converts the WKT read by the scanner of `ctx`, or its WKB input,
+ * into GeoJSON features appended to the output sink of `ctx`, without
+ * the header and the footer of the collection and without flushing the
+ * sink.
+ * Returns 0 on success or 1 in case of error.
+ */
+int transpile_features(wkt2geojson_ctx *ctx) {
     /** Uncomment the line below to enable the debugging */
     //yydebug = 1;
 
-    int status = 1;
-    yyin = in_file;
-    y_output_file = out_file;
+    size_t allocations = ctx->arena.allocations;
+    stats_phase previous = stats_enter(ctx->stats, STATS_PARSE);
+    int status = ctx->format == INPUT_WKT ? (yyparse(ctx) ? 1 : 0)
+                                          : wkb_transpile_features(ctx);
+    stats_leave(ctx->stats, previous);
+    if (ctx->stats) {
+        ctx->stats->allocations += ctx->arena.allocations - allocations;
+    }
+    return status;
+}
+
+/*
+ * Converts the WKT read by the scanner of `ctx` into a GeoJSON
+ * document written to the output sink of `ctx`, which is flushed at
+ * the end.
+ * Returns 0 on success or 1 in case of error.
+ */
+int transpile_ctx(wkt2geojson_ctx *ctx) {
+    stats_phase previous = stats_enter(ctx->stats, STATS_FORMAT);
+    int failed = write_header(&ctx->sink) < 0;
+    stats_leave(ctx->stats, previous);
+    if (failed) {
+        yyerror(ctx, strerror(ctx->sink.error));
+        return 1;
+    }
+
+    /* WKB inputs are not split into chunks. */
+    int status = ctx->jobs > 1 && ctx->format == INPUT_WKT
+                     ? transpile_parallel(ctx)
+                     : transpile_features(ctx);
+
+    /* The footer is written even after a syntax error, so that the
+     * features converted so far form a complete document. A failure of
+     * the sink during the parse has already been reported. */
+    int reported = ctx->sink.error != 0;
+    previous = stats_enter(ctx->stats, STATS_FORMAT);
+    failed = write_footer(&ctx->sink, ctx->precision) < 0
+             || output_sink_flush(&ctx->sink) < 0;
+    stats_leave(ctx->stats, previous);
+    if (failed) {
+        if (!reported) {
+            yyerror(ctx, strerror(ctx->sink.error));
+        }
+        status = 1;
+    }
 
-    char* header_str = header();
-    fprintf(y_output_file, "%s", header_str);
-    free(header_str);
+    return status;
+}
 
-    if (!yyparse()) {
-        status = 0;
+/*
+ * Converts the WKT read from `in_file` into a GeoJSON document written
+ * to `out_file`, using a context private to this call.
+ * Returns 0 on success or 1 in case of error.
+ */
+int transpile(FILE *in_file, FILE *out_file) {
+    wkt2geojson_ctx *ctx = wkt2geojson_ctx_new(in_file, out_file);
+    if (!ctx) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
     }
 
-    char* footer_str = footer();
-    fprintf(y_output_file, "%s", footer_str);
-    free(footer_str);
+    int status = transpile_ctx(ctx);
+    wkt2geojson_ctx_free(ctx);
+    return status;
+}
+
+/*
+ * Parses the WKT read from `in_file` into geometries appended to `ir`,
+ * without producing GeoJSON. After a syntax error, `ir` holds the
+ * geometries parsed before it.
+ * Returns 0 on success or 1 in case of error.
+ */
+int wkt_parse_to_ir(FILE *in_file, wkt_ir *ir) {
+    wkt2geojson_ctx *ctx = wkt2geojson_ctx_new(in_file, NULL);
+    if (!ctx) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
 
+    ctx->ir = ir;
+    int status = transpile_features(ctx);
+    wkt2geojson_ctx_free(ctx);
     return status;
 }
@@ -44,6 +44,19 @@
 #if YYDEBUG
 extern int yydebug;
 #endif
+/* "%code requires" blocks.  */
+#line 64 "parser.y"
+
+#include "context.h"
+#include "coordinates.h"
+#include "ir.h"
+
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void* yyscan_t;
+#endif
+
+#line 60 "parser.tab.h"
 
 /* Token kinds.  */
 #ifndef YYTOKENTYPE
@@ -66,12 +79,13 @@ extern int yydebug;
 #if ! defined YYSTYPE && ! defined YYSTYPE_IS_DECLARED
 union YYSTYPE
 {
-#line 39 "parser.y"
+#line 79 "parser.y"
 
     double dval;
-    char* sval;
+    vertex vval;
+    coordinate_buffer* cval;
 
-#line 75 "parser.tab.h"
+#line 89 "parser.tab.h"
 
 };
 typedef union YYSTYPE YYSTYPE;
@@ -80,16 +94,19 @@ typedef union YYSTYPE YYSTYPE;
 #endif
 
 
-extern YYSTYPE yylval;
 
 
-int yyparse (void);
+int yyparse (wkt2geojson_ctx *ctx);
 
 /* "%code provides" blocks.  */
-#line 44 "parser.y"
+#line 85 "parser.y"
 
   int transpile(FILE *in_file, FILE *out_file);
+  int transpile_ctx(wkt2geojson_ctx *ctx);
+  int transpile_features(wkt2geojson_ctx *ctx);
+  int wkt_parse_to_ir(FILE *in_file, wkt_ir *ir);
+  void yyerror(wkt2geojson_ctx *ctx, const char *s);
 
-#line 94 "parser.tab.h"
+#line 111 "parser.tab.h"
 
 #endif /* !YY_YY_PARSER_TAB_H_INCLUDED  */
@@ -16,10 +16,35 @@
  * processed, the parser outputs the resulting GeoJSON object to
  * the specified file.
  *
+ * The parser is pure (reentrant): it keeps no global state and reads
+ * its tokens from a reentrant scanner: either the Flex scanner or the
+ * SIMD tokenizer, as selected on the context. The state of a conversion, such
+ * as the output file and the number of features written so far, lives
+ * in a `wkt2geojson_ctx` (see `context.h`), so several conversions can
+ * run concurrently, each one on its own context.
+ *
  * The parser exports the `transpile` function, which requires
- * two arguments: the input file and the output file.
+ * two arguments: the input file and the output file, and the
+ * `transpile_ctx` function, which runs a conversion on a context
+ * created by the caller. `transpile_features` converts the features
+ * only, without the header and footer of the collection, so that the
+ * chunks of a parallel conversion (`parallel.h`) can be concatenated.
+ * `wkt_parse_to_ir` parses the input into a columnar IR (`ir.h`)
+ * instead, for callers that only need the coordinates. A context whose
+ * input is WKB is converted by the WKB module (`wkb.h`) instead of
+ * the grammar, through the same functions. When the context has a
+ * spatial filter (`filter.h`), the actions drop the geometries it does
+ * not keep before they are simplified and written.
+ *
+ * A record with a syntax error, or with a number too large for a double
+ * (which GeoJSON cannot represent), is matched by the `error`
+ * production of `feature`. Unless the context records rejects (`reject.h`), the
+ * parse then stops, as it always did; otherwise the record is logged
+ * and skipped, and the parser resumes at the next geometry keyword,
+ * whose shift marks the start of a new record and re-arms the
+ * reporting of errors (`yyerrok`).
  * To activate Bison's debug mode, set the `yydebug` variable to 1
- * within the `transpile` function.
+ * within the `transpile_features` function.
  *
  * The static function `clear_token` cleans tokens by removing whitespace
  * and newline characters. Since the lexical scanner generated by Flex
@@ -28,27 +53,58 @@
 
 
 %{
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
+#include "parallel.h"
+#include "wkb.h"
 #include "writer.h"
-
-void yyerror(const char *s);
-int yylex(void);
 %}
 
+%code requires {
+#include "context.h"
+#include "coordinates.h"
+#include "ir.h"
+
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void* yyscan_t;
+#endif
+}
+
+%define api.pure full
+%define parse.error custom
+%param {wkt2geojson_ctx *ctx}
+
 %union {
     double dval;
-    char* sval;
+    vertex vval;
+    coordinate_buffer* cval;
 }
 
 %code provides {
   int transpile(FILE *in_file, FILE *out_file);
+  int transpile_ctx(wkt2geojson_ctx *ctx);
+  int transpile_features(wkt2geojson_ctx *ctx);
+  int wkt_parse_to_ir(FILE *in_file, wkt_ir *ir);
+  void yyerror(wkt2geojson_ctx *ctx, const char *s);
 }
 
 %code {
-    extern FILE *yyin;
-    static int count = 0;
-    static FILE *y_output_file = NULL;
+    int flex_lex(YYSTYPE *yylval_param, yyscan_t yyscanner);
+    int yyget_leng(yyscan_t yyscanner);
+    static int yylex(YYSTYPE *yylval_param, wkt2geojson_ctx *ctx);
+
+    static input_position token_position(wkt2geojson_ctx *ctx);
+    static void report_record_error(wkt2geojson_ctx *ctx,
+                                    const char *message);
+    static void begin_record(wkt2geojson_ctx *ctx);
+    static int skip_record(wkt2geojson_ctx *ctx);
+
+    static int first_feature(const wkt2geojson_ctx *ctx);
+    static void drop_feature(wkt2geojson_ctx *ctx);
+    static int end_feature(wkt2geojson_ctx *ctx, int status,
+                           wkt_geometry_type type, size_t vertices);
 }
 
 %left ','
@@ -56,7 +112,8 @@ int yylex(void);
 %token <dval> NUMBER
 %token POINT LINESTRING POLYGON
 
-%type <sval> coordinate coordinate_list point linestring polygon geometry_list polygon_coordinates
+%type <vval> coordinate
+%type <cval> coordinate_list polygon_coordinates
 
 %%
 
@@ -65,121 +122,394 @@ geometry:
     ;
 
 geometry_list:
+    feature
+  | geometry_list feature
+  ;
+
+feature:
     point
   | linestring
   | polygon
-  | geometry_list point
-  | geometry_list linestring
-  | geometry_list polygon
+  | error
+    {
+        if (skip_record(ctx) < 0) {
+            YYABORT;
+        }
+    }
   ;
 
 point:
-    POINT '(' coordinate ')'
+    POINT { begin_record(ctx); yyerrok; } '(' coordinate ')'
     {
-        $$ = to_geojson_point($3);
-        count++;
-        if (count > 1) {
-            fprintf(y_output_file, ",%s\n", $$);
+        if (!spatial_filter_match_point(ctx->filter, $4)) {
+            drop_feature(ctx);
         } else {
-            fprintf(y_output_file, "%s\n", $$);
+            stats_phase previous = stats_enter(ctx->stats, STATS_FORMAT);
+            int status = ctx->ir
+                ? wkt_ir_append_point(ctx->ir, $4)
+                : write_point(&ctx->sink, $4, ctx->precision,
+                              first_feature(ctx));
+            stats_leave(ctx->stats, previous);
+            if (end_feature(ctx, status, WKT_POINT, 1) < 0) {
+                YYABORT;
+            }
         }
-        free($3);
-        free($$);
     }
   ;
 
 linestring:
-    LINESTRING '(' coordinate_list ')'
+    LINESTRING { begin_record(ctx); yyerrok; } '(' coordinate_list ')'
     {
-        $$ = to_geojson_linestring($3);
-        count++;
-        if (count > 1) {
-            fprintf(y_output_file, ",%s\n", $$);
+        if (!spatial_filter_match_buffer(ctx->filter, WKT_LINESTRING, $4)) {
+            drop_feature(ctx);
         } else {
-            fprintf(y_output_file, "%s\n", $$);
+            if (simplify_coordinates($4, &ctx->simplify) < 0) {
+                yyerror(ctx, "out of memory");
+                YYABORT;
+            }
+            stats_phase previous = stats_enter(ctx->stats, STATS_FORMAT);
+            int status = ctx->ir
+                ? wkt_ir_append_buffer(ctx->ir, WKT_LINESTRING, $4)
+                : write_linestring(&ctx->sink, $4, ctx->precision,
+                                   first_feature(ctx));
+            stats_leave(ctx->stats, previous);
+            size_t vertices = $4->size / 2;
+            if (end_feature(ctx, status, WKT_LINESTRING, vertices) < 0) {
+                YYABORT;
+            }
         }
-
-        free($3);
-        free($$);
     }
   ;
 
 polygon:
-    POLYGON '(' polygon_coordinates ')'
+    POLYGON { begin_record(ctx); yyerrok; } '(' polygon_coordinates ')'
     {
-        $$ = to_geojson_polygon($3);
-        count++;
-        if (count > 1) {
-            fprintf(y_output_file, ",%s\n", $$);
+        if (!spatial_filter_match_buffer(ctx->filter, WKT_POLYGON, $4)) {
+            drop_feature(ctx);
         } else {
-            fprintf(y_output_file, "%s\n", $$);
+            if (simplify_coordinates($4, &ctx->simplify) < 0) {
+                yyerror(ctx, "out of memory");
+                YYABORT;
+            }
+            stats_phase previous = stats_enter(ctx->stats, STATS_FORMAT);
+            int status = ctx->ir
+                ? wkt_ir_append_buffer(ctx->ir, WKT_POLYGON, $4)
+                : write_polygon(&ctx->sink, $4, ctx->precision,
+                                first_feature(ctx));
+            stats_leave(ctx->stats, previous);
+            size_t vertices = $4->size / 2;
+            if (end_feature(ctx, status, WKT_POLYGON, vertices) < 0) {
+                YYABORT;
+            }
         }
-
-        free($3);
-        free($$);
     }
   ;
 
 polygon_coordinates:
     '(' coordinate_list ')'
     {
-        $$ = strdup($2);
-        free($2);
+        $$ = $2;
+        if (coordinate_buffer_close_ring($$) < 0) {
+            yyerror(ctx, "out of memory");
+            YYABORT;
+        }
     }
   | polygon_coordinates ',' '(' coordinate_list ')'
     {
-        write_string(&$$, "%s, %s", $1, $4);
-        free($1);
-        free($4);
+        $$ = $1;
+        if (coordinate_buffer_append_ring($$, $4) < 0) {
+            yyerror(ctx, "out of memory");
+            YYABORT;
+        }
     }
   ;
 
 coordinate:
     NUMBER NUMBER
     {
-        write_string(&$$, "[%f, %f]", $1, $2);
+        /* Numbers beyond the range of a double overflow to infinity. */
+        if (!isfinite($1) || !isfinite($2)) {
+            report_record_error(ctx, "number out of range");
+            YYERROR;
+        }
+        $$.x = $1;
+        $$.y = $2;
     }
   ;
 
 coordinate_list:
     coordinate
     {
-        $$ = strdup($1);
-        free($1);
+        $$ = coordinate_buffer_new(&ctx->arena);
+        if (!$$ || coordinate_buffer_append($$, $1) < 0) {
+            yyerror(ctx, "out of memory");
+            YYABORT;
+        }
     }
   | coordinate_list ',' coordinate
     {
-        write_string(&$$, "%s, %s", $1, $3);
-        free($1);
-        free($3);
+        $$ = $1;
+        if (coordinate_buffer_append($$, $3) < 0) {
+            yyerror(ctx, "out of memory");
+            YYABORT;
+        }
     }
   ;
 
 %%
 
-void yyerror(const char *s) {
-    fprintf(stderr, "Error: %s\n", s);
+void yyerror(wkt2geojson_ctx *ctx, const char *s) {
+    if (!ctx->error) {
+        ctx->error = s;
+    }
+    if (!ctx->defer_errors) {
+        fprintf(stderr, "Error: %s\n", s);
+    }
 }
 
-int transpile(FILE *in_file, FILE *out_file) {
+/*
+ * Returns the next token from the tokenizer engine of the context.
+ */
+static int yylex(YYSTYPE *yylval_param, wkt2geojson_ctx *ctx) {
+    stats_phase previous = stats_enter(ctx->stats, STATS_SCAN);
+    int token = ctx->tokenizer
+        ? tokenizer_next(ctx->tokenizer, &yylval_param->dval)
+        : flex_lex(yylval_param, ctx->scanner);
+    stats_leave(ctx->stats, previous);
+
+    if (ctx->rejects) {
+        ctx->lookahead = token;
+        if (token == POINT || token == LINESTRING || token == POLYGON) {
+            ctx->keyword = token_position(ctx);
+        }
+    }
+    return token;
+}
+
+/*
+ * Returns the position in the input of the last token read, when the
+ * context records rejects.
+ */
+static input_position token_position(wkt2geojson_ctx *ctx) {
+    input_position position;
+    if (ctx->tokenizer) {
+        position.offset = tokenizer_offset(ctx->tokenizer);
+        position.line = tokenizer_line(ctx->tokenizer);
+    } else {
+        /* The end of the input (or a zero byte) is located after its
+         * last byte, like the tokenizer does. */
+        position = ctx->scanned;
+        if (ctx->lookahead) {
+            position.offset -= (size_t)yyget_leng(ctx->scanner);
+        }
+    }
+    return position;
+}
+
+/*
+ * Reports an error in the record being parsed. When the context records
+ * rejects, the error is left to `skip_record`, run once the parser has
+ * resynchronized.
+ */
+static void report_record_error(wkt2geojson_ctx *ctx,
+                                const char *message) {
+    if (ctx->rejects) {
+        ctx->record_error = message;
+    } else {
+        yyerror(ctx, message);
+    }
+}
+
+/*
+ * Reports a syntax error.
+ */
+static int yyreport_syntax_error(const yypcontext_t *yyctx,
+                                 wkt2geojson_ctx *ctx) {
+    /* The expected tokens are not reported. */
+    (void)yyctx;
+    (void)yypcontext_expected_tokens;
+    report_record_error(ctx, "syntax error");
+    return 0;
+}
+
+/*
+ * Marks the start of a record, at the geometry keyword just shifted.
+ */
+static void begin_record(wkt2geojson_ctx *ctx) {
+    ctx->record = ctx->keyword;
+    ctx->record_open = 1;
+}
+
+/*
+ * Skips the record that caused a syntax error or held a number out of
+ * range, run by the `error` production once the tokens of the record
+ * have been popped. The record is added to the log of rejects, starting at its geometry
+ * keyword or, for stray tokens between records, at the token the error
+ * was found at. The parser then discards tokens, running this function
+ * again for each of them, until the next geometry keyword.
+ * Returns 0 on success, or -1 if the context does not record rejects,
+ * if more records than tolerated have been rejected, or in case of
+ * error.
+ */
+static int skip_record(wkt2geojson_ctx *ctx) {
+    if (!ctx->rejects) {
+        return -1;
+    }
+    arena_reset(&ctx->arena);
+    if (!ctx->record_error) {
+        return 0;
+    }
+
+    reject_entry entry = {
+        .position = ctx->record_open ? ctx->record : token_position(ctx),
+        .message = ctx->record_error,
+        .output_length = ctx->sink.length,
+        .count = ctx->count
+    };
+    ctx->record_error = NULL;
+    ctx->record_open = 0;
+
+    if (reject_log_add(ctx->rejects, &entry) < 0) {
+        yyerror(ctx, "cannot record a rejected record");
+        return -1;
+    }
+    if (ctx->rejects->count > ctx->rejects->max_errors) {
+        yyerror(ctx, "too many rejected records");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Returns 1 if the next feature is the first one of the collection,
+ * which is written without a leading comma.
+ */
+static int first_feature(const wkt2geojson_ctx *ctx) {
+    return !ctx->count && !ctx->continued;
+}
+
+/*
+ * Releases the semantic values of a feature dropped by the spatial
+ * filter of the context, which is neither written nor counted.
+ */
+static void drop_feature(wkt2geojson_ctx *ctx) {
+    arena_reset(&ctx->arena);
+    ctx->record_open = 0;
+}
+
+/*
+ * Accounts for a feature of `vertices` vertices written to the sink of
+ * the context by the writer, or appended to its IR, reporting the
+ * error if it failed. The semantic values of the feature, held by the
+ * arena of the context, are released.
+ * Returns 0 on success or -1 if the feature could not be written.
+ */
+static int end_feature(wkt2geojson_ctx *ctx, int status,
+                       wkt_geometry_type type, size_t vertices) {
+    arena_reset(&ctx->arena);
+    ctx->record_open = 0;
+    if (status < 0) {
+        yyerror(ctx, ctx->ir ? "out of memory" : strerror(ctx->sink.error));
+        return -1;
+    }
+
+    ctx->count++;
+    stats_count_feature(ctx->stats, type, vertices);
+    return 0;
+}
+
+/*
+ * Converts the WKT read by the scanner of `ctx`, or its WKB input,
+ * into GeoJSON features appended to the output sink of `ctx`, without
+ * the header and the footer of the collection and without flushing the
+ * sink.
+ * Returns 0 on success or 1 in case of error.
+ */
+int transpile_features(wkt2geojson_ctx *ctx) {
     /** Uncomment the line below to enable the debugging */
     //yydebug = 1;
 
-    int status = 1;
-    yyin = in_file;
-    y_output_file = out_file;
+    size_t allocations = ctx->arena.allocations;
+    stats_phase previous = stats_enter(ctx->stats, STATS_PARSE);
+    int status = ctx->format == INPUT_WKT ? (yyparse(ctx) ? 1 : 0)
+                                          : wkb_transpile_features(ctx);
+    stats_leave(ctx->stats, previous);
+    if (ctx->stats) {
+        ctx->stats->allocations += ctx->arena.allocations - allocations;
+    }
+    return status;
+}
 
-    char* header_str = header();
-    fprintf(y_output_file, "%s", header_str);
-    free(header_str);
+/*
+ * Converts the WKT read by the scanner of `ctx` into a GeoJSON
+ * document written to the output sink of `ctx`, which is flushed at
+ * the end.
+ * Returns 0 on success or 1 in case of error.
+ */
+int transpile_ctx(wkt2geojson_ctx *ctx) {
+    stats_phase previous = stats_enter(ctx->stats, STATS_FORMAT);
+    int failed = write_header(&ctx->sink) < 0;
+    stats_leave(ctx->stats, previous);
+    if (failed) {
+        yyerror(ctx, strerror(ctx->sink.error));
+        return 1;
+    }
+
+    /* WKB inputs are not split into chunks. */
+    int status = ctx->jobs > 1 && ctx->format == INPUT_WKT
+                     ? transpile_parallel(ctx)
+                     : transpile_features(ctx);
 
-    if (!yyparse()) {
-        status = 0;
+    /* The footer is written even after a syntax error, so that the
+     * features converted so far form a complete document. A failure of
+     * the sink during the parse has already been reported. */
+    int reported = ctx->sink.error != 0;
+    previous = stats_enter(ctx->stats, STATS_FORMAT);
+    failed = write_footer(&ctx->sink, ctx->precision) < 0
+             || output_sink_flush(&ctx->sink) < 0;
+    stats_leave(ctx->stats, previous);
+    if (failed) {
+        if (!reported) {
+            yyerror(ctx, strerror(ctx->sink.error));
+        }
+        status = 1;
     }
 
-    char* footer_str = footer();
-    fprintf(y_output_file, "%s", footer_str);
-    free(footer_str);
+    return status;
+}
+
+/*
+ * Converts the WKT read from `in_file` into a GeoJSON document written
+ * to `out_file`, using a context private to this call.
+ * Returns 0 on success or 1 in case of error.
+ */
+int transpile(FILE *in_file, FILE *out_file) {
+    wkt2geojson_ctx *ctx = wkt2geojson_ctx_new(in_file, out_file);
+    if (!ctx) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+
+    int status = transpile_ctx(ctx);
+    wkt2geojson_ctx_free(ctx);
+    return status;
+}
+
+/*
+ * Parses the WKT read from `in_file` into geometries appended to `ir`,
+ * without producing GeoJSON. After a syntax error, `ir` holds the
+ * geometries parsed before it.
+ * Returns 0 on success or 1 in case of error.
+ */
+int wkt_parse_to_ir(FILE *in_file, wkt_ir *ir) {
+    wkt2geojson_ctx *ctx = wkt2geojson_ctx_new(in_file, NULL);
+    if (!ctx) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
 
+    ctx->ir = ir;
+    int status = transpile_features(ctx);
+    wkt2geojson_ctx_free(ctx);
     return status;
 }
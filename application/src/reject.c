@@ -0,0 +1,90 @@
+/*
+ * reject.c
+ *
+ * This module keeps the log of the records rejected by the parser. On
+ * a syntax error, the parser skips the bad record, resumes at the next
+ * geometry keyword and adds an entry to the log, so that a multi-GB
+ * conversion is not lost to a single malformed line: the records to
+ * fix are listed in a sidecar file, one per line, with their byte
+ * offset and line in the input.
+ *
+ * The chunks of a parallel conversion keep their entries in memory,
+ * and the calling thread adds them to the log of the conversion in
+ * input order, with their offsets and lines made relative to the
+ * whole input.
+ */
+
+#include "reject.h"
+
+#include <stdlib.h>
+
+/* Initial capacity, in entries, of a log kept in memory. */
+#define REJECT_LOG_INITIAL_CAPACITY 16
+
+
+/*
+ * Initializes an empty log.
+ *
+ * Parameters:
+ *   log        - The log to initialize.
+ *   file       - The sidecar file, or NULL to keep the entries.
+ *   max_errors - The number of rejected records tolerated.
+ */
+void reject_log_init(reject_log *log, FILE *file, size_t max_errors) {
+    log->file = file;
+    log->max_errors = max_errors;
+    log->count = 0;
+    log->entries = NULL;
+    log->capacity = 0;
+}
+
+
+/*
+ * Records a rejected record, writing it to the sidecar file of the log
+ * or keeping it in memory.
+ *
+ * Parameters:
+ *   log   - The log.
+ *   entry - The rejected record.
+ *
+ * Returns:
+ *   0 on success, or -1 if the entry could not be written or kept.
+ */
+int reject_log_add(reject_log *log, const reject_entry *entry) {
+    if (log->file) {
+        log->count++;
+        if (fprintf(log->file, "%zu\t%zu\t%s\n", entry->position.offset,
+                    entry->position.line, entry->message) < 0) {
+            return -1;
+        }
+        return 0;
+    }
+
+    if (log->count == log->capacity) {
+        size_t capacity = log->capacity ? log->capacity * 2
+                                        : REJECT_LOG_INITIAL_CAPACITY;
+        reject_entry *entries = realloc(log->entries,
+                                        capacity * sizeof(reject_entry));
+        if (!entries) {
+            return -1;
+        }
+        log->entries = entries;
+        log->capacity = capacity;
+    }
+    log->entries[log->count++] = *entry;
+    return 0;
+}
+
+
+/*
+ * Releases the entries kept by the log.
+ *
+ * Parameters:
+ *   log - The log to release.
+ */
+void reject_log_release(reject_log *log) {
+    free(log->entries);
+    log->entries = NULL;
+    log->count = 0;
+    log->capacity = 0;
+}
@@ -0,0 +1,75 @@
+/*
+ * reject.h
+ *
+ * Interface for the reject module, used to record the WKT records
+ * skipped after a syntax error, so that one bad record does not fail
+ * a whole conversion.
+ */
+#include <stddef.h>
+#include <stdio.h>
+
+#ifndef INCLUDED_REJECT_H
+#define INCLUDED_REJECT_H
+
+/*
+ * Position of a byte of the input.
+ */
+typedef struct input_position {
+    size_t offset;           /* offset of the byte, from 0 */
+    size_t line;             /* line of the byte, from 1 */
+} input_position;
+
+
+/*
+ * A rejected record.
+ * `output_length` and `count` describe the output converted before
+ * the record, so that a conversion split into chunks (`parallel.h`)
+ * can stop at the same record as a single-threaded one.
+ */
+typedef struct reject_entry {
+    input_position position; /* start of the record */
+    const char *message;     /* reason of the rejection */
+    size_t output_length;    /* bytes of output written before it */
+    int count;               /* features converted before it */
+} reject_entry;
+
+
+/*
+ * Rejected records of a conversion.
+ * Every entry is written to `file` as a line of tab-separated fields
+ * (byte offset, line and reason), or kept in `entries` when `file` is
+ * NULL. A conversion fails once more than `max_errors` records are
+ * rejected.
+ */
+typedef struct reject_log {
+    FILE *file;              /* sidecar file, or NULL to keep entries */
+    size_t max_errors;       /* number of rejects tolerated */
+    size_t count;            /* number of records rejected so far */
+    reject_entry *entries;   /* entries kept in memory */
+    size_t capacity;         /* size of `entries` */
+} reject_log;
+
+
+/*
+ * Initializes an empty log writing to `file`, or keeping its entries
+ * in memory when `file` is NULL, and tolerating `max_errors` rejects.
+ */
+void reject_log_init(reject_log *log, FILE *file, size_t max_errors);
+
+
+/*
+ * Records a rejected record. The conversion must stop when the count
+ * of the log then exceeds its `max_errors`.
+ * Returns 0 on success or -1 in case of error.
+ */
+int reject_log_add(reject_log *log, const reject_entry *entry);
+
+
+/*
+ * Releases the entries kept by the log.
+ */
+void reject_log_release(reject_log *log);
+
+#endif  /* INCLUDED_REJECT_H */
+
+// EOF
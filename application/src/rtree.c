@@ -0,0 +1,557 @@
+/*
+ * rtree.c
+ *
+ * This module indexes the features of a GeoJSON output, so that the
+ * features intersecting a box can be read from a large output without
+ * scanning it.
+ *
+ * The writer records the byte range and the bounding box of every
+ * feature it writes. Once the output is complete, the features are
+ * sorted by the Hilbert key of the centres of their boxes (see
+ * `sorter.h`), and a packed R-tree is built bottom-up over them: every
+ * RTREE_NODE_SIZE consecutive nodes of a level get a parent covering
+ * their boxes, until a single root is left. Sorting along the curve
+ * keeps the boxes of the nodes small, and packing fills every node, so
+ * the tree is both compact and selective.
+ *
+ * The tree is written as a flat array of fixed-size nodes, the root
+ * first and the leaves last, that is used in place once mapped in
+ * memory: a query starts at the root and only descends into the nodes
+ * overlapping the query box, then reads the matching features with
+ * pread(2), in output order.
+ */
+
+#include "rtree.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sorter.h"
+
+_Static_assert(sizeof(rtree_header) == 32, "unexpected index header size");
+_Static_assert(sizeof(rtree_node) == 48, "unexpected index node size");
+
+/* Largest number of levels of a tree: enough for 2^64 leaves. */
+#define RTREE_MAX_LEVELS 64
+
+
+/*
+ * Key of a leaf of the tree, sorted instead of the leaf itself.
+ */
+typedef struct keyed_leaf {
+    uint64_t key;        /* Hilbert key of the centre of the box */
+    size_t leaf;         /* rank of the leaf in output order */
+} keyed_leaf;
+
+
+/*
+ * Orders keyed leaves by key, then in output order.
+ */
+static int compare_leaves(const void *a, const void *b) {
+    const keyed_leaf *p = a;
+    const keyed_leaf *q = b;
+    if (p->key != q->key) {
+        return p->key < q->key ? -1 : 1;
+    }
+    return (p->leaf > q->leaf) - (p->leaf < q->leaf);
+}
+
+
+/*
+ * Orders leaves by offset in the output.
+ */
+static int compare_offsets(const void *a, const void *b) {
+    const rtree_node *p = *(const rtree_node *const *)a;
+    const rtree_node *q = *(const rtree_node *const *)b;
+    return (p->offset > q->offset) - (p->offset < q->offset);
+}
+
+
+/*
+ * Computes the number of nodes of every level of a tree, from the
+ * leaves up to the root.
+ *
+ * Parameters:
+ *   count     - The number of leaves.
+ *   node_size - The number of children per node.
+ *   sizes     - Where the sizes of the levels are stored.
+ *   total     - Where the total number of nodes is stored.
+ *
+ * Returns:
+ *   The number of levels, 0 for a tree without leaves.
+ */
+static size_t level_sizes(uint64_t count, uint64_t node_size,
+                          uint64_t *sizes, uint64_t *total) {
+    size_t levels = 0;
+    *total = 0;
+    while (count) {
+        sizes[levels++] = count;
+        *total += count;
+        if (count == 1) {
+            break;
+        }
+        count = count / node_size + (count % node_size ? 1 : 0);
+    }
+    return levels;
+}
+
+
+/*
+ * Initializes an empty index.
+ *
+ * Parameters:
+ *   index - The index to initialize.
+ */
+void feature_index_init(feature_index *index) {
+    index->leaves = NULL;
+    index->count = 0;
+    index->capacity = 0;
+}
+
+
+/*
+ * Records a feature of the output.
+ *
+ * Parameters:
+ *   index  - The index.
+ *   offset - The offset of the feature in the output.
+ *   length - The number of bytes of the feature.
+ *   box    - The box of the vertices of the feature.
+ *
+ * Returns:
+ *   0 on success, or -1 if the memory could not be allocated.
+ */
+int feature_index_add(feature_index *index, uint64_t offset,
+                      uint64_t length, const bounding_box *box) {
+    if (index->count == index->capacity) {
+        size_t capacity = index->capacity ? 2 * index->capacity : 1024;
+        rtree_node *leaves = realloc(index->leaves,
+                                     capacity * sizeof(rtree_node));
+        if (!leaves) {
+            return -1;
+        }
+        index->leaves = leaves;
+        index->capacity = capacity;
+    }
+
+    rtree_node *leaf = &index->leaves[index->count++];
+    leaf->box = *box;
+    leaf->offset = offset;
+    leaf->length = length;
+    return 0;
+}
+
+
+/*
+ * Records the features of another index, such as the index of a part
+ * of the output converted on its own.
+ *
+ * Parameters:
+ *   index  - The index.
+ *   source - The index of the features to record.
+ *   count  - The number of features of `source` to record.
+ *   base   - The offset of the start of `source` in the output.
+ *
+ * Returns:
+ *   0 on success, or -1 if the memory could not be allocated.
+ */
+int feature_index_append(feature_index *index, const feature_index *source,
+                         size_t count, uint64_t base) {
+    for (size_t i = 0; i < count && i < source->count; i++) {
+        const rtree_node *leaf = &source->leaves[i];
+        if (feature_index_add(index, base + leaf->offset, leaf->length,
+                              &leaf->box) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * Builds the packed R-tree of the features recorded and writes it.
+ *
+ * Parameters:
+ *   index - The index.
+ *   file  - The file the tree is written to.
+ *
+ * Returns:
+ *   0 on success, or -1 in case of error, with errno set.
+ */
+int feature_index_write(const feature_index *index, FILE *file) {
+    uint64_t sizes[RTREE_MAX_LEVELS];
+    uint64_t total;
+    size_t levels = level_sizes(index->count, RTREE_NODE_SIZE, sizes, &total);
+
+    rtree_header header;
+    memcpy(header.magic, RTREE_MAGIC, sizeof(header.magic));
+    header.version = RTREE_VERSION;
+    header.node_size = RTREE_NODE_SIZE;
+    header.feature_count = index->count;
+    header.node_count = total;
+
+    /* The keys are computed over the extent of the centres. */
+    bounding_box extent;
+    bounding_box_reset(&extent);
+    for (size_t i = 0; i < index->count; i++) {
+        const bounding_box *box = &index->leaves[i].box;
+        double centre[2] = {
+            (box->min.x + box->max.x) / 2, (box->min.y + box->max.y) / 2
+        };
+        bounding_box_extend(&extent, centre, 1);
+    }
+
+    keyed_leaf *keyed = malloc((index->count ? index->count : 1)
+                               * sizeof(keyed_leaf));
+    rtree_node *nodes = malloc((total ? (size_t)total : 1)
+                               * sizeof(rtree_node));
+    if (!keyed || !nodes) {
+        free(keyed);
+        free(nodes);
+        errno = ENOMEM;
+        return -1;
+    }
+    for (size_t i = 0; i < index->count; i++) {
+        keyed[i].key = hilbert_key(&extent, &index->leaves[i].box);
+        keyed[i].leaf = i;
+    }
+    qsort(keyed, index->count, sizeof(keyed_leaf), compare_leaves);
+
+    /* Levels are stored from the root down: `start` is the index of
+     * the first node of the level being built, and `below` that of the
+     * level under it. */
+    size_t start = (size_t)(total - index->count);
+    for (size_t i = 0; i < index->count; i++) {
+        nodes[start + i] = index->leaves[keyed[i].leaf];
+    }
+    free(keyed);
+
+    for (size_t level = 1; level < levels; level++) {
+        size_t below = start;
+        start -= (size_t)sizes[level];
+        for (size_t j = 0; j < sizes[level]; j++) {
+            size_t first = below + j * RTREE_NODE_SIZE;
+            size_t count = (size_t)sizes[level - 1] - j * RTREE_NODE_SIZE;
+            if (count > RTREE_NODE_SIZE) {
+                count = RTREE_NODE_SIZE;
+            }
+            rtree_node *node = &nodes[start + j];
+            bounding_box_reset(&node->box);
+            for (size_t c = 0; c < count; c++) {
+                bounding_box_merge(&node->box, &nodes[first + c].box);
+            }
+            node->offset = first;
+            node->length = count;
+        }
+    }
+
+    int failed = fwrite(&header, sizeof(header), 1, file) != 1
+                 || fwrite(nodes, sizeof(rtree_node), (size_t)total, file)
+                        != total;
+    free(nodes);
+    return failed ? -1 : 0;
+}
+
+
+/*
+ * Releases the features recorded.
+ *
+ * Parameters:
+ *   index - The index, or NULL.
+ */
+void feature_index_release(feature_index *index) {
+    if (!index) {
+        return;
+    }
+    free(index->leaves);
+    feature_index_init(index);
+}
+
+
+/*
+ * Describes an errno value with a string literal.
+ *
+ * Parameters:
+ *   error - The errno value.
+ *
+ * Returns:
+ *   The message of the error.
+ */
+const char* rtree_error_message(int error) {
+    switch (error) {
+        case ENOENT:
+            return "No such file or directory";
+        case EACCES:
+            return "Permission denied";
+        case EISDIR:
+            return "Is a directory";
+        case ENOMEM:
+            return "Cannot allocate memory";
+        case EIO:
+            return "Input/output error";
+        case EINVAL:
+            return "Invalid argument";
+        case ENODEV:
+            return "No such device";
+        case ELOOP:
+            return "Too many levels of symbolic links";
+        case ENAMETOOLONG:
+            return "File name too long";
+        case ENOTDIR:
+            return "Not a directory";
+        case EMFILE:
+        case ENFILE:
+            return "Too many open files";
+        default:
+            return "Cannot read the index or its output";
+    }
+}
+
+
+/*
+ * Maps an index file in memory.
+ *
+ * Parameters:
+ *   tree  - Where the mapped index is stored.
+ *   path  - The path of the index file.
+ *   error - Where the message of a failure is stored.
+ *
+ * Returns:
+ *   0 on success, or -1 in case of error.
+ */
+int rtree_open(rtree_index *tree, const char *path, const char **error) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        *error = rtree_error_message(errno);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    if (st.st_size < (off_t)sizeof(rtree_header)) {
+        close(fd);
+        *error = "not a wkt2geojson index";
+        return -1;
+    }
+
+    size_t length = (size_t)st.st_size;
+    void *data = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        *error = rtree_error_message(errno);
+        return -1;
+    }
+
+    const rtree_header *header = data;
+    size_t room = (length - sizeof(rtree_header)) / sizeof(rtree_node);
+    const char *message = NULL;
+    if (memcmp(header->magic, RTREE_MAGIC, sizeof(header->magic))) {
+        message = "not a wkt2geojson index";
+    } else if (header->version != RTREE_VERSION) {
+        message = "unsupported index version or byte order";
+    } else if (header->node_size < 2 || header->feature_count > room) {
+        message = "corrupt index";
+    } else {
+        uint64_t sizes[RTREE_MAX_LEVELS];
+        uint64_t total;
+        level_sizes(header->feature_count, header->node_size, sizes, &total);
+        if (total != header->node_count
+                || sizeof(rtree_header) + total * sizeof(rtree_node)
+                       != length) {
+            message = "corrupt index";
+        }
+    }
+    if (message) {
+        *error = message;
+        munmap(data, length);
+        return -1;
+    }
+
+    tree->header = header;
+    tree->nodes = (const rtree_node *)(header + 1);
+    tree->mapped = length;
+    madvise(data, length, MADV_RANDOM);
+    return 0;
+}
+
+
+/*
+ * Returns 1 if two boxes intersect, boundaries included, 0 otherwise.
+ */
+static int boxes_meet(const bounding_box *a, const bounding_box *b) {
+    return a->min.x <= b->max.x && b->min.x <= a->max.x
+           && a->min.y <= b->max.y && b->min.y <= a->max.y;
+}
+
+
+/*
+ * Collects the leaves of the tree whose box intersects `query`.
+ *
+ * Parameters:
+ *   tree  - The mapped index.
+ *   query - The query box.
+ *   hits  - Where the array of the matching leaves is stored, to be
+ *           freed by the caller.
+ *   count - Where the number of matching leaves is stored.
+ *
+ * Returns:
+ *   0 on success, or the errno value of a failure.
+ */
+static int rtree_search(const rtree_index *tree, const bounding_box *query,
+                        const rtree_node ***hits, size_t *count) {
+    size_t nodes = (size_t)tree->header->node_count;
+    size_t leaves = nodes - (size_t)tree->header->feature_count;
+    size_t *stack = NULL;
+    size_t depth = 0;
+    size_t stack_capacity = 0;
+    const rtree_node **found = NULL;
+    size_t found_capacity = 0;
+    int error = 0;
+
+    *count = 0;
+    if (nodes && boxes_meet(&tree->nodes[0].box, query)) {
+        stack = malloc(RTREE_NODE_SIZE * sizeof(size_t));
+        stack_capacity = RTREE_NODE_SIZE;
+        error = stack ? 0 : ENOMEM;
+        if (stack) {
+            stack[depth++] = 0;
+        }
+    }
+
+    while (depth && !error) {
+        size_t i = stack[--depth];
+        const rtree_node *node = &tree->nodes[i];
+        if (i >= leaves) {
+            if (*count == found_capacity) {
+                size_t capacity = found_capacity ? 2 * found_capacity : 64;
+                const rtree_node **grown = realloc(
+                    found, capacity * sizeof(const rtree_node *));
+                if (!grown) {
+                    error = ENOMEM;
+                    break;
+                }
+                found = grown;
+                found_capacity = capacity;
+            }
+            found[(*count)++] = node;
+            continue;
+        }
+
+        /* Children always follow their parent, so a corrupt file
+         * cannot make the search loop. */
+        if (node->offset <= i || node->offset > nodes
+                || node->length > nodes - node->offset) {
+            error = EINVAL;
+            break;
+        }
+        if (depth + node->length > stack_capacity) {
+            size_t capacity = 2 * stack_capacity + (size_t)node->length;
+            size_t *grown = realloc(stack, capacity * sizeof(size_t));
+            if (!grown) {
+                error = ENOMEM;
+                break;
+            }
+            stack = grown;
+            stack_capacity = capacity;
+        }
+        for (size_t c = (size_t)node->length; c-- > 0;) {
+            size_t child = (size_t)node->offset + c;
+            if (boxes_meet(&tree->nodes[child].box, query)) {
+                stack[depth++] = child;
+            }
+        }
+    }
+
+    free(stack);
+    if (error) {
+        free(found);
+        *count = 0;
+        return error;
+    }
+    *hits = found;
+    return 0;
+}
+
+
+/*
+ * Reads the features of an output intersecting a box.
+ *
+ * Parameters:
+ *   tree      - The mapped index of the output.
+ *   fd        - The output, open for reading.
+ *   query     - The query box.
+ *   fn        - The function receiving the features.
+ *   user_data - The first argument of `fn`.
+ *
+ * Returns:
+ *   0 on success, or the errno value of the first failure.
+ */
+int rtree_query(const rtree_index *tree, int fd, const bounding_box *query,
+                rtree_fn fn, void *user_data) {
+    const rtree_node **hits = NULL;
+    size_t count;
+    int error = rtree_search(tree, query, &hits, &count);
+    if (error) {
+        return error;
+    }
+
+    /* Reading in output order turns the reads into a forward scan. */
+    if (count) {
+        qsort(hits, count, sizeof(const rtree_node *), compare_offsets);
+    }
+
+    char *buffer = NULL;
+    size_t capacity = 0;
+    for (size_t i = 0; i < count && !error; i++) {
+        size_t length = (size_t)hits[i]->length;
+        if (length > capacity) {
+            char *grown = realloc(buffer, length);
+            if (!grown) {
+                error = ENOMEM;
+                break;
+            }
+            buffer = grown;
+            capacity = length;
+        }
+
+        size_t read = 0;
+        while (read < length && !error) {
+            ssize_t n = pread(fd, buffer + read, length - read,
+                              (off_t)(hits[i]->offset + read));
+            if (n < 0 && errno != EINTR) {
+                error = errno;
+            } else if (n == 0) {
+                error = EIO;
+            } else if (n > 0) {
+                read += (size_t)n;
+            }
+        }
+        if (!error) {
+            error = fn(user_data, buffer, length);
+        }
+    }
+
+    free(buffer);
+    free(hits);
+    return error;
+}
+
+
+/*
+ * Unmaps an index file.
+ *
+ * Parameters:
+ *   tree - The mapped index.
+ */
+void rtree_close(rtree_index *tree) {
+    munmap((void *)tree->header, tree->mapped);
+    tree->header = NULL;
+    tree->nodes = NULL;
+    tree->mapped = 0;
+}
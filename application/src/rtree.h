@@ -0,0 +1,158 @@
+/*
+ * rtree.h
+ *
+ * Interface for the rtree module, used to write a packed Hilbert
+ * R-tree of the features of a GeoJSON output to a sidecar file, and to
+ * answer bounding box queries against the output with it.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "coordinates.h"
+
+#ifndef INCLUDED_RTREE_H
+#define INCLUDED_RTREE_H
+
+/*
+ * First bytes of an index file.
+ */
+#define RTREE_MAGIC "W2GJRTRE"
+
+/*
+ * Version of the layout of an index file, written in the byte order of
+ * the machine, so that another byte order is rejected as a version
+ * mismatch.
+ */
+#define RTREE_VERSION 1
+
+/*
+ * Number of children of every node but the last one of a level.
+ */
+#define RTREE_NODE_SIZE 16
+
+
+/*
+ * Header of an index file, followed by its `node_count` nodes.
+ */
+typedef struct rtree_header {
+    char magic[8];            /* RTREE_MAGIC, without its terminator */
+    uint32_t version;         /* RTREE_VERSION */
+    uint32_t node_size;       /* children per node */
+    uint64_t feature_count;   /* number of leaves */
+    uint64_t node_count;      /* number of nodes, leaves included */
+} rtree_header;
+
+
+/*
+ * Node of an index file. The nodes are stored level by level from the
+ * root, the last `feature_count` nodes being the leaves, in the
+ * Hilbert order of the centres of their boxes. The children of a node
+ * are consecutive nodes of the level below.
+ */
+typedef struct rtree_node {
+    bounding_box box;         /* box of the feature, or of the children */
+    uint64_t offset;          /* offset of the feature, or first child */
+    uint64_t length;          /* length of the feature, or child count */
+} rtree_node;
+
+
+/*
+ * Features of an output, collected while they are written.
+ */
+typedef struct feature_index {
+    rtree_node *leaves;       /* one leaf per feature, in output order */
+    size_t count;             /* number of leaves */
+    size_t capacity;          /* room in `leaves` */
+} feature_index;
+
+
+/*
+ * Index file mapped in memory.
+ */
+typedef struct rtree_index {
+    const rtree_header *header; /* first byte of the file */
+    const rtree_node *nodes;  /* nodes of the tree */
+    size_t mapped;            /* length of the mapping */
+} rtree_index;
+
+
+/*
+ * Function receiving the features matching a query, in output order.
+ * Returns 0 on success or the errno value of a failure.
+ */
+typedef int (*rtree_fn)(void *user_data, const char *data, size_t length);
+
+
+/*
+ * Initializes an empty index.
+ */
+void feature_index_init(feature_index *index);
+
+
+/*
+ * Records the feature written as the `length` bytes at `offset` of the
+ * output, whose vertices lie in `box`.
+ * Returns 0 on success or -1 if the memory could not be allocated.
+ */
+int feature_index_add(feature_index *index, uint64_t offset,
+                      uint64_t length, const bounding_box *box);
+
+
+/*
+ * Records the first `count` features of `source`, moved `base` bytes
+ * further in the output.
+ * Returns 0 on success or -1 if the memory could not be allocated.
+ */
+int feature_index_append(feature_index *index, const feature_index *source,
+                         size_t count, uint64_t base);
+
+
+/*
+ * Writes the packed R-tree of the features recorded to `file`.
+ * Returns 0 on success or -1 in case of error, with errno set.
+ */
+int feature_index_write(const feature_index *index, FILE *file);
+
+
+/*
+ * Releases the features recorded. Accepts NULL.
+ */
+void feature_index_release(feature_index *index);
+
+
+/*
+ * Maps the index file at `path` in memory and checks its layout.
+ * Returns 0 on success or -1 in case of error, with `*error` set to a
+ * static message.
+ */
+int rtree_open(rtree_index *tree, const char *path, const char **error);
+
+
+/*
+ * Returns a static message describing the errno value `error` of a
+ * failure to open or query an index. Unlike strerror(3), the message
+ * is never overwritten, and can be used from any thread.
+ */
+const char* rtree_error_message(int error);
+
+
+/*
+ * Reads with pread(2) the features of the output open as `fd` whose box
+ * intersects `query`, boundaries included, and hands them to `fn` with
+ * `user_data`, in output order. Only the nodes overlapping the query
+ * are visited.
+ * Returns 0 on success or the errno value of the first failure.
+ */
+int rtree_query(const rtree_index *tree, int fd, const bounding_box *query,
+                rtree_fn fn, void *user_data);
+
+
+/*
+ * Unmaps the index file.
+ */
+void rtree_close(rtree_index *tree);
+
+#endif  /* INCLUDED_RTREE_H */
+
+// EOF
@@ -0,0 +1,548 @@
+/*
+ * server.c
+ *
+ * This module keeps a conversion process warm behind a Unix domain
+ * socket, so that clients pay for a request instead of a process
+ * launch. The main thread runs an epoll loop that accepts clients and
+ * reads their requests without blocking; complete requests are queued
+ * to a pool of worker threads, which convert them with the library
+ * interface (`libwkt2geojson.h`) and stream the GeoJSON back as soon
+ * as the output sink is flushed.
+ *
+ * Client sockets are registered with EPOLLONESHOT: a client is owned
+ * either by the epoll loop, while its request is being read, or by the
+ * worker converting its request, which re-arms it once the response is
+ * sent. A client is thus never read and answered at the same time.
+ *
+ * SIGINT and SIGTERM are received through a signalfd in the epoll
+ * loop: the server stops accepting requests, lets the workers finish
+ * the queued ones, and removes its socket file.
+ */
+
+#define _GNU_SOURCE  /* accept4 */
+
+#include "server.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* Pending connections queued by the kernel. */
+#define SERVER_BACKLOG 128
+
+/* Events handled by a single call to epoll_wait. */
+#define SERVER_MAX_EVENTS 64
+
+/* Time a worker waits for a client to make room for its response,
+ * in milliseconds, before the client is dropped. */
+#define SERVER_SEND_TIMEOUT 10000
+
+/* Size of a request header and of a response frame header. */
+#define REQUEST_HEADER_SIZE 4
+#define FRAME_HEADER_SIZE 5
+
+
+/*
+ * A connected client and the request being read from it.
+ */
+typedef struct client {
+    int fd;                                  /* connected socket */
+    unsigned char header[REQUEST_HEADER_SIZE];  /* length of the request */
+    size_t header_length;                    /* header bytes read */
+    char *payload;                           /* WKT of the request */
+    size_t length;                           /* length of the WKT */
+    size_t received;                         /* WKT bytes read */
+    int broken;                              /* whether a send failed */
+    struct client *queued;                   /* next client in the queue */
+    struct client *prev;                     /* previous connected client */
+    struct client *next;                     /* next connected client */
+} client;
+
+
+/*
+ * State shared by the epoll loop and the workers.
+ */
+typedef struct server {
+    int epoll_fd;                  /* epoll instance */
+    int listen_fd;                 /* listening socket */
+    int signal_fd;                 /* SIGINT and SIGTERM */
+    wkt2geojson_options options;   /* options of every conversion */
+    pthread_mutex_t lock;          /* protects the fields below */
+    pthread_cond_t ready;          /* signals a queued client */
+    client *head;                  /* first client with a full request */
+    client *tail;                  /* last client with a full request */
+    client *clients;               /* every connected client */
+    int stopping;                  /* whether the server shuts down */
+} server;
+
+
+/*
+ * Writes `length` bytes to a non-blocking socket, waiting for room
+ * when it is full. A client that reads nothing for SERVER_SEND_TIMEOUT
+ * milliseconds would otherwise hold the worker forever.
+ *
+ * Returns:
+ *   0 on success, ETIMEDOUT if the socket stays full, or an errno value
+ *   if an error occurs.
+ */
+static int send_all(int fd, const char *data, size_t length) {
+    while (length) {
+        ssize_t count = send(fd, data, length, MSG_NOSIGNAL);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                return errno;
+            }
+            struct pollfd wait = { .fd = fd, .events = POLLOUT };
+            int ready = poll(&wait, 1, SERVER_SEND_TIMEOUT);
+            if (ready < 0 && errno != EINTR) {
+                return errno;
+            }
+            if (ready == 0) {
+                return ETIMEDOUT;
+            }
+            continue;
+        }
+        data += count;
+        length -= (size_t)count;
+    }
+    return 0;
+}
+
+
+/*
+ * Sends a response frame to a client.
+ *
+ * Returns:
+ *   0 on success, or an errno value if an error occurs.
+ */
+static int send_frame(client *c, char type, const char *data,
+                      size_t length) {
+    unsigned char header[FRAME_HEADER_SIZE] = {
+        (unsigned char)type,
+        (unsigned char)(length >> 24), (unsigned char)(length >> 16),
+        (unsigned char)(length >> 8), (unsigned char)length
+    };
+
+    int error = send_all(c->fd, (const char *)header, sizeof(header));
+    if (!error) {
+        error = send_all(c->fd, data, length);
+    }
+    if (error) {
+        c->broken = 1;
+    }
+    return error;
+}
+
+
+/*
+ * Sink of the conversions: sends every flushed piece of GeoJSON as a
+ * data frame.
+ */
+static int send_data(void *user_data, const char *data, size_t length) {
+    return send_frame(user_data, 'D', data, length);
+}
+
+
+/*
+ * Registers a client socket for a single readable event.
+ *
+ * Returns:
+ *   0 on success, or -1 if an error occurs.
+ */
+static int arm_client(server *s, client *c, int operation) {
+    struct epoll_event event = {
+        .events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT,
+        .data.ptr = c
+    };
+    return epoll_ctl(s->epoll_fd, operation, c->fd, &event);
+}
+
+
+/*
+ * Disconnects a client and releases it.
+ */
+static void drop_client(server *s, client *c) {
+    epoll_ctl(s->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+
+    pthread_mutex_lock(&s->lock);
+    if (c->prev) {
+        c->prev->next = c->next;
+    } else {
+        s->clients = c->next;
+    }
+    if (c->next) {
+        c->next->prev = c->prev;
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    free(c->payload);
+    free(c);
+}
+
+
+/*
+ * Accepts every pending connection.
+ */
+static void accept_clients(server *s) {
+    for (;;) {
+        int fd = accept4(s->listen_fd, NULL, NULL,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            return;
+        }
+
+        client *c = calloc(1, sizeof(client));
+        if (!c) {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+
+        pthread_mutex_lock(&s->lock);
+        c->next = s->clients;
+        if (s->clients) {
+            s->clients->prev = c;
+        }
+        s->clients = c;
+        pthread_mutex_unlock(&s->lock);
+
+        if (arm_client(s, c, EPOLL_CTL_ADD) < 0) {
+            drop_client(s, c);
+        }
+    }
+}
+
+
+/*
+ * Reads the available bytes of the request of a client.
+ *
+ * Returns:
+ *   1 if the request is complete, 0 if more bytes are expected, or -1
+ *   if the client must be dropped.
+ */
+static int read_request(client *c) {
+    while (c->header_length < REQUEST_HEADER_SIZE) {
+        ssize_t count = read(c->fd, c->header + c->header_length,
+                             REQUEST_HEADER_SIZE - c->header_length);
+        if (count <= 0) {
+            return count < 0 && (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+        }
+        c->header_length += (size_t)count;
+
+        if (c->header_length == REQUEST_HEADER_SIZE) {
+            c->length = (size_t)c->header[0] << 24
+                        | (size_t)c->header[1] << 16
+                        | (size_t)c->header[2] << 8
+                        | (size_t)c->header[3];
+            if (c->length > SERVER_MAX_REQUEST) {
+                static const char message[] = "request too large";
+                send_frame(c, 'E', message, sizeof(message) - 1);
+                return -1;
+            }
+            c->payload = malloc(c->length ? c->length : 1);
+            if (!c->payload) {
+                static const char message[] = "out of memory";
+                send_frame(c, 'E', message, sizeof(message) - 1);
+                return -1;
+            }
+            c->received = 0;
+        }
+    }
+
+    while (c->received < c->length) {
+        ssize_t count = read(c->fd, c->payload + c->received,
+                             c->length - c->received);
+        if (count <= 0) {
+            return count < 0 && (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+        }
+        c->received += (size_t)count;
+    }
+    return 1;
+}
+
+
+/*
+ * Converts the request of a client and sends the response.
+ */
+static void respond(server *s, client *c) {
+    const char *error = NULL;
+    if (wkt2geojson_convert(c->payload, c->length, &s->options, send_data,
+                            c, &error) < 0) {
+        if (!c->broken) {
+            send_frame(c, 'E', error, strlen(error));
+        }
+    } else {
+        send_frame(c, 'Z', NULL, 0);
+    }
+
+    free(c->payload);
+    c->payload = NULL;
+    c->header_length = 0;
+    c->length = 0;
+    c->received = 0;
+}
+
+
+/*
+ * Worker thread body: converts the queued requests until the server
+ * shuts down and the queue is empty.
+ */
+static void* run_worker(void *arg) {
+    server *s = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&s->lock);
+        while (!s->head && !s->stopping) {
+            pthread_cond_wait(&s->ready, &s->lock);
+        }
+        client *c = s->head;
+        if (c) {
+            s->head = c->queued;
+            if (!s->head) {
+                s->tail = NULL;
+            }
+        }
+        pthread_mutex_unlock(&s->lock);
+
+        if (!c) {
+            return NULL;
+        }
+
+        respond(s, c);
+        if (c->broken || arm_client(s, c, EPOLL_CTL_MOD) < 0) {
+            drop_client(s, c);
+        }
+    }
+}
+
+
+/*
+ * Queues a client whose request is complete for the workers.
+ */
+static void queue_client(server *s, client *c) {
+    c->queued = NULL;
+    pthread_mutex_lock(&s->lock);
+    if (s->tail) {
+        s->tail->queued = c;
+    } else {
+        s->head = c;
+    }
+    s->tail = c;
+    pthread_cond_signal(&s->ready);
+    pthread_mutex_unlock(&s->lock);
+}
+
+
+/*
+ * Creates the listening socket at `path`, replacing a stale socket
+ * file.
+ *
+ * Returns:
+ *   The socket, or -1 if an error occurs.
+ */
+static int listen_on(const char *path) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    struct stat status;
+    if (!lstat(path, &status) && S_ISSOCK(status.st_mode)) {
+        unlink(path);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0
+            || listen(fd, SERVER_BACKLOG) < 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+
+/*
+ * Runs the epoll loop until a shutdown signal is received.
+ */
+static void run_loop(server *s) {
+    struct epoll_event events[SERVER_MAX_EVENTS];
+
+    for (;;) {
+        int count = epoll_wait(s->epoll_fd, events, SERVER_MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Error waiting for clients");
+            return;
+        }
+
+        for (int i = 0; i < count; i++) {
+            void *source = events[i].data.ptr;
+            if (source == &s->signal_fd) {
+                /* Consumes the signal, so that it is not delivered
+                 * once unblocked. */
+                struct signalfd_siginfo info;
+                if (read(s->signal_fd, &info, sizeof(info)) < 0) {
+                    continue;
+                }
+                return;
+            }
+            if (source == &s->listen_fd) {
+                accept_clients(s);
+                continue;
+            }
+
+            client *c = source;
+            int status = read_request(c);
+            if (status < 0) {
+                drop_client(s, c);
+            } else if (status > 0) {
+                queue_client(s, c);
+            } else if (arm_client(s, c, EPOLL_CTL_MOD) < 0) {
+                drop_client(s, c);
+            }
+        }
+    }
+}
+
+
+/*
+ * Opens the listening socket, the signalfd and the epoll instance of
+ * the server.
+ *
+ * Returns:
+ *   0 on success, or -1 if an error occurs.
+ */
+static int open_server(server *s, const char *path,
+                       const sigset_t *signals) {
+    s->listen_fd = listen_on(path);
+    if (s->listen_fd < 0) {
+        perror("Error opening the server socket");
+        return -1;
+    }
+
+    s->signal_fd = signalfd(-1, signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    s->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event listen_event = { .events = EPOLLIN,
+                                        .data.ptr = &s->listen_fd };
+    struct epoll_event signal_event = { .events = EPOLLIN,
+                                        .data.ptr = &s->signal_fd };
+    if (s->signal_fd < 0 || s->epoll_fd < 0
+            || epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, s->listen_fd,
+                         &listen_event) < 0
+            || epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, s->signal_fd,
+                         &signal_event) < 0) {
+        perror("Error starting the server");
+        return -1;
+    }
+    return 0;
+}
+
+
+/*
+ * Serves conversions on a Unix domain socket.
+ *
+ * Parameters:
+ *   path    - The path of the socket.
+ *   workers - The number of worker threads, or 0 for one per CPU.
+ *   options - The options of every conversion.
+ *
+ * Returns:
+ *   0 on a clean shutdown, or 1 if an error occurs.
+ */
+int server_run(const char *path, int workers,
+               const wkt2geojson_options *options) {
+    if (workers <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (int)cpus : 1;
+    }
+    if (workers > SERVER_MAX_WORKERS) {
+        workers = SERVER_MAX_WORKERS;
+    }
+
+    server s = { .epoll_fd = -1, .listen_fd = -1, .signal_fd = -1,
+                 .options = *options };
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.ready, NULL);
+
+    /* The signals are blocked before the workers start, so that they
+     * are only delivered through the signalfd. */
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    pthread_t *threads = calloc((size_t)workers, sizeof(pthread_t));
+    int started = 0;
+    int status = 1;
+
+    if (threads && !open_server(&s, path, &signals)) {
+        for (; started < workers; started++) {
+            if (pthread_create(&threads[started], NULL, run_worker, &s)) {
+                break;
+            }
+        }
+        if (started) {
+            fprintf(stderr, "Listening on %s with %d workers\n", path,
+                    started);
+            run_loop(&s);
+            status = 0;
+        } else {
+            fprintf(stderr, "Error: cannot start the worker threads\n");
+        }
+    }
+
+    pthread_mutex_lock(&s.lock);
+    s.stopping = 1;
+    pthread_cond_broadcast(&s.ready);
+    pthread_mutex_unlock(&s.lock);
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    while (s.clients) {
+        drop_client(&s, s.clients);
+    }
+    if (s.listen_fd >= 0) {
+        close(s.listen_fd);
+        unlink(path);
+    }
+    if (s.signal_fd >= 0) {
+        close(s.signal_fd);
+    }
+    if (s.epoll_fd >= 0) {
+        close(s.epoll_fd);
+    }
+    free(threads);
+    pthread_cond_destroy(&s.ready);
+    pthread_mutex_destroy(&s.lock);
+    pthread_sigmask(SIG_UNBLOCK, &signals, NULL);
+    return status;
+}
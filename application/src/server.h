@@ -0,0 +1,49 @@
+/*
+ * server.h
+ *
+ * Interface for the server module, a long-running conversion daemon
+ * listening on a Unix domain socket.
+ *
+ * Protocol: a client sends requests made of a 4-byte big-endian length
+ * followed by that many bytes of WKT, and may send several requests on
+ * the same connection. Every response is a sequence of frames made of
+ * a type byte, a 4-byte big-endian length and a payload:
+ *
+ *   'D' - a piece of the GeoJSON document, in order;
+ *   'Z' - end of a successful conversion, with an empty payload;
+ *   'E' - end of a failed conversion, with the error message as
+ *         payload. The 'D' frames sent before form a complete document
+ *         holding the features converted before the error.
+ *
+ * A client that makes no room for its response for 10 seconds is
+ * disconnected.
+ */
+#include "libwkt2geojson.h"
+
+#ifndef INCLUDED_SERVER_H
+#define INCLUDED_SERVER_H
+
+/*
+ * Largest WKT payload accepted in a single request.
+ */
+#define SERVER_MAX_REQUEST (256u * 1024 * 1024)
+
+/*
+ * Largest number of worker threads.
+ */
+#define SERVER_MAX_WORKERS 1024
+
+
+/*
+ * Serves conversions on the Unix socket at `path` until SIGINT or
+ * SIGTERM is received, with `workers` threads (or one per CPU when it
+ * is 0) converting the requests with `options`. A stale socket file at
+ * `path` is replaced, and removed on exit.
+ * Returns 0 on a clean shutdown or 1 in case of error.
+ */
+int server_run(const char *path, int workers,
+               const wkt2geojson_options *options);
+
+#endif  /* INCLUDED_SERVER_H */
+
+// EOF
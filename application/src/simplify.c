@@ -0,0 +1,405 @@
+/*
+ * simplify.c
+ *
+ * This module simplifies the lines and rings of the geometries before
+ * they are formatted, so that the vertices a web map cannot display
+ * are neither formatted nor written. It works in place on the
+ * interleaved coordinates of the buffer the parser filled (see
+ * `coordinates.h`): the vertices of every ring are marked as kept or
+ * dropped, then the kept ones are moved down and the ring offsets
+ * updated, so the writer is handed a smaller buffer of the same shape.
+ *
+ * Douglas-Peucker keeps the endpoints, then recursively the vertex
+ * farthest from the segment between two kept vertices while it is
+ * farther than the tolerance; the recursion is run from an explicit
+ * stack, in O(n log n) time for usual lines (O(n^2) for adversarial
+ * ones). A closed ring, whose endpoints are the same vertex, is first
+ * split at the vertex farthest from them.
+ *
+ * Visvalingam-Whyatt repeatedly drops the vertex forming the smallest
+ * triangle with its neighbours, until every triangle is at least the
+ * tolerance squared. The vertices are kept in a binary heap indexed by
+ * vertex, so that the triangles of the two neighbours of a dropped
+ * vertex are updated in place, in O(n log n) time. As usual, the area
+ * of a neighbour never becomes smaller than that of a vertex dropped
+ * before it.
+ *
+ * Both algorithms stop at the minimum size of a valid geometry: two
+ * vertices for a line and four for a ring, whose first and last
+ * vertices are kept, so closed rings stay closed.
+ */
+
+#include "simplify.h"
+
+#include <string.h>
+
+/* Smallest number of vertices of a simplified line and ring. */
+#define SIMPLIFY_MIN_LINE 2
+#define SIMPLIFY_MIN_RING 4
+
+
+/*
+ * Scratch memory of the simplification of a buffer, sized for its
+ * largest ring and shared by all of its rings.
+ */
+typedef struct simplify_scratch {
+    unsigned char *kept;  /* whether every vertex of the ring is kept */
+    size_t *stack;        /* Douglas-Peucker ranges, or heap items */
+    size_t *slots;        /* position of every vertex in the heap */
+    size_t *prev;         /* previous kept vertex of every vertex */
+    size_t *next;         /* next kept vertex of every vertex */
+    double *area;         /* effective area of every vertex */
+} simplify_scratch;
+
+
+/*
+ * Looks up the simplification algorithm called `name`.
+ *
+ * Parameters:
+ *   name   - The name of the algorithm, as given on the command line.
+ *   method - Where the algorithm is stored.
+ *
+ * Returns:
+ *   0 on success, or -1 if the name is unknown.
+ */
+int simplify_method_from_name(const char *name, simplify_method *method) {
+    static const struct {
+        const char *name;
+        simplify_method method;
+    } names[] = {
+        { "dp", SIMPLIFY_DOUGLAS_PEUCKER },
+        { "vw", SIMPLIFY_VISVALINGAM }
+    };
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (!strcmp(name, names[i].name)) {
+            *method = names[i].method;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
+/*
+ * Returns the squared distance from the vertex `p` to the segment from
+ * `a` to `b`, all given as pointers to x/y pairs.
+ */
+static double segment_distance2(const double *p, const double *a,
+                                const double *b) {
+    double dx = b[0] - a[0];
+    double dy = b[1] - a[1];
+    double px = p[0] - a[0];
+    double py = p[1] - a[1];
+    double length2 = dx * dx + dy * dy;
+    if (length2 > 0) {
+        double t = (px * dx + py * dy) / length2;
+        if (t >= 1) {
+            px = p[0] - b[0];
+            py = p[1] - b[1];
+        } else if (t > 0) {
+            px -= t * dx;
+            py -= t * dy;
+        }
+    }
+    return px * px + py * py;
+}
+
+
+/*
+ * Returns the area of the triangle of the vertices `a`, `b` and `c`.
+ */
+static double triangle_area(const double *a, const double *b,
+                            const double *c) {
+    double cross = (b[0] - a[0]) * (c[1] - a[1])
+                   - (c[0] - a[0]) * (b[1] - a[1]);
+    return (cross < 0 ? -cross : cross) / 2;
+}
+
+
+/*
+ * Finds the vertex of the range (first, last) of `xy` that is not kept
+ * and is farthest from the segment between `first` and `last`.
+ *
+ * Returns:
+ *   The vertex, or `first` if every vertex of the range is kept.
+ */
+static size_t farthest_vertex(const double *xy, const unsigned char *kept,
+                              size_t first, size_t last, double *distance2) {
+    size_t farthest = first;
+    *distance2 = -1;
+    for (size_t i = first + 1; i < last; i++) {
+        double d = segment_distance2(xy + 2 * i, xy + 2 * first,
+                                     xy + 2 * last);
+        if (!kept[i] && d > *distance2) {
+            *distance2 = d;
+            farthest = i;
+        }
+    }
+    return farthest;
+}
+
+
+/*
+ * Marks the vertices of the range [first, last] of `xy` kept by
+ * Douglas-Peucker, `first` and `last` being kept already.
+ */
+static void douglas_peucker(const double *xy, size_t first, size_t last,
+                            double tolerance2, simplify_scratch *s) {
+    size_t top = 0;
+    s->stack[top++] = first;
+    s->stack[top++] = last;
+    while (top) {
+        size_t b = s->stack[--top];
+        size_t a = s->stack[--top];
+        double distance2;
+        size_t k = farthest_vertex(xy, s->kept, a, b, &distance2);
+        if (k != a && distance2 > tolerance2) {
+            s->kept[k] = 1;
+            s->stack[top++] = a;
+            s->stack[top++] = k;
+            s->stack[top++] = k;
+            s->stack[top++] = b;
+        }
+    }
+}
+
+
+/*
+ * Marks the vertices of a ring or line of `count` vertices kept by
+ * Douglas-Peucker.
+ */
+static void simplify_douglas_peucker(const double *xy, size_t count,
+                                     int ring, double tolerance,
+                                     simplify_scratch *s) {
+    size_t last = count - 1;
+    double tolerance2 = tolerance * tolerance;
+    memset(s->kept, 0, count);
+    s->kept[0] = 1;
+    s->kept[last] = 1;
+
+    if (!ring) {
+        douglas_peucker(xy, 0, last, tolerance2, s);
+    } else {
+        /* The endpoints are the same vertex: the ring is split at the
+         * vertex farthest from it, and a fourth vertex is added if the
+         * halves are straight enough to be reduced to it. */
+        double distance2;
+        size_t split = farthest_vertex(xy, s->kept, 0, last, &distance2);
+        s->kept[split] = 1;
+        douglas_peucker(xy, 0, split, tolerance2, s);
+        douglas_peucker(xy, split, last, tolerance2, s);
+
+        size_t kept = 0;
+        for (size_t i = 0; i < count; i++) {
+            kept += s->kept[i];
+        }
+        if (kept < SIMPLIFY_MIN_RING) {
+            double before, after;
+            size_t a = farthest_vertex(xy, s->kept, 0, split, &before);
+            size_t b = farthest_vertex(xy, s->kept, split, last, &after);
+            s->kept[before >= after ? a : b] = 1;
+        }
+    }
+}
+
+
+/*
+ * Returns 1 if the heap item at `i` orders before the one at `j`.
+ */
+static int heap_before(const simplify_scratch *s, size_t i, size_t j) {
+    return s->area[s->stack[i]] < s->area[s->stack[j]];
+}
+
+
+/*
+ * Swaps the heap items at `i` and `j`.
+ */
+static void heap_swap(simplify_scratch *s, size_t i, size_t j) {
+    size_t item = s->stack[i];
+    s->stack[i] = s->stack[j];
+    s->stack[j] = item;
+    s->slots[s->stack[i]] = i;
+    s->slots[s->stack[j]] = j;
+}
+
+
+/*
+ * Restores the order of the heap of `size` items after the area of the
+ * item at `i` changed.
+ */
+static void heap_update(simplify_scratch *s, size_t size, size_t i) {
+    while (i > 0 && heap_before(s, i, (i - 1) / 2)) {
+        heap_swap(s, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    for (;;) {
+        size_t smallest = i;
+        size_t left = 2 * i + 1;
+        if (left < size && heap_before(s, left, smallest)) {
+            smallest = left;
+        }
+        if (left + 1 < size && heap_before(s, left + 1, smallest)) {
+            smallest = left + 1;
+        }
+        if (smallest == i) {
+            return;
+        }
+        heap_swap(s, i, smallest);
+        i = smallest;
+    }
+}
+
+
+/*
+ * Recomputes the effective area of the vertex `i`, which is not an
+ * endpoint, after a neighbour of area `dropped` was dropped.
+ */
+static void update_area(const double *xy, simplify_scratch *s, size_t size,
+                        size_t i, double dropped) {
+    double area = triangle_area(xy + 2 * s->prev[i], xy + 2 * i,
+                                xy + 2 * s->next[i]);
+    s->area[i] = area > dropped ? area : dropped;
+    heap_update(s, size, s->slots[i]);
+}
+
+
+/*
+ * Marks the vertices of a ring or line of `count` vertices kept by
+ * Visvalingam-Whyatt.
+ */
+static void simplify_visvalingam(const double *xy, size_t count,
+                                 int ring, double tolerance,
+                                 simplify_scratch *s) {
+    size_t last = count - 1;
+    size_t minimum = ring ? SIMPLIFY_MIN_RING : SIMPLIFY_MIN_LINE;
+    double threshold = tolerance * tolerance;
+    memset(s->kept, 1, count);
+
+    /* The interior vertices, 1 to last - 1, are heap items 0 to
+     * last - 2, ordered in a single pass from the bottom up. */
+    size_t size = 0;
+    for (size_t i = 1; i < last; i++) {
+        s->prev[i] = i - 1;
+        s->next[i] = i + 1;
+        s->area[i] = triangle_area(xy + 2 * (i - 1), xy + 2 * i,
+                                   xy + 2 * (i + 1));
+        s->stack[size] = i;
+        s->slots[i] = size++;
+    }
+    for (size_t i = size / 2; i-- > 0;) {
+        heap_update(s, size, i);
+    }
+
+    size_t kept = count;
+    while (size && kept > minimum) {
+        size_t i = s->stack[0];
+        double dropped = s->area[i];
+        if (dropped >= threshold) {
+            break;
+        }
+        heap_swap(s, 0, --size);
+        heap_update(s, size, 0);
+
+        s->kept[i] = 0;
+        kept--;
+        size_t p = s->prev[i];
+        size_t n = s->next[i];
+        s->next[p] = n;
+        s->prev[n] = p;
+        if (p > 0) {
+            update_area(xy, s, size, p, dropped);
+        }
+        if (n < last) {
+            update_area(xy, s, size, n, dropped);
+        }
+    }
+}
+
+
+/*
+ * Simplifies the vertices of a buffer in place.
+ *
+ * Parameters:
+ *   buffer  - The vertices of a line, or the rings of a polygon.
+ *   options - The algorithm and its tolerance.
+ *
+ * Returns:
+ *   0 on success, or -1 if the scratch memory could not be allocated.
+ */
+int simplify_coordinates(coordinate_buffer *buffer,
+                         const simplify_options *options) {
+    if (!(options->tolerance > 0)) {
+        return 0;
+    }
+
+    /* A buffer without rings is a single line. */
+    size_t line_end = buffer->size / 2;
+    size_t *ends = buffer->ring_count ? buffer->rings : &line_end;
+    size_t parts = buffer->ring_count ? buffer->ring_count : 1;
+
+    size_t largest = 0;
+    size_t start = 0;
+    for (size_t r = 0; r < parts; r++) {
+        if (ends[r] - start > largest) {
+            largest = ends[r] - start;
+        }
+        start = ends[r];
+    }
+    if (largest <= SIMPLIFY_MIN_LINE) {
+        return 0;
+    }
+
+    simplify_scratch s = { 0 };
+    value_arena *arena = buffer->arena;
+    s.kept = arena_alloc(arena, largest);
+    s.stack = arena_alloc(arena, 2 * largest * sizeof(size_t));
+    if (options->method == SIMPLIFY_VISVALINGAM) {
+        s.slots = arena_alloc(arena, largest * sizeof(size_t));
+        s.prev = arena_alloc(arena, largest * sizeof(size_t));
+        s.next = arena_alloc(arena, largest * sizeof(size_t));
+        s.area = arena_alloc(arena, largest * sizeof(double));
+        if (!s.slots || !s.prev || !s.next || !s.area) {
+            return -1;
+        }
+    }
+    if (!s.kept || !s.stack) {
+        return -1;
+    }
+
+    double *xy = buffer->values;
+    size_t written = 0;
+    start = 0;
+    for (size_t r = 0; r < parts; r++) {
+        const double *part = xy + 2 * start;
+        size_t count = ends[r] - start;
+        int ring = buffer->ring_count && count >= SIMPLIFY_MIN_RING
+                   && !memcmp(part, part + 2 * (count - 1),
+                              2 * sizeof(double));
+        size_t minimum = ring ? SIMPLIFY_MIN_RING : SIMPLIFY_MIN_LINE;
+
+        if (count <= minimum) {
+            memmove(xy + 2 * written, part, 2 * count * sizeof(double));
+            written += count;
+        } else {
+            if (options->method == SIMPLIFY_VISVALINGAM) {
+                simplify_visvalingam(part, count, ring, options->tolerance,
+                                     &s);
+            } else {
+                simplify_douglas_peucker(part, count, ring,
+                                         options->tolerance, &s);
+            }
+            for (size_t i = 0; i < count; i++) {
+                if (s.kept[i]) {
+                    xy[2 * written] = part[2 * i];
+                    xy[2 * written + 1] = part[2 * i + 1];
+                    written++;
+                }
+            }
+        }
+        start = ends[r];
+        ends[r] = written;
+    }
+    buffer->size = 2 * written;
+    return 0;
+}
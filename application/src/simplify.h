@@ -0,0 +1,56 @@
+/*
+ * simplify.h
+ *
+ * Interface for the simplify module, used to drop the vertices of
+ * lines and rings that do not change their shape by more than a
+ * tolerance, before they are formatted.
+ */
+#include "coordinates.h"
+
+#ifndef INCLUDED_SIMPLIFY_H
+#define INCLUDED_SIMPLIFY_H
+
+/*
+ * Simplification algorithms.
+ */
+typedef enum simplify_method {
+    SIMPLIFY_DOUGLAS_PEUCKER,  /* keeps the vertices farther than the
+                                  tolerance from the simplified line */
+    SIMPLIFY_VISVALINGAM       /* drops the vertices whose triangle with
+                                  their neighbours is smaller than the
+                                  tolerance squared */
+} simplify_method;
+
+/*
+ * Simplification of the geometries of a conversion. A zeroed value
+ * keeps every vertex.
+ */
+typedef struct simplify_options {
+    double tolerance;          /* in units of the coordinates, or 0 */
+    simplify_method method;    /* algorithm applied with `tolerance` */
+} simplify_options;
+
+
+/*
+ * Looks up the algorithm called `name`: "dp" (Douglas-Peucker) or "vw"
+ * (Visvalingam-Whyatt).
+ * Returns 0 on success or -1 if the name is unknown.
+ */
+int simplify_method_from_name(const char *name, simplify_method *method);
+
+
+/*
+ * Simplifies the vertices of `buffer` in place, as selected by
+ * `options`: every ring, or the whole buffer when it has no rings, is
+ * simplified on its own. The first and last vertices of every line and
+ * ring are kept, so closed rings stay closed, and a ring keeps at
+ * least four vertices and a line two. Scratch memory is allocated from
+ * the arena of the buffer.
+ * Returns 0 on success or -1 in case of error.
+ */
+int simplify_coordinates(coordinate_buffer *buffer,
+                         const simplify_options *options);
+
+#endif  /* INCLUDED_SIMPLIFY_H */
+
+// EOF
@@ -0,0 +1,692 @@
+/*
+ * sorter.c
+ *
+ * This module reorders the formatted features of a conversion along a
+ * Hilbert curve, so that features close in space are close in the
+ * output: tile builders and R-tree bulk loaders then read them with
+ * good locality, and compressors find more repetitions.
+ *
+ * The key of a feature is the Hilbert index of the centre of its
+ * bounding box, quantized to 32 bits per axis over the extent of all of
+ * the centres. That extent is only known once every feature has been
+ * added, so features are kept in memory unsorted, with their box,
+ * until the memory budget is reached, and the full buffer is then
+ * spilled to a temporary file as an unsorted run. At the end, an input
+ * that fit in memory is sorted in place; otherwise every run is read
+ * back, sorted and written to a new temporary file, and the sorted runs
+ * are merged through a binary heap, reading every run sequentially.
+ * Ties are broken by the order the features were added in, so the
+ * output does not depend on the memory budget.
+ *
+ * Temporary files are unlinked as soon as they are created, so they
+ * are removed by the system even if the process is killed.
+ */
+
+#include "sorter.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Size of the stdio buffer of every temporary file. */
+#define SORTER_FILE_BUFFER ((size_t)64 << 10)
+
+
+/*
+ * Header of a record of the memory of the sorter and of an unsorted
+ * run, followed by the bytes of the feature.
+ */
+typedef struct sort_record {
+    bounding_box box;    /* box of the vertices of the feature */
+    size_t length;       /* number of bytes of the feature */
+} sort_record;
+
+/*
+ * Header of a record of a sorted run, followed by the bytes of the
+ * feature.
+ */
+typedef struct sorted_record {
+    uint64_t key;        /* Hilbert key of the centre */
+    size_t sequence;     /* rank of the feature in the input order */
+    bounding_box box;    /* box of the vertices of the feature */
+    size_t length;       /* number of bytes of the feature */
+} sorted_record;
+
+/*
+ * Key of a record of the memory of the sorter, sorted instead of the
+ * records themselves.
+ */
+typedef struct sort_entry {
+    uint64_t key;        /* Hilbert key of the centre */
+    size_t sequence;     /* rank of the feature in the input order */
+    size_t offset;       /* offset of the record in the memory */
+} sort_entry;
+
+/*
+ * Run of records spilled to a temporary file.
+ */
+typedef struct sort_run {
+    FILE *file;          /* unlinked temporary file */
+    size_t bytes;        /* size of the unsorted run */
+    size_t count;        /* number of records left to read */
+    size_t first;        /* rank of its first feature in the input order */
+    sorted_record head;  /* next record of the sorted run */
+} sort_run;
+
+struct feature_sorter {
+    size_t memory;           /* bytes kept before spilling, or 0 */
+    char *temp_dir;          /* directory of the temporary files */
+    char *data;              /* records kept in memory */
+    size_t length;           /* number of bytes of `data` used */
+    size_t capacity;         /* size of `data` */
+    size_t count;            /* number of records in `data` */
+    size_t total;            /* number of records added */
+    bounding_box extent;     /* extent of the centres */
+    sort_run *runs;          /* spilled runs */
+    size_t run_count;        /* number of spilled runs */
+    size_t run_capacity;     /* room in `runs` */
+};
+
+
+/*
+ * Looks up the order called `name`.
+ *
+ * Parameters:
+ *   name  - The name of the order, as given on the command line.
+ *   order - Where the order is stored.
+ *
+ * Returns:
+ *   0 on success, or -1 if the name is unknown.
+ */
+int sort_order_from_name(const char *name, sort_order *order) {
+    static const struct {
+        const char *name;
+        sort_order order;
+    } names[] = {
+        { "hilbert", SORT_HILBERT },
+        { "none", SORT_NONE }
+    };
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (!strcmp(name, names[i].name)) {
+            *order = names[i].order;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
+/*
+ * Returns the errno value of the last failed stdio call.
+ */
+static int file_error(void) {
+    return errno ? errno : EIO;
+}
+
+
+/*
+ * Returns the index of the point (`x`, `y`) on the Hilbert curve
+ * filling a grid of 2^32 by 2^32 cells. The quadrant bits are
+ * unpredictable, so the rotations are done with masks instead of
+ * branches.
+ */
+static uint64_t hilbert_index(uint32_t x, uint32_t y) {
+    uint64_t index = 0;
+    for (unsigned bit = 32; bit-- > 0;) {
+        uint32_t rx = (x >> bit) & 1;
+        uint32_t ry = (y >> bit) & 1;
+        index |= (uint64_t)((3 * rx) ^ ry) << (2 * bit);
+
+        /* In the lower quadrants, the cells are reflected when in the
+         * right one, then transposed. */
+        uint32_t reflect = 0 - (rx & (ry ^ 1));
+        uint32_t transpose = 0 - (ry ^ 1);
+        x ^= reflect;
+        y ^= reflect;
+        uint32_t t = (x ^ y) & transpose;
+        x ^= t;
+        y ^= t;
+    }
+    return index;
+}
+
+
+/*
+ * Returns the cell of `value` among 2^32 cells spanning `min` to `max`.
+ */
+static uint32_t quantize(double value, double min, double max) {
+    if (!(max > min)) {
+        return 0;
+    }
+    double scaled = (value - min) / (max - min) * (double)UINT32_MAX;
+    if (scaled >= (double)UINT32_MAX) {
+        return UINT32_MAX;
+    }
+    return scaled > 0 ? (uint32_t)scaled : 0;
+}
+
+
+/*
+ * Returns the Hilbert key of the centre of a box.
+ *
+ * Parameters:
+ *   extent - The extent of the centres of every box sorted.
+ *   box    - The box.
+ *
+ * Returns:
+ *   The Hilbert index of the centre over a grid of 2^32 by 2^32 cells
+ *   spanning `extent`, or UINT64_MAX for an empty box, so that the
+ *   features without vertices come last.
+ */
+uint64_t hilbert_key(const bounding_box *extent, const bounding_box *box) {
+    double x = (box->min.x + box->max.x) / 2;
+    double y = (box->min.y + box->max.y) / 2;
+    if (isnan(x) || isnan(y)) {
+        return UINT64_MAX;
+    }
+    return hilbert_index(quantize(x, extent->min.x, extent->max.x),
+                         quantize(y, extent->min.y, extent->max.y));
+}
+
+
+/*
+ * Orders sort entries by key, then by rank in the input.
+ */
+static int compare_entries(const void *a, const void *b) {
+    const sort_entry *p = a;
+    const sort_entry *q = b;
+    if (p->key != q->key) {
+        return p->key < q->key ? -1 : 1;
+    }
+    return (p->sequence > q->sequence) - (p->sequence < q->sequence);
+}
+
+
+/*
+ * Ensures the memory of the sorter can hold `extra` more bytes.
+ *
+ * Returns:
+ *   0 on success, or ENOMEM.
+ */
+static int reserve(feature_sorter *sorter, size_t extra) {
+    if (sorter->length + extra <= sorter->capacity) {
+        return 0;
+    }
+    size_t capacity = sorter->capacity ? sorter->capacity : 4096;
+    while (capacity < sorter->length + extra) {
+        capacity *= 2;
+    }
+    char *data = realloc(sorter->data, capacity);
+    if (!data) {
+        return ENOMEM;
+    }
+    sorter->data = data;
+    sorter->capacity = capacity;
+    return 0;
+}
+
+
+/*
+ * Creates an unlinked temporary file in the directory of the sorter.
+ *
+ * Returns:
+ *   0 on success, or the errno value of a failure.
+ */
+static int open_temp(const feature_sorter *sorter, FILE **file) {
+    static const char name[] = "/wkt2geojson-sort-XXXXXX";
+    size_t length = strlen(sorter->temp_dir);
+    char *path = malloc(length + sizeof(name));
+    if (!path) {
+        return ENOMEM;
+    }
+    memcpy(path, sorter->temp_dir, length);
+    memcpy(path + length, name, sizeof(name));
+
+    int fd = mkstemp(path);
+    int error = fd < 0 ? errno : 0;
+    if (fd >= 0) {
+        unlink(path);
+        *file = fdopen(fd, "w+b");
+        if (!*file) {
+            error = errno;
+            close(fd);
+        } else {
+            setvbuf(*file, NULL, _IOFBF, SORTER_FILE_BUFFER);
+        }
+    }
+    free(path);
+    return error;
+}
+
+
+/*
+ * Sorts the records in the memory of the sorter, the first one being
+ * feature `first` of the input.
+ *
+ * Returns:
+ *   The sorted entries, to be freed by the caller, or NULL if the
+ *   memory could not be allocated.
+ */
+static sort_entry* sort_memory(const feature_sorter *sorter, size_t first) {
+    sort_entry *entries = malloc((sorter->count ? sorter->count : 1)
+                                 * sizeof(sort_entry));
+    if (!entries) {
+        return NULL;
+    }
+
+    size_t offset = 0;
+    for (size_t i = 0; i < sorter->count; i++) {
+        sort_record record;
+        memcpy(&record, sorter->data + offset, sizeof(record));
+        entries[i].key = hilbert_key(&sorter->extent, &record.box);
+        entries[i].sequence = first + i;
+        entries[i].offset = offset;
+        offset += sizeof(record) + record.length;
+    }
+    qsort(entries, sorter->count, sizeof(sort_entry), compare_entries);
+    return entries;
+}
+
+
+/*
+ * Writes the records in the memory of the sorter to a new unsorted run
+ * and empties the memory.
+ *
+ * Returns:
+ *   0 on success, or the errno value of a failure.
+ */
+static int spill(feature_sorter *sorter) {
+    if (sorter->run_count == sorter->run_capacity) {
+        size_t capacity = sorter->run_capacity ? 2 * sorter->run_capacity
+                                               : 16;
+        sort_run *runs = realloc(sorter->runs, capacity * sizeof(sort_run));
+        if (!runs) {
+            return ENOMEM;
+        }
+        sorter->runs = runs;
+        sorter->run_capacity = capacity;
+    }
+
+    sort_run *run = &sorter->runs[sorter->run_count];
+    int error = open_temp(sorter, &run->file);
+    if (error) {
+        return error;
+    }
+    sorter->run_count++;
+    run->bytes = sorter->length;
+    run->count = sorter->count;
+    run->first = sorter->total - sorter->count;
+    if (fwrite(sorter->data, 1, sorter->length, run->file) != sorter->length
+            || fflush(run->file)) {
+        return file_error();
+    }
+
+    sorter->length = 0;
+    sorter->count = 0;
+    return 0;
+}
+
+
+/*
+ * Adds a record to the memory of the sorter, spilling the memory first
+ * when the record does not fit in the budget.
+ *
+ * Returns:
+ *   0 on success, or the errno value of a failure.
+ */
+static int add_record(feature_sorter *sorter, const bounding_box *box,
+                      const char *data, size_t length) {
+    sort_record record = { *box, length };
+    if (sorter->memory && sorter->count
+            && sorter->length + sizeof(record) + length > sorter->memory) {
+        int error = spill(sorter);
+        if (error) {
+            return error;
+        }
+    }
+
+    int error = reserve(sorter, sizeof(record) + length);
+    if (error) {
+        return error;
+    }
+    memcpy(sorter->data + sorter->length, &record, sizeof(record));
+    memcpy(sorter->data + sorter->length + sizeof(record), data, length);
+    sorter->length += sizeof(record) + length;
+    sorter->count++;
+    sorter->total++;
+
+    double centre[2] = {
+        (box->min.x + box->max.x) / 2, (box->min.y + box->max.y) / 2
+    };
+    bounding_box_extend(&sorter->extent, centre, 1);
+    return 0;
+}
+
+
+/*
+ * Replaces an unsorted run by the same records, sorted, read back into
+ * the memory of the sorter.
+ *
+ * Returns:
+ *   0 on success, or the errno value of a failure.
+ */
+static int sort_run_file(feature_sorter *sorter, sort_run *run) {
+    sorter->length = 0;
+    int error = reserve(sorter, run->bytes);
+    if (error) {
+        return error;
+    }
+    rewind(run->file);
+    if (fread(sorter->data, 1, run->bytes, run->file) != run->bytes) {
+        return file_error();
+    }
+    sorter->count = run->count;
+
+    FILE *sorted = NULL;
+    sort_entry *entries = sort_memory(sorter, run->first);
+    error = entries ? open_temp(sorter, &sorted) : ENOMEM;
+    for (size_t i = 0; i < run->count && !error; i++) {
+        sort_record record;
+        memcpy(&record, sorter->data + entries[i].offset, sizeof(record));
+        sorted_record header = {
+            entries[i].key, entries[i].sequence, record.box, record.length
+        };
+        const char *bytes = sorter->data + entries[i].offset + sizeof(record);
+        if (fwrite(&header, sizeof(header), 1, sorted) != 1
+                || fwrite(bytes, 1, record.length, sorted) != record.length) {
+            error = file_error();
+        }
+    }
+    free(entries);
+    sorter->count = 0;
+
+    if (!error && (fflush(sorted) || fseek(sorted, 0, SEEK_SET))) {
+        error = file_error();
+    }
+    if (error) {
+        if (sorted) {
+            fclose(sorted);
+        }
+        return error;
+    }
+    fclose(run->file);
+    run->file = sorted;
+    return 0;
+}
+
+
+/*
+ * Reads the header of the next record of a sorted run.
+ *
+ * Returns:
+ *   0 on success, or the errno value of a failure.
+ */
+static int read_head(sort_run *run) {
+    if (fread(&run->head, sizeof(run->head), 1, run->file) != 1) {
+        return file_error();
+    }
+    return 0;
+}
+
+
+/*
+ * Returns 1 if the head of run `a` comes before the head of run `b`.
+ */
+static int run_before(const sort_run *a, const sort_run *b) {
+    if (a->head.key != b->head.key) {
+        return a->head.key < b->head.key;
+    }
+    return a->head.sequence < b->head.sequence;
+}
+
+
+/*
+ * Moves the run at position `i` of the heap down to its place.
+ */
+static void sift_down(const sort_run *runs, size_t *heap, size_t size,
+                      size_t i) {
+    for (;;) {
+        size_t smallest = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        if (left < size && run_before(&runs[heap[left]], &runs[heap[smallest]])) {
+            smallest = left;
+        }
+        if (right < size
+                && run_before(&runs[heap[right]], &runs[heap[smallest]])) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            return;
+        }
+        size_t t = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = t;
+        i = smallest;
+    }
+}
+
+
+/*
+ * Merges the sorted runs of the sorter, handing their records to `fn`.
+ *
+ * Returns:
+ *   0 on success, or the errno value of the first failure.
+ */
+static int merge_runs(feature_sorter *sorter, feature_sorter_fn fn,
+                      void *user_data) {
+    size_t *heap = malloc(sorter->run_count * sizeof(size_t));
+    if (!heap) {
+        return ENOMEM;
+    }
+
+    int error = 0;
+    size_t size = 0;
+    for (size_t r = 0; r < sorter->run_count && !error; r++) {
+        if (sorter->runs[r].count) {
+            error = read_head(&sorter->runs[r]);
+            heap[size++] = r;
+        }
+    }
+    for (size_t i = size; i-- > 0 && !error;) {
+        sift_down(sorter->runs, heap, size, i);
+    }
+
+    while (size && !error) {
+        sort_run *run = &sorter->runs[heap[0]];
+        size_t length = run->head.length;
+        sorter->length = 0;
+        error = reserve(sorter, length);
+        if (!error && fread(sorter->data, 1, length, run->file) != length) {
+            error = file_error();
+        }
+        if (!error) {
+            error = fn(user_data, sorter->data, length, &run->head.box);
+        }
+        if (!error && --run->count) {
+            error = read_head(run);
+        } else if (!error) {
+            heap[0] = heap[--size];
+        }
+        sift_down(sorter->runs, heap, size, 0);
+    }
+
+    free(heap);
+    sorter->length = 0;
+    return error;
+}
+
+
+/*
+ * Closes the runs of the sorter and forgets its records.
+ */
+static void clear(feature_sorter *sorter) {
+    for (size_t r = 0; r < sorter->run_count; r++) {
+        fclose(sorter->runs[r].file);
+    }
+    sorter->run_count = 0;
+    sorter->length = 0;
+    sorter->count = 0;
+    sorter->total = 0;
+    bounding_box_reset(&sorter->extent);
+}
+
+
+/*
+ * Creates a sorter.
+ *
+ * Parameters:
+ *   memory   - The number of bytes of features kept in memory before
+ *              they are spilled, or 0 to keep them all in memory.
+ *   temp_dir - The directory of the temporary files, or NULL for
+ *              $TMPDIR or /tmp.
+ *
+ * Returns:
+ *   The sorter, or NULL if it could not be allocated.
+ */
+feature_sorter* feature_sorter_new(size_t memory, const char *temp_dir) {
+    feature_sorter *sorter = calloc(1, sizeof(feature_sorter));
+    if (!sorter) {
+        return NULL;
+    }
+
+    if (!temp_dir) {
+        temp_dir = getenv("TMPDIR");
+    }
+    sorter->temp_dir = strdup(temp_dir && *temp_dir ? temp_dir : "/tmp");
+    if (!sorter->temp_dir) {
+        free(sorter);
+        return NULL;
+    }
+    sorter->memory = memory;
+    bounding_box_reset(&sorter->extent);
+    return sorter;
+}
+
+
+/*
+ * Returns the memory budget of a sorter.
+ *
+ * Parameters:
+ *   sorter - The sorter.
+ *
+ * Returns:
+ *   The bytes kept in memory before spilling, or 0 for no limit.
+ */
+size_t feature_sorter_memory(const feature_sorter *sorter) {
+    return sorter->memory;
+}
+
+
+/*
+ * Adds a formatted feature to the sorter.
+ *
+ * Parameters:
+ *   sorter - The sorter.
+ *   data   - The bytes of the feature.
+ *   length - The number of bytes of the feature.
+ *   box    - The bounding box of the vertices of the feature.
+ *
+ * Returns:
+ *   0 on success, or the errno value of a failure.
+ */
+int feature_sorter_add(feature_sorter *sorter, const char *data,
+                       size_t length, const bounding_box *box) {
+    return add_record(sorter, box, data, length);
+}
+
+
+/*
+ * Adds the first features of an in-memory sorter to another sorter.
+ *
+ * Parameters:
+ *   sorter - The sorter receiving the features.
+ *   source - The sorter holding the features, which never spilled.
+ *   count  - The number of features to add.
+ *
+ * Returns:
+ *   0 on success, or the errno value of a failure.
+ */
+int feature_sorter_append(feature_sorter *sorter,
+                          const feature_sorter *source, size_t count) {
+    size_t offset = 0;
+    for (size_t i = 0; i < count && i < source->count; i++) {
+        sort_record record;
+        memcpy(&record, source->data + offset, sizeof(record));
+        int error = add_record(sorter, &record.box,
+                               source->data + offset + sizeof(record),
+                               record.length);
+        if (error) {
+            return error;
+        }
+        offset += sizeof(record) + record.length;
+    }
+    return 0;
+}
+
+
+/*
+ * Hands the features of the sorter to a function in Hilbert order.
+ *
+ * Parameters:
+ *   sorter    - The sorter, emptied.
+ *   fn        - The function receiving the features.
+ *   user_data - The first argument of `fn`.
+ *
+ * Returns:
+ *   0 on success, or the errno value of the first failure.
+ */
+int feature_sorter_finish(feature_sorter *sorter, feature_sorter_fn fn,
+                          void *user_data) {
+    int error = 0;
+    if (!sorter->run_count) {
+        sort_entry *entries = sort_memory(sorter, 0);
+        if (!entries) {
+            error = ENOMEM;
+        }
+        for (size_t i = 0; entries && i < sorter->count && !error; i++) {
+            sort_record record;
+            memcpy(&record, sorter->data + entries[i].offset, sizeof(record));
+            error = fn(user_data,
+                       sorter->data + entries[i].offset + sizeof(record),
+                       record.length, &record.box);
+        }
+        free(entries);
+    } else {
+        if (sorter->count) {
+            error = spill(sorter);
+        }
+        for (size_t r = 0; r < sorter->run_count && !error; r++) {
+            error = sort_run_file(sorter, &sorter->runs[r]);
+        }
+        if (!error) {
+            error = merge_runs(sorter, fn, user_data);
+        }
+    }
+
+    clear(sorter);
+    return error;
+}
+
+
+/*
+ * Releases a sorter.
+ *
+ * Parameters:
+ *   sorter - The sorter, or NULL.
+ */
+void feature_sorter_free(feature_sorter *sorter) {
+    if (!sorter) {
+        return;
+    }
+    clear(sorter);
+    free(sorter->runs);
+    free(sorter->data);
+    free(sorter->temp_dir);
+    free(sorter);
+}
@@ -0,0 +1,110 @@
+/*
+ * sorter.h
+ *
+ * Interface for the sorter module, used to write the features of a
+ * conversion in the order of a space-filling curve instead of the
+ * input order, within a bounded amount of memory.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#include "coordinates.h"
+
+#ifndef INCLUDED_SORTER_H
+#define INCLUDED_SORTER_H
+
+/*
+ * Default memory of a sorter, in bytes, before it spills to disk.
+ */
+#define SORTER_DEFAULT_MEMORY ((size_t)256 << 20)
+
+/*
+ * Orders of the features of a conversion.
+ */
+typedef enum sort_order {
+    SORT_NONE,           /* input order */
+    SORT_HILBERT         /* Hilbert curve order of the bbox centres */
+} sort_order;
+
+/*
+ * Opaque sorter of formatted features.
+ */
+typedef struct feature_sorter feature_sorter;
+
+/*
+ * Function receiving the features of a sorter, in order, with the box
+ * they were added with.
+ * Returns 0 on success or the errno value of a failure.
+ */
+typedef int (*feature_sorter_fn)(void *user_data, const char *data,
+                                 size_t length, const bounding_box *box);
+
+
+/*
+ * Looks up the order called `name`: "hilbert" or "none".
+ * Returns 0 on success or -1 if the name is unknown.
+ */
+int sort_order_from_name(const char *name, sort_order *order);
+
+
+/*
+ * Returns the index on a Hilbert curve of the centre of `box`, over a
+ * grid of 2^32 by 2^32 cells spanning `extent`, the extent of the
+ * centres of every box ordered, or UINT64_MAX for an empty box.
+ */
+uint64_t hilbert_key(const bounding_box *extent, const bounding_box *box);
+
+
+/*
+ * Creates a sorter keeping at most about `memory` bytes of features in
+ * memory, the others being spilled to temporary files in `temp_dir`,
+ * or keeping them all in memory when `memory` is 0.
+ * Returns NULL in case of error.
+ */
+feature_sorter* feature_sorter_new(size_t memory, const char *temp_dir);
+
+
+/*
+ * Returns the number of bytes of features the sorter keeps in memory
+ * before it spills, or 0 if it keeps them all.
+ */
+size_t feature_sorter_memory(const feature_sorter *sorter);
+
+
+/*
+ * Adds the `length` bytes of a formatted feature whose vertices lie in
+ * `box`.
+ * Returns 0 on success or the errno value of a failure.
+ */
+int feature_sorter_add(feature_sorter *sorter, const char *data,
+                       size_t length, const bounding_box *box);
+
+
+/*
+ * Adds the first `count` features added to `source`, a sorter keeping
+ * its features in memory, in the order they were added.
+ * Returns 0 on success or the errno value of a failure.
+ */
+int feature_sorter_append(feature_sorter *sorter,
+                          const feature_sorter *source, size_t count);
+
+
+/*
+ * Hands every feature added to the sorter to `fn`, with `user_data`, in
+ * the Hilbert order of the centres of their boxes over the extent of
+ * all of the centres; features with equal keys keep the order they
+ * were added in. The sorter is emptied.
+ * Returns 0 on success or the errno value of the first failure.
+ */
+int feature_sorter_finish(feature_sorter *sorter, feature_sorter_fn fn,
+                          void *user_data);
+
+
+/*
+ * Releases the sorter and its temporary files. Accepts NULL.
+ */
+void feature_sorter_free(feature_sorter *sorter);
+
+#endif  /* INCLUDED_SORTER_H */
+
+// EOF
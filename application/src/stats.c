@@ -0,0 +1,164 @@
+/*
+ * stats.c
+ *
+ * This module initializes, merges and reports the statistics of a
+ * conversion (see `stats.h`). Phase times are kept in time stamp
+ * counter ticks while converting, and turned into seconds only when
+ * reported, by comparing the ticks and the wall clock time elapsed
+ * since the statistics were initialized.
+ */
+
+#include "stats.h"
+
+#include <string.h>
+#include <sys/resource.h>
+
+/* Names of the reported phases and geometry types. */
+static const char *const phase_names[STATS_IDLE] = {
+    "read", "scan", "parse", "format", "write"
+};
+static const char *const type_names[STATS_GEOMETRY_TYPES] = {
+    "point", "linestring", "polygon"
+};
+
+
+/*
+ * Initializes the statistics.
+ *
+ * Parameters:
+ *   stats - The statistics to initialize.
+ *   phase - The phase timed from now on.
+ */
+void stats_init(wkt2geojson_stats *stats, stats_phase phase) {
+    memset(stats, 0, sizeof(wkt2geojson_stats));
+    clock_gettime(CLOCK_MONOTONIC, &stats->start_time);
+    stats->start_ticks = stats_now();
+    stats->since = stats->start_ticks;
+    stats->phase = phase;
+}
+
+
+/*
+ * Adds the statistics of another thread.
+ *
+ * Parameters:
+ *   stats - The statistics receiving the counts and times.
+ *   other - The statistics of the other thread, idle.
+ */
+void stats_merge(wkt2geojson_stats *stats, const wkt2geojson_stats *other) {
+    for (int i = 0; i < STATS_IDLE; i++) {
+        stats->ticks[i] += other->ticks[i];
+    }
+    for (int i = 0; i < STATS_GEOMETRY_TYPES; i++) {
+        stats->features[i] += other->features[i];
+        stats->vertices[i] += other->vertices[i];
+    }
+    stats->bytes_read += other->bytes_read;
+    stats->bytes_written += other->bytes_written;
+    stats->allocations += other->allocations;
+}
+
+
+static double timeval_seconds(const struct timeval *time) {
+    return (double)time->tv_sec + (double)time->tv_usec / 1e6;
+}
+
+
+/*
+ * Writes a summary of the statistics.
+ *
+ * Parameters:
+ *   stats - The statistics, whose current phase is ended.
+ *   out   - The stream the summary is written to.
+ *   json  - Non-zero to write a JSON object instead of text.
+ *
+ * Returns:
+ *   0 on success, or -1 if an error occurs.
+ */
+int stats_report(wkt2geojson_stats *stats, FILE *out, int json) {
+    stats_enter(stats, STATS_IDLE);
+
+    struct timespec end_time;
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    uint64_t ticks = stats_now() - stats->start_ticks;
+    double wall = (double)(end_time.tv_sec - stats->start_time.tv_sec)
+                  + (double)(end_time.tv_nsec - stats->start_time.tv_nsec)
+                    / 1e9;
+    double seconds_per_tick = ticks ? wall / (double)ticks : 0.0;
+
+    struct rusage usage;
+    memset(&usage, 0, sizeof(usage));
+    getrusage(RUSAGE_SELF, &usage);
+    double user = timeval_seconds(&usage.ru_utime);
+    double system = timeval_seconds(&usage.ru_stime);
+
+    double seconds[STATS_IDLE];
+    double busy = 0.0;
+    for (int i = 0; i < STATS_IDLE; i++) {
+        seconds[i] = (double)stats->ticks[i] * seconds_per_tick;
+        busy += seconds[i];
+    }
+
+    size_t features = 0;
+    size_t vertices = 0;
+    for (int i = 0; i < STATS_GEOMETRY_TYPES; i++) {
+        features += stats->features[i];
+        vertices += stats->vertices[i];
+    }
+    double megabytes = (double)stats->bytes_read / 1e6;
+    double rate = wall > 0.0 ? 1.0 / wall : 0.0;
+
+    if (json) {
+        fprintf(out, "{\n  \"wall_seconds\": %.6f,\n"
+                "  \"user_seconds\": %.6f,\n"
+                "  \"system_seconds\": %.6f,\n"
+                "  \"peak_rss_kib\": %ld,\n  \"phases\": {",
+                wall, user, system, usage.ru_maxrss);
+        for (int i = 0; i < STATS_IDLE; i++) {
+            fprintf(out, "%s\n    \"%s\": %.6f", i ? "," : "",
+                    phase_names[i], seconds[i]);
+        }
+        fprintf(out, "\n  },\n  \"features\": { \"total\": %zu", features);
+        for (int i = 0; i < STATS_GEOMETRY_TYPES; i++) {
+            fprintf(out, ", \"%s\": %zu", type_names[i], stats->features[i]);
+        }
+        fprintf(out, " },\n  \"vertices\": { \"total\": %zu", vertices);
+        for (int i = 0; i < STATS_GEOMETRY_TYPES; i++) {
+            fprintf(out, ", \"%s\": %zu", type_names[i], stats->vertices[i]);
+        }
+        fprintf(out, " },\n  \"bytes_read\": %zu,\n"
+                "  \"bytes_written\": %zu,\n"
+                "  \"parser_allocations\": %zu,\n"
+                "  \"mb_per_s\": %.1f,\n"
+                "  \"features_per_s\": %.0f,\n"
+                "  \"vertices_per_s\": %.0f\n}\n",
+                stats->bytes_read, stats->bytes_written,
+                stats->allocations, megabytes * rate,
+                (double)features * rate, (double)vertices * rate);
+    } else {
+        fprintf(out, "Statistics:\n  %-8s %12s %8s\n", "phase", "seconds",
+                "share");
+        for (int i = 0; i < STATS_IDLE; i++) {
+            fprintf(out, "  %-8s %12.6f %7.1f%%\n", phase_names[i],
+                    seconds[i], busy > 0.0 ? seconds[i] * 100.0 / busy
+                                           : 0.0);
+        }
+        fprintf(out, "  wall %.6f s, user %.6f s, system %.6f s,"
+                " peak RSS %ld KiB\n", wall, user, system, usage.ru_maxrss);
+        fprintf(out, "  features %zu (points %zu, linestrings %zu,"
+                " polygons %zu)\n", features, stats->features[WKT_POINT],
+                stats->features[WKT_LINESTRING],
+                stats->features[WKT_POLYGON]);
+        fprintf(out, "  vertices %zu (points %zu, linestrings %zu,"
+                " polygons %zu)\n", vertices, stats->vertices[WKT_POINT],
+                stats->vertices[WKT_LINESTRING],
+                stats->vertices[WKT_POLYGON]);
+        fprintf(out, "  read %zu bytes, wrote %zu bytes\n",
+                stats->bytes_read, stats->bytes_written);
+        fprintf(out, "  parser heap allocations %zu\n", stats->allocations);
+        fprintf(out, "  %.1f MB/s, %.0f features/s, %.0f vertices/s\n",
+                megabytes * rate, (double)features * rate,
+                (double)vertices * rate);
+    }
+    return ferror(out) ? -1 : 0;
+}
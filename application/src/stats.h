@@ -0,0 +1,152 @@
+/*
+ * stats.h
+ *
+ * Interface for the stats module, used to measure where the time of a
+ * conversion goes and to count what it converted (`--stats`).
+ *
+ * The time of a conversion is split into exclusive phases: the code
+ * entering a phase charges the time elapsed since the previous switch
+ * to the phase it interrupts, so that nested phases (the reads of the
+ * scanner, the writes of the writer) are not counted twice. Switches
+ * read the time stamp counter where available, and every function
+ * accepts a NULL statistics pointer and then does nothing, so that
+ * the instrumentation costs a test when it is off.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "ir.h"
+
+#ifndef INCLUDED_STATS_H
+#define INCLUDED_STATS_H
+
+/*
+ * Number of geometry types counted separately.
+ */
+#define STATS_GEOMETRY_TYPES 3
+
+/*
+ * Phases of a conversion.
+ */
+typedef enum stats_phase {
+    STATS_READ,          /* reading (or mapping) the input */
+    STATS_SCAN,          /* tokenizing the input */
+    STATS_PARSE,         /* parsing the tokens */
+    STATS_FORMAT,        /* formatting the GeoJSON (or filling an IR) */
+    STATS_WRITE,         /* writing the output */
+    STATS_IDLE,          /* waiting for other threads, not reported */
+    STATS_PHASES
+} stats_phase;
+
+
+/*
+ * Statistics of a conversion.
+ * `ticks` hold the time of every phase in units of `stats_now`. With
+ * several threads, the statistics of every thread are merged, and the
+ * phase times are the sums of the times of the threads.
+ */
+typedef struct wkt2geojson_stats {
+    uint64_t ticks[STATS_PHASES];              /* time of every phase */
+    stats_phase phase;                         /* phase being timed */
+    uint64_t since;                            /* start of `phase` */
+    uint64_t start_ticks;                      /* `stats_now` at start */
+    struct timespec start_time;                /* wall clock at start */
+    size_t features[STATS_GEOMETRY_TYPES];     /* features by type */
+    size_t vertices[STATS_GEOMETRY_TYPES];     /* vertices by type */
+    size_t bytes_read;                         /* bytes of input read */
+    size_t bytes_written;                      /* bytes of output written */
+    size_t allocations;                        /* heap allocations of the
+                                                  parser values */
+} wkt2geojson_stats;
+
+
+/*
+ * Returns a monotonic time stamp: the time stamp counter on x86, or
+ * nanoseconds of CLOCK_MONOTONIC elsewhere.
+ */
+static inline uint64_t stats_now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+#endif
+}
+
+
+/*
+ * Charges the time elapsed since the last switch to the current phase
+ * and starts `phase`. Returns the interrupted phase, to be restored
+ * with `stats_leave`. Does nothing and returns `phase` if `stats` is
+ * NULL.
+ */
+static inline stats_phase stats_enter(wkt2geojson_stats *stats,
+                                      stats_phase phase) {
+    if (!stats) {
+        return phase;
+    }
+    uint64_t now = stats_now();
+    stats_phase previous = stats->phase;
+    stats->ticks[previous] += now - stats->since;
+    stats->phase = phase;
+    stats->since = now;
+    return previous;
+}
+
+
+/*
+ * Ends the current phase and resumes `previous`, as returned by
+ * `stats_enter`. Does nothing if `stats` is NULL.
+ */
+static inline void stats_leave(wkt2geojson_stats *stats,
+                               stats_phase previous) {
+    stats_enter(stats, previous);
+}
+
+
+/*
+ * Counts a converted feature of `vertices` vertices. Does nothing if
+ * `stats` is NULL.
+ */
+static inline void stats_count_feature(wkt2geojson_stats *stats,
+                                       wkt_geometry_type type,
+                                       size_t vertices) {
+    if (stats) {
+        stats->features[type]++;
+        stats->vertices[type] += vertices;
+    }
+}
+
+
+/*
+ * Initializes the statistics, starting in `phase`.
+ */
+void stats_init(wkt2geojson_stats *stats, stats_phase phase);
+
+
+/*
+ * Adds the counts and phase times of `other`, the statistics of
+ * another thread, to `stats`. `other` must have ended its phases with
+ * `stats_enter(other, STATS_IDLE)`.
+ */
+void stats_merge(wkt2geojson_stats *stats, const wkt2geojson_stats *other);
+
+
+/*
+ * Writes a summary of the statistics, with the wall and CPU times and
+ * the peak resident set size of the process, to `out`: readable text,
+ * or a JSON object when `json` is set. Ends the current phase.
+ * Returns 0 on success or -1 in case of error.
+ */
+int stats_report(wkt2geojson_stats *stats, FILE *out, int json);
+
+#endif  /* INCLUDED_STATS_H */
+
+// EOF
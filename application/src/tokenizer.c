@@ -0,0 +1,714 @@
+/*
+ * tokenizer.c
+ *
+ * This module implements a two-stage tokenizer, an alternative to the
+ * Flex scanner for large inputs. The Flex automaton performs one
+ * transition per byte, including for the long runs of whitespace and
+ * digits that make up most of a WKT dump.
+ *
+ * Stage one classifies the input in blocks of 64 bytes and builds, for
+ * every block, three bitmaps: whitespace bytes, digits and structural
+ * characters (`(`, `)` and `,`). It is implemented with AVX2, with
+ * SSE4.2 string instructions and with portable C code; the best
+ * implementation supported by the CPU is chosen at runtime.
+ *
+ * The input is either streamed through a buffer refilled with fread,
+ * or scanned in place when it is mapped in memory: stage one then
+ * classifies a window that slides over the mapping, and no byte of the
+ * input is copied.
+ *
+ * Stage two walks the bitmaps to produce the tokens consumed by the
+ * parser. Whitespace runs and digit runs are skipped with a single
+ * count-trailing-zeros over the bitmaps instead of byte by byte.
+ *
+ * The tokens follow the rules of `scanner.l` exactly, including its
+ * longest-match behavior and the single-character tokens returned for
+ * unexpected bytes, so that the output does not depend on the engine
+ * in use.
+ */
+
+#include "tokenizer.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "number.h"
+#include "parser.tab.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TOKENIZER_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+/* Number of bytes read from the input at each refill. */
+#ifndef TOKENIZER_CHUNK_SIZE
+#define TOKENIZER_CHUNK_SIZE (64 * 1024)
+#endif
+
+/* Number of bytes classified at once by stage one. */
+#define TOKENIZER_BLOCK_SIZE 64
+
+/* Length of the longest keyword, "LINESTRING". */
+#define TOKENIZER_KEYWORD_MAX 10
+
+/* Character classes of the scalar stage one. */
+#define CLASS_WHITESPACE 1
+#define CLASS_DIGIT 2
+#define CLASS_STRUCTURAL 4
+
+/* Stage one: classifies one block of TOKENIZER_BLOCK_SIZE bytes. */
+typedef void (*classify_fn)(const unsigned char *block, uint64_t *whitespace,
+                            uint64_t *digits, uint64_t *structural);
+
+struct tokenizer {
+    FILE *input;              /* streamed input, or NULL when mapped */
+    const char *mapped;       /* mapped input, or NULL when streamed */
+    size_t mapped_length;     /* length of the mapped input */
+    size_t offset;            /* offset of `data` in the input */
+    classify_fn classify;
+    const char *data;         /* window of the input being tokenized */
+    char *buffer;             /* storage of the window when streamed */
+    size_t capacity;          /* largest length of the window */
+    size_t length;            /* bytes in the window */
+    size_t position;          /* next byte to tokenize */
+    size_t token;             /* first byte of the last token */
+    int count_lines;          /* whether lines are counted */
+    size_t lines;             /* line feeds before `line_offset` */
+    size_t line_offset;       /* offset where lines were counted to */
+    int eof;                  /* whether the input has been exhausted */
+    uint64_t *whitespace;     /* stage one bitmaps, one word per block */
+    uint64_t *digits;
+    uint64_t *structural;
+    wkt2geojson_stats *stats; /* statistics of the reads, or NULL */
+};
+
+static const struct {
+    const char *text;
+    size_t length;
+    int token;
+} keywords[] = {
+    { "POINT", 5, POINT },
+    { "LINESTRING", 10, LINESTRING },
+    { "POLYGON", 7, POLYGON }
+};
+
+
+/*
+ * Stage one, portable implementation based on a table of classes.
+ */
+static void classify_scalar(const unsigned char *block, uint64_t *whitespace,
+                            uint64_t *digits, uint64_t *structural) {
+    static const unsigned char classes[256] = {
+        [' '] = CLASS_WHITESPACE, ['\t'] = CLASS_WHITESPACE,
+        ['\n'] = CLASS_WHITESPACE, ['\r'] = CLASS_WHITESPACE,
+        ['0'] = CLASS_DIGIT, ['1'] = CLASS_DIGIT, ['2'] = CLASS_DIGIT,
+        ['3'] = CLASS_DIGIT, ['4'] = CLASS_DIGIT, ['5'] = CLASS_DIGIT,
+        ['6'] = CLASS_DIGIT, ['7'] = CLASS_DIGIT, ['8'] = CLASS_DIGIT,
+        ['9'] = CLASS_DIGIT,
+        ['('] = CLASS_STRUCTURAL, [')'] = CLASS_STRUCTURAL,
+        [','] = CLASS_STRUCTURAL
+    };
+
+    uint64_t ws = 0, dg = 0, st = 0;
+    for (unsigned i = 0; i < TOKENIZER_BLOCK_SIZE; i++) {
+        uint64_t bit = (uint64_t)1 << i;
+        unsigned char cls = classes[block[i]];
+        if (cls & CLASS_WHITESPACE) ws |= bit;
+        if (cls & CLASS_DIGIT) dg |= bit;
+        if (cls & CLASS_STRUCTURAL) st |= bit;
+    }
+
+    *whitespace = ws;
+    *digits = dg;
+    *structural = st;
+}
+
+
+#ifdef TOKENIZER_HAVE_X86
+
+/*
+ * Stage one, AVX2 implementation: two 32-byte lanes compared against
+ * every character of the classes.
+ */
+__attribute__((target("avx2")))
+static void classify_avx2(const unsigned char *block, uint64_t *whitespace,
+                          uint64_t *digits, uint64_t *structural) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i carriage = _mm256_set1_epi8('\r');
+    const __m256i open = _mm256_set1_epi8('(');
+    const __m256i close = _mm256_set1_epi8(')');
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i zero = _mm256_set1_epi8('0');
+    const __m256i nine = _mm256_set1_epi8(9);
+
+    uint64_t ws = 0, dg = 0, st = 0;
+    for (unsigned lane = 0; lane < 2; lane++) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(block + 32 * lane));
+
+        __m256i w = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, space),
+                            _mm256_cmpeq_epi8(v, tab)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, newline),
+                            _mm256_cmpeq_epi8(v, carriage)));
+
+        __m256i offset = _mm256_sub_epi8(v, zero);
+        __m256i d = _mm256_cmpeq_epi8(_mm256_min_epu8(offset, nine), offset);
+
+        __m256i s = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, open),
+                            _mm256_cmpeq_epi8(v, close)),
+            _mm256_cmpeq_epi8(v, comma));
+
+        unsigned shift = 32 * lane;
+        ws |= (uint64_t)(uint32_t)_mm256_movemask_epi8(w) << shift;
+        dg |= (uint64_t)(uint32_t)_mm256_movemask_epi8(d) << shift;
+        st |= (uint64_t)(uint32_t)_mm256_movemask_epi8(s) << shift;
+    }
+
+    *whitespace = ws;
+    *digits = dg;
+    *structural = st;
+}
+
+
+/*
+ * Stage one, SSE4.2 implementation: four 16-byte lanes matched against
+ * the classes with the explicit-length string comparison instruction.
+ */
+__attribute__((target("sse4.2")))
+static void classify_sse42(const unsigned char *block, uint64_t *whitespace,
+                           uint64_t *digits, uint64_t *structural) {
+    const __m128i ws_set = _mm_setr_epi8(' ', '\t', '\n', '\r',
+                                         0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i digit_range = _mm_setr_epi8('0', '9',
+                                              0, 0, 0, 0, 0, 0,
+                                              0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i st_set = _mm_setr_epi8('(', ')', ',',
+                                         0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+
+    uint64_t ws = 0, dg = 0, st = 0;
+    for (unsigned lane = 0; lane < 4; lane++) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(block + 16 * lane));
+
+        __m128i w = _mm_cmpestrm(ws_set, 4, v, 16,
+                                 _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY |
+                                 _SIDD_BIT_MASK);
+        __m128i d = _mm_cmpestrm(digit_range, 2, v, 16,
+                                 _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES |
+                                 _SIDD_BIT_MASK);
+        __m128i s = _mm_cmpestrm(st_set, 3, v, 16,
+                                 _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY |
+                                 _SIDD_BIT_MASK);
+
+        unsigned shift = 16 * lane;
+        ws |= (uint64_t)(uint16_t)_mm_cvtsi128_si32(w) << shift;
+        dg |= (uint64_t)(uint16_t)_mm_cvtsi128_si32(d) << shift;
+        st |= (uint64_t)(uint16_t)_mm_cvtsi128_si32(s) << shift;
+    }
+
+    *whitespace = ws;
+    *digits = dg;
+    *structural = st;
+}
+
+#endif  /* TOKENIZER_HAVE_X86 */
+
+
+/*
+ * Looks up the engine called `name`.
+ *
+ * Parameters:
+ *   name   - The name of the engine, as given on the command line.
+ *   engine - Where the engine is stored.
+ *
+ * Returns:
+ *   0 on success, or -1 if the name is unknown.
+ */
+int tokenizer_engine_from_name(const char *name, tokenizer_engine *engine) {
+    static const struct {
+        const char *name;
+        tokenizer_engine engine;
+    } names[] = {
+        { "flex", TOKENIZER_FLEX },
+        { "simd", TOKENIZER_SIMD },
+        { "avx2", TOKENIZER_AVX2 },
+        { "sse4.2", TOKENIZER_SSE42 },
+        { "scalar", TOKENIZER_SCALAR }
+    };
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (!strcmp(name, names[i].name)) {
+            *engine = names[i].engine;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
+/*
+ * Returns 1 if `engine` can run on the current CPU, 0 otherwise.
+ */
+int tokenizer_engine_supported(tokenizer_engine engine) {
+    switch (engine) {
+#ifdef TOKENIZER_HAVE_X86
+        case TOKENIZER_AVX2:
+            return __builtin_cpu_supports("avx2") ? 1 : 0;
+        case TOKENIZER_SSE42:
+            return __builtin_cpu_supports("sse4.2") ? 1 : 0;
+#else
+        case TOKENIZER_AVX2:
+        case TOKENIZER_SSE42:
+            return 0;
+#endif
+        case TOKENIZER_FLEX:
+        case TOKENIZER_SIMD:
+        case TOKENIZER_SCALAR:
+        default:
+            return 1;
+    }
+}
+
+
+/*
+ * Returns the stage one implementation of `engine`, or NULL if it is
+ * not supported by the CPU.
+ */
+static classify_fn select_classifier(tokenizer_engine engine) {
+    if (engine == TOKENIZER_SIMD) {
+        if (tokenizer_engine_supported(TOKENIZER_AVX2)) {
+            engine = TOKENIZER_AVX2;
+        } else if (tokenizer_engine_supported(TOKENIZER_SSE42)) {
+            engine = TOKENIZER_SSE42;
+        } else {
+            engine = TOKENIZER_SCALAR;
+        }
+    }
+
+    if (!tokenizer_engine_supported(engine)) {
+        return NULL;
+    }
+
+    switch (engine) {
+#ifdef TOKENIZER_HAVE_X86
+        case TOKENIZER_AVX2:
+            return classify_avx2;
+        case TOKENIZER_SSE42:
+            return classify_sse42;
+#endif
+        case TOKENIZER_SCALAR:
+            return classify_scalar;
+        default:
+            return NULL;
+    }
+}
+
+
+/*
+ * Makes room for a window of at least `capacity` bytes, keeping the
+ * bytes already loaded.
+ *
+ * Returns:
+ *   0 on success, or -1 if the memory could not be allocated.
+ */
+static int reserve(tokenizer *t, size_t capacity) {
+    size_t blocks = capacity / TOKENIZER_BLOCK_SIZE + 1;
+
+    /* A spare block of zeros lets stage one read whole blocks, and
+     * stage two look ahead of the last token. A mapped input is
+     * followed by such padding already. */
+    if (!t->mapped) {
+        char *buffer = realloc(t->buffer, (blocks + 1) * TOKENIZER_BLOCK_SIZE);
+        if (!buffer) {
+            return -1;
+        }
+        t->buffer = buffer;
+        t->data = buffer;
+    }
+
+    uint64_t **bitmaps[] = { &t->whitespace, &t->digits, &t->structural };
+    for (size_t i = 0; i < 3; i++) {
+        uint64_t *bitmap = realloc(*bitmaps[i], blocks * sizeof(uint64_t));
+        if (!bitmap) {
+            return -1;
+        }
+        *bitmaps[i] = bitmap;
+    }
+
+    t->capacity = capacity;
+    return 0;
+}
+
+
+/*
+ * Counts the line feeds of the window up to `end`, from where they
+ * were last counted to.
+ */
+static void count_lines(tokenizer *t, size_t end) {
+    const char *p = t->data + (t->line_offset - t->offset);
+    const char *last = t->data + end;
+    while (p < last && (p = memchr(p, '\n', (size_t)(last - p)))) {
+        t->lines++;
+        p++;
+    }
+    t->line_offset = t->offset + end;
+}
+
+
+/*
+ * Moves the window so that it starts at the first byte not yet
+ * tokenized and holds as many new bytes as fit, then runs stage one
+ * over it. A streamed window is moved to the front of the buffer and
+ * completed with fread; a mapped window just slides over the mapping.
+ *
+ * Returns:
+ *   0 on success, or -1 if the memory could not be allocated.
+ */
+static int refill(tokenizer *t) {
+    size_t pending = t->length - t->position;
+
+    if (t->count_lines) {
+        count_lines(t, t->position);
+    }
+    t->offset += t->position;
+    if (!t->mapped && t->position) {
+        memmove(t->buffer, t->buffer + t->position, pending);
+    }
+    t->position = 0;
+    t->length = pending;
+
+    /* A single token fills the window: grow it. */
+    if (pending > t->capacity / 2 && reserve(t, t->capacity * 2) < 0) {
+        return -1;
+    }
+
+    if (t->mapped) {
+        size_t remaining = t->mapped_length - t->offset;
+        t->data = t->mapped + t->offset;
+        t->length = remaining < t->capacity ? remaining : t->capacity;
+        t->eof = t->length == remaining;
+        if (t->stats) {
+            t->stats->bytes_read += t->length - pending;
+        }
+    } else {
+        stats_phase previous = stats_enter(t->stats, STATS_READ);
+        size_t read = fread(t->buffer + t->length, 1,
+                            t->capacity - t->length, t->input);
+        stats_leave(t->stats, previous);
+        if (read < t->capacity - t->length) {
+            t->eof = 1;
+        }
+        if (t->stats) {
+            t->stats->bytes_read += read;
+        }
+        t->length += read;
+        memset(t->buffer + t->length, 0,
+               (t->length / TOKENIZER_BLOCK_SIZE + 2) * TOKENIZER_BLOCK_SIZE
+               - t->length);
+    }
+
+    size_t blocks = t->length / TOKENIZER_BLOCK_SIZE + 1;
+    for (size_t b = 0; b < blocks; b++) {
+        t->classify((const unsigned char *)t->data + b * TOKENIZER_BLOCK_SIZE,
+                    &t->whitespace[b], &t->digits[b], &t->structural[b]);
+    }
+    return 0;
+}
+
+
+/*
+ * Returns the position of the first byte at or after `from` that is
+ * not in `bitmap`, or the number of loaded bytes if there is none.
+ */
+static size_t find_clear(const tokenizer *t, const uint64_t *bitmap,
+                         size_t from) {
+    size_t blocks = t->length / TOKENIZER_BLOCK_SIZE + 1;
+    size_t b = from / TOKENIZER_BLOCK_SIZE;
+    uint64_t bits = ~bitmap[b] >> (from % TOKENIZER_BLOCK_SIZE);
+
+    if (bits) {
+        size_t found = from + (size_t)__builtin_ctzll(bits);
+        return found < t->length ? found : t->length;
+    }
+
+    for (b++; b < blocks; b++) {
+        bits = ~bitmap[b];
+        if (bits) {
+            size_t found = b * TOKENIZER_BLOCK_SIZE
+                           + (size_t)__builtin_ctzll(bits);
+            return found < t->length ? found : t->length;
+        }
+    }
+    return t->length;
+}
+
+
+/*
+ * Returns 1 if the byte at `position` is in `bitmap`.
+ */
+static int has_bit(const uint64_t *bitmap, size_t position) {
+    return (bitmap[position / TOKENIZER_BLOCK_SIZE]
+            >> (position % TOKENIZER_BLOCK_SIZE)) & 1;
+}
+
+
+/*
+ * Returns 1 if `c` is a decimal digit.
+ */
+static int is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+
+/*
+ * Returns the end of the NUMBER token starting at `start`, following
+ * the longest match of -?[0-9]+(\.[0-9]+)?([eE][-+]?[0-9]+)?
+ * The fraction and the exponent are taken only if digits follow them,
+ * which reads up to two bytes past the end of the token. The zero
+ * padding after the loaded bytes stops every run.
+ */
+static size_t scan_number(const tokenizer *t, size_t start) {
+    const char *data = t->data;
+    size_t end = start + (data[start] == '-');
+
+    end = find_clear(t, t->digits, end);
+
+    if (data[end] == '.' && is_digit(data[end + 1])) {
+        end = find_clear(t, t->digits, end + 1);
+    }
+
+    if (data[end] == 'e' || data[end] == 'E') {
+        size_t digits = end + 1;
+        if (data[digits] == '-' || data[digits] == '+') {
+            digits++;
+        }
+        if (is_digit(data[digits])) {
+            end = find_clear(t, t->digits, digits);
+        }
+    }
+    return end;
+}
+
+
+/*
+ * Creates a SIMD tokenizer reading WKT from `in_file`.
+ *
+ * Parameters:
+ *   in_file - The WKT input stream.
+ *   engine  - The stage one implementation to use.
+ *
+ * Returns:
+ *   A dynamically allocated tokenizer, or NULL if the engine is not
+ *   supported or an error occurs.
+ */
+tokenizer* tokenizer_new(FILE *in_file, tokenizer_engine engine) {
+    classify_fn classify = select_classifier(engine);
+    if (!classify) {
+        return NULL;
+    }
+
+    tokenizer *t = calloc(1, sizeof(tokenizer));
+    if (!t) {
+        return NULL;
+    }
+
+    if (reserve(t, TOKENIZER_CHUNK_SIZE) < 0) {
+        tokenizer_free(t);
+        return NULL;
+    }
+
+    t->input = in_file;
+    t->classify = classify;
+    t->whitespace[0] = t->digits[0] = t->structural[0] = 0;
+    return t;
+}
+
+
+/*
+ * Creates a SIMD tokenizer scanning WKT straight from memory.
+ *
+ * Parameters:
+ *   data   - The input, followed by at least TOKENIZER_PADDING readable
+ *            bytes, starting with a zero byte or a keyword.
+ *   length - The length of the input, without the padding.
+ *   engine - The stage one implementation to use.
+ *
+ * Returns:
+ *   A dynamically allocated tokenizer, or NULL if the engine is not
+ *   supported or an error occurs.
+ */
+tokenizer* tokenizer_new_mapped(const char *data, size_t length,
+                                tokenizer_engine engine) {
+    classify_fn classify = select_classifier(engine);
+    if (!classify) {
+        return NULL;
+    }
+
+    tokenizer *t = calloc(1, sizeof(tokenizer));
+    if (!t) {
+        return NULL;
+    }
+
+    t->mapped = data;
+    t->mapped_length = length;
+    t->data = data;
+    if (reserve(t, TOKENIZER_CHUNK_SIZE) < 0) {
+        tokenizer_free(t);
+        return NULL;
+    }
+
+    t->classify = classify;
+    t->whitespace[0] = t->digits[0] = t->structural[0] = 0;
+    return t;
+}
+
+
+/*
+ * Records the reads of the tokenizer in statistics.
+ *
+ * Parameters:
+ *   t     - The tokenizer.
+ *   stats - The statistics, or NULL to stop recording them.
+ */
+void tokenizer_set_stats(tokenizer *t, wkt2geojson_stats *stats) {
+    t->stats = stats;
+}
+
+
+/*
+ * Makes the tokenizer count the lines of its input, so that
+ * `tokenizer_line` can be called.
+ *
+ * Parameters:
+ *   t - The tokenizer, before any token is read.
+ */
+void tokenizer_count_lines(tokenizer *t) {
+    t->count_lines = 1;
+}
+
+
+/*
+ * Returns the offset in the input of the last token returned by
+ * `tokenizer_next`, or the offset following the end of the input (or
+ * the zero byte) after it returned 0.
+ */
+size_t tokenizer_offset(const tokenizer *t) {
+    return t->offset + t->token;
+}
+
+
+/*
+ * Returns the line, from 1, of the last token returned by
+ * `tokenizer_next`. Lines are counted from the previous call, so the
+ * cost of all of the calls is linear in the size of the input.
+ */
+size_t tokenizer_line(tokenizer *t) {
+    count_lines(t, t->token);
+    return t->lines + 1;
+}
+
+
+/*
+ * Releases the tokenizer and its buffers.
+ *
+ * Parameters:
+ *   t - The tokenizer to release. May be NULL.
+ */
+void tokenizer_free(tokenizer *t) {
+    if (!t) {
+        return;
+    }
+    free(t->buffer);
+    free(t->whitespace);
+    free(t->digits);
+    free(t->structural);
+    free(t);
+}
+
+
+/*
+ * Stage two: returns the next token of the input.
+ *
+ * Whenever a token may continue past the loaded bytes, the buffer is
+ * refilled and the token is recognized again from its first byte.
+ *
+ * Parameters:
+ *   t     - The tokenizer.
+ *   value - Where the value of a NUMBER token is stored.
+ *
+ * Returns:
+ *   The token, or 0 at the end of the input.
+ */
+int tokenizer_next(tokenizer *t, double *value) {
+    for (;;) {
+        size_t start = find_clear(t, t->whitespace, t->position);
+        t->position = start;
+        t->token = start;
+
+        if (start == t->length) {
+            if (t->eof || refill(t) < 0) {
+                return 0;
+            }
+            continue;
+        }
+
+        unsigned char c = (unsigned char)t->data[start];
+
+        if (has_bit(t->structural, start)) {
+            t->position = start + 1;
+            return c;
+        }
+
+        if (c == '-' && start + 1 >= t->length && !t->eof) {
+            if (refill(t) < 0) {
+                return 0;
+            }
+            continue;
+        }
+
+        if (has_bit(t->digits, start)
+                || (c == '-' && is_digit(t->data[start + 1]))) {
+            size_t end = scan_number(t, start);
+
+            /* The lookahead of the number reaches the loaded bytes. */
+            if (end + 3 > t->length && !t->eof) {
+                if (refill(t) < 0) {
+                    return 0;
+                }
+                continue;
+            }
+
+            *value = parse_number(t->data + start, end - start);
+            t->position = end;
+            return NUMBER;
+        }
+
+        if ((c == 'P' || c == 'L') && !t->eof
+                && t->length - start < TOKENIZER_KEYWORD_MAX) {
+            if (refill(t) < 0) {
+                return 0;
+            }
+            continue;
+        }
+
+        for (size_t k = 0; k < sizeof(keywords) / sizeof(keywords[0]); k++) {
+            if (t->length - start >= keywords[k].length
+                    && !memcmp(t->data + start, keywords[k].text,
+                               keywords[k].length)) {
+                t->position = start + keywords[k].length;
+                return keywords[k].token;
+            }
+        }
+
+        /* Any other byte is returned as is, like the `.` rule. A zero
+         * byte is read as the end of the input, located after it. */
+        t->position = start + 1;
+        if (!c) {
+            t->token = t->position;
+        }
+        return (char)c;
+    }
+}
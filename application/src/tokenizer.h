@@ -0,0 +1,116 @@
+/*
+ * tokenizer.h
+ *
+ * Interface for the tokenizer module, a two-stage SIMD tokenizer that
+ * can be used by the parser instead of the Flex scanner. It recognizes
+ * exactly the same tokens as `scanner.l`, so the GeoJSON produced with
+ * either engine is byte-identical.
+ */
+#include <stdio.h>
+
+#include "stats.h"
+
+#ifndef INCLUDED_TOKENIZER_H
+#define INCLUDED_TOKENIZER_H
+
+/*
+ * Number of zero bytes that must follow an input scanned in memory.
+ */
+#define TOKENIZER_PADDING 64
+
+/*
+ * Tokenizer engines that can be selected at runtime.
+ */
+typedef enum tokenizer_engine {
+    TOKENIZER_FLEX,      /* the Flex scanner generated from scanner.l */
+    TOKENIZER_SIMD,      /* the best stage one supported by the CPU */
+    TOKENIZER_AVX2,      /* stage one with AVX2 instructions */
+    TOKENIZER_SSE42,     /* stage one with SSE4.2 instructions */
+    TOKENIZER_SCALAR     /* stage one with portable C code */
+} tokenizer_engine;
+
+
+/*
+ * State of a SIMD tokenizer reading from a file.
+ */
+typedef struct tokenizer tokenizer;
+
+
+/*
+ * Looks up the engine called `name` ("flex", "simd", "avx2", "sse4.2"
+ * or "scalar").
+ * Returns 0 on success or -1 if the name is unknown.
+ */
+int tokenizer_engine_from_name(const char *name, tokenizer_engine *engine);
+
+
+/*
+ * Returns 1 if `engine` can run on the current CPU, 0 otherwise.
+ */
+int tokenizer_engine_supported(tokenizer_engine engine);
+
+
+/*
+ * Creates a SIMD tokenizer reading WKT from `in_file`, with the stage
+ * one implementation of `engine` (which must not be TOKENIZER_FLEX).
+ * Returns NULL in case of error.
+ */
+tokenizer* tokenizer_new(FILE *in_file, tokenizer_engine engine);
+
+
+/*
+ * Creates a SIMD tokenizer scanning the `length` bytes of WKT at `data`
+ * in place, such as a memory-mapped file. The input must be followed
+ * by TOKENIZER_PADDING readable bytes, the first of which cannot
+ * extend a token (a zero byte, or the first letter of a keyword), and
+ * must outlive the tokenizer.
+ * Returns NULL in case of error.
+ */
+tokenizer* tokenizer_new_mapped(const char *data, size_t length,
+                                tokenizer_engine engine);
+
+
+/*
+ * Times the reads of the tokenizer and counts the bytes it reads in
+ * `stats`, or stops when it is NULL.
+ */
+void tokenizer_set_stats(tokenizer *t, wkt2geojson_stats *stats);
+
+
+/*
+ * Makes the tokenizer count the lines of its input, as required by
+ * `tokenizer_line`. Must be called before any token is read.
+ */
+void tokenizer_count_lines(tokenizer *t);
+
+
+/*
+ * Returns the byte offset in the input of the last token returned by
+ * `tokenizer_next`, or the offset following the end of the input (or
+ * the zero byte read as such) after it returned 0.
+ */
+size_t tokenizer_offset(const tokenizer *t);
+
+
+/*
+ * Returns the line, from 1, of the last token returned by
+ * `tokenizer_next`. Lines must be counted (`tokenizer_count_lines`).
+ */
+size_t tokenizer_line(tokenizer *t);
+
+
+/*
+ * Releases the tokenizer. Accepts NULL.
+ */
+void tokenizer_free(tokenizer *t);
+
+
+/*
+ * Returns the next token of the input, as `yylex` does, storing the
+ * value of NUMBER tokens in `value`. Returns 0 at the end of the input.
+ */
+int tokenizer_next(tokenizer *t, double *value);
+
+#endif  /* INCLUDED_TOKENIZER_H */
+
+// EOF
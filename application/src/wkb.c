@@ -0,0 +1,648 @@
+/*
+ * wkb.c
+ *
+ * This module converts Well-Known Binary (WKB) geometries into GeoJSON.
+ * Geometries exported from a database are often WKB, or WKB encoded in
+ * hexadecimal with one geometry per line, as PostGIS dumps them, and
+ * converting them to WKT first, only to tokenize the text again and to
+ * parse the numbers back, costs more than the conversion itself. The
+ * coordinates of WKB are IEEE 754 doubles: they are copied as they are
+ * (with their bytes swapped when the byte order of the geometry is not
+ * the one of the CPU) into a coordinate buffer, and handed to the
+ * writer like the coordinates of the parser.
+ *
+ * The supported geometries are the ones of the WKT grammar: Point,
+ * LineString and Polygon, in two dimensions. The extended WKB (EWKB)
+ * of PostGIS is accepted when it only adds an SRID, which is ignored.
+ * Empty geometries, which WKT records cannot hold either, are invalid.
+ *
+ * A raw WKB input is a sequence of geometries stored back to back. The
+ * end of an invalid geometry cannot be found, so the conversion stops
+ * at the first one. A hex-encoded input holds one geometry per line:
+ * when the context records rejects (`reject.h`), an invalid line is
+ * skipped and logged with its byte offset and line number, as the
+ * parser does with WKT records.
+ */
+
+#include "wkb.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parser.tab.h"
+
+/* Size of the first buffer of a streamed WKB input. */
+#define WKB_READ_SIZE (64 * 1024)
+
+/* Byte order of WKB little-endian (NDR) geometries. */
+#define WKB_NDR 1
+
+/* Geometry types of WKB, and flag of the type of EWKB followed by an
+ * SRID. Other types and flags, such as those of the Z and M
+ * dimensions, are not supported. */
+#define WKB_POINT 1
+#define WKB_LINESTRING 2
+#define WKB_POLYGON 3
+#define EWKB_SRID_FLAG 0x20000000u
+
+/* Size of a vertex of two dimensions. */
+#define WKB_VERTEX_SIZE (2 * sizeof(double))
+
+/* Value of the hex digits, plus one, and 0 for other characters. */
+static const unsigned char HEX_DIGITS[256] = {
+    ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+    ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+    ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15,
+    ['f'] = 16, ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14,
+    ['E'] = 15, ['F'] = 16
+};
+
+
+/*
+ * Reader of WKB bytes: a window over a mapped input or a decoded line,
+ * or the buffer of a streamed input, which is refilled on demand.
+ */
+typedef struct wkb_reader {
+    const unsigned char *data;  /* bytes available */
+    size_t length;              /* number of bytes at `data` */
+    size_t position;            /* next byte to decode */
+    int swap;                   /* whether to swap the bytes of numbers */
+    FILE *file;                 /* streamed input, or NULL */
+    unsigned char *buffer;      /* buffer of the streamed input */
+    size_t capacity;            /* size of `buffer` */
+    const char *error;          /* error reading the input, or NULL */
+    wkt2geojson_stats *stats;   /* statistics of the reads, or NULL */
+} wkb_reader;
+
+
+/*
+ * Reader of the lines of a hex-encoded input, from a mapped input or
+ * from a stream.
+ */
+typedef struct line_reader {
+    const mapped_input *mapped; /* mapped input, or NULL */
+    FILE *file;                 /* streamed input */
+    char *buffer;               /* last line read from `file` */
+    size_t capacity;            /* size of `buffer` */
+    size_t offset;              /* offset of the next line */
+    size_t line;                /* number of the next line, from 1 */
+    wkt2geojson_stats *stats;   /* statistics of the reads, or NULL */
+} line_reader;
+
+
+/*
+ * Moves the unread bytes of a streamed input to the start of its
+ * buffer, and reads from the stream until `count` bytes are available.
+ *
+ * Returns:
+ *   0 on success, or -1 at the end of the input or if an error occurs,
+ *   in which case the error of the reader is set.
+ */
+static int reader_refill(wkb_reader *r, size_t count) {
+    size_t left = r->length - r->position;
+    if (left) {
+        memmove(r->buffer, r->data + r->position, left);
+    }
+    r->data = r->buffer;
+    r->length = left;
+    r->position = 0;
+
+    if (r->capacity < count) {
+        size_t capacity = r->capacity ? r->capacity : WKB_READ_SIZE;
+        while (capacity < count) {
+            capacity *= 2;
+        }
+        unsigned char *buffer = realloc(r->buffer, capacity);
+        if (!buffer) {
+            r->error = "out of memory";
+            return -1;
+        }
+        r->data = r->buffer = buffer;
+        r->capacity = capacity;
+    }
+
+    stats_phase previous = stats_enter(r->stats, STATS_READ);
+    while (r->length < count) {
+        size_t read = fread(r->buffer + r->length, 1,
+                            r->capacity - r->length, r->file);
+        if (!read) {
+            break;
+        }
+        r->length += read;
+        if (r->stats) {
+            r->stats->bytes_read += read;
+        }
+    }
+    stats_leave(r->stats, previous);
+
+    if (r->length < count) {
+        if (ferror(r->file)) {
+            r->error = "cannot read the input";
+        }
+        return -1;
+    }
+    return 0;
+}
+
+
+/*
+ * Ensures that `count` bytes can be decoded from the reader.
+ *
+ * Returns:
+ *   0 on success, or -1 if the input ends before or an error occurs.
+ */
+static inline int reader_require(wkb_reader *r, size_t count) {
+    if (r->length - r->position >= count) {
+        return 0;
+    }
+    return r->file ? reader_refill(r, count) : -1;
+}
+
+
+/*
+ * Decodes an unsigned 32-bit integer, after `reader_require`.
+ */
+static inline uint32_t read_uint32(wkb_reader *r) {
+    uint32_t value;
+    memcpy(&value, r->data + r->position, sizeof(value));
+    r->position += sizeof(value);
+    return r->swap ? __builtin_bswap32(value) : value;
+}
+
+
+/*
+ * Decodes a double, after `reader_require`.
+ */
+static inline double read_double(wkb_reader *r) {
+    uint64_t bits;
+    memcpy(&bits, r->data + r->position, sizeof(bits));
+    r->position += sizeof(bits);
+    if (r->swap) {
+        bits = __builtin_bswap64(bits);
+    }
+
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+
+/*
+ * Decodes `count` vertices into a coordinate buffer.
+ *
+ * Returns:
+ *   0 on success, 1 if the geometry is truncated, or -1 if the memory
+ *   could not be allocated.
+ */
+static int read_vertices(wkb_reader *r, coordinate_buffer *coordinates,
+                         uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (reader_require(r, WKB_VERTEX_SIZE) < 0) {
+            return 1;
+        }
+        vertex v;
+        v.x = read_double(r);
+        v.y = read_double(r);
+        if (coordinate_buffer_append(coordinates, v) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * Decodes the geometry at the position of the reader into a coordinate
+ * buffer allocated from the arena of the context: the vertex of a
+ * Point, the vertices of a LineString, or the rings of a Polygon.
+ *
+ * Parameters:
+ *   ctx         - The context of the conversion.
+ *   r           - The reader, at the byte order of the geometry.
+ *   type        - Where the type of the geometry is stored.
+ *   coordinates - Where the coordinates of the geometry are stored.
+ *   error       - Where the reason is stored for an invalid geometry.
+ *
+ * Returns:
+ *   0 on success, 1 if the geometry is invalid or unsupported, or -1
+ *   if the memory could not be allocated.
+ */
+static int decode_geometry(wkt2geojson_ctx *ctx, wkb_reader *r,
+                           wkt_geometry_type *type,
+                           coordinate_buffer **coordinates,
+                           const char **error) {
+    *error = "truncated WKB geometry";
+    if (reader_require(r, 1 + sizeof(uint32_t)) < 0) {
+        return 1;
+    }
+    unsigned char order = r->data[r->position++];
+    if (order > WKB_NDR) {
+        *error = "invalid WKB byte order";
+        return 1;
+    }
+    r->swap = (order == WKB_NDR)
+              != (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__);
+
+    uint32_t code = read_uint32(r);
+    if (code & EWKB_SRID_FLAG) {
+        if (reader_require(r, sizeof(uint32_t)) < 0) {
+            return 1;
+        }
+        r->position += sizeof(uint32_t);
+        code &= ~EWKB_SRID_FLAG;
+    }
+
+    coordinate_buffer *buffer = coordinate_buffer_new(&ctx->arena);
+    if (!buffer) {
+        return -1;
+    }
+    *coordinates = buffer;
+
+    int status = 0;
+    uint32_t count = 0;
+    uint32_t rings = 0;
+    switch (code) {
+        case WKB_POINT:
+            *type = WKT_POINT;
+            status = read_vertices(r, buffer, 1);
+            /* POINT EMPTY is encoded as NaN coordinates. */
+            if (!status && isnan(buffer->values[0])
+                    && isnan(buffer->values[1])) {
+                *error = "empty WKB geometry";
+                return 1;
+            }
+            break;
+
+        case WKB_LINESTRING:
+            *type = WKT_LINESTRING;
+            if (reader_require(r, sizeof(uint32_t)) < 0) {
+                return 1;
+            }
+            count = read_uint32(r);
+            if (!count) {
+                *error = "empty WKB geometry";
+                return 1;
+            }
+            status = read_vertices(r, buffer, count);
+            break;
+
+        case WKB_POLYGON:
+            *type = WKT_POLYGON;
+            if (reader_require(r, sizeof(uint32_t)) < 0) {
+                return 1;
+            }
+            rings = read_uint32(r);
+            if (!rings) {
+                *error = "empty WKB geometry";
+                return 1;
+            }
+            for (uint32_t i = 0; i < rings && !status; i++) {
+                if (reader_require(r, sizeof(uint32_t)) < 0) {
+                    return 1;
+                }
+                count = read_uint32(r);
+                if (!count) {
+                    *error = "empty WKB geometry";
+                    return 1;
+                }
+                status = read_vertices(r, buffer, count);
+                if (!status && coordinate_buffer_close_ring(buffer) < 0) {
+                    status = -1;
+                }
+            }
+            break;
+
+        default:
+            *error = "unsupported WKB geometry type";
+            return 1;
+    }
+
+    /* GeoJSON cannot represent infinities and NaN. */
+    for (size_t i = 0; !status && i < buffer->size; i++) {
+        if (!isfinite(buffer->values[i])) {
+            *error = "non-finite WKB coordinate";
+            return 1;
+        }
+    }
+    return status;
+}
+
+
+/*
+ * Writes a decoded geometry, simplified as selected by the context, to
+ * the sink of the context, or appends it to its IR, and releases its
+ * coordinates. A geometry dropped by the spatial filter of the context
+ * is only released.
+ *
+ * Returns:
+ *   0 on success, or -1 if an error occurs, which is reported.
+ */
+static int write_feature(wkt2geojson_ctx *ctx, wkt_geometry_type type,
+                         coordinate_buffer *coordinates) {
+    vertex point = { coordinates->values[0], coordinates->values[1] };
+    int first = !ctx->count && !ctx->continued;
+
+    if (type == WKT_POINT ? !spatial_filter_match_point(ctx->filter, point)
+            : !spatial_filter_match_buffer(ctx->filter, type, coordinates)) {
+        arena_reset(&ctx->arena);
+        return 0;
+    }
+
+    if (type != WKT_POINT
+            && simplify_coordinates(coordinates, &ctx->simplify) < 0) {
+        arena_reset(&ctx->arena);
+        yyerror(ctx, "out of memory");
+        return -1;
+    }
+
+    stats_phase previous = stats_enter(ctx->stats, STATS_FORMAT);
+    int status;
+    if (ctx->ir) {
+        status = type == WKT_POINT
+            ? wkt_ir_append_point(ctx->ir, point)
+            : wkt_ir_append_buffer(ctx->ir, type, coordinates);
+    } else if (type == WKT_POINT) {
+        status = write_point(&ctx->sink, point, ctx->precision, first);
+    } else if (type == WKT_LINESTRING) {
+        status = write_linestring(&ctx->sink, coordinates, ctx->precision,
+                                  first);
+    } else {
+        status = write_polygon(&ctx->sink, coordinates, ctx->precision,
+                               first);
+    }
+    stats_leave(ctx->stats, previous);
+
+    size_t vertices = coordinate_buffer_length(coordinates);
+    arena_reset(&ctx->arena);
+    if (status < 0) {
+        yyerror(ctx, ctx->ir ? "out of memory" : strerror(ctx->sink.error));
+        return -1;
+    }
+
+    ctx->count++;
+    stats_count_feature(ctx->stats, type, vertices);
+    return 0;
+}
+
+
+/*
+ * Converts a raw WKB input, stopping at the first invalid geometry.
+ *
+ * Returns:
+ *   0 on success, or 1 if an error occurs, which is reported.
+ */
+static int transpile_raw(wkt2geojson_ctx *ctx) {
+    wkb_reader r = { .stats = ctx->stats };
+    if (ctx->mapped) {
+        r.data = (const unsigned char*)ctx->mapped->data;
+        r.length = ctx->mapped->length;
+        if (ctx->stats) {
+            ctx->stats->bytes_read += r.length;
+        }
+    } else {
+        r.file = ctx->input;
+    }
+
+    int status = 0;
+    while (!status && reader_require(&r, 1) == 0) {
+        wkt_geometry_type type;
+        coordinate_buffer *coordinates;
+        const char *error;
+        int decoded = decode_geometry(ctx, &r, &type, &coordinates, &error);
+        if (decoded) {
+            yyerror(ctx, r.error ? r.error
+                         : decoded < 0 ? "out of memory" : error);
+            status = 1;
+        } else if (write_feature(ctx, type, coordinates) < 0) {
+            status = 1;
+        }
+    }
+    if (!status && r.error) {
+        yyerror(ctx, r.error);
+        status = 1;
+    }
+
+    arena_reset(&ctx->arena);
+    free(r.buffer);
+    return status;
+}
+
+
+/*
+ * Reads the next line of a hex-encoded input, without its line feed.
+ *
+ * Parameters:
+ *   lines  - The reader of the lines.
+ *   text   - Where the first character of the line is stored.
+ *   length - Where the length of the line is stored.
+ *
+ * Returns:
+ *   1 if a line was read, or 0 at the end of the input.
+ */
+static int next_line(line_reader *lines, const char **text,
+                     size_t *length) {
+    size_t size;
+    if (lines->mapped) {
+        if (lines->offset >= lines->mapped->length) {
+            return 0;
+        }
+        *text = lines->mapped->data + lines->offset;
+        size = lines->mapped->length - lines->offset;
+        const char *end = memchr(*text, '\n', size);
+        *length = end ? (size_t)(end - *text) : size;
+        size = end ? *length + 1 : size;
+    } else {
+        stats_phase previous = stats_enter(lines->stats, STATS_READ);
+        ssize_t read = getline(&lines->buffer, &lines->capacity,
+                               lines->file);
+        stats_leave(lines->stats, previous);
+        if (read < 0) {
+            return 0;
+        }
+        size = (size_t)read;
+        *text = lines->buffer;
+        *length = size && lines->buffer[size - 1] == '\n' ? size - 1 : size;
+    }
+
+    if (lines->stats) {
+        lines->stats->bytes_read += size;
+    }
+    lines->offset += size;
+    lines->line++;
+    return 1;
+}
+
+
+/*
+ * Returns 1 if `c` is a blank around the hex digits of a line, 0
+ * otherwise.
+ */
+static int is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+
+/*
+ * Decodes a hex-encoded line into bytes.
+ *
+ * Parameters:
+ *   text     - The hex digits.
+ *   length   - The number of hex digits.
+ *   bytes    - The buffer receiving the bytes, grown as needed.
+ *   capacity - The size of `bytes`.
+ *
+ * Returns:
+ *   0 on success, 1 if the line is not an even number of hex digits,
+ *   or -1 if the memory could not be allocated.
+ */
+static int decode_hex(const char *text, size_t length,
+                      unsigned char **bytes, size_t *capacity) {
+    if (length % 2) {
+        return 1;
+    }
+    if (*capacity < length / 2) {
+        unsigned char *grown = realloc(*bytes, length / 2);
+        if (!grown) {
+            return -1;
+        }
+        *bytes = grown;
+        *capacity = length / 2;
+    }
+
+    const unsigned char *digits = (const unsigned char*)text;
+    unsigned char *out = *bytes;
+    for (size_t i = 0; i < length; i += 2) {
+        unsigned high = HEX_DIGITS[digits[i]];
+        unsigned low = HEX_DIGITS[digits[i + 1]];
+        if (!high || !low) {
+            return 1;
+        }
+        *out++ = (unsigned char)((high - 1) << 4 | (low - 1));
+    }
+    return 0;
+}
+
+
+/*
+ * Skips an invalid line of a hex-encoded input, adding it to the log
+ * of rejects of the context.
+ *
+ * Returns:
+ *   0 on success, or -1 if the context does not record rejects, if
+ *   more lines than tolerated have been rejected, or in case of error,
+ *   which is reported.
+ */
+static int reject_line(wkt2geojson_ctx *ctx, input_position position,
+                       const char *message) {
+    arena_reset(&ctx->arena);
+    if (!ctx->rejects) {
+        yyerror(ctx, message);
+        return -1;
+    }
+
+    reject_entry entry = {
+        .position = position,
+        .message = message,
+        .output_length = ctx->sink.length,
+        .count = ctx->count
+    };
+    if (reject_log_add(ctx->rejects, &entry) < 0) {
+        yyerror(ctx, "cannot record a rejected record");
+        return -1;
+    }
+    if (ctx->rejects->count > ctx->rejects->max_errors) {
+        yyerror(ctx, "too many rejected records");
+        return -1;
+    }
+    return 0;
+}
+
+
+/*
+ * Converts a hex-encoded WKB input, one geometry per line. Blank lines
+ * are skipped, as are the blanks around the hex digits.
+ *
+ * Returns:
+ *   0 on success, or 1 if an error occurs, which is reported.
+ */
+static int transpile_hex(wkt2geojson_ctx *ctx) {
+    line_reader lines = {
+        .mapped = ctx->mapped,
+        .file = ctx->input,
+        .line = 1,
+        .stats = ctx->stats
+    };
+    unsigned char *bytes = NULL;
+    size_t capacity = 0;
+    int status = 0;
+
+    input_position position = { lines.offset, lines.line };
+    const char *text;
+    size_t length;
+    while (!status && next_line(&lines, &text, &length)) {
+        size_t start = 0;
+        while (start < length && is_blank(text[start])) {
+            start++;
+        }
+        while (length > start && is_blank(text[length - 1])) {
+            length--;
+        }
+        if (start == length) {
+            position = (input_position){ lines.offset, lines.line };
+            continue;
+        }
+
+        stats_phase previous = stats_enter(ctx->stats, STATS_SCAN);
+        int decoded = decode_hex(text + start, length - start, &bytes,
+                                 &capacity);
+        stats_leave(ctx->stats, previous);
+
+        const char *error = "invalid hex-encoded WKB";
+        wkt_geometry_type type = WKT_POINT;
+        coordinate_buffer *coordinates = NULL;
+        if (!decoded) {
+            wkb_reader r = { .data = bytes, .length = (length - start) / 2 };
+            decoded = decode_geometry(ctx, &r, &type, &coordinates, &error);
+            if (!decoded && r.position != r.length) {
+                error = "trailing bytes after a WKB geometry";
+                decoded = 1;
+            }
+        }
+
+        if (decoded < 0) {
+            yyerror(ctx, "out of memory");
+            status = 1;
+        } else if (decoded) {
+            status = reject_line(ctx, position, error) < 0;
+        } else {
+            status = write_feature(ctx, type, coordinates) < 0;
+        }
+        position = (input_position){ lines.offset, lines.line };
+    }
+    if (!status && !lines.mapped && ferror(lines.file)) {
+        yyerror(ctx, "cannot read the input");
+        status = 1;
+    }
+
+    arena_reset(&ctx->arena);
+    free(lines.buffer);
+    free(bytes);
+    return status;
+}
+
+
+/*
+ * Converts the WKB input of a context into GeoJSON features.
+ *
+ * Parameters:
+ *   ctx - The context, whose format is INPUT_WKB or INPUT_HEX_WKB.
+ *
+ * Returns:
+ *   0 on success, or 1 if an error occurs.
+ */
+int wkb_transpile_features(wkt2geojson_ctx *ctx) {
+    return ctx->format == INPUT_HEX_WKB ? transpile_hex(ctx)
+                                        : transpile_raw(ctx);
+}
@@ -0,0 +1,25 @@
+/*
+ * wkb.h
+ *
+ * Interface for the WKB module, used to convert Well-Known Binary
+ * geometries, raw or hex-encoded as in PostGIS dumps, into GeoJSON
+ * without going through WKT.
+ */
+#include "context.h"
+
+#ifndef INCLUDED_WKB_H
+#define INCLUDED_WKB_H
+
+/*
+ * Converts the WKB read from the input of `ctx`, in the encoding of
+ * its `format`, into GeoJSON features appended to its output sink, or
+ * into its IR, as `transpile_features` does for WKT. Point, LineString
+ * and Polygon geometries in two dimensions are supported, with or
+ * without the SRID of EWKB.
+ * Returns 0 on success or 1 in case of error.
+ */
+int wkb_transpile_features(wkt2geojson_ctx *ctx);
+
+#endif  /* INCLUDED_WKB_H */
+
+// EOF
@@ -24,34 +24,184 @@
  *
  * Command-Line Options:
  *
- * - `-i <file>`: Specifies the input file.
- *   If not provided, the program reads from stdin.
- * - `-o <file>`: Specifies the output file.
+ * - `-i, --input <file>`: Specifies the input file.
+ *   If not provided, the program reads from stdin. A regular input
+ *   file is mapped in memory and read without read(2) calls; other
+ *   files, such as pipes, are streamed. An input compressed with gzip
+ *   or zstd is detected from its magic bytes and decompressed while
+ *   it is streamed.
+ * - `--input-format <format>`: Selects the encoding of the input: `wkt`
+ *   (default); `wkb`, Well-Known Binary geometries stored back to back;
+ *   or `hexwkb`, one hex-encoded WKB (or PostGIS EWKB) geometry per
+ *   line. WKB is decoded without tokenizing any text, and is always
+ *   converted on a single thread. Points, LineStrings and Polygons in
+ *   two dimensions are supported, like in WKT.
+ * - `-H, --huge-pages`: Advises the kernel to back the mapped input file with
+ *   transparent huge pages, where supported.
+ * - `-o, --output <file>`: Specifies the output file.
  *   If not provided, the program writes to stdout.
- * - `-h`: Displays the help message with usage instructions.
+ * - `--compress <codec>`: Compresses the output with `gzip` or `zstd`,
+ *   or not at all with `none`. By default, an output file ending in
+ *   `.gz` or `.zst` is compressed accordingly. The output is
+ *   compressed on a thread of its own, while the input is converted.
+ * - `-t, --tokenizer <engine>`: Selects the tokenizer engine: `flex` (default),
+ *   the Flex scanner; `simd`, the SIMD tokenizer with the best
+ *   instruction set supported by the CPU; or `avx2`, `sse4.2` and
+ *   `scalar` to force one of its implementations. Every engine
+ *   produces the same output.
+ * - `-j, --jobs <jobs>`: Converts a regular input file on up to `jobs`
+ *   threads, from 1 (default) to 256. The input is split at record
+ *   boundaries and the output is the same as with a single thread.
+ *   Streamed inputs are always converted on a single thread.
+ * - `-p, --precision <digits>`: Rounds every coordinate to a number of
+ *   fraction digits, from 0 to 17, and writes it without trailing
+ *   zeros (e.g. `12.5` rather than `12.500000`); 7 digits are about a
+ *   centimetre in degrees of WGS84. By default, coordinates are written
+ *   with the shortest representation that reads back as the same
+ *   value.
+ * - `--simplify <tolerance>`: Simplifies every LineString and Polygon
+ *   ring before it is written, dropping the vertices that do not move
+ *   it by more than `tolerance`, in units of the coordinates. Rings
+ *   stay closed and keep at least four vertices; lines keep their
+ *   endpoints.
+ * - `--simplify-method <method>`: Selects the simplification
+ *   algorithm: `dp` (default), Douglas-Peucker, which keeps the
+ *   vertices farther than `tolerance` from the simplified line; or
+ *   `vw`, Visvalingam-Whyatt, which drops the vertices forming a
+ *   triangle smaller than `tolerance` squared with their neighbours.
+ * - `--format <format>`: Selects the layout of the output: `geojson`
+ *   (default), a single FeatureCollection; `geojsonseq`, a GeoJSON
+ *   text sequence (RFC 8142) of features, each on a line of its own
+ *   that starts with a record separator (0x1E); or `ndjson`, one
+ *   feature per line. The features of a sequence are self-contained,
+ *   so the output can be streamed, split and loaded in parallel.
+ * - `--emit-bbox[=<scope>]`: Writes a `bbox` member (RFC 7946,
+ *   section 5) on every feature, computed while the coordinates are
+ *   parsed; with `all`, the FeatureCollection gets one too, written
+ *   after its features. `features` is the default scope.
+ * - `--bbox <minx,miny,maxx,maxy>`: Keeps only the features that
+ *   intersect the box, boundary included. The other features are
+ *   dropped once their coordinates are parsed, and never formatted.
+ * - `--intersects-wkt <wkt>`: Keeps only the features that intersect
+ *   one of the geometries of the WKT text, like `--bbox`.
+ * - `--sort <order>`: Writes the features in the order of the Hilbert
+ *   curve through the centres of their bounding boxes with `hilbert`,
+ *   so that features close in space are close in the output, or in
+ *   input order with `none` (default). The formatted features are kept
+ *   in memory up to `--sort-memory`, then spilled to sorted runs in
+ *   temporary files that are merged at the end of the input. Not
+ *   supported by `--batch` and `--serve`.
+ * - `--sort-memory <MiB>`: Memory of `--sort` before it spills to
+ *   disk (default: 256); 0 keeps every feature in memory.
+ * - `--temp-dir <dir>`: Directory of the temporary files of `--sort`
+ *   (default: `$TMPDIR`, or `/tmp`).
+ * - `--index <file>`: Writes a packed Hilbert R-tree of the features
+ *   of the output to `file`: the byte offset, length and bounding box
+ *   of every feature, in a flat file meant to be memory-mapped (see
+ *   `rtree.h`). Not supported with a compressed output, `--batch` and
+ *   `--serve`.
+ * - `--query-index <file>`: Instead of converting WKT, reads the
+ *   features of the GeoJSON output given with `-i` that intersect
+ *   `--bbox`, looked up in its index `file`, and writes them in the
+ *   selected `--format`.
+ * - `--stats[=<file>]`: Measures the time spent reading, scanning,
+ *   parsing, formatting and writing, counts the features and
+ *   vertices of every geometry type, and reports them with the CPU
+ *   time and the peak resident set size: as text on stderr, or as a
+ *   JSON object written to `file`. With `-j`, the phase times are
+ *   summed over the threads.
+ * - `--rejects <file>`: Skips the records with a syntax error instead
+ *   of stopping at the first one: the parser resumes at the next
+ *   geometry keyword, and every skipped record is written to `file` as
+ *   a line with its byte offset, its line and the error, separated by
+ *   tabs. The conversion succeeds unless more than `--max-errors`
+ *   records are skipped.
+ * - `--max-errors <n>`: Number of records that can be skipped before
+ *   the conversion fails (default: no limit with `--rejects`). Without
+ *   `--rejects`, skipped records are listed on stderr.
+ * - `--batch`: Converts many input files in one process: the files
+ *   and glob patterns given as operands or with `-i`, and the paths
+ *   listed one per line on stdin for a `-` operand or when no input
+ *   is given. The inputs are
+ *   converted on `-j` threads (default: one per CPU) and their
+ *   features merged, in input order, into a single document written
+ *   to the output file, unless `--output-dir` is given. A failing
+ *   input is reported with its path and does not stop the batch.
+ * - `--output-dir <dir>`: Writes one GeoJSON file per input of
+ *   `--batch` to `dir`, at the path of the input below the deepest
+ *   directory holding every input, with a `.geojson` extension. Two
+ *   inputs that would share an output file fail the batch.
+ * - `--serve <path>`: Runs as a daemon serving conversions on the
+ *   Unix domain socket at `path` until SIGINT or SIGTERM is received
+ *   (see `server.h` for the protocol). The input and output options
+ *   are ignored; the other options apply to every request.
+ * - `--workers <n>`: Number of threads converting the requests of
+ *   `--serve`, from 1 to 1024 (default: one per CPU).
+ * - `-h, --help`: Displays the help message with usage instructions.
  *
  * **Usage Examples**:
  * ```
  * ./wkt2geojson -i input.wkt -o output.geojson
  * ./wkt2geojson < input.wkt > output.geojson
+ * ./wkt2geojson -t simd -i dump.wkt -o dump.geojson
+ * ./wkt2geojson --input-format hexwkb -i dump.hex -o dump.geojson
+ * ./wkt2geojson --format ndjson -i dump.wkt | split -l 100000
+ * ./wkt2geojson -i dump.wkt.zst -o dump.geojson.gz
+ * ./wkt2geojson --sort=hilbert --sort-memory 64 -i dump.wkt -o sorted.geojson
+ * ./wkt2geojson --index dump.idx -i dump.wkt -o dump.geojson
+ * ./wkt2geojson --query-index dump.idx --bbox 2.2,48.8,2.5,48.9 -i dump.geojson
+ * ./wkt2geojson --batch --output-dir out/ tiles/a.wkt tiles/b.wkt
+ * find tiles -name '*.wkt' | ./wkt2geojson --batch -o merged.geojson
+ * ./wkt2geojson --serve /run/wkt2geojson.sock --workers 8
  * ```
  * This command reads WKT data from `input.wkt` and writes the
  * corresponding GeoJSON to `output.geojson`. If any of the file
  * options are omitted, the program defaults to using stdin and stdout.
  *
- * The `getopt` function is used to parse the command-line options.
+ * The `getopt_long` function is used to parse the command-line
+ * options.
  * The available options are:
  * - `i`: Specifies the input file path.
+ * - `input-format`: Specifies the encoding of the input.
+ * - `H`: Requests huge pages for the mapped input file.
  * - `o`: Specifies the output file path.
+ * - `compress`: Specifies the compression of the output.
+ * - `t`: Specifies the tokenizer engine.
+ * - `j`: Specifies the number of threads.
+ * - `p`: Specifies the number of fraction digits of the coordinates.
+ * - `simplify`: Specifies the simplification tolerance.
+ * - `simplify-method`: Specifies the simplification algorithm.
+ * - `format`: Specifies the layout of the output.
+ * - `emit-bbox`: Specifies the bounding boxes written.
+ * - `bbox`: Specifies the box the features must intersect.
+ * - `intersects-wkt`: Specifies the geometries the features must
+ *   intersect.
+ * - `sort`: Specifies the order of the features.
+ * - `sort-memory`: Specifies the memory of the sort.
+ * - `temp-dir`: Specifies the directory of the temporary files.
+ * - `index`: Specifies the index file written with the output.
+ * - `query-index`: Specifies the index file of a query.
  * - `h`: Prints the help message and exits.
+ * - `stats`: Reports the statistics of the conversion.
+ * - `rejects`: Specifies the file listing the skipped records.
+ * - `max-errors`: Specifies the number of records that can be skipped.
+ * - `batch`: Converts the operands (or a manifest) in one process.
+ * - `output-dir`: Specifies the output directory of a batch.
+ * - `serve`: Specifies the socket path of the daemon.
+ * - `workers`: Specifies the number of threads of the daemon.
  *
  * The program flow is as follows:
- * 1. Command-line arguments are processed using `getopt`.
+ * 1. Command-line arguments are processed using `getopt_long`. With
+ *   `--serve`, the daemon is run instead of the following steps; with
+ *   `--batch`, the batch is converted after the output file is
+ *   opened.
  * 2. The input file is opened
  *   (or stdin is used if no file is provided).
  * 3. The output file is opened
  *   (or stdout is used if no file is provided).
- * 4. The parser is invoked to transpile the WKT data into GeoJSON.
+ * 4. A transpile context is created, with the input file mapped in
+ *   memory when possible, and with the selected tokenizer, and
+ *   the parser is invoked to transpile the WKT data into GeoJSON.
  * 5. After processing, the input and output files are closed
  *   (if they were opened).
  *
@@ -60,6 +210,43 @@
  *   and the program exits with a status of 1.
  * - If the output file cannot be opened, an error message is printed,
  *   and the program exits with a status of 1.
+ * - If the tokenizer engine is unknown or not supported by the CPU, an
+ *   error message is printed, and the program exits with a status of 1.
+ * - If the precision is not a number from 0 to 17, an error message is
+ *   printed, and the program exits with a status of 1.
+ * - If the input format is unknown, an error message is printed, and
+ *   the program exits with a status of 1.
+ * - If the output format is unknown, an error message is printed, and
+ *   the program exits with a status of 1.
+ * - If the compression is unknown or not supported by this build, or
+ *   the compressed input is corrupt or truncated, an error message is
+ *   printed, and the program exits with a status of 1. The outputs of
+ *   `--output-dir` are not compressed.
+ * - If the simplification tolerance is not a non-negative number, or
+ *   its method is unknown, an error message is printed, and the
+ *   program exits with a status of 1.
+ * - If the sort order is unknown, its memory is not a number of MiB,
+ *   it is combined with `--batch` or `--serve`, or its temporary files
+ *   cannot be written, an error message is printed, and the program
+ *   exits with a status of 1.
+ * - If the index file cannot be written or read, or the index is
+ *   combined with a compressed output, `--batch` or `--serve`, or a
+ *   query lacks `--bbox` or `-i`, an error message is printed, and the
+ *   program exits with a status of 1.
+ * - If the number of threads is not a number from 1 to 256, an error
+ *   message is printed, and the program exits with a status of 1.
+ * - If the statistics file cannot be written, an error message is
+ *   printed, and the program exits with a status of 1.
+ * - If the rejects file cannot be written, the maximum number of
+ *   errors is not a number, or more records than it allows have a
+ *   syntax error, an error message is printed, and the program exits
+ *   with a status of 1. Rejects are not supported by `--batch`.
+ * - If an input of a batch cannot be converted, an error message with
+ *   its path is printed, the other inputs are converted, and the
+ *   program exits with a status of 1.
+ * - If the number of workers is not a number from 1 to 1024, or the
+ *   socket of the daemon cannot be opened, an error message is
+ *   printed, and the program exits with a status of 1.
  *
  * **Return Value**:
  * - Returns 0 on success.
@@ -67,11 +254,24 @@
  *
  * Dependencies:
  * - `getopt.h`: Used for parsing command-line arguments.
+ * - `batch.h`: Converts many input files in one process.
+ * - `compression.h`: Reads and writes gzip or zstd compressed files.
+ * - `stats.h`: Measures the phases of the conversion.
+ * - `reject.h`: Logs the records skipped after a syntax error.
+ * - `server.h`: Runs the conversion daemon.
+ * - `simplify.h`: Simplifies the lines and rings before they are
+ *   written.
+ * - `filter.h`: Drops the features outside of `--bbox` or
+ *   `--intersects-wkt`.
+ * - `sorter.h`: Sorts the features along a Hilbert curve.
+ * - `rtree.h`: Writes and queries the index of the output.
  * - `parser.tab.h`: Generated by Bison, contains the declarations
  *   for the parser.
  *
  * Functions:
  * - `print_help`: Displays the usage instructions.
+ * - `query_index`: Writes the features of an indexed output that
+ *   intersect a box.
  * - `main`: Entry point for the program. Handles argument parsing,
  *   file I/O, and invocation of the parser.
  *
@@ -82,34 +282,458 @@
  */
 
 
+#include <errno.h>
+#include <float.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <getopt.h>
 
+#include "batch.h"
+#include "compression.h"
+#include "filter.h"
+#include "parallel.h"
 #include "parser.tab.h"
+#include "reject.h"
+#include "rtree.h"
+#include "server.h"
+#include "simplify.h"
+#include "sorter.h"
+#include "stats.h"
+#include "tokenizer.h"
+#include "writer.h"
+
+/* Identifiers of the options without a short form. */
+enum {
+    OPT_STATS = 256,
+    OPT_BATCH,
+    OPT_OUTPUT_DIR,
+    OPT_SERVE,
+    OPT_WORKERS,
+    OPT_REJECTS,
+    OPT_MAX_ERRORS,
+    OPT_FORMAT,
+    OPT_INPUT_FORMAT,
+    OPT_COMPRESS,
+    OPT_SIMPLIFY,
+    OPT_SIMPLIFY_METHOD,
+    OPT_EMIT_BBOX,
+    OPT_BBOX,
+    OPT_INTERSECTS_WKT,
+    OPT_SORT,
+    OPT_SORT_MEMORY,
+    OPT_TEMP_DIR,
+    OPT_INDEX,
+    OPT_QUERY_INDEX
+};
+
+static const struct option long_options[] = {
+    { "input", required_argument, NULL, 'i' },
+    { "input-format", required_argument, NULL, OPT_INPUT_FORMAT },
+    { "huge-pages", no_argument, NULL, 'H' },
+    { "output", required_argument, NULL, 'o' },
+    { "compress", required_argument, NULL, OPT_COMPRESS },
+    { "tokenizer", required_argument, NULL, 't' },
+    { "jobs", required_argument, NULL, 'j' },
+    { "precision", required_argument, NULL, 'p' },
+    { "simplify", required_argument, NULL, OPT_SIMPLIFY },
+    { "simplify-method", required_argument, NULL, OPT_SIMPLIFY_METHOD },
+    { "format", required_argument, NULL, OPT_FORMAT },
+    { "emit-bbox", optional_argument, NULL, OPT_EMIT_BBOX },
+    { "bbox", required_argument, NULL, OPT_BBOX },
+    { "intersects-wkt", required_argument, NULL, OPT_INTERSECTS_WKT },
+    { "sort", required_argument, NULL, OPT_SORT },
+    { "sort-memory", required_argument, NULL, OPT_SORT_MEMORY },
+    { "temp-dir", required_argument, NULL, OPT_TEMP_DIR },
+    { "index", required_argument, NULL, OPT_INDEX },
+    { "query-index", required_argument, NULL, OPT_QUERY_INDEX },
+    { "stats", optional_argument, NULL, OPT_STATS },
+    { "rejects", required_argument, NULL, OPT_REJECTS },
+    { "max-errors", required_argument, NULL, OPT_MAX_ERRORS },
+    { "batch", no_argument, NULL, OPT_BATCH },
+    { "output-dir", required_argument, NULL, OPT_OUTPUT_DIR },
+    { "serve", required_argument, NULL, OPT_SERVE },
+    { "workers", required_argument, NULL, OPT_WORKERS },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+};
 
 void print_help(const char *program_name) {
     printf("Usage: %s [options]\n", program_name);
+    printf("       %s --batch [options] [file|pattern...]\n",
+           program_name);
     printf("Options:\n");
-    printf("  -i <file>  Specify input file (default: stdin)\n");
-    printf("  -o <file>  Specify output file (default: stdout)\n");
-    printf("  -h         Display this help message\n");
+    printf("  -i, --input <file>        Specify input file (default:"
+           " stdin)\n");
+    printf("      --input-format <enc>  Read wkt, wkb or hexwkb records"
+           " (default: wkt)\n");
+    printf("  -H, --huge-pages          Advise huge pages for the"
+           " memory-mapped input file\n");
+    printf("  -o, --output <file>       Specify output file (default:"
+           " stdout)\n");
+    printf("      --compress <codec>    Compress the output with gzip, zstd"
+           " or none (default: from the output extension)\n");
+    printf("  -t, --tokenizer <engine>  Specify tokenizer engine: flex,"
+           " simd, avx2, sse4.2 or scalar (default: flex)\n");
+    printf("  -j, --jobs <jobs>         Convert a regular input file on"
+           " several threads (default: 1)\n");
+    printf("  -p, --precision <digits>  Round coordinates to a number of"
+           " fraction digits (default: shortest round-trip)\n");
+    printf("      --simplify <tolerance>\n"
+           "                            Simplify lines and rings within"
+           " tolerance, in coordinate units\n");
+    printf("      --simplify-method <method>\n"
+           "                            Simplify with dp (Douglas-Peucker)"
+           " or vw (Visvalingam-Whyatt) (default: dp)\n");
+    printf("      --format <format>     Write a geojson FeatureCollection,"
+           " or one feature per line: geojsonseq or ndjson"
+           " (default: geojson)\n");
+    printf("      --emit-bbox[=<scope>] Write the bbox of every feature,"
+           " or of the collection too with all (default: features)\n");
+    printf("      --bbox <minx,miny,maxx,maxy>\n"
+           "                            Keep only the features intersecting"
+           " the box\n");
+    printf("      --intersects-wkt <wkt>\n"
+           "                            Keep only the features intersecting"
+           " the WKT geometries\n");
+    printf("      --sort <order>        Write the features in hilbert order"
+           " of their bbox centres, or none (default: none)\n");
+    printf("      --sort-memory <MiB>   Memory of --sort before it spills to"
+           " disk, 0 for no limit (default: 256)\n");
+    printf("      --temp-dir <dir>      Directory of the temporary files of"
+           " --sort (default: $TMPDIR or /tmp)\n");
+    printf("      --index <file>        Write an R-tree index of the features"
+           " of the output\n");
+    printf("      --query-index <file>  Write the features of the -i output"
+           " intersecting --bbox, using its index\n");
+    printf("      --stats[=<file>]      Report the time of every phase and"
+           " the counts, on stderr or as JSON\n");
+    printf("      --rejects <file>      Skip the records with a syntax error"
+           " and list them in file\n");
+    printf("      --max-errors <n>      Fail when more than n records are"
+           " skipped (default: no limit)\n");
+    printf("      --batch               Convert the files given as operands,"
+           " or listed on stdin\n");
+    printf("      --output-dir <dir>    Write one output per input of"
+           " --batch (default: merged)\n");
+    printf("      --serve <path>        Serve conversions on a Unix domain"
+           " socket\n");
+    printf("      --workers <n>         Number of threads of --serve"
+           " (default: one per CPU)\n");
+    printf("  -h, --help                Display this help message\n");
+}
+
+
+/*
+ * Output of a query: the features read back with the index, written
+ * to a sink.
+ */
+typedef struct query_output {
+    output_sink sink;    /* the sink written to */
+    int first;           /* whether no feature was written yet */
+} query_output;
+
+
+/*
+ * Writes a feature read back with the index.
+ *
+ * Returns:
+ *   0 on success, or the errno value of a failure.
+ */
+static int write_queried(void *user_data, const char *data, size_t length) {
+    query_output *output = user_data;
+    if (write_feature_text(&output->sink, data, length, output->first) < 0) {
+        return output->sink.error;
+    }
+    output->first = 0;
+    return 0;
+}
+
+
+/*
+ * Writes the features of an indexed GeoJSON output that intersect a
+ * box, in the order of the output.
+ *
+ * Parameters:
+ *   index_file - The path of the index of the output.
+ *   fd         - The output, open for reading.
+ *   box        - The query box.
+ *   output_fp  - The file the features are written to.
+ *   format     - The layout of the features written.
+ *
+ * Returns:
+ *   0 on success, or 1 if an error occurs.
+ */
+static int query_index(const char *index_file, int fd, const bounding_box *box,
+                       FILE *output_fp, writer_format format) {
+    rtree_index tree;
+    const char *message;
+    if (rtree_open(&tree, index_file, &message) < 0) {
+        fprintf(stderr, "Error opening index file: %s\n", message);
+        return 1;
+    }
+
+    int status = 1;
+    query_output output = { .first = 1 };
+    if (output_sink_init(&output.sink, fileno(output_fp), 0) < 0) {
+        fprintf(stderr, "Error: out of memory\n");
+    } else {
+        output_sink_set_format(&output.sink, format);
+        int error = write_header(&output.sink) < 0
+                        ? output.sink.error
+                        : rtree_query(&tree, fd, box, write_queried, &output);
+        if (!error && (write_footer(&output.sink, WRITER_SHORTEST) < 0
+                       || output_sink_flush(&output.sink) < 0)) {
+            error = output.sink.error;
+        }
+        if (error) {
+            fprintf(stderr, "Error: %s\n", strerror(error));
+        } else {
+            status = 0;
+        }
+        output_sink_release(&output.sink);
+    }
+    rtree_close(&tree);
+    return status;
+}
+
+
+/*
+ * Writes the index of the features of the output.
+ *
+ * Parameters:
+ *   index_file - The path of the index file.
+ *   index      - The features written.
+ *
+ * Returns:
+ *   0 on success, or -1 if an error occurs.
+ */
+static int write_index(const char *index_file, const feature_index *index) {
+    FILE *index_fp = fopen(index_file, "wb");
+    if (!index_fp) {
+        perror("Error opening index file");
+        return -1;
+    }
+    int failed = feature_index_write(index, index_fp);
+    if (fclose(index_fp)) {
+        failed = -1;
+    }
+    if (failed) {
+        perror("Error writing index file");
+        return -1;
+    }
+    return 0;
 }
 
 
 int main(int argc, char *argv[]) {
     int opt;
     char *input_file = NULL;
+    input_format in_format = INPUT_WKT;
+    const char *in_format_name = NULL;
+    int huge_pages = 0;
     char *output_file = NULL;
+    compression codec = COMPRESSION_NONE;
+    int codec_set = 0;
+    tokenizer_engine engine = TOKENIZER_FLEX;
+    int precision = WRITER_SHORTEST;
+    simplify_options simplify = { 0 };
+    const char *simplify_name = NULL;
+    writer_format format = WRITER_FEATURE_COLLECTION;
+    const char *format_name = NULL;
+    writer_bbox bbox = WRITER_BBOX_NONE;
+    const char *bbox_name = NULL;
+    const char *filter_bbox = NULL;
+    const char *intersects_wkt = NULL;
+    sort_order order = SORT_NONE;
+    size_t sort_memory = SORTER_DEFAULT_MEMORY;
+    const char *temp_dir = NULL;
+    char *index_file = NULL;
+    char *query_file = NULL;
+    int jobs = 0;               /* 0 until -j is given */
+    int stats_enabled = 0;
+    char *stats_file = NULL;
+    char *rejects_file = NULL;
+    int recover = 0;
+    size_t max_errors = SIZE_MAX;
+    int batch = 0;
+    char *output_dir = NULL;
+    char *socket_path = NULL;
+    int workers = 0;
+    const char *engine_name = "flex";
+    long value;
+    char *end;
 
-    while ((opt = getopt(argc, argv, "i:o:h")) != -1) {
+    while ((opt = getopt_long(argc, argv, "i:Ho:t:j:p:h", long_options,
+                              NULL)) != -1) {
         switch (opt) {
             case 'i':
                 input_file = optarg;
                 break;
+            case 'H':
+                huge_pages = 1;
+                break;
             case 'o':
                 output_file = optarg;
                 break;
+            case 't':
+                if (tokenizer_engine_from_name(optarg, &engine) < 0) {
+                    fprintf(stderr, "Unknown tokenizer engine: %s\n", optarg);
+                    print_help(argv[0]);
+                    return 1;
+                }
+                if (!tokenizer_engine_supported(engine)) {
+                    fprintf(stderr, "Tokenizer engine not supported by this"
+                            " CPU: %s\n", optarg);
+                    return 1;
+                }
+                engine_name = optarg;
+                break;
+            case 'j':
+                value = strtol(optarg, &end, 10);
+                if (end == optarg || *end || value < 1
+                        || value > PARALLEL_MAX_JOBS) {
+                    fprintf(stderr, "Invalid number of threads: %s\n", optarg);
+                    print_help(argv[0]);
+                    return 1;
+                }
+                jobs = (int)value;
+                break;
+            case 'p':
+                value = strtol(optarg, &end, 10);
+                if (end == optarg || *end || value < 0
+                        || value > WRITER_MAX_PRECISION) {
+                    fprintf(stderr, "Invalid precision: %s\n", optarg);
+                    print_help(argv[0]);
+                    return 1;
+                }
+                precision = (int)value;
+                break;
+            case OPT_SIMPLIFY:
+                simplify.tolerance = strtod(optarg, &end);
+                if (end == optarg || *end || !(simplify.tolerance >= 0)
+                        || simplify.tolerance > DBL_MAX) {
+                    fprintf(stderr, "Invalid simplification tolerance: %s\n",
+                            optarg);
+                    print_help(argv[0]);
+                    return 1;
+                }
+                break;
+            case OPT_SIMPLIFY_METHOD:
+                if (simplify_method_from_name(optarg, &simplify.method) < 0) {
+                    fprintf(stderr, "Unknown simplification method: %s\n",
+                            optarg);
+                    print_help(argv[0]);
+                    return 1;
+                }
+                simplify_name = optarg;
+                break;
+            case OPT_INPUT_FORMAT:
+                if (input_format_from_name(optarg, &in_format) < 0) {
+                    fprintf(stderr, "Unknown input format: %s\n", optarg);
+                    print_help(argv[0]);
+                    return 1;
+                }
+                in_format_name = optarg;
+                break;
+            case OPT_FORMAT:
+                if (writer_format_from_name(optarg, &format) < 0) {
+                    fprintf(stderr, "Unknown output format: %s\n", optarg);
+                    print_help(argv[0]);
+                    return 1;
+                }
+                format_name = optarg;
+                break;
+            case OPT_BBOX:
+                filter_bbox = optarg;
+                break;
+            case OPT_INTERSECTS_WKT:
+                intersects_wkt = optarg;
+                break;
+            case OPT_SORT:
+                if (sort_order_from_name(optarg, &order) < 0) {
+                    fprintf(stderr, "Unknown sort order: %s\n", optarg);
+                    print_help(argv[0]);
+                    return 1;
+                }
+                break;
+            case OPT_SORT_MEMORY:
+                errno = 0;
+                value = strtol(optarg, &end, 10);
+                if (end == optarg || *end || value < 0 || errno
+                        || (unsigned long)value > SIZE_MAX >> 20) {
+                    fprintf(stderr, "Invalid sort memory: %s\n", optarg);
+                    print_help(argv[0]);
+                    return 1;
+                }
+                sort_memory = (size_t)value << 20;
+                break;
+            case OPT_TEMP_DIR:
+                temp_dir = optarg;
+                break;
+            case OPT_INDEX:
+                index_file = optarg;
+                break;
+            case OPT_QUERY_INDEX:
+                query_file = optarg;
+                break;
+            case OPT_EMIT_BBOX:
+                bbox_name = optarg ? optarg : "features";
+                if (writer_bbox_from_name(bbox_name, &bbox) < 0) {
+                    fprintf(stderr, "Unknown bounding boxes: %s\n", optarg);
+                    print_help(argv[0]);
+                    return 1;
+                }
+                break;
+            case OPT_COMPRESS:
+                if (compression_from_name(optarg, &codec) < 0) {
+                    fprintf(stderr, "Unknown compression: %s\n", optarg);
+                    print_help(argv[0]);
+                    return 1;
+                }
+                codec_set = 1;
+                break;
+            case OPT_STATS:
+                stats_enabled = 1;
+                stats_file = optarg;
+                break;
+            case OPT_REJECTS:
+                rejects_file = optarg;
+                recover = 1;
+                break;
+            case OPT_MAX_ERRORS:
+                errno = 0;
+                value = strtol(optarg, &end, 10);
+                if (end == optarg || *end || value < 0 || errno) {
+                    fprintf(stderr, "Invalid maximum number of errors: %s\n",
+                            optarg);
+                    print_help(argv[0]);
+                    return 1;
+                }
+                max_errors = (size_t)value;
+                recover = 1;
+                break;
+            case OPT_BATCH:
+                batch = 1;
+                break;
+            case OPT_OUTPUT_DIR:
+                output_dir = optarg;
+                break;
+            case OPT_SERVE:
+                socket_path = optarg;
+                break;
+            case OPT_WORKERS:
+                value = strtol(optarg, &end, 10);
+                if (end == optarg || *end || value < 1
+                        || value > SERVER_MAX_WORKERS) {
+                    fprintf(stderr, "Invalid number of workers: %s\n",
+                            optarg);
+                    print_help(argv[0]);
+                    return 1;
+                }
+                workers = (int)value;
+                break;
             case 'h':
                 print_help(argv[0]);
                 return 0;
@@ -119,10 +743,91 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    if (order != SORT_NONE && (batch || socket_path)) {
+        fprintf(stderr, "--sort is not supported with --batch and"
+                " --serve\n");
+        return 1;
+    }
+    if ((index_file || query_file) && (batch || socket_path)) {
+        fprintf(stderr, "Indexes are not supported with --batch and"
+                " --serve\n");
+        return 1;
+    }
+    if (query_file && (!filter_bbox || !input_file)) {
+        fprintf(stderr, "--query-index needs --bbox and -i\n");
+        return 1;
+    }
+    if (filter_bbox && intersects_wkt) {
+        fprintf(stderr, "--bbox and --intersects-wkt cannot be combined\n");
+        return 1;
+    }
+    spatial_filter filter;
+    const spatial_filter *query = NULL;
+    if (filter_bbox) {
+        if (spatial_filter_init_bbox(&filter, filter_bbox) < 0) {
+            fprintf(stderr, "Invalid bounding box: %s\n", filter_bbox);
+            print_help(argv[0]);
+            return 1;
+        }
+        query = &filter;
+    } else if (intersects_wkt) {
+        const char *message;
+        if (spatial_filter_init_wkt(&filter, intersects_wkt, &message) < 0) {
+            fprintf(stderr, "Invalid query geometry: %s\n", message);
+            return 1;
+        }
+        query = &filter;
+    }
+
+    if (socket_path) {
+        /* Every request builds its own filter from the options. */
+        spatial_filter_release(query ? &filter : NULL);
+        wkt2geojson_options options;
+        wkt2geojson_options_init(&options);
+        options.precision = precision;
+        options.tokenizer = engine_name;
+        options.jobs = jobs ? jobs : 1;
+        options.format = format_name;
+        options.input_format = in_format_name;
+        options.simplify = simplify.tolerance;
+        options.simplify_method = simplify_name;
+        options.bbox = bbox_name;
+        options.filter_bbox = filter_bbox;
+        options.intersects_wkt = intersects_wkt;
+        return server_run(socket_path, workers, &options);
+    }
+
+    if (recover && batch) {
+        fprintf(stderr, "Rejects are not supported with --batch\n");
+        return 1;
+    }
+
+    if (!codec_set && output_file) {
+        codec = compression_from_path(output_file);
+    }
+    if (codec != COMPRESSION_NONE && batch && output_dir) {
+        fprintf(stderr, "Compression is not supported with --output-dir\n");
+        return 1;
+    }
+    if (codec != COMPRESSION_NONE && (index_file || query_file)) {
+        fprintf(stderr, "Indexes are not supported with a compressed"
+                " output\n");
+        return 1;
+    }
+    if (!compression_supported(codec)) {
+        fprintf(stderr, "Compression not supported by this build\n");
+        return 1;
+    }
+
+    wkt2geojson_stats stats;
+    if (stats_enabled) {
+        stats_init(&stats, STATS_READ);
+    }
+
     FILE *input_fp = stdin;
     FILE *output_fp = stdout;
 
-    if (input_file) {
+    if (input_file && !batch) {
         input_fp = fopen(input_file, "r");
         if (!input_fp) {
             perror("Error opening input file");
@@ -139,10 +844,173 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    if (query_file) {
+        int status = query_index(query_file, fileno(input_fp),
+                                 &filter.envelope, output_fp, format);
+        spatial_filter_release(&filter);
+        fclose(input_fp);
+        if (output_fp != stdout) fclose(output_fp);
+        return status;
+    }
+
+    if (batch) {
+        batch_list inputs = { 0 };
+        int status = 0;
+        if (input_file) {
+            status = batch_list_add(&inputs, input_file);
+        }
+        if (!input_file && optind == argc) {
+            status = batch_list_read(&inputs, stdin);
+        }
+        for (int i = optind; i < argc && !status; i++) {
+            status = strcmp(argv[i], "-")
+                         ? batch_list_add(&inputs, argv[i])
+                         : batch_list_read(&inputs, stdin);
+        }
+        if (status) {
+            fprintf(stderr, "Error: cannot list the batch inputs\n");
+        } else {
+            batch_options options = {
+                .engine = engine,
+                .precision = precision,
+                .simplify = simplify,
+                .filter = query,
+                .format = format,
+                .bbox = bbox,
+                .input = in_format,
+                .huge_pages = huge_pages,
+                .jobs = jobs,
+                .output_dir = output_dir,
+                .compress = codec
+            };
+            status = batch_run(&inputs, &options, output_fp);
+        }
+        batch_list_release(&inputs);
+        spatial_filter_release(query ? &filter : NULL);
+        if (output_fp != stdout) fclose(output_fp);
+        return status ? 1 : 0;
+    }
+
+    const char *error = NULL;
+    compressed_input *input = compressed_input_open(input_fp, &error);
+    compressed_output *output = NULL;
+    if (input && codec != COMPRESSION_NONE) {
+        output = compressed_output_open(fileno(output_fp), codec, &error);
+    }
+    if (!input || (codec != COMPRESSION_NONE && !output)) {
+        fprintf(stderr, "Error: %s\n", error);
+        compressed_input_close(input);
+        if (input_fp != stdin) fclose(input_fp);
+        if (output_fp != stdout) fclose(output_fp);
+        return 1;
+    }
+
+    reject_log rejects;
+    FILE *rejects_fp = stderr;
+    if (rejects_file) {
+        rejects_fp = fopen(rejects_file, "w");
+        if (!rejects_fp) {
+            perror("Error opening rejects file");
+            compressed_output_close(output);
+            compressed_input_close(input);
+            if (input_fp != stdin) fclose(input_fp);
+            if (output_fp != stdout) fclose(output_fp);
+            return 1;
+        }
+    }
+    reject_log_init(&rejects, rejects_fp, max_errors);
+
+    feature_index index;
+    feature_index_init(&index);
+    feature_sorter *sorter = NULL;
+    if (order == SORT_HILBERT) {
+        sorter = feature_sorter_new(sort_memory, temp_dir);
+    }
+
     // Run the parser
     int status = 1;
-    if (!transpile(input_fp, output_fp)) {
-        status = 0;
+    wkt2geojson_ctx *ctx = wkt2geojson_ctx_new(compressed_input_file(input),
+                                               output_fp);
+    if (ctx && stats_enabled) {
+        wkt2geojson_ctx_set_stats(ctx, &stats);
+    }
+    if (ctx && input_file) {
+        /* Falls back to streaming when the file cannot be mapped. */
+        wkt2geojson_ctx_map_input(ctx, huge_pages);
+    }
+    if (!ctx || wkt2geojson_ctx_use_tokenizer(ctx, engine) < 0) {
+        fprintf(stderr, "Error: cannot initialize the tokenizer\n");
+    } else if (order != SORT_NONE && !sorter) {
+        fprintf(stderr, "Error: cannot initialize the sort\n");
+    } else {
+        ctx->format = in_format;
+        ctx->precision = precision;
+        ctx->simplify = simplify;
+        ctx->filter = query;
+        output_sink_set_format(&ctx->sink, format);
+        output_sink_set_bbox(&ctx->sink, bbox);
+        output_sink_set_sorter(&ctx->sink, sorter);
+        output_sink_set_index(&ctx->sink, index_file ? &index : NULL);
+        if (output) {
+            output_sink_set_callback(&ctx->sink, compressed_output_write,
+                                     output);
+        }
+        ctx->jobs = jobs ? jobs : 1;
+        if (recover) {
+            wkt2geojson_ctx_set_rejects(ctx, &rejects);
+        }
+        if (!transpile_ctx(ctx)) {
+            status = 0;
+        }
+        /* The output is complete even after a syntax error. */
+        if (index_file && !ctx->sink.error
+                && write_index(index_file, &index) < 0) {
+            status = 1;
+        }
+    }
+    wkt2geojson_ctx_free(ctx);
+    feature_sorter_free(sorter);
+    feature_index_release(&index);
+    spatial_filter_release(query ? &filter : NULL);
+
+    int write_error = compressed_output_close(output);
+    if (write_error && !status) {
+        fprintf(stderr, "Error writing output file: %s\n",
+                strerror(write_error));
+        status = 1;
+    }
+    if (compressed_input_error(input)) {
+        fprintf(stderr, "Error reading input file: %s\n",
+                compressed_input_error(input));
+        status = 1;
+    }
+    compressed_input_close(input);
+
+    if (rejects_fp != stderr) {
+        if (ferror(rejects_fp) | fclose(rejects_fp)) {
+            perror("Error writing rejects file");
+            status = 1;
+        } else if (rejects.count) {
+            fprintf(stderr, "Skipped %zu records with errors, listed in"
+                    " %s\n", rejects.count, rejects_file);
+        }
+    }
+
+    if (stats_enabled) {
+        FILE *stats_fp = stats_file ? fopen(stats_file, "w") : stderr;
+        if (!stats_fp) {
+            perror("Error opening statistics file");
+            status = 1;
+        } else {
+            int failed = stats_report(&stats, stats_fp, stats_file != NULL);
+            if (stats_fp != stderr && fclose(stats_fp)) {
+                failed = -1;
+            }
+            if (failed) {
+                perror("Error writing statistics file");
+                status = 1;
+            }
+        }
     }
 
     // Cleanup
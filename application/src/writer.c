@@ -1,150 +1,1019 @@
 /*
  * writer.c
  *
- * This module provides functions to generate GeoJSON strings
- * based on the parsed WKT data. The `writer` is used by the parser
- * to create the final GeoJSON output.
+ * This module writes the GeoJSON output based on the parsed WKT data.
+ * The `writer` is used by the parser to append every feature, as soon
+ * as it is recognized, to an output sink.
+ *
+ * The sink is a single buffer that is reused for the whole document
+ * and written to the output file with write(2) once a watermark is
+ * reached. The fixed parts of every feature are precomputed literals,
+ * and coordinates are formatted in place, so that writing a feature
+ * does not allocate memory.
+ *
+ * The features are written either as the members of a single
+ * FeatureCollection or, for consumers that stream the output, as a
+ * sequence of self-contained features, one per line: plain NDJSON, or
+ * GeoJSONSeq (RFC 8142), where every line also starts with a record
+ * separator.
+ *
+ * Every feature is serialized from columnar coordinates: interleaved
+ * x/y values and ring end offsets. The coordinate buffers of the parser
+ * and the geometries of an IR (`ir.h`) share this layout, so both are
+ * written by the same code.
  */
 
 #include "writer.h"
 
-#include <stdarg.h>
+#include <errno.h>
+#include <float.h>
+#include <math.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dtoa.h"
+
+/* Room reserved for a vertex: two numbers and the punctuation. */
+#define VERTEX_MAX (2 * DTOA_SHORTEST_MAX + 4)
+
+/* Longest number written at any precision: the sign and the integer
+ * digits of DBL_MAX, then a point and 17 fraction digits. */
+#define NUMBER_MAX (1 + (DBL_MAX_10_EXP + 1) + 1 + 17)
+
+/* Room reserved for the corners of a bbox, whatever their values. */
+#define BBOX_MAX (4 * NUMBER_MAX + 8)
+
+/* Fixed parts of the document. Feature prefixes start with the comma
+ * that separates them from the previous feature, which is skipped for
+ * the first feature of the collection and in sequences. Features end
+ * with a line feed, which terminates the lines of a sequence. */
+static const char HEADER[] =
+    "{\n\"type\": \"FeatureCollection\",\n\"features\": [";
+static const char FOOTER[] = "\n]\n}\n";
+static const char FOOTER_BBOX[] = "\n],\n\"bbox\": ";
+static const char FOOTER_BBOX_SUFFIX[] = "\n}\n";
+/* Start of every feature prefix, after which a bbox member goes. */
+static const char FEATURE_PREFIX[] = ",{\"type\": \"Feature\", ";
+static const char POINT_PREFIX[] =
+    ",{\"type\": \"Feature\", \"geometry\": {\"type\": \"Point\", \"coordinates\": ";
+static const char POINT_SUFFIX[] = "}}\n";
+static const char LINESTRING_PREFIX[] =
+    ",{\"type\": \"Feature\", \"geometry\": {\"type\": \"LineString\", \"coordinates\": [";
+static const char POLYGON_PREFIX[] =
+    ",{\"type\": \"Feature\", \"geometry\": {\"type\": \"Polygon\", \"coordinates\": [";
+static const char COORDINATES_SUFFIX[] = "]}}\n";
+static const char RECORD_SEPARATOR[] = "\x1e";
 
 
 /*
- * Creates and returns the header for the GeoJSON file.
- * This function returns a string containing the start of a GeoJSON
- * FeatureCollection, which includes the opening of the features
- * array.
+ * Appends a string literal to the sink.
+ */
+#define SINK_APPEND_LITERAL(sink, literal) \
+    sink_append((sink), (literal), sizeof(literal) - 1)
+
+
+/*
+ * Appends a feature prefix literal, framed for the format of the sink
+ * by `sink_append_prefix`, with the bbox member of `box` when the sink
+ * writes bounding boxes.
+ */
+#define SINK_APPEND_PREFIX(sink, prefix, first, box, precision) \
+    sink_append_feature_prefix((sink), (prefix), sizeof(prefix) - 1, \
+                               (first), (box), (precision))
+
+
+/*
+ * Initializes a sink.
+ *
+ * Parameters:
+ *   sink      - The sink to initialize.
+ *   fd        - The destination file descriptor, or -1 to keep the
+ *               output in memory.
+ *   watermark - The number of buffered bytes above which the sink is
+ *               flushed, or 0 for OUTPUT_SINK_DEFAULT_WATERMARK.
+ *
+ * Returns:
+ *   0 on success, or -1 if the memory could not be allocated.
+ */
+int output_sink_init(output_sink *sink, int fd, size_t watermark) {
+    sink->fd = fd;
+    sink->callback = NULL;
+    sink->user_data = NULL;
+    sink->watermark = watermark ? watermark : OUTPUT_SINK_DEFAULT_WATERMARK;
+    sink->length = 0;
+    sink->error = 0;
+    sink->stats = NULL;
+    sink->format = WRITER_FEATURE_COLLECTION;
+    sink->bbox = WRITER_BBOX_NONE;
+    bounding_box_reset(&sink->extent);
+    sink->sorter = NULL;
+    sink->index = NULL;
+    sink->offset = 0;
+
+    /* Room for a whole feature past the watermark, so that features
+     * are rarely split across two writes. */
+    sink->capacity = 2 * sink->watermark;
+    sink->data = malloc(sink->capacity);
+    if (!sink->data) {
+        sink->capacity = 0;
+        sink->error = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+
+/*
+ * Makes the sink hand its output to a function.
+ *
+ * Parameters:
+ *   sink      - The sink.
+ *   callback  - The function receiving the flushed bytes.
+ *   user_data - The first argument of `callback`.
+ */
+void output_sink_set_callback(output_sink *sink, output_sink_fn callback,
+                              void *user_data) {
+    sink->callback = callback;
+    sink->user_data = user_data;
+}
+
+
+/*
+ * Sets the layout of the document written by the sink.
+ *
+ * Parameters:
+ *   sink   - The sink.
+ *   format - The layout of the features.
+ */
+void output_sink_set_format(output_sink *sink, writer_format format) {
+    sink->format = format;
+}
+
+
+/*
+ * Sets the bounding boxes written by the sink.
+ *
+ * Parameters:
+ *   sink - The sink.
+ *   bbox - The bounding boxes to write.
+ */
+void output_sink_set_bbox(output_sink *sink, writer_bbox bbox) {
+    sink->bbox = bbox;
+}
+
+
+/*
+ * Sets the sorter of the features of the sink. The features are then
+ * formatted as the first one of the document, their leading comma
+ * being added by `write_footer` once their order is known.
+ *
+ * Parameters:
+ *   sink   - The sink.
+ *   sorter - The sorter, owned by the caller, or NULL to write the
+ *            features in input order.
+ */
+void output_sink_set_sorter(output_sink *sink, feature_sorter *sorter) {
+    sink->sorter = sorter;
+}
+
+
+/*
+ * Sets the index of the features written by the sink.
+ *
+ * Parameters:
+ *   sink  - The sink.
+ *   index - The index, owned by the caller, or NULL.
+ */
+void output_sink_set_index(output_sink *sink, feature_index *index) {
+    sink->index = index;
+}
+
+
+/*
+ * Looks up the bounding boxes called `name`.
+ *
+ * Parameters:
+ *   name - The name of the bounding boxes, as given on the command line.
+ *   bbox - Where the bounding boxes are stored.
+ *
+ * Returns:
+ *   0 on success, or -1 if the name is unknown.
+ */
+int writer_bbox_from_name(const char *name, writer_bbox *bbox) {
+    static const struct {
+        const char *name;
+        writer_bbox bbox;
+    } names[] = {
+        { "features", WRITER_BBOX_FEATURES },
+        { "all", WRITER_BBOX_ALL }
+    };
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (!strcmp(name, names[i].name)) {
+            *bbox = names[i].bbox;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
+/*
+ * Looks up the format called `name`.
+ *
+ * Parameters:
+ *   name   - The name of the format, as given on the command line.
+ *   format - Where the format is stored.
+ *
+ * Returns:
+ *   0 on success, or -1 if the name is unknown.
+ */
+int writer_format_from_name(const char *name, writer_format *format) {
+    static const struct {
+        const char *name;
+        writer_format format;
+    } names[] = {
+        { "geojson", WRITER_FEATURE_COLLECTION },
+        { "geojsonseq", WRITER_GEOJSONSEQ },
+        { "ndjson", WRITER_NDJSON }
+    };
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (!strcmp(name, names[i].name)) {
+            *format = names[i].format;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
+/*
+ * Returns 1 if the sink is flushed to a file descriptor or a callback,
+ * or 0 if it keeps its output in memory.
+ */
+static int sink_has_destination(const output_sink *sink) {
+    return sink->callback || sink->fd >= 0;
+}
+
+
+/*
+ * Writes `length` bytes of `data` to the destination of the sink: the
+ * callback, or the file descriptor, retrying on partial writes and
+ * interruptions.
  *
  * Returns:
- *   A dynamically allocated string containing the GeoJSON header.
+ *   0 on success, or -1 if an error occurs.
  */
-char* header(void) {
-    char* result;
-    write_string(&result, "%s",
-        "{\n\"type\": \"FeatureCollection\",\n\"features\": [");
-    return result;
+static int sink_write_out(output_sink *sink, const char *data, size_t length) {
+    sink->offset += length;
+    if (sink->stats) {
+        sink->stats->bytes_written += length;
+    }
+
+    stats_phase previous = stats_enter(sink->stats, STATS_WRITE);
+    int error = 0;
+    if (sink->callback) {
+        error = length ? sink->callback(sink->user_data, data, length) : 0;
+    } else {
+        size_t written = 0;
+        while (written < length) {
+            ssize_t count = write(sink->fd, data + written, length - written);
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                error = errno;
+                break;
+            }
+            written += (size_t)count;
+        }
+    }
+    stats_leave(sink->stats, previous);
+
+    if (error) {
+        sink->error = error;
+        return -1;
+    }
+    return 0;
 }
 
 
 /*
- * Creates and returns the footer for the GeoJSON file.
- * This function returns a string containing the closing braces of the
- * features array and the entire FeatureCollection object.
+ * Writes the buffered bytes to the file descriptor of the sink. Does
+ * nothing for an in-memory sink.
  *
  * Returns:
- *   A dynamically allocated string containing the GeoJSON footer.
+ *   0 on success, or -1 if an error occurs.
  */
-char* footer(void) {
-    char* result;
-    write_string(&result, "%s", "\n]\n}\n");
-    return result;
+int output_sink_flush(output_sink *sink) {
+    if (sink->error) {
+        return -1;
+    }
+    if (!sink_has_destination(sink)) {
+        return 0;
+    }
+
+    if (sink_write_out(sink, sink->data, sink->length) < 0) {
+        return -1;
+    }
+    sink->length = 0;
+    return 0;
 }
 
 
 /*
- * Formats and allocates a string dynamically using a variable number
- * of arguments.
- * This function uses `vsnprintf` to format the string according to the
- * provided format and arguments, and allocates enough memory to store
- * the result.
+ * Releases the buffer of the sink.
  *
  * Parameters:
- *   strp - Pointer to a char* where the resulting string will be stored.
- *   fmt  - Format string similar to printf.
- *   ...  - Additional arguments that correspond to the format specifiers.
+ *   sink - The sink to release.
+ */
+void output_sink_release(output_sink *sink) {
+    free(sink->data);
+    sink->data = NULL;
+    sink->length = 0;
+    sink->capacity = 0;
+}
+
+
+/*
+ * Ensures the sink can take `extra` more bytes: flushes it if needed,
+ * and only grows the buffer for in-memory sinks, for sinks handing
+ * their features to a sorter, or for a single chunk larger than the
+ * buffer.
  *
  * Returns:
- *   The length of the formatted string (excluding the null terminator),
- *   or -1 if an error occurs.
+ *   0 on success, or -1 if an error occurs.
  */
-int write_string(char **strp, const char *fmt, ...) {
-    va_list ap;
-    va_start(ap, fmt);
+static int sink_reserve(output_sink *sink, size_t extra) {
+    if (sink->error) {
+        return -1;
+    }
+    if (sink->length + extra <= sink->capacity) {
+        return 0;
+    }
+    if (sink_has_destination(sink) && !sink->sorter
+            && output_sink_flush(sink) < 0) {
+        return -1;
+    }
+    if (sink->length + extra <= sink->capacity) {
+        return 0;
+    }
+
+    size_t capacity = sink->capacity ? sink->capacity : 1;
+    while (capacity < sink->length + extra) {
+        capacity *= 2;
+    }
+
+    char *data = realloc(sink->data, capacity);
+    if (!data) {
+        sink->error = ENOMEM;
+        return -1;
+    }
+
+    sink->data = data;
+    sink->capacity = capacity;
+    return 0;
+}
+
 
-    int len = vsnprintf(NULL, 0, fmt, ap);
-    if (len < 0) {
-        va_end(ap);
+/*
+ * Appends `length` bytes of `str` to the sink.
+ *
+ * Returns:
+ *   0 on success, or -1 if an error occurs.
+ */
+static int sink_append(output_sink *sink, const char *str, size_t length) {
+    if (sink_reserve(sink, length) < 0) {
         return -1;
     }
+    memcpy(sink->data + sink->length, str, length);
+    sink->length += length;
+    return 0;
+}
+
+
+/*
+ * Ends a feature: flushes the sink if the watermark is reached.
+ *
+ * Returns:
+ *   0 on success, or -1 if an error occurs.
+ */
+static int sink_end_feature(output_sink *sink) {
+    if (sink_has_destination(sink) && sink->length >= sink->watermark) {
+        return output_sink_flush(sink);
+    }
+    return sink->error ? -1 : 0;
+}
 
-    *strp = malloc((size_t)len + 1);
-    if (!*strp) {
-        va_end(ap);
+
+/*
+ * Appends the prefix of a feature: with its leading comma in a
+ * collection, unless it is the first feature, and without it in a
+ * sequence, after the record separator of GeoJSONSeq.
+ *
+ * Returns:
+ *   0 on success, or -1 if an error occurs.
+ */
+static int sink_append_prefix(output_sink *sink, const char *prefix,
+                              size_t length, int first) {
+    if (sink->format == WRITER_FEATURE_COLLECTION && !first) {
+        return sink_append(sink, prefix, length);
+    }
+    if (sink->format == WRITER_GEOJSONSEQ
+            && SINK_APPEND_LITERAL(sink, RECORD_SEPARATOR) < 0) {
         return -1;
     }
+    return sink_append(sink, prefix + 1, length - 1);
+}
 
-    va_end(ap);
 
-    va_start(ap, fmt);
-    vsnprintf(*strp, (size_t)len + 1, fmt, ap);
-    va_end(ap);
+/*
+ * Appends bytes already formatted, such as the output of another sink.
+ * Blocks of at least the watermark are written straight to the
+ * destination, after the buffered bytes, instead of being copied.
+ *
+ * Parameters:
+ *   sink   - The sink.
+ *   data   - The bytes to append.
+ *   length - The number of bytes to append.
+ *
+ * Returns:
+ *   0 on success, or -1 if an error occurs.
+ */
+int output_sink_write(output_sink *sink, const char *data, size_t length) {
+    if (!sink_has_destination(sink) || length < sink->watermark) {
+        if (sink_append(sink, data, length) < 0) {
+            return -1;
+        }
+        return sink_end_feature(sink);
+    }
 
-    return len;
+    if (output_sink_flush(sink) < 0) {
+        return -1;
+    }
+    return sink_write_out(sink, data, length);
 }
 
 
 /*
- * Creates and returns a GeoJSON Feature with Point geometry.
+ * Appends a coordinate to the sink, written straight into its buffer:
+ * with the shortest representation that round-trips when `precision`
+ * is WRITER_SHORTEST, or rounded to `precision` fraction digits
+ * otherwise, without trailing zeros. Infinities and NaN, which JSON
+ * cannot represent and the readers reject, fail with EDOM. Both
+ * representations are written without checking the room left, which
+ * the caller must have reserved; only values too large for
+ * `dtoa_fixed` go through `snprintf`.
+ *
+ * Returns:
+ *   0 on success, or -1 if an error occurs.
+ */
+static int sink_append_number(output_sink *sink, double value,
+                              int precision) {
+    if (!isfinite(value)) {
+        sink->error = EDOM;
+        return -1;
+    }
+
+    if (precision == WRITER_SHORTEST) {
+        sink->length += dtoa_shortest(sink->data + sink->length, value);
+        return 0;
+    }
+
+    size_t fixed = dtoa_fixed(sink->data + sink->length, value, precision);
+    if (fixed) {
+        sink->length += fixed;
+        return 0;
+    }
+
+    size_t extra = DTOA_SHORTEST_MAX;
+    for (;;) {
+        if (sink_reserve(sink, extra) < 0) {
+            return -1;
+        }
+
+        size_t available = sink->capacity - sink->length;
+        int len = snprintf(sink->data + sink->length, available,
+                           "%.*f", precision, value);
+        if (len < 0) {
+            sink->error = errno ? errno : EINVAL;
+            return -1;
+        }
+        if ((size_t)len < available) {
+            char *digits = sink->data + sink->length;
+            size_t length = (size_t)len;
+            if (memchr(digits, '.', length)) {
+                while (digits[length - 1] == '0') {
+                    length--;
+                }
+                if (digits[length - 1] == '.') {
+                    length--;
+                }
+            }
+            sink->length += length;
+            return 0;
+        }
+        extra = (size_t)len + 1;
+    }
+}
+
+
+/*
+ * Appends a single vertex, formatted as a GeoJSON position, to the
+ * sink.
+ *
+ * Returns:
+ *   0 on success, or -1 if an error occurs.
+ */
+static int sink_append_vertex(output_sink *sink, double x, double y,
+                              int precision) {
+    if (sink_reserve(sink, VERTEX_MAX) < 0) {
+        return -1;
+    }
+
+    sink->data[sink->length++] = '[';
+    if (sink_append_number(sink, x, precision) < 0
+        || SINK_APPEND_LITERAL(sink, ", ") < 0
+        || sink_append_number(sink, y, precision) < 0
+        || SINK_APPEND_LITERAL(sink, "]") < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+
+/*
+ * Appends the vertices in the range [first, last) of the interleaved
+ * coordinates `xy` to the sink, as a comma separated list of GeoJSON
+ * positions.
+ *
+ * Returns:
+ *   0 on success, or -1 if an error occurs.
+ */
+static int sink_append_positions(output_sink *sink, const double *xy,
+                                 size_t first, size_t last, int precision) {
+    for (size_t i = first; i < last; i++) {
+        if (i > first && SINK_APPEND_LITERAL(sink, ", ") < 0) {
+            return -1;
+        }
+        if (sink_append_vertex(sink, xy[2 * i], xy[2 * i + 1],
+                               precision) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * Appends the corners of `box` to the sink, as the value of a GeoJSON
+ * bbox member. The box of a single point has equal corners, whose
+ * formatted text is copied rather than formatted twice. The room of the
+ * longest corners is reserved up front, so that the sink is not flushed
+ * between the copy and its source, even for numbers that
+ * `sink_append_number` formats with `snprintf`.
+ *
+ * Returns:
+ *   0 on success, or -1 if an error occurs.
+ */
+static int sink_append_bbox(output_sink *sink, const bounding_box *box,
+                            int precision) {
+    if (SINK_APPEND_LITERAL(sink, "[") < 0
+        || sink_reserve(sink, BBOX_MAX) < 0) {
+        return -1;
+    }
+
+    size_t corner = sink->length;
+    if (sink_append_number(sink, box->min.x, precision) < 0
+        || SINK_APPEND_LITERAL(sink, ", ") < 0
+        || sink_append_number(sink, box->min.y, precision) < 0
+        || SINK_APPEND_LITERAL(sink, ", ") < 0) {
+        return -1;
+    }
+
+    if (!memcmp(&box->min, &box->max, sizeof(vertex))) {
+        size_t length = sink->length - corner - 2;
+        memcpy(sink->data + sink->length, sink->data + corner, length);
+        sink->length += length;
+        return SINK_APPEND_LITERAL(sink, "]");
+    }
+
+    if (sink_append_number(sink, box->max.x, precision) < 0
+        || SINK_APPEND_LITERAL(sink, ", ") < 0
+        || sink_append_number(sink, box->max.y, precision) < 0
+        || SINK_APPEND_LITERAL(sink, "]") < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+
+/*
+ * Appends a feature prefix literal like `sink_append_prefix`, with a
+ * bbox member after the type of the feature when the sink writes
+ * bounding boxes and `box` is not empty. Every prefix starts with
+ * FEATURE_PREFIX.
+ *
+ * Returns:
+ *   0 on success, or -1 if an error occurs.
+ */
+static int sink_append_feature_prefix(output_sink *sink, const char *prefix,
+                                      size_t length, int first,
+                                      const bounding_box *box,
+                                      int precision) {
+    if (sink->bbox == WRITER_BBOX_NONE || bounding_box_empty(box)) {
+        return sink_append_prefix(sink, prefix, length, first);
+    }
+
+    size_t head = sizeof(FEATURE_PREFIX) - 1;
+    if (sink_append_prefix(sink, prefix, head, first) < 0
+        || SINK_APPEND_LITERAL(sink, "\"bbox\": ") < 0
+        || sink_append_bbox(sink, box, precision) < 0
+        || SINK_APPEND_LITERAL(sink, ", ") < 0) {
+        return -1;
+    }
+    return sink_append(sink, prefix + head, length - head);
+}
+
+
+/*
+ * Records in the index of the sink the feature written from offset
+ * `start` to offset `end` of the output, without the separator before
+ * it, when `separated` is set, and the line feed after it.
+ *
+ * Returns:
+ *   0 on success, or -1 if the memory could not be allocated.
+ */
+static int sink_index_feature(output_sink *sink, uint64_t start,
+                              uint64_t end, int separated,
+                              const bounding_box *box) {
+    start += separated ? 1 : 0;
+    if (feature_index_add(sink->index, start, end - start - 1, box) < 0) {
+        sink->error = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+
+/*
+ * Appends a whole feature from columnar coordinates: the rings of the
+ * geometry end at the vertex offsets `ring_ends`, the first one
+ * starting at vertex `start` of `xy`. A Point is written from the
+ * first vertex, a LineString from the first ring, and a Polygon from
+ * every ring. When the sink writes bounding boxes, the box of the
+ * vertices written is added to the feature and to the extent of the
+ * sink. When the sink has a sorter, the feature is handed to it with
+ * its box instead of being kept in the buffer; otherwise, it is
+ * recorded in the index of the sink, if any.
+ *
+ * Returns:
+ *   0 on success, or -1 if an error occurs.
+ */
+static int sink_append_feature(output_sink *sink, wkt_geometry_type type,
+                               const double *xy, size_t start,
+                               const size_t *ring_ends, size_t rings,
+                               int precision, int first) {
+    bounding_box box;
+    if (sink->bbox != WRITER_BBOX_NONE || sink->sorter || sink->index) {
+        size_t end = start;
+        if (type == WKT_POINT) {
+            end = start + 1;
+        } else if (rings) {
+            end = ring_ends[type == WKT_LINESTRING ? 0 : rings - 1];
+        }
+        bounding_box_reset(&box);
+        bounding_box_extend(&box, xy + 2 * start, end - start);
+        bounding_box_merge(&sink->extent, &box);
+    }
+
+    size_t begin = sink->length;
+    uint64_t position = sink->offset + begin;
+    if (sink->sorter) {
+        first = 1;
+    }
+    switch (type) {
+        case WKT_POINT:
+            if (SINK_APPEND_PREFIX(sink, POINT_PREFIX, first, &box,
+                                   precision) < 0
+                || sink_append_vertex(sink, xy[2 * start], xy[2 * start + 1],
+                                      precision) < 0
+                || SINK_APPEND_LITERAL(sink, POINT_SUFFIX) < 0) {
+                return -1;
+            }
+            break;
+
+        case WKT_LINESTRING:
+            if (SINK_APPEND_PREFIX(sink, LINESTRING_PREFIX, first, &box,
+                                   precision) < 0
+                || sink_append_positions(sink, xy, start,
+                                         rings ? ring_ends[0] : start,
+                                         precision) < 0
+                || SINK_APPEND_LITERAL(sink, COORDINATES_SUFFIX) < 0) {
+                return -1;
+            }
+            break;
+
+        case WKT_POLYGON:
+            if (SINK_APPEND_PREFIX(sink, POLYGON_PREFIX, first, &box,
+                                   precision) < 0) {
+                return -1;
+            }
+            for (size_t r = 0; r < rings; r++) {
+                if ((r > 0 && SINK_APPEND_LITERAL(sink, ", ") < 0)
+                    || SINK_APPEND_LITERAL(sink, "[") < 0
+                    || sink_append_positions(sink, xy, start, ring_ends[r],
+                                             precision) < 0
+                    || SINK_APPEND_LITERAL(sink, "]") < 0) {
+                    return -1;
+                }
+                start = ring_ends[r];
+            }
+            if (SINK_APPEND_LITERAL(sink, COORDINATES_SUFFIX) < 0) {
+                return -1;
+            }
+            break;
+    }
+
+    if (sink->sorter) {
+        int error = feature_sorter_add(sink->sorter, sink->data + begin,
+                                       sink->length - begin, &box);
+        sink->length = begin;
+        if (error) {
+            sink->error = error;
+            return -1;
+        }
+        return 0;
+    }
+    if (sink->index) {
+        int separated = sink->format == WRITER_GEOJSONSEQ
+                        || (sink->format == WRITER_FEATURE_COLLECTION
+                            && !first);
+        if (sink_index_feature(sink, position, sink->offset + sink->length,
+                               separated, &box) < 0) {
+            return -1;
+        }
+    }
+    return sink_end_feature(sink);
+}
+
+
+/*
+ * Writes the header for the GeoJSON file: the start of a GeoJSON
+ * FeatureCollection, which includes the opening of the features
+ * array. A sequence of features has no header.
+ *
+ * Returns:
+ *   0 on success, or -1 if an error occurs.
+ */
+int write_header(output_sink *sink) {
+    if (sink->format != WRITER_FEATURE_COLLECTION) {
+        return sink->error ? -1 : 0;
+    }
+    return SINK_APPEND_LITERAL(sink, HEADER);
+}
+
+
+/*
+ * Sink receiving the features handed back by a sorter.
+ */
+typedef struct sorted_output {
+    output_sink *sink;   /* the sink written to */
+    int first;           /* whether no feature was written yet */
+} sorted_output;
+
+
+/*
+ * Writes a feature handed back by the sorter of a sink, formatted as
+ * the first one of the document, with the comma separating it from
+ * the previous feature of a collection.
+ *
+ * Returns:
+ *   0 on success, or the errno value of a failure.
+ */
+static int sink_write_sorted(void *user_data, const char *data,
+                             size_t length, const bounding_box *box) {
+    sorted_output *output = user_data;
+    output_sink *sink = output->sink;
+    if (sink->format == WRITER_FEATURE_COLLECTION && !output->first
+            && SINK_APPEND_LITERAL(sink, ",") < 0) {
+        return sink->error;
+    }
+    uint64_t position = sink->offset + sink->length;
+    if (output_sink_write(sink, data, length) < 0
+        || (sink->index
+            && sink_index_feature(sink, position, position + length,
+                                  sink->format == WRITER_GEOJSONSEQ,
+                                  box) < 0)) {
+        return sink->error;
+    }
+    output->first = 0;
+    return 0;
+}
+
+
+/*
+ * Writes the features held by the sorter of the sink in its order,
+ * and detaches the sorter.
+ *
+ * Returns:
+ *   0 on success, or -1 if an error occurs.
+ */
+static int sink_drain_sorter(output_sink *sink) {
+    feature_sorter *sorter = sink->sorter;
+    sink->sorter = NULL;
+    if (sink->error) {
+        return -1;
+    }
+
+    sorted_output output = { sink, 1 };
+    int error = feature_sorter_finish(sorter, sink_write_sorted, &output);
+    if (error) {
+        sink->error = error;
+        return -1;
+    }
+    return 0;
+}
+
+
+/*
+ * Writes the footer for the GeoJSON file: the closing braces of the
+ * features array and the entire FeatureCollection object. With
+ * WRITER_BBOX_ALL, the extent of the features is written as a bbox
+ * member after the features array, since it is only known once they
+ * have all been written. A sequence of features has no footer. The
+ * features held by the sorter of the sink are written first.
+ *
+ * Parameters:
+ *   sink      - The sink.
+ *   precision - The number of fraction digits of the bbox, or
+ *               WRITER_SHORTEST.
+ *
+ * Returns:
+ *   0 on success, or -1 if an error occurs.
+ */
+int write_footer(output_sink *sink, int precision) {
+    if (sink->sorter && sink_drain_sorter(sink) < 0) {
+        return -1;
+    }
+    if (sink->format != WRITER_FEATURE_COLLECTION) {
+        return sink->error ? -1 : 0;
+    }
+    if (sink->bbox != WRITER_BBOX_ALL || bounding_box_empty(&sink->extent)) {
+        return SINK_APPEND_LITERAL(sink, FOOTER);
+    }
+    if (SINK_APPEND_LITERAL(sink, FOOTER_BBOX) < 0
+        || sink_append_bbox(sink, &sink->extent, precision) < 0) {
+        return -1;
+    }
+    return SINK_APPEND_LITERAL(sink, FOOTER_BBOX_SUFFIX);
+}
+
+
+/*
+ * Writes a GeoJSON Feature with Point geometry.
  * The coordinates are inserted into the appropriate place in the
  * GeoJSON structure for a Point.
  *
  * Parameters:
- *   coordinates - A string representing the coordinates of the point.
+ *   sink       - The sink the feature is written to.
+ *   coordinate - The vertex of the point.
+ *   precision  - The number of fraction digits of the coordinates, or
+ *                WRITER_SHORTEST.
+ *   first      - Whether this is the first feature of the collection.
  *
  * Returns:
- *   A dynamically allocated string containing the GeoJSON representation
- *   of a Point feature.
+ *   0 on success, or -1 if an error occurs.
  */
-char* to_geojson_point(const char* coordinates) {
-    char* result;
-    write_string(&result,
-        "{\"type\": \"Feature\", \"geometry\": {\"type\": \"Point\", \"coordinates\": %s}}",
-        coordinates);
-    return result;
+int write_point(output_sink *sink, vertex coordinate, int precision,
+                int first) {
+    static const size_t ring_end = 1;
+    double xy[2] = { coordinate.x, coordinate.y };
+    return sink_append_feature(sink, WKT_POINT, xy, 0, &ring_end, 1,
+                               precision, first);
 }
 
 
 /*
- * Creates and returns a GeoJSON Feature with LineString geometry.
+ * Writes a GeoJSON Feature with LineString geometry.
  * The coordinates are inserted into the appropriate place in the
  * GeoJSON structure for a LineString.
  *
  * Parameters:
- *   coordinates - A string representing the coordinates of the LineString.
+ *   sink        - The sink the feature is written to.
+ *   coordinates - The vertices of the LineString.
+ *   precision   - The number of fraction digits of the coordinates, or
+ *                 WRITER_SHORTEST.
+ *   first       - Whether this is the first feature of the collection.
+ *
+ * Returns:
+ *   0 on success, or -1 if an error occurs.
+ */
+int write_linestring(output_sink *sink, const coordinate_buffer *coordinates,
+                     int precision, int first) {
+    size_t ring_end = coordinate_buffer_length(coordinates);
+    return sink_append_feature(sink, WKT_LINESTRING, coordinates->values, 0,
+                               &ring_end, 1, precision, first);
+}
+
+
+/*
+ * Writes a GeoJSON Feature with Polygon geometry.
+ * Every ring of the coordinates buffer is written as a separate
+ * linear ring of the Polygon: the first one is the exterior ring and
+ * the remaining ones are its holes.
+ *
+ * Parameters:
+ *   sink        - The sink the feature is written to.
+ *   coordinates - The vertices of the Polygon, split into rings.
+ *   precision   - The number of fraction digits of the coordinates, or
+ *                 WRITER_SHORTEST.
+ *   first       - Whether this is the first feature of the collection.
  *
  * Returns:
- *   A dynamically allocated string containing the GeoJSON representation
- *   of a LineString feature.
+ *   0 on success, or -1 if an error occurs.
  */
-char* to_geojson_linestring(const char* coordinates) {
-    char* result;
-    write_string(&result,
-        "{\"type\": \"Feature\", \"geometry\": {\"type\": \"LineString\", \"coordinates\": [%s]}}",
-        coordinates);
-    return result;
+int write_polygon(output_sink *sink, const coordinate_buffer *coordinates,
+                  int precision, int first) {
+    return sink_append_feature(sink, WKT_POLYGON, coordinates->values, 0,
+                               coordinates->rings, coordinates->ring_count,
+                               precision, first);
 }
 
 
 /*
- * Creates and returns a GeoJSON Feature with Polygon geometry.
- * The coordinates list is inserted into the appropriate place in the
- * GeoJSON structure for a Polygon.
+ * Writes the geometry at `index` of an IR as a GeoJSON Feature.
  *
  * Parameters:
- *   coordinates_list - A string representing the list of coordinates
- *                      that define the Polygon.
+ *   sink      - The sink the feature is written to.
+ *   ir        - The IR holding the geometry.
+ *   index     - The index of the geometry in the IR.
+ *   precision - The number of fraction digits of the coordinates, or
+ *               WRITER_SHORTEST.
+ *   first     - Whether this is the first feature of the collection.
  *
  * Returns:
- *   A dynamically allocated string containing the GeoJSON representation
- *   of a Polygon feature.
+ *   0 on success, or -1 if an error occurs.
  */
-char* to_geojson_polygon(const char* coordinates_list) {
-    char* result;
-    write_string(&result,
-        "{\"type\": \"Feature\", \"geometry\": {\"type\": \"Polygon\", \"coordinates\": [[%s]]}}",
-        coordinates_list);
-    return result;
+int write_geometry(output_sink *sink, const wkt_ir *ir, size_t index,
+                   int precision, int first) {
+    size_t ring = ir->part_offsets[index];
+    size_t rings = ir->part_offsets[index + 1] - ring;
+    return sink_append_feature(sink, (wkt_geometry_type)ir->types[index],
+                               ir->xy, ir->ring_offsets[ring],
+                               ir->ring_offsets + ring + 1, rings,
+                               precision, first);
+}
+
+
+/*
+ * Writes a feature already formatted as a JSON object, with the
+ * separator and line feed of the format of the sink.
+ *
+ * Parameters:
+ *   sink   - The sink the feature is written to.
+ *   data   - The JSON object of the feature.
+ *   length - The number of bytes of the object.
+ *   first  - Whether this is the first feature of the collection.
+ *
+ * Returns:
+ *   0 on success, or -1 if an error occurs.
+ */
+int write_feature_text(output_sink *sink, const char *data, size_t length,
+                       int first) {
+    if ((sink->format == WRITER_FEATURE_COLLECTION && !first
+         && SINK_APPEND_LITERAL(sink, ",") < 0)
+        || (sink->format == WRITER_GEOJSONSEQ
+            && SINK_APPEND_LITERAL(sink, RECORD_SEPARATOR) < 0)
+        || sink_append(sink, data, length) < 0
+        || SINK_APPEND_LITERAL(sink, "\n") < 0) {
+        return -1;
+    }
+    return sink_end_feature(sink);
+}
+
+
+/*
+ * Writes every geometry of an IR as GeoJSON Features, in order.
+ *
+ * Parameters:
+ *   sink      - The sink the features are written to.
+ *   ir        - The IR.
+ *   precision - The number of fraction digits of the coordinates, or
+ *               WRITER_SHORTEST.
+ *   first     - Whether the first geometry is the first feature of the
+ *               collection.
+ *
+ * Returns:
+ *   0 on success, or -1 if an error occurs.
+ */
+int write_ir(output_sink *sink, const wkt_ir *ir, int precision, int first) {
+    for (size_t g = 0; g < ir->geometry_count; g++) {
+        if (write_geometry(sink, ir, g, precision, first && !g) < 0) {
+            return -1;
+        }
+    }
+    return 0;
 }
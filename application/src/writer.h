@@ -1,54 +1,250 @@
 /*
  * writer.h
  *
- * Interface for the writer module, used to generate GeoJSON strings
- * from parsed WKT data.
+ * Interface for the writer module, used to write GeoJSON from parsed
+ * WKT data into an output sink.
  */
 #include <stdio.h>
 
+#include "coordinates.h"
+#include "ir.h"
+#include "rtree.h"
+#include "sorter.h"
+#include "stats.h"
+
 #ifndef INCLUDED_WRITER_H
 #define INCLUDED_WRITER_H
 
 /*
- * Formats and allocates a string dynamically.
- * Returns the length of the formatted string or -1 in case of error.
+ * Precision value selecting the shortest representation of every
+ * coordinate that reads back as the same double.
+ */
+#define WRITER_SHORTEST (-1)
+
+/*
+ * Largest number of fraction digits of a fixed precision.
+ */
+#define WRITER_MAX_PRECISION 17
+
+/*
+ * Default number of buffered bytes above which a sink is flushed.
+ */
+#define OUTPUT_SINK_DEFAULT_WATERMARK (256 * 1024)
+
+
+/*
+ * Layouts of the output document.
+ */
+typedef enum writer_format {
+    WRITER_FEATURE_COLLECTION, /* a FeatureCollection of every feature */
+    WRITER_GEOJSONSEQ,         /* RFC 8142 text sequence of features */
+    WRITER_NDJSON              /* one feature per line */
+} writer_format;
+
+
+/*
+ * Bounding boxes written in the document (RFC 7946, section 5).
+ */
+typedef enum writer_bbox {
+    WRITER_BBOX_NONE,          /* no bbox member */
+    WRITER_BBOX_FEATURES,      /* a bbox member on every feature */
+    WRITER_BBOX_ALL            /* on every feature and on the collection */
+} writer_bbox;
+
+
+/*
+ * Function receiving the bytes flushed by a sink, such as a callback
+ * of an embedding program. Returns 0 on success, or a positive errno
+ * value to stop the conversion.
+ */
+typedef int (*output_sink_fn)(void *user_data, const char *data,
+                              size_t length);
+
+
+/*
+ * Buffered output sink.
+ * Features are appended to a single reusable buffer, which is written
+ * to `fd` with write(2), or handed to `callback` when it is set,
+ * whenever a feature ends with at least `watermark` bytes buffered. A
+ * sink with neither a callback nor a file descriptor keeps the whole
+ * output in memory. While `sorter` is set, features are handed to it
+ * instead, and written in its order by `write_footer`. When `index` is
+ * set, the byte range of every feature written is recorded in it.
+ */
+typedef struct output_sink {
+    int fd;                   /* destination file descriptor, or -1 */
+    output_sink_fn callback;  /* destination function, or NULL */
+    void *user_data;          /* argument of `callback` */
+    char *data;               /* buffered bytes */
+    size_t length;            /* number of buffered bytes */
+    size_t capacity;          /* size of `data` */
+    size_t watermark;         /* flush threshold */
+    int error;                /* errno of the first failure, or 0 */
+    wkt2geojson_stats *stats; /* statistics of the writes, or NULL */
+    writer_format format;     /* layout of the written document */
+    writer_bbox bbox;         /* bounding boxes written */
+    bounding_box extent;      /* extent of the features, with `bbox` */
+    feature_sorter *sorter;   /* sorter of the features, or NULL */
+    feature_index *index;     /* index of the features, or NULL */
+    uint64_t offset;          /* bytes handed to the destination so far */
+} output_sink;
+
+
+/*
+ * Initializes a sink writing to `fd` (or to memory when `fd` is -1),
+ * flushed at `watermark` bytes, or OUTPUT_SINK_DEFAULT_WATERMARK when
+ * it is 0.
+ * Returns 0 on success or -1 in case of error.
+ */
+int output_sink_init(output_sink *sink, int fd, size_t watermark);
+
+
+/*
+ * Makes the sink hand its output to `callback` instead of writing it
+ * to its file descriptor.
+ */
+void output_sink_set_callback(output_sink *sink, output_sink_fn callback,
+                              void *user_data);
+
+
+/*
+ * Makes the sink write its features in the given layout.
+ */
+void output_sink_set_format(output_sink *sink, writer_format format);
+
+
+/*
+ * Makes the sink write the bounding boxes selected by `bbox`. The
+ * extent of the features written is then tracked in `extent`.
+ */
+void output_sink_set_bbox(output_sink *sink, writer_bbox bbox);
+
+
+/*
+ * Makes the sink hand its features to `sorter`, which it does not
+ * own, until `write_footer` writes them in order.
+ */
+void output_sink_set_sorter(output_sink *sink, feature_sorter *sorter);
+
+
+/*
+ * Makes the sink record the offset, length and box of every feature
+ * it writes in `index`, which it does not own. A feature spans its
+ * JSON object, without separators.
+ */
+void output_sink_set_index(output_sink *sink, feature_index *index);
+
+
+/*
+ * Looks up the bounding boxes called `name`: "features" or "all".
+ * Returns 0 on success or -1 if the name is unknown.
+ */
+int writer_bbox_from_name(const char *name, writer_bbox *bbox);
+
+
+/*
+ * Looks up the format called `name`: "geojson", "geojsonseq" or
+ * "ndjson".
+ * Returns 0 on success or -1 if the name is unknown.
+ */
+int writer_format_from_name(const char *name, writer_format *format);
+
+
+/*
+ * Writes the buffered bytes to the file descriptor of the sink.
+ * Returns 0 on success or -1 in case of error.
+ */
+int output_sink_flush(output_sink *sink);
+
+
+/*
+ * Appends `length` bytes of already formatted output to the sink.
+ * Returns 0 on success or -1 in case of error.
+ */
+int output_sink_write(output_sink *sink, const char *data, size_t length);
+
+
+/*
+ * Releases the buffer of the sink, without flushing it.
+ */
+void output_sink_release(output_sink *sink);
+
+
+/*
+ * Writes the header of a GeoJSON FeatureCollection, or nothing when
+ * the sink writes a sequence of features.
+ * Returns 0 on success or -1 in case of error.
+ */
+int write_header(output_sink *sink);
+
+
+/*
+ * Writes the features held by the sorter of the sink, if any, then the
+ * footer of a GeoJSON FeatureCollection, with the bbox of its features
+ * for WRITER_BBOX_ALL, written with `precision` fraction digits or
+ * WRITER_SHORTEST, or nothing when the sink writes a sequence of
+ * features.
+ * Returns 0 on success or -1 in case of error.
+ */
+int write_footer(output_sink *sink, int precision);
+
+
+/*
+ * Writes a GeoJSON Point feature from the given vertex, with
+ * `precision` fraction digits per coordinate or WRITER_SHORTEST.
+ * Features other than the first one of a collection are preceded by
+ * a comma; in a sequence, every feature is a line of its own, preceded
+ * by a record separator for GeoJSONSeq.
+ * Returns 0 on success or -1 in case of error.
  */
-int write_string(char **strp, const char *fmt, ...);
+int write_point(output_sink *sink, vertex coordinate, int precision,
+                int first);
 
 
 /*
- * Generates the header for a GeoJSON FeatureCollection.
- * Returns a dynamically allocated string.
+ * Writes a GeoJSON LineString feature from the given coordinates, as
+ * `write_point` does.
+ * Returns 0 on success or -1 in case of error.
  */
-char* header(void);
+int write_linestring(output_sink *sink, const coordinate_buffer *coordinates,
+                     int precision, int first);
 
 
 /*
- * Generates the footer for a GeoJSON FeatureCollection.
- * Returns a dynamically allocated string.
+ * Writes a GeoJSON Polygon feature from the given coordinates, as
+ * `write_point` does, writing each ring of the buffer as a linear ring
+ * of the polygon.
+ * Returns 0 on success or -1 in case of error.
  */
-char* footer(void);
+int write_polygon(output_sink *sink, const coordinate_buffer *coordinates,
+                  int precision, int first);
 
 
 /*
- * Creates a GeoJSON Point feature from the given coordinates.
- * Returns a dynamically allocated string.
+ * Writes the geometry at `index` of `ir` as a GeoJSON feature, as
+ * `write_point` does.
+ * Returns 0 on success or -1 in case of error.
  */
-char* to_geojson_point(const char* coordinates);
+int write_geometry(output_sink *sink, const wkt_ir *ir, size_t index,
+                   int precision, int first);
 
 
 /*
- * Creates a GeoJSON LineString feature from the given coordinates.
- * Returns a dynamically allocated string.
+ * Writes a feature already formatted as the `length` bytes of a JSON
+ * object, such as a feature read back with an index, framed as
+ * `write_point` does.
+ * Returns 0 on success or -1 in case of error.
  */
-char* to_geojson_linestring(const char* coordinates);
+int write_feature_text(output_sink *sink, const char *data, size_t length,
+                       int first);
 
 
 /*
- * Creates a GeoJSON Polygon feature from the given coordinates list.
- * Returns a dynamically allocated string.
+ * Writes every geometry of `ir` as GeoJSON features, as `write_point`
+ * does for the first one and with a leading comma for the others.
+ * Returns 0 on success or -1 in case of error.
  */
-char* to_geojson_polygon(const char* coordinates_list);
+int write_ir(output_sink *sink, const wkt_ir *ir, int precision, int first);
 
 #endif  /* INCLUDED_WRITER_H */
 
@@ -11,11 +11,11 @@ REM Function to print usage information
     echo This script facilitates the execution of the 'wkt2geojson' program
     echo inside a Docker container. It allows users to specify the absolute or
     echo relative path to an input file, which is then processed by the
-    echo 'wkt2geojson' command. The script dynamically determines the project
-    echo directory and mounts both the project directory and the directory
-    echo containing the input file into the Docker container. It ensures that
-    echo the input file is accessible within the container and executes the
-    echo 'wkt2geojson' program with the '-i' option for the input file.
+    echo 'wkt2geojson' command. The script mounts the directory containing
+    echo the input file into the Docker container. It ensures that the input
+    echo file is accessible within the container and executes the
+    echo 'wkt2geojson' program built in the image with the '-i' option for
+    echo the input file.
     echo.
     echo Options:
     echo   -h    Show this help message and exit
@@ -52,9 +52,8 @@ if not exist "%FILE_PATH%" (
     exit /b 1
 )
 
-REM Absolute path to the directory where the script is located
-set SCRIPT_DIR=%~dp0
-set PROJECT_DIR=%SCRIPT_DIR%
+REM The binary built in the image is run: mounting the project over /app
+REM would run the one of the host instead.
 
 REM Directory containing the input file
 for %%I in ("%FILE_PATH%") do set INPUT_DIR=%%~dpI
@@ -62,7 +61,6 @@ for %%I in ("%FILE_PATH%") do set INPUT_FILE=%%~nxI
 
 REM Execute the command in the container
 docker run --rm ^
-    -v "%PROJECT_DIR%:/app" ^
     -v "%INPUT_DIR%:/data" ^
     -w /data ^
     wkt2geojson /app/application/bin/wkt2geojson -i "/data/%INPUT_FILE%"
@@ -9,21 +9,28 @@
 # Function to print usage information
 print_help() {
     echo "Usage: $0 <full_path_to_wkt_file>"
+    echo "       $0 <full_path_to_wkt_directory>"
     echo
     echo "This script facilitates the execution of the 'wkt2geojson' program"
     echo "inside a Docker container. It allows users to specify the absolute or"
     echo "relative path to an input file, which is then processed by the"
-    echo "'wkt2geojson' command. The script dynamically determines the project"
-    echo "directory and mounts both the project directory and the directory"
-    echo "containing the input file into the Docker container. It ensures that"
-    echo "the input file is accessible within the container and executes the"
-    echo "'wkt2geojson' program with the '-i' option for the input file."
+    echo "'wkt2geojson' command. The script mounts the directory containing"
+    echo "the input file into the Docker container. It ensures that the input"
+    echo "file is accessible within the container and executes the"
+    echo "'wkt2geojson' program built in the image with the '-i' option for"
+    echo "the input file."
+    echo "When a directory is given, every '.wkt' file of the directory is"
+    echo "converted in a single run of 'wkt2geojson --batch', and written"
+    echo "next to its input with a '.geojson' extension."
     echo
     echo "Options:"
     echo "  -h    Show this help message and exit"
     echo
     echo "Arguments:"
     echo "  full_path_to_wkt_file    Absolute or relative path to the input file"
+    echo "  full_path_to_wkt_directory"
+    echo "                           Absolute or relative path to a directory"
+    echo "                           of input files"
     echo
     echo "Requirements:"
     echo "  Docker"
@@ -31,6 +38,7 @@ print_help() {
     echo
     echo "Example:"
     echo "  ./run-wkt2geojson.sh /absolute/path/to/file"
+    echo "  ./run-wkt2geojson.sh /absolute/path/to/directory"
 }
 
 
@@ -50,23 +58,32 @@ fi
 
 FILE_PATH=$1
 
+# The binary built in the image is run: mounting the project over /app
+# would run the one of the host instead, which may predate the options
+# used here.
+
+# Convert every WKT file of a directory in a single batch
+if [ -d "$FILE_PATH" ]; then
+    docker run --rm \
+        -v "$(cd "$FILE_PATH" && pwd):/data" \
+        -w /data \
+        wkt2geojson /app/application/bin/wkt2geojson \
+            --batch --output-dir /data '/data/*.wkt'
+    exit $?
+fi
+
 # Check if the input file exists
 if [ ! -f "$FILE_PATH" ]; then
     echo "Error: File $FILE_PATH not found."
     exit 1
 fi
 
-# Absolute path to the directory where the script is located
-SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
-PROJECT_DIR="$(dirname "$SCRIPT_DIR")"
-
 # Directory containing the input file
 INPUT_DIR="$(dirname "$FILE_PATH")"
 INPUT_FILE="$(basename "$FILE_PATH")"
 
 # Execute the command in the container
 docker run --rm \
-    -v "${PROJECT_DIR}:/app" \
     -v "$INPUT_DIR:/data" \
     -w /data \
     wkt2geojson /app/application/bin/wkt2geojson -i "/data/${INPUT_FILE}"
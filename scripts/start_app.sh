@@ -6,6 +6,13 @@
 #   for our iniquities: the chastisement of our peace was upon him;
 #   and with his stripes we are healed." Isaiah 53:5 (KJV)
 
+# Serve conversions on a Unix domain socket when a path is given,
+# otherwise keep the container running for interactive use.
+if [ -n "$WKT2GEOJSON_SOCKET" ]; then
+    exec /app/application/bin/wkt2geojson --serve "$WKT2GEOJSON_SOCKET" \
+        $WKT2GEOJSON_OPTIONS
+fi
+
 while true; do sleep 1; done
 
 # EOF